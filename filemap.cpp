@@ -35,13 +35,18 @@
 
 
 #include "filemap.h"
+#include "filemap_simd.h"
 #include <iostream>
+#include <algorithm>
 #if defined(_MSC_VER)
 #include <tchar.h>
 #else
 #include <locale>       /* std::wstring_convert */
 #include <codecvt>      /* std::codecvt_utf8_utf16 */
 #endif
+#if !defined(OS_WIN)
+#include <sys/resource.h> /* getrlimit */
+#endif
 
 using namespace std;
 
@@ -67,18 +72,23 @@ CFileMap::CFileMap( uint64_t limit_map_memory /*= 0*/ )
     m_ptr_file = nullptr;           // адрес, куда отображается файл (неизменяемый - для освобождения)
     m_page_size = get_page_size();  // размер страницы памяти в OS
     m_limit_memory = 0;
+    m_limit_block = 0;              // размер блока проекции, заданный set_limit_memory
     set_limit_memory( limit_map_memory );
     m_sync = true;
-#if defined(OS_WIN)
-#   if defined(__STDC_LIB_EXT1__) || defined(OS_WIN)
-    memcpy_s( m_new_line, 2, "\r\n", 2 );
-#   else
-    memcpy( m_new_line, "\r\n", 2 );
-#   endif
-    m_return = false;
-#else
-    strcpy( m_new_line, "\n" );
-#endif  // defined(OS_WIN)
+    m_hash_block = 0;               // размер блока для поблочных хешей
+    m_budget_info = nullptr;        // учет проекции в бюджете отраженной памяти
+    memset( &m_window_stats, 0, sizeof(m_window_stats) );   // статистика отражения блоков
+    m_window_overlap = 0;           // перекрытие соседних блоков проекции
+    m_map_size = 0;                 // фактический размер отраженного региона
+    m_locked = 0;                   // размер закрепленных в памяти диапазонов
+    m_snapshot = false;             // файл открыт в режиме снимка (copy-on-write)
+    m_consume_step = 0;             // режим однократного чтения выключен
+    m_consume_pageout = false;
+    m_consumed = 0;                 // граница освобожденных страниц
+    m_uncached = 0;                 // граница данных, удаленных из кеша страниц
+    m_released = 0;                 // количество освобожденных байт
+    m_line_ending = line_ending::autodetect;   // режим конца строки
+    set_line_ending( m_line_ending );           // символы новой строки платформы
 
 }   //  CFileMap()
 
@@ -87,8 +97,553 @@ CFileMap::CFileMap( uint64_t limit_map_memory /*= 0*/ )
 CFileMap::~CFileMap()
 {
     close_file_map();
+    set_budget( nullptr );
 }   //  ~CFileMap()
 
+///////////////////////////////////////////////////////////////////////////////
+// подключить объект к бюджету отраженной памяти
+void CFileMap::set_budget( CFileMapBudget *budget )
+{
+    if ( m_ptr_file != nullptr )
+        return;
+    if ( m_budget_info ) {
+        m_budget_info->budget->detach( m_budget_info );
+        m_budget_info = nullptr;
+    }
+    if ( budget )
+        m_budget_info = budget->attach( this );
+}   //  set_budget( CFileMapBudget *budget )
+
+///////////////////////////////////////////////////////////////////////////////
+// задать перекрытие соседних блоков проекции
+void CFileMap::set_window_overlap( uint64_t margin )
+{
+    if ( m_ptr_file != nullptr )
+        return;
+    m_window_overlap = margin;
+}   //  set_window_overlap( uint64_t margin )
+
+///////////////////////////////////////////////////////////////////////////////
+// задать режим конца строки
+void CFileMap::set_line_ending( line_ending le )
+{
+    m_line_ending = le;
+    m_line_detected = false;
+    switch ( le ) {
+    case line_ending::lf:
+        memcpy( m_new_line, "\n", 2 );
+        break;
+    case line_ending::crlf:
+        memcpy( m_new_line, "\r\n", 3 );
+        break;
+    default:
+#       if defined(OS_WIN)
+        memcpy( m_new_line, "\r\n", 3 );
+#       else
+        memcpy( m_new_line, "\n", 2 );
+#       endif  // defined(OS_WIN)
+        break;
+    }
+}   //  set_line_ending( line_ending le )
+
+///////////////////////////////////////////////////////////////////////////////
+// определить символы новой строки по данным
+void CFileMap::detect_line_ending( const char *data, uint64_t length )
+{
+    if ( m_line_ending != line_ending::autodetect || m_line_detected )
+        return;
+    if ( length > 64*1024 )
+        length = 64*1024;
+
+    alignas(64) char tail[CFileMapSimd::block_size];
+    // количество LF и количество CR LF
+    uint64_t lf = 0;
+    uint64_t crlf = 0;
+    // CR в последнем байте предыдущего блока
+    uint64_t carry = 0;
+    for ( uint64_t index = 0; index < length; index += CFileMapSimd::block_size ) {
+        uint64_t size = length - index;
+        if ( size > CFileMapSimd::block_size )
+            size = CFileMapSimd::block_size;
+        const char *block = CFileMapSimd::load_block( data + index, size, tail );
+        uint64_t valid = CFileMapSimd::low_mask( size );
+        uint64_t mask_lf = CFileMapSimd::eq_mask( block, '\n' ) & valid;
+        uint64_t mask_cr = CFileMapSimd::eq_mask( block, '\r' ) & valid;
+        lf += CFileMapSimd::popcount( mask_lf );
+        crlf += CFileMapSimd::popcount( mask_lf & ( (mask_cr << 1) | carry ) );
+        carry = mask_cr >> 63;
+    }
+
+    /* строки читаются как mixed в любом случае: первый блок не гарантирует
+     * режим всего файла, а на файле только с LF mixed совпадает с lf.
+     * Смешанные концы строк оставляют символы платформы */
+    m_line_detected = true;
+    if ( lf != 0 && crlf == 0 )
+        memcpy( m_new_line, "\n", 2 );
+    else if ( lf != 0 && crlf == lf )
+        memcpy( m_new_line, "\r\n", 3 );
+}   //  detect_line_ending( const char *data, uint64_t length )
+
+///////////////////////////////////////////////////////////////////////////////
+// закрепить диапазон текущей проекции в памяти
+uint64_t CFileMap::lock_region( uint64_t offset, uint64_t length, bool on_fault /*= false*/ )
+{
+    uint64_t last_error = 0;
+
+    try
+    {
+        // диапазон должен лежать в текущей проекции (и в пределах файла)
+        uint64_t base = m_offset.QuadPart - m_offset_block;
+        uint64_t mapped = m_file_size.QuadPart - base;
+        if ( m_limit_memory != 0 && m_map_size < mapped )
+            mapped = m_map_size;
+        if ( m_ptr_file == nullptr || length == 0 || offset < base ||
+             offset - base > mapped || length > mapped - ( offset - base ) ) {
+#           if defined(OS_WIN)
+            last_error = ERROR_INVALID_PARAMETER;
+#           else
+            last_error = EINVAL;
+#           endif  // defined(OS_WIN)
+            throw last_error;
+        }
+        char *address = (char *)m_ptr_file + ( offset - base );
+
+#       if defined(OS_WIN)
+        /* VirtualLock всегда читает страницы сразу, объем ограничен
+         * минимальным рабочим набором процесса (SetProcessWorkingSetSize) */
+        (void)on_fault;
+        if ( ::VirtualLock( address, (SIZE_T)length ) == FALSE ) {
+            last_error = ::GetLastError();
+            if ( last_error == ERROR_WORKING_SET_QUOTA )
+                cout<< "lock of " << length << " bytes exceeds the process working set quota" <<endl;
+            throw last_error;
+        }
+#       else
+        /* без CAP_IPC_LOCK объем закрепленной памяти ограничен RLIMIT_MEMLOCK,
+         * проверим заранее, чтобы сообщить причину (привилегии root не проверяются) */
+        struct rlimit limit;
+        if ( ::geteuid() != 0 && ::getrlimit( RLIMIT_MEMLOCK, &limit ) == 0 &&
+             limit.rlim_cur != RLIM_INFINITY && m_locked + length > limit.rlim_cur ) {
+            cout<< "lock of " << length << " bytes exceeds RLIMIT_MEMLOCK (" << limit.rlim_cur
+                << " bytes, locked " << m_locked << " bytes)" <<endl;
+            last_error = ENOMEM;
+            throw last_error;
+        }
+
+        int res = 0;
+#       if defined(MLOCK_ONFAULT)
+        // MLOCK_ONFAULT - страницы закрепляются по мере обращения, а не читаются сразу
+        if ( on_fault )
+            res = ::mlock2( address, length, MLOCK_ONFAULT );
+        else
+            res = ::mlock( address, length );
+#       else
+        (void)on_fault;
+        res = ::mlock( address, length );
+#       endif  // defined(MLOCK_ONFAULT)
+        if ( res ) {
+            last_error = errno;
+            if ( last_error == ENOMEM || last_error == EAGAIN || last_error == EPERM )
+                cout<< "lock of " << length << " bytes failed, locked " << m_locked
+                    << " bytes (check RLIMIT_MEMLOCK / CAP_IPC_LOCK)" <<endl;
+            throw last_error;
+        }
+#       endif  // defined(OS_WIN)
+
+        m_locks.push_back( std::make_pair( (void *)address, length ) );
+        m_locked += length;
+        // закрепленные страницы бюджет памяти освобождать не должен
+        if ( m_budget_info )
+            m_budget_info->budget->commit( m_budget_info, m_ptr_file, false );
+    }
+    catch( uint64_t error ) {
+        last_error = error;
+        cout<< "an error number \"" << error << "\" is generated in the method lock_region" <<endl;
+    }
+
+    return last_error;
+}   //  lock_region( uint64_t offset, uint64_t length, bool on_fault /*= false*/ )
+
+///////////////////////////////////////////////////////////////////////////////
+// закрепить текущую проекцию в памяти
+uint64_t CFileMap::lock_window( bool on_fault /*= false*/ )
+{
+    uint64_t base = m_offset.QuadPart - m_offset_block;
+    uint64_t mapped = m_file_size.QuadPart - base;
+    if ( m_limit_memory != 0 && m_map_size < mapped )
+        mapped = m_map_size;
+    return lock_region( base, mapped, on_fault );
+}   //  lock_window( bool on_fault /*= false*/ )
+
+///////////////////////////////////////////////////////////////////////////////
+// снять закрепление всех диапазонов проекции
+void CFileMap::unlock_region()
+{
+    if ( m_locks.empty() )
+        return;
+
+    for ( const std::pair<void *, uint64_t> &item : m_locks ) {
+#       if defined(OS_WIN)
+        ::VirtualUnlock( item.first, (SIZE_T)item.second );
+#       else
+        ::munlock( item.first, item.second );
+#       endif  // defined(OS_WIN)
+    }
+    m_locks.clear();
+    m_locked = 0;
+
+    if ( m_budget_info && m_ptr_file )
+        m_budget_info->budget->commit( m_budget_info, m_ptr_file, is_droppable() );
+}   //  unlock_region()
+
+///////////////////////////////////////////////////////////////////////////////
+// получить диапазоны файла, измененные в проекции (режим снимка)
+uint64_t CFileMap::get_dirty_ranges( vector< pair<uint64_t, uint64_t> > &ranges )
+{
+    uint64_t last_error = 0;
+    ranges.clear();
+
+    try
+    {
+        if ( m_snapshot == false || m_ptr_file == nullptr ) {
+#           if defined(OS_WIN)
+            last_error = ERROR_INVALID_PARAMETER;
+#           else
+            last_error = EINVAL;
+#           endif  // defined(OS_WIN)
+            throw last_error;
+        }
+
+        uint64_t base = m_offset.QuadPart - m_offset_block;
+        uint64_t size = m_file_size.QuadPart - base;
+        const char *view = (const char *)m_ptr_file;
+        // соседние страницы объединяются в один диапазон
+        auto add_page = [&]( uint64_t offset, uint64_t length ) {
+            if ( length > size - offset )
+                length = size - offset;
+            if ( ranges.size() && ranges.back().first + ranges.back().second == base + offset )
+                ranges.back().second += length;
+            else
+                ranges.push_back( make_pair( base + offset, length ) );
+        };
+
+#       if defined(OS_LINUX)
+        /* измененная страница частной проекции становится анонимной: в /proc/self/pagemap
+         * у нее установлен бит 63 (в памяти) или 62 (в swap) и снят бит 61 (страница файла) */
+        int pagemap = ::open( "/proc/self/pagemap", O_RDONLY );
+        if ( pagemap != -1 ) {
+            uint64_t page = (uint64_t)::sysconf( _SC_PAGESIZE );
+            uint64_t pages = ( size + page - 1 ) / page;
+            uint64_t entries[512];
+            for ( uint64_t index = 0; index < pages; index += 512 ) {
+                uint64_t count = std::min( pages - index, (uint64_t)512 );
+                off_t position = (off_t)( ( (uint64_t)view / page + index ) * sizeof(uint64_t) );
+                ssize_t res = ::pread( pagemap, entries, count * sizeof(uint64_t), position );
+                if ( res != (ssize_t)( count * sizeof(uint64_t) ) ) {
+                    last_error = ( res < 0 ) ? errno : EIO;
+                    ::close( pagemap );
+                    throw last_error;
+                }
+                for ( uint64_t k = 0; k < count; k++ ) {
+                    bool present = ( entries[k] >> 63 ) & 1;
+                    bool swapped = ( entries[k] >> 62 ) & 1;
+                    bool file_page = ( entries[k] >> 61 ) & 1;
+                    if ( ( present && !file_page ) || swapped )
+                        add_page( ( index + k ) * page, page );
+                }
+            }
+            ::close( pagemap );
+            return 0;
+        }
+#       endif  // defined(OS_LINUX)
+
+        // изменения не отслеживаются системой - сравним проекцию с файлом
+        const uint64_t page = 4096;
+        vector<char> buffer( 1024 * 1024 );
+        for ( uint64_t offset = 0; offset < size; offset += buffer.size() ) {
+            uint64_t length = std::min( size - offset, (uint64_t)buffer.size() );
+#           if defined(OS_WIN)
+            OVERLAPPED overlapped;
+            memset( &overlapped, 0, sizeof(overlapped) );
+            overlapped.Offset = (DWORD)( base + offset );
+            overlapped.OffsetHigh = (DWORD)( ( base + offset ) >> 32 );
+            DWORD done = 0;
+            if ( ::ReadFile( m_file, buffer.data(), (DWORD)length, &done, &overlapped ) == FALSE ||
+                 done != length ) {
+                last_error = ::GetLastError();
+                throw last_error;
+            }
+#           else
+            ssize_t res = ::pread( m_file, buffer.data(), length, (off_t)( base + offset ) );
+            if ( res != (ssize_t)length ) {
+                last_error = ( res < 0 ) ? errno : EIO;
+                throw last_error;
+            }
+#           endif  // defined(OS_WIN)
+            for ( uint64_t index = 0; index < length; index += page ) {
+                uint64_t chunk = std::min( length - index, page );
+                if ( memcmp( view + offset + index, buffer.data() + index, (size_t)chunk ) != 0 )
+                    add_page( offset + index, page );
+            }
+        }
+    }
+    catch( uint64_t error ) {
+        last_error = error;
+        cout<< "an error number \"" << error << "\" is generated in the method get_dirty_ranges" <<endl;
+    }
+
+    return last_error;
+}   //  get_dirty_ranges( vector< pair<uint64_t, uint64_t> > &ranges )
+
+///////////////////////////////////////////////////////////////////////////////
+// записать измененные страницы снимка в файл
+uint64_t CFileMap::commit_snapshot( bool sync /*= false*/ )
+{
+    vector< pair<uint64_t, uint64_t> > ranges;
+    uint64_t last_error = get_dirty_ranges( ranges );
+    if ( last_error || ranges.empty() )
+        return last_error;
+
+    uint64_t base = m_offset.QuadPart - m_offset_block;
+    const char *view = (const char *)m_ptr_file;
+
+    try
+    {
+        // проекция открыта на чтение - для записи файл открывается отдельно
+#       if defined(OS_WIN)
+        HANDLE file = ::CreateFileW( m_file_path.c_str(), GENERIC_WRITE,
+                                     FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                                     OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+        if ( file == INVALID_HANDLE_VALUE ) {
+            last_error = ::GetLastError();
+            throw last_error;
+        }
+        for ( const pair<uint64_t, uint64_t> &range : ranges ) {
+            for ( uint64_t done = 0; done < range.second; ) {
+                uint64_t offset = range.first + done;
+                DWORD length = (DWORD)std::min( range.second - done, (uint64_t)0x40000000 );
+                OVERLAPPED overlapped;
+                memset( &overlapped, 0, sizeof(overlapped) );
+                overlapped.Offset = (DWORD)offset;
+                overlapped.OffsetHigh = (DWORD)( offset >> 32 );
+                DWORD written = 0;
+                if ( ::WriteFile( file, view + ( offset - base ), length, &written, &overlapped ) == FALSE ) {
+                    last_error = ::GetLastError();
+                    ::CloseHandle( file );
+                    throw last_error;
+                }
+                done += written;
+            }
+        }
+        if ( sync && ::FlushFileBuffers( file ) == FALSE )
+            last_error = ::GetLastError();
+        ::CloseHandle( file );
+#       else
+        string file_path = wchar_string( m_file_path.c_str(), m_file_path.length() );
+        int file = ::open( file_path.c_str(), O_WRONLY | O_LARGEFILE );
+        if ( file == INVALID_HANDLE_VALUE ) {
+            last_error = errno;
+            throw last_error;
+        }
+        for ( const pair<uint64_t, uint64_t> &range : ranges ) {
+            for ( uint64_t done = 0; done < range.second; ) {
+                uint64_t offset = range.first + done;
+                ssize_t written = ::pwrite( file, view + ( offset - base ),
+                                            range.second - done, (off_t)offset );
+                if ( written <= 0 ) {
+                    last_error = ( written < 0 ) ? errno : EIO;
+                    ::close( file );
+                    throw last_error;
+                }
+                done += (uint64_t)written;
+            }
+        }
+        if ( sync && ::fdatasync( file ) != 0 )
+            last_error = errno;
+        ::close( file );
+#       endif  // defined(OS_WIN)
+        if ( last_error )
+            throw last_error;
+    }
+    catch( uint64_t error ) {
+        last_error = error;
+        cout<< "an error number \"" << error << "\" is generated in the method commit_snapshot" <<endl;
+        return last_error;
+    }
+
+    // копии страниц совпадают с файлом - сбросим их, следующий снимок начнется с нуля
+    return discard_snapshot();
+}   //  commit_snapshot( bool sync /*= false*/ )
+
+///////////////////////////////////////////////////////////////////////////////
+// отменить изменения снимка
+uint64_t CFileMap::discard_snapshot()
+{
+    uint64_t last_error = 0;
+
+    try
+    {
+        if ( m_snapshot == false || m_ptr_file == nullptr ) {
+#           if defined(OS_WIN)
+            last_error = ERROR_INVALID_PARAMETER;
+#           else
+            last_error = EINVAL;
+#           endif  // defined(OS_WIN)
+            throw last_error;
+        }
+        // закрепленные страницы сбросить нельзя
+        unlock_region();
+
+#       if defined(OS_LINUX)
+        /* для частной проекции MADV_DONTNEED удаляет копии страниц,
+         * при следующем обращении страницы читаются из файла (адрес не меняется) */
+        if ( ::madvise( m_ptr_file, m_map_size, MADV_DONTNEED ) != 0 ) {
+            last_error = errno;
+            throw last_error;
+        }
+#       else
+        // отразим файл заново, текущая позиция сохраняется
+        uint64_t position = m_offset.QuadPart;
+        uint64_t base = m_offset.QuadPart - m_offset_block;
+        last_error = unmap_region( m_limit_memory, false );
+        if ( last_error )
+            throw last_error;
+        m_offset.QuadPart = base;
+        last_error = map_region( 0, 0 );
+        if ( last_error )
+            throw last_error;
+        last_error = seek( position );
+        if ( last_error )
+            throw last_error;
+#       endif  // defined(OS_LINUX)
+    }
+    catch( uint64_t error ) {
+        last_error = error;
+        cout<< "an error number \"" << error << "\" is generated in the method discard_snapshot" <<endl;
+    }
+
+    return last_error;
+}   //  discard_snapshot()
+
+///////////////////////////////////////////////////////////////////////////////
+// страницы проекции можно освободить без потери данных
+bool CFileMap::is_droppable() const
+{
+    if ( m_locked != 0 )
+        return false;
+    // страницы можно освободить, если это не частная запись (copy-on-write)
+#   if defined(OS_WIN)
+    return true;
+#   else
+    return ( m_map_mode & MAP_SHARED ) || !( m_page_protect & PROT_WRITE );
+#   endif  // defined(OS_WIN)
+}   //  is_droppable()
+
+///////////////////////////////////////////////////////////////////////////////
+// включить режим однократного чтения
+void CFileMap::set_consume_once( uint64_t step, bool pageout /*= false*/ )
+{
+    if ( m_consume_step != 0 && m_ptr_file != nullptr )
+        drop_consumed( m_consumed, true );
+    m_consume_step = step ? memory_allocation_granularity( step ) : 0;
+    m_consume_pageout = pageout;
+    m_consumed = m_offset.QuadPart - m_offset.QuadPart % m_page_size;
+    m_uncached = m_consumed;
+}   //  set_consume_once( uint64_t step, bool pageout /*= false*/ )
+
+///////////////////////////////////////////////////////////////////////////////
+// освободить страницы позади позиции
+void CFileMap::drop_consumed( uint64_t end, bool force )
+{
+    if ( m_consume_step == 0 || m_ptr_file == nullptr || is_droppable() == false )
+        return;
+
+    // освобождаются только целые страницы позади позиции
+    uint64_t stop = force ? end : end - end % m_page_size;
+    if ( stop < m_consumed )
+        stop = m_consumed;
+    if ( force == false && stop - m_consumed < m_consume_step )
+        return;
+
+    // 1. страницы текущей проекции
+    uint64_t base = m_offset.QuadPart - m_offset_block;
+    uint64_t start = ( m_consumed > base ) ? m_consumed : base;
+    uint64_t limit = ( stop < base + m_map_size ) ? stop : base + m_map_size;
+    if ( limit > start ) {
+        void *address = (char *)m_ptr_file + ( start - base );
+#       if defined(OS_WIN)
+        // для незакрепленных страниц VirtualUnlock удаляет их из рабочего набора
+        ::VirtualUnlock( address, (SIZE_T)( limit - start ) );
+#       else
+        int advice = MADV_DONTNEED;
+#           if defined(MADV_PAGEOUT)
+        if ( m_consume_pageout )
+            advice = MADV_PAGEOUT;
+#           endif  // defined(MADV_PAGEOUT)
+        ::madvise( address, (size_t)( limit - start ), advice );
+#       endif  // defined(OS_WIN)
+    }
+
+    // 2. диапазон файла в кеше страниц
+#   if defined(OS_LINUX)
+    if ( m_page_protect & PROT_WRITE ) {
+        /* запись: новая порция отдается на запись, а предыдущая (ее запись
+         * уже идет) дожидается окончания записи и удаляется из кеша -
+         * грязные страницы из кеша не удаляются */
+        if ( stop > m_consumed )
+            ::sync_file_range( m_file, (off64_t)m_consumed, (off64_t)( stop - m_consumed ),
+                               SYNC_FILE_RANGE_WRITE );
+        uint64_t written = force ? stop : m_consumed;
+        if ( written > m_uncached ) {
+            ::sync_file_range( m_file, (off64_t)m_uncached, (off64_t)( written - m_uncached ),
+                               SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER );
+            ::posix_fadvise( m_file, (off_t)m_uncached, (off_t)( written - m_uncached ), POSIX_FADV_DONTNEED );
+            m_uncached = written;
+        }
+    } else
+#   endif  // defined(OS_LINUX)
+    {
+#       if !defined(OS_WIN)
+        if ( stop > m_uncached )
+            ::posix_fadvise( m_file, (off_t)m_uncached, (off_t)( stop - m_uncached ), POSIX_FADV_DONTNEED );
+#       endif  // !defined(OS_WIN)
+        m_uncached = stop;
+    }
+
+    m_released += stop - m_consumed;
+    m_consumed = stop;
+}   //  drop_consumed( uint64_t end, bool force )
+
+///////////////////////////////////////////////////////////////////////////////
+// включить адаптивный размер блока проекции
+void CFileMap::set_adaptive_window( uint64_t min_window, uint64_t max_window )
+{
+    if ( m_ptr_file != nullptr )
+        return;
+    if ( max_window == 0 ) {
+        m_window_stats.min_window = 0;
+        m_window_stats.max_window = 0;
+        return;
+    }
+
+    min_window = memory_allocation_granularity( min_window ? min_window : 1 );
+    max_window = memory_allocation_granularity( max_window );
+    if ( max_window < min_window )
+        max_window = min_window;
+    m_window_stats.min_window = min_window;
+    m_window_stats.max_window = max_window;
+
+    // начальный размер - заданный set_limit_memory, в пределах [min, max]
+    uint64_t window = ( m_limit_block != 0 ) ? m_limit_block : min_window;
+    if ( window < min_window )
+        window = min_window;
+    if ( window > max_window )
+        window = max_window;
+    m_limit_memory = window;
+    m_limit_block = window;
+    m_window_stats.window = window;
+}   //  set_adaptive_window( uint64_t min_window, uint64_t max_window )
+
 ///////////////////////////////////////////////////////////////////////////////
 // открыть файл для последющего отображения используя флаги
 #if defined(OS_WIN)
@@ -101,8 +656,9 @@ uint64_t CFileMap::open_file_map(uint32_t md_fl /*=GENERIC_READ*/,         /* mo
                                  uint64_t offset /*=0*/ )                  /* смещение от начала    */
 {
     uint64_t last_error = 0;
-    m_return = false;
     m_offset.QuadPart = offset;
+    // режим конца строки определяется для каждого файла заново
+    set_line_ending( m_line_ending );
 
     if ( md_fl == GENERIC_READ )
         m_sync = false;
@@ -157,7 +713,13 @@ uint64_t CFileMap::open_file_map(uint32_t md_fl /*=GENERIC_READ*/,         /* mo
     }
 
     if ( last_error == 0 ) {
-        last_error = map_region( offset );
+        // первый блок не должен выходить за границу файла (как в next_region)
+        uint64_t size_region = 0;
+        if ( m_limit_memory != 0 && m_file_size.QuadPart > offset &&
+             m_file_size.QuadPart - offset < m_limit_memory ) {
+            size_region = m_file_size.QuadPart - offset;
+        }
+        last_error = map_region( offset, size_region );
     }
 
     return last_error;
@@ -172,6 +734,8 @@ uint64_t CFileMap::open_file_map(uint32_t md_fl /*=O_RDONLY*/,             /* mo
 {
     uint64_t last_error = 0;
     m_offset.QuadPart = offset;
+    // режим конца строки определяется для каждого файла заново
+    set_line_ending( m_line_ending );
 
     if ( md_fl == O_RDONLY )
         m_sync = false;
@@ -193,10 +757,13 @@ uint64_t CFileMap::open_file_map(uint32_t md_fl /*=O_RDONLY*/,             /* mo
         return last_error;
     }
 
-    if ( (md_fl & O_WRONLY) == O_WRONLY || (md_fl & O_RDWR) == O_RDWR ) {
+    struct stat st;
+    bool extend = ( ::fstat( m_file, &st ) != 0 || (uint64_t)st.st_size < m_file_size.QuadPart );
+    if ( extend && ( (md_fl & O_WRONLY) == O_WRONLY || (md_fl & O_RDWR) == O_RDWR ) ) {
         /* Если мы не установим размер выходного файла таким способом, функции mmap
          * завершится успехом, но при первой же попытке обратиться к отображенной
-         * памяти мы получим сигнал SIGBUS. */
+         * памяти мы получим сигнал SIGBUS. Файл, который уже не меньше нужного
+         * размера, не изменяется (последний байт не затирается). */
         int result = ::lseek( m_file, m_file_size.QuadPart-1, SEEK_SET );
         if ( result == INVALID_HANDLE_VALUE ) {
             last_error = errno;
@@ -210,7 +777,13 @@ uint64_t CFileMap::open_file_map(uint32_t md_fl /*=O_RDONLY*/,             /* mo
     }
 
     if ( last_error == 0 ) {
-        last_error = map_region( offset );
+        // первый блок не должен выходить за границу файла (как в next_region)
+        uint64_t size_region = 0;
+        if ( m_limit_memory != 0 && m_file_size.QuadPart > offset &&
+             m_file_size.QuadPart - offset < m_limit_memory ) {
+            size_region = m_file_size.QuadPart - offset;
+        }
+        last_error = map_region( offset, size_region );
     }
 
     return last_error;;
@@ -279,9 +852,33 @@ uint64_t CFileMap::open_file_map ( mode md, uint64_t offset /*= 0*/ )
             md_mm = FILE_MAP_WRITE;        /* Доступ к операциям чтения-записи.                    */
 #           else
             md_fl = O_RDWR;                /* файл доступен для чтения и записи                    */
-            md_op = O_APPEND;              /* Файл открывается в режиме добавления                 */
+            md_op = NO_FLAG;               /* O_APPEND не нужен: проекция его игнорирует, а запись
+                                            * нулевого байта для роста файла ушла бы в конец файла
+                                            * (журнал с добавлением - CFileMapAppend)              */
             md_pp = PROT_WRITE | PROT_READ;/* можно записывать информацию                          */
             md_mm = MAP_SHARED;            /* Доступ к операциям чтения-записи.                    */
+#           endif  // defined(OS_WIN)
+            break;
+
+        case mode::snapshot:
+            /* Файл доступен только на чтение, страницы памяти - на запись с копированием
+             *  (copy-on-write): изменения видны только в проекции, в файл их переносит
+             *  commit_snapshot(). Файл отражается только целиком. */
+            if ( m_limit_memory != 0 ) {
+#               if defined(OS_WIN)
+                last_error = ERROR_INVALID_PARAMETER;
+#               else
+                last_error = EINVAL;
+#               endif  // defined(OS_WIN)
+                throw last_error;
+            }
+#           if defined(OS_WIN)
+            md_sh = FILE_SHARE_READ | FILE_SHARE_WRITE;  /* commit_snapshot() открывает файл на запись */
+            md_pp = PAGE_WRITECOPY;        /* Запись в страницы с копированием                     */
+            md_mm = FILE_MAP_COPY;         /* Частная проекция с копированием при записи           */
+#           else
+            md_pp = PROT_WRITE | PROT_READ;/* можно записывать информацию (в копию страницы)       */
+            md_mm = MAP_PRIVATE;           /* Частная проекция с копированием при записи           */
 #           endif  // defined(OS_WIN)
             break;
         }
@@ -293,6 +890,9 @@ uint64_t CFileMap::open_file_map ( mode md, uint64_t offset /*= 0*/ )
         if ( last_error ) {
             throw last_error;
         }
+        m_snapshot = ( md == mode::snapshot );
+        m_consumed = m_offset.QuadPart - m_offset.QuadPart % m_page_size;
+        m_uncached = m_consumed;
     }
     catch( uint64_t error ) {
         last_error = error;
@@ -307,6 +907,7 @@ uint64_t CFileMap::open_file_map ( mode md, uint64_t offset /*= 0*/ )
 uint64_t CFileMap::map_region ( uint64_t offset /*= 0*/, uint64_t size_region /*= 0*/ )
 {
     uint64_t last_error = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
     // если отражение было выполнено - освободим память
     if ( m_ptr_file ) {
@@ -327,6 +928,29 @@ uint64_t CFileMap::map_region ( uint64_t offset /*= 0*/, uint64_t size_region /*
     }
     m_offset_block = 0; // смещение от начала текущего блока
 
+    if ( m_budget_info ) {
+        // размер блока выдается из бюджета, файл целиком только учитывается
+        if ( size_region ) {
+            // запас перекрытия отражается вместе с блоком и тоже учитывается в бюджете
+            size_region = m_budget_info->budget->acquire( m_budget_info, size_region, m_page_size,
+                                                          m_window_overlap );
+            m_limit_memory = size_region;
+        } else {
+            uint64_t size_file = m_file_size.QuadPart - m_offset.QuadPart;
+            m_budget_info->budget->acquire( m_budget_info, size_file, size_file );
+        }
+    }
+
+    /* в режиме перекрытия блок отражается с запасом m_window_overlap байт (не дальше
+     * конца файла), m_limit_memory и m_max_copy запас не учитывают */
+    uint64_t size_map = size_region;
+    if ( m_window_overlap != 0 && size_region != 0 ) {
+        uint64_t size_tail = m_file_size.QuadPart - m_offset.QuadPart;
+        size_map = size_region + m_window_overlap;
+        if ( size_map > size_tail )
+            size_map = ( size_tail > size_region ) ? size_tail : size_region;
+    }
+
     try
     {
         // отображаем файл в память
@@ -340,7 +964,7 @@ uint64_t CFileMap::map_region ( uint64_t offset /*= 0*/, uint64_t size_region /*
                                                            *  файла, где начинается отображение. */
                                       m_offset.LowPart,   /*  Младшее двойное слово (DWORD) смещения
                                                            *  файла, где начинается отображение. */
-                                      (SIZE_T)size_region /*  Число отображаемых байтов файла.
+                                      (SIZE_T)size_map    /*  Число отображаемых байтов файла.
                                                            *  Если == 0, отображается весь файл.*/
                                       );
 
@@ -349,13 +973,13 @@ uint64_t CFileMap::map_region ( uint64_t offset /*= 0*/, uint64_t size_region /*
             throw last_error;
         }
 #   else
-        if ( size_region == 0 )
-            size_region = m_file_size.QuadPart;
+        if ( size_map == 0 )
+            size_map = m_file_size.QuadPart;
 
         /* On success, mmap() returns a pointer to the mapped area.
          * On error, the value MAP_FAILED (that is, (void *) -1) is returned,
          * and errno is set to indicate the cause of the error. */
-        m_ptr_file = ::mmap( nullptr, size_region, m_page_protect,
+        m_ptr_file = ::mmap( nullptr, size_map, m_page_protect,
                              m_map_mode, m_file, m_offset.QuadPart );
 
         if ( m_ptr_file == MAP_FAILED ) {
@@ -368,6 +992,15 @@ uint64_t CFileMap::map_region ( uint64_t offset /*= 0*/, uint64_t size_region /*
         cout<< "an error number \"" << error << "\" is generated in the method map_region" <<endl;
         m_ptr_file = nullptr;
     }
+    m_map_size = ( m_ptr_file != nullptr ) ? size_map : 0;
+
+    if ( m_budget_info ) {
+        if ( m_ptr_file ) {
+            m_budget_info->budget->commit( m_budget_info, m_ptr_file, is_droppable(), size_map );
+        } else {
+            m_budget_info->budget->release( m_budget_info );
+        }
+    }
 
     set_max_copy();
 
@@ -375,6 +1008,14 @@ uint64_t CFileMap::map_region ( uint64_t offset /*= 0*/, uint64_t size_region /*
      * в процессе выполнения */
     m_address.map_ptr = m_ptr_file;
 
+    m_window_time = std::chrono::steady_clock::now();
+    m_window_stats.last_map_time = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                       m_window_time - start ).count();
+    m_window_stats.map_time += m_window_stats.last_map_time;
+    m_window_stats.maps++;
+    if ( m_window_stats.max_window == 0 )
+        m_window_stats.window = m_limit_block;
+
     return last_error;
 }   //  map_region ( uint64_t size_region /*= 0*/ )
 
@@ -386,6 +1027,9 @@ uint64_t CFileMap::unmap_region ( uint64_t size_region, bool sync /*= true*/ )
 
     if ( size_region == 0 )
         size_region = m_file_size.QuadPart;
+    // с перекрытием отражено больше, чем размер блока
+    if ( m_map_size > size_region )
+        size_region = m_map_size;
 //    else
 //        // выравнивание размера отображения файла с учетом гранулярности страниц памяти
 //        size_region = memory_allocation_granularity( size_region );
@@ -409,6 +1053,11 @@ uint64_t CFileMap::unmap_region ( uint64_t size_region, bool sync /*= true*/ )
                 }
             }
 
+            // снимем закрепление страниц и вернем размер в бюджет до снятия проекции
+            unlock_region();
+            if ( m_budget_info )
+                m_budget_info->budget->release( m_budget_info );
+
             bError = FALSE;
             /* Если функция завершается успешно, возвращаемое значение не нуль, а все
              * недействительные страницы, внутри заданной области "вяло" записываются  на диск.
@@ -444,6 +1093,11 @@ uint64_t CFileMap::unmap_region ( uint64_t size_region, bool sync /*= true*/ )
                 }
             }
 
+            // снимем закрепление страниц и вернем размер в бюджет до снятия проекции
+            unlock_region();
+            if ( m_budget_info )
+                m_budget_info->budget->release( m_budget_info );
+
             res = 0;
             /* При удачном выполнении munmap возвращаемое значение равно нулю. При ошибке
              * возвращается -1, а переменная errno приобретает соответствующее значение.
@@ -501,15 +1155,9 @@ uint64_t CFileMap::write( const char *str, uint64_t length )
                 if ( eof() )
                     break;
 
-                // определим размер блока для проекции, что бы не выйти за границу файла
-                uint64_t size_region = m_file_size.QuadPart - m_offset.QuadPart;
-                if ( size_region < m_limit_memory ) {
-                    if ( map_region( 0, size_region ) != 0 )
-                        return 0;
-                } else {
-                    if ( map_region() != 0 )
-                        return 0;
-                }
+                // размер блока - как при чтении (m_limit_block, адаптивный режим, бюджет)
+                if ( next_region() != 0 )
+                    return 0;
             }
             // проверим что все скоировано
             if ( length && !eof() ) {
@@ -524,65 +1172,68 @@ uint64_t CFileMap::write( const char *str, uint64_t length )
 // прочитать строку из файла
 uint64_t CFileMap::read_line( char *dest )
 {
-    // указатель на проекцию очередного блока файла
-    const char *file = nullptr;
     if ( eof() )
         return 0;
     // проверим, сколько байт можно прочитать
     if ( m_max_copy == 0 ) {
         if ( next_region() != 0 )
             return 0;
-
-#       if defined(OS_WIN)
-        /* в *nix систмах символ перехода на новую строку занимает 1 байт,
-         * поэтому алгоритм все отработает, а вот в Windows нужно проверить
-         * первый символ и учеть последний байт предыдущего диапазона  */
-        if ( m_return == false && m_max_copy == 1 ) {
-            // просто прочитаем символ
-            return read( dest, 1 );
-        }
-        // указатель на проекцию очередного блока файла
-        file = (const char *)m_address.map_ptr;
-        // проверим что первый символ - конец строки
-        if ( (m_return && !strncmp( file, m_new_line+1, 1 )) ) {
-            // переход на строку разбит между поддиапазонами
-            m_return = false;
-            return read( dest, 1 )-sizeof(m_new_line);
-        } else {
-            m_return = false;
-        }
-#       endif  // defined(OS_WIN)
     }
+    detect_line_ending( (const char *)m_address.map_ptr, m_max_copy );
 
-    // флаг true - нашли симвло(ы) перехода на новую строку
-    bool find = false;
-    // указатель на проекцию очередного блока файла
-    file = (const char *)m_address.map_ptr;
-    // счетчик скопированных байт
-    uint64_t length = sizeof(m_new_line);
+    // LF без CR перед ним - не конец строки
+    bool strict = ( m_line_ending == line_ending::crlf );
 
-    // найдем символ новой строки
-    while ( length <= m_max_copy ) {
-        if ( !strncmp( file, m_new_line, sizeof(m_new_line) ) ){
-            find = true;
+    alignas(64) char tail[CFileMapSimd::block_size];
+    // счетчик скопированных байт
+    uint64_t length = 0;
+    while ( !eof() ) {
+        if ( m_max_copy == 0 && next_region() != 0 )
             break;
+        // указатель на проекцию очередного блока файла
+        const char *file = (const char *)m_address.map_ptr;
+        // в режиме перекрытия строка, пересекающая границу блока, видна целиком
+        uint64_t limit = ( m_window_overlap != 0 ) ? get_contiguous() : m_max_copy;
+        /* CR LF может быть разделен между блоками проекции: CR - последний
+         * скопированный байт строки, LF - первый байт нового блока */
+        uint64_t carry = ( length != 0 && dest[length-1] == '\r' ) ? 1 : 0;
+
+        // найдем символ новой строки
+        uint64_t found = limit;
+        for ( uint64_t index = 0; index < limit; index += CFileMapSimd::block_size ) {
+            uint64_t size = limit - index;
+            if ( size > CFileMapSimd::block_size )
+                size = CFileMapSimd::block_size;
+            const char *block = CFileMapSimd::load_block( file + index, size, tail );
+            uint64_t valid = CFileMapSimd::low_mask( size );
+            uint64_t mask = CFileMapSimd::eq_mask( block, '\n' ) & valid;
+            if ( strict ) {
+                uint64_t mask_cr = CFileMapSimd::eq_mask( block, '\r' ) & valid;
+                mask &= ( mask_cr << 1 ) | carry;
+                carry = mask_cr >> 63;
+            }
+            if ( mask ) {
+                found = index + CFileMapSimd::trailing_zeros( mask );
+                break;
+            }
         }
 
-        file = file + 1;
-        length = length+ 1;
-    }
+        if ( found < limit ) {
+            if ( found + 1 > m_max_copy ) {
+                // строка за границей блока, но в пределах перекрытия - копируем без разбиения
+                memcpy( dest + length, file, (size_t)found );
+                check_map_region( found + 1 );
+            } else {
+                read( dest + length, found + 1 );
+            }
+            return line_length( dest, length + found );
+        }
 
-    if ( find == false ) {
-        length = read( dest, m_max_copy );
-        dest = dest + length;
-#       if defined(OS_WIN)
-        if ( m_max_copy == 0 )
-            m_return = !strncmp( file, m_new_line, 1 );
-#       endif  // defined(OS_WIN)
-        length = length + read_line( dest );
-    } else {
-        length = read( dest, length );
-        length = length-sizeof(m_new_line);
+        // конец строки не найден - копируем остаток блока и продолжаем в следующем
+        uint64_t size = read( dest + length, m_max_copy );
+        if ( size == 0 )
+            break;
+        length += size;
     }
 
     return length;
@@ -638,6 +1289,15 @@ uint64_t CFileMap::read( char *dest, uint64_t length )
     return copy_from_file;
 }   //  read( const char *dest, uint64_t length )
 
+///////////////////////////////////////////////////////////////////////////////
+// прочитать данные из файла с указанного смещения
+uint64_t CFileMap::read_at( uint64_t offset, char *dest, uint64_t length )
+{
+    if ( seek( offset ) != 0 )
+        return 0;
+    return read( dest, length );
+}   //  read_at( uint64_t offset, char *dest, uint64_t length )
+
 ///////////////////////////////////////////////////////////////////////////////
 // проверка выделеного региона и проекция следующего
 void* CFileMap::check_map_region( uint64_t length )
@@ -645,9 +1305,28 @@ void* CFileMap::check_map_region( uint64_t length )
     if ( length == 0 )
         return m_address.map_ptr;
 
+    if ( m_hash.get_method() != CFileMapHash::method::none )
+        hash_update( m_address.map_ptr, length );
+    if ( m_budget_info )
+        m_budget_info->uses.fetch_add( 1, std::memory_order_relaxed );
+
+    if ( length > m_max_copy && m_window_overlap != 0 && m_limit_memory != 0 ) {
+        /* запись пересекла границу блока (в пределах перекрытия) -
+         * отразим блок, который начинается с новой позиции */
+        if ( m_consume_step )
+            drop_consumed( m_offset.QuadPart + length, true );
+        if ( seek( m_offset.QuadPart + length ) != 0 )
+            return 0;
+        if ( eof() )
+            return 0;
+        return m_address.map_ptr;
+    }
+
     m_address.map_mth += length;
 
     set_max_copy( length );
+    if ( m_consume_step )
+        drop_consumed( m_offset.QuadPart, false );
     if ( eof() )
         return 0;
     // проверим, сколько байт можно прочитать
@@ -663,14 +1342,219 @@ void* CFileMap::check_map_region( uint64_t length )
 uint64_t CFileMap::next_region()
 {
     // определим размер блока для проекции, что бы не выйти за границу файла
+    if ( m_window_stats.max_window != 0 && m_ptr_file != nullptr )
+        adapt_window();
+
     uint64_t size_region = m_file_size.QuadPart - m_offset.QuadPart;
-    if ( size_region < m_limit_memory ) {
+    // размер блока - заданный set_limit_memory (m_limit_memory мог уменьшиться)
+    uint64_t limit_region = ( m_limit_block != 0 ) ? m_limit_block : m_limit_memory;
+    if ( size_region < limit_region ) {
         return map_region( 0, size_region );
     } else {
-        return map_region();
+        return map_region( 0, limit_region );
     }
 }   //  next_region()
 
+///////////////////////////////////////////////////////////////////////////////
+// выбрать размер следующего блока (адаптивный режим)
+void CFileMap::adapt_window()
+{
+    // время обработки блока, который только что закончился
+    uint64_t elapsed = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now() - m_window_time ).count();
+    uint64_t consumed = m_limit_memory;
+    uint64_t cost = m_window_stats.last_map_time;
+    uint64_t window = m_limit_block;
+
+    if ( elapsed )
+        m_window_stats.rate = consumed * 1000000000ull / elapsed;
+
+    if ( consumed < window ) {
+        // бюджет памяти выдал меньше - уменьшаем блок до выданного
+        window = consumed - consumed % m_page_size;
+    } else if ( elapsed < cost * 64 ) {
+        // отражение занимает больше ~1.5% времени обработки - увеличиваем блок
+        window = window * 2;
+    } else if ( elapsed > cost * 4096 && elapsed > 100000000ull ) {
+        // блок обрабатывается долго (>100 мс) - держим меньше памяти
+        window = window / 2;
+    }
+
+    window = memory_allocation_granularity( window );
+    if ( window < m_window_stats.min_window )
+        window = m_window_stats.min_window;
+    if ( window > m_window_stats.max_window )
+        window = m_window_stats.max_window;
+
+    if ( window > m_limit_block )
+        m_window_stats.grows++;
+    else if ( window < m_limit_block )
+        m_window_stats.shrinks++;
+    m_limit_block = window;
+    m_window_stats.window = window;
+}   //  adapt_window()
+
+///////////////////////////////////////////////////////////////////////////////
+// установить текущую позицию в открытом файле
+uint64_t CFileMap::seek( uint64_t offset )
+{
+    if ( offset > m_file_size.QuadPart ) {
+#       if defined(OS_WIN)
+        return ERROR_INVALID_PARAMETER;
+#       else
+        return EINVAL;
+#       endif  // defined(OS_WIN)
+    }
+
+    // смещение начала текущей проекции от начала файла
+    uint64_t base = m_offset.QuadPart - m_offset_block;
+    uint64_t size = ( m_limit_memory != 0 ) ? m_limit_memory : m_file_size.QuadPart - base;
+
+    // конец файла, совпадающий с концом проекции, считается внутри проекции
+    bool inside = ( offset >= base && offset < base + size ) ||
+                  ( offset == base + size && offset == m_file_size.QuadPart );
+
+    if ( m_ptr_file == nullptr || inside == false ) {
+        // позиция вне текущей проекции - отразим регион, который её содержит
+        uint64_t start = offset - offset % m_page_size;
+        uint64_t size_region = 0;
+        if ( m_limit_block != 0 ) {
+            size_region = m_file_size.QuadPart - start;
+            if ( size_region > m_limit_block )
+                size_region = m_limit_block;
+        }
+        m_offset.QuadPart = start;
+        uint64_t last_error = map_region( 0, size_region );
+        if ( last_error )
+            return last_error;
+        base = start;
+    }
+
+    // сдвинем адрес внутри проекции
+    m_address.map_mth = (uint64_t)m_ptr_file + ( offset - base );
+    m_offset_block = 0;
+    m_offset.QuadPart = base;
+    set_max_copy( offset - base );
+
+    if ( m_consume_step ) {
+        // пропущенные страницы не освобождаются, недописанная порция дописывается
+        drop_consumed( m_consumed, true );
+        m_consumed = offset - offset % m_page_size;
+        m_uncached = m_consumed;
+    }
+
+    return 0;
+}   //  seek( uint64_t offset )
+
+///////////////////////////////////////////////////////////////////////////////
+// изменить размер открытого файла в проекции без переоткрытия
+uint64_t CFileMap::resize_map( uint64_t file_size )
+{
+    if ( file_size == m_file_size.QuadPart )
+        return 0;
+
+    uint64_t position = m_offset.QuadPart;
+    if ( position > file_size )
+        position = file_size;
+
+    if ( m_ptr_file && file_size > m_file_size.QuadPart ) {
+        if ( m_limit_block != 0 && m_limit_memory == m_limit_block ) {
+            // текущий блок полный - новые данные отразит next_region()
+            m_file_size.QuadPart = file_size;
+#           if !defined(OS_WIN)
+            return 0;
+#           endif  // !defined(OS_WIN)
+        }
+#       if defined(OS_LINUX) && defined(MREMAP_MAYMOVE)
+        else if ( m_limit_block == 0 ) {
+            // файл целиком - расширим проекцию на месте (или перенесем)
+            unlock_region();
+            if ( m_budget_info )
+                m_budget_info->budget->release( m_budget_info );
+            void *ptr = ::mremap( m_ptr_file, m_file_size.QuadPart,
+                                  file_size, MREMAP_MAYMOVE );
+            if ( ptr == MAP_FAILED )
+                return errno;
+            if ( m_budget_info ) {
+                uint64_t size_file = file_size - ( m_offset.QuadPart - m_offset_block );
+                m_budget_info->budget->acquire( m_budget_info, size_file, size_file );
+                m_budget_info->budget->commit( m_budget_info, ptr, is_droppable() );
+            }
+            m_address.map_mth = (uint64_t)ptr + ( m_address.map_mth - (uint64_t)m_ptr_file );
+            m_ptr_file = ptr;
+            m_map_size = file_size;
+            m_file_size.QuadPart = file_size;
+            set_max_copy();
+            return 0;
+        }
+#       endif  // defined(OS_LINUX) && defined(MREMAP_MAYMOVE)
+    }
+
+    if ( m_ptr_file && m_file_size.QuadPart != file_size ) {
+        uint64_t last_error = unmap_region( m_limit_memory, false );
+        if ( last_error )
+            return last_error;
+    }
+    m_file_size.QuadPart = file_size;
+    m_max_copy = 0;
+
+#   if defined(OS_WIN)
+    /* размер объекта "проекция файла" фиксируется при создании, поэтому
+     * объект создается заново (текущая проекция удерживает прежний) */
+    if ( m_hFileMapping != INVALID_HANDLE_VALUE ) {
+        ::CloseHandle( m_hFileMapping );
+        m_hFileMapping = INVALID_HANDLE_VALUE;
+    }
+    if ( file_size ) {
+        DWORD protect = ( m_map_mode == FILE_MAP_READ ) ? PAGE_READONLY : PAGE_READWRITE;
+        HANDLE mapping = ::CreateFileMapping( m_file, NULL, protect,
+                                              m_file_size.HighPart, m_file_size.LowPart, NULL );
+        if ( mapping == NULL )
+            return ::GetLastError();
+        m_hFileMapping = mapping;
+    }
+    if ( m_ptr_file )
+        return 0;
+#   endif  // defined(OS_WIN)
+
+    // пустой файл отразить нельзя - проекция появится при следующем росте
+    if ( file_size == 0 ) {
+        m_offset.QuadPart = 0;
+        m_offset_block = 0;
+        return 0;
+    }
+    return seek( position );
+}   //  resize_map( uint64_t file_size )
+
+///////////////////////////////////////////////////////////////////////////////
+// получить размер и время последнего изменения файла (по имени файла)
+uint64_t CFileMap::get_file_info( uint64_t &file_size, uint64_t &file_time )
+{
+#   if defined(OS_WIN)
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    /* If the function succeeds, the return value is a nonzero value.
+     * If the function fails, the return value is zero (0).
+     * To get extended error information, call GetLastError. */
+    if ( ::GetFileAttributesExW( m_file_path.c_str(), GetFileExInfoStandard, &data ) == 0 ) {
+        return ::GetLastError();
+    }
+    file_size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    file_time = ((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) |
+                 data.ftLastWriteTime.dwLowDateTime;
+#   else
+    struct stat info;
+    string file_path = wchar_string( m_file_path.c_str(), m_file_path.length() );
+    /* В случае успеха возвращается ноль. При ошибке возвращается -1,
+     * а errno устанавливается должным образом. */
+    if ( ::stat( file_path.c_str(), &info ) != 0 ) {
+        return errno;
+    }
+    file_size = (uint64_t)info.st_size;
+    file_time = (uint64_t)info.st_mtim.tv_sec * 1000000000ull + (uint64_t)info.st_mtim.tv_nsec;
+#   endif  // defined(OS_WIN)
+    return 0;
+}   //  get_file_info( uint64_t &file_size, uint64_t &file_time )
+
 ///////////////////////////////////////////////////////////////////////////////
 // установить максимальное количество байт доступных для чтения/записи
 void CFileMap::set_max_copy( uint64_t length /*= 0*/ )
@@ -698,8 +1582,14 @@ uint64_t CFileMap::write2memory ( const void *src_ptr, uint64_t length )
 #   if defined(__STDC_LIB_EXT1__) || defined(OS_WIN)
     int res = memcpy_s( m_address.map_ptr, (const rsize_t)m_max_copy, src_ptr, (const rsize_t)length );
     if ( res == 0 ) {
+        if ( m_hash.get_method() != CFileMapHash::method::none )
+            hash_update( m_address.map_ptr, length );
+        if ( m_budget_info )
+            m_budget_info->uses.fetch_add( 1, std::memory_order_relaxed );
         m_address.map_mth = m_address.map_mth + length;
         set_max_copy( length );
+        if ( m_consume_step )
+            drop_consumed( m_offset.QuadPart, false );
         return length;
     } else {
         return 0;
@@ -707,8 +1597,14 @@ uint64_t CFileMap::write2memory ( const void *src_ptr, uint64_t length )
 #   else
     void* res = memcpy( m_address.map_ptr, src_ptr, length );
     if ( res ) {
+        if ( m_hash.get_method() != CFileMapHash::method::none )
+            hash_update( m_address.map_ptr, length );
+        if ( m_budget_info )
+            m_budget_info->uses.fetch_add( 1, std::memory_order_relaxed );
         m_address.map_mth = m_address.map_mth + length;
         set_max_copy( length );
+        if ( m_consume_step )
+            drop_consumed( m_offset.QuadPart, false );
         return length;
     } else {
         return 0;
@@ -723,8 +1619,14 @@ uint64_t CFileMap::read_from_memory ( void *dest_ptr, uint64_t length )
 #   if defined(__STDC_LIB_EXT1__) || defined(OS_WIN)
     int res = memcpy_s( dest_ptr, (const rsize_t)m_max_copy, m_address.map_ptr, (const rsize_t)length );
     if ( res == 0 ) {
+        if ( m_hash.get_method() != CFileMapHash::method::none )
+            hash_update( m_address.map_ptr, length );
+        if ( m_budget_info )
+            m_budget_info->uses.fetch_add( 1, std::memory_order_relaxed );
         m_address.map_mth = m_address.map_mth + length;
         set_max_copy( length );
+        if ( m_consume_step )
+            drop_consumed( m_offset.QuadPart, false );
         return length;
     } else {
         return 0;
@@ -732,8 +1634,14 @@ uint64_t CFileMap::read_from_memory ( void *dest_ptr, uint64_t length )
 #   else
     void* res = memcpy( dest_ptr, m_address.map_ptr, length );
     if ( res ) {
+        if ( m_hash.get_method() != CFileMapHash::method::none )
+            hash_update( m_address.map_ptr, length );
+        if ( m_budget_info )
+            m_budget_info->uses.fetch_add( 1, std::memory_order_relaxed );
         m_address.map_mth = m_address.map_mth + length;
         set_max_copy( length );
+        if ( m_consume_step )
+            drop_consumed( m_offset.QuadPart, false );
         return length;
     } else {
         return 0;
@@ -741,6 +1649,98 @@ uint64_t CFileMap::read_from_memory ( void *dest_ptr, uint64_t length )
 #   endif
 }   //  read_from_memory ( void *dest_ptr, uint64_t length )
 
+///////////////////////////////////////////////////////////////////////////////
+// включить (выключить) хеширование данных при чтении/записи
+void CFileMap::set_hash( CFileMapHash::method md, uint64_t block_size /*= 0*/ )
+{
+    m_hash.reset( md );
+    m_block_hash.reset( md );
+    m_hash_block = ( md != CFileMapHash::method::none ) ? block_size : 0;
+    m_block_hashes.clear();
+}   //  set_hash( CFileMapHash::method md, uint64_t block_size /*= 0*/ )
+
+///////////////////////////////////////////////////////////////////////////////
+// получить поблочные хеши обработанных байт
+std::vector<uint64_t> CFileMap::get_block_hashes() const
+{
+    std::vector<uint64_t> hashes( m_block_hashes );
+    if ( m_hash_block != 0 && m_block_hash.get_length() != 0 )
+        hashes.push_back( m_block_hash.digest() );
+    return hashes;
+}   //  get_block_hashes()
+
+///////////////////////////////////////////////////////////////////////////////
+// обновить хеш (и поблочные хеши) обработанными байтами
+void CFileMap::hash_update( const void *data, uint64_t length )
+{
+    m_hash.update( data, length );
+    if ( m_hash_block == 0 )
+        return;
+
+    const char *ptr = (const char *)data;
+    while ( length ) {
+        uint64_t size = m_hash_block - m_block_hash.get_length();
+        if ( size > length )
+            size = length;
+        m_block_hash.update( ptr, size );
+        ptr += size;
+        length -= size;
+        if ( m_block_hash.get_length() == m_hash_block ) {
+            m_block_hashes.push_back( m_block_hash.digest() );
+            m_block_hash.reset( m_block_hash.get_method() );
+        }
+    }
+}   //  hash_update( const void *data, uint64_t length )
+
+///////////////////////////////////////////////////////////////////////////////
+// вычислить хеш диапазона файла
+uint64_t CFileMap::hash_range( uint64_t offset, uint64_t length, uint64_t &result,
+                               CFileMapHash::method md /*= CFileMapHash::method::none*/ )
+{
+    if ( md == CFileMapHash::method::none )
+        md = m_hash.get_method();
+    if ( md == CFileMapHash::method::none || offset > m_file_size.QuadPart ||
+         length > m_file_size.QuadPart - offset ) {
+#       if defined(OS_WIN)
+        return ERROR_INVALID_PARAMETER;
+#       else
+        return EINVAL;
+#       endif  // defined(OS_WIN)
+    }
+
+    uint64_t position = m_offset.QuadPart;
+    uint64_t last_error = 0;
+    CFileMapHash state( md );
+
+    // seek() не обновляет хеш, поэтому проходим по проекциям через него
+    while ( length ) {
+        last_error = seek( offset );
+        if ( last_error )
+            break;
+        uint64_t size = get_max_copy_ex();
+        if ( size == 0 ) {
+#           if defined(OS_WIN)
+            last_error = ERROR_READ_FAULT;
+#           else
+            last_error = EIO;
+#           endif  // defined(OS_WIN)
+            break;
+        }
+        if ( size > length )
+            size = length;
+        state.update( m_address.map_ptr, size );
+        offset += size;
+        length -= size;
+    }
+
+    uint64_t res = seek( position );
+    if ( last_error == 0 )
+        last_error = res;
+    if ( last_error == 0 )
+        result = state.digest();
+    return last_error;
+}   //  hash_range( uint64_t offset, uint64_t length, uint64_t &result, CFileMapHash::method md )
+
 ///////////////////////////////////////////////////////////////////////////////
 // закрывает объект
 void CFileMap::close_file_map ( bool b_shrink_to_fit /*= false*/ )
@@ -749,6 +1749,9 @@ void CFileMap::close_file_map ( bool b_shrink_to_fit /*= false*/ )
     {
 
         if ( m_ptr_file ) {
+            // режим однократного чтения - освободим и обработанный хвост
+            if ( m_consume_step )
+                drop_consumed( m_offset.QuadPart, true );
             uint64_t res = unmap_region( m_limit_memory );
             m_limit_memory = 0;
             if ( res ) {
@@ -756,10 +1759,11 @@ void CFileMap::close_file_map ( bool b_shrink_to_fit /*= false*/ )
             }
         }
         m_limit_memory = 0;
+        m_limit_block = 0;
+        m_snapshot = false;
 
 #       if defined(OS_WIN)
 
-        m_return = false;
         BOOL bError = FALSE;
         if ( m_hFileMapping != INVALID_HANDLE_VALUE ) {
             // If the function succeeds, the return value is nonzero.
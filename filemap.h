@@ -61,6 +61,10 @@
 #endif
 #include <string.h>
 #include <string>
+#include <vector>
+#include <chrono>
+#include "filemap_hash.h"
+#include "filemap_budget.h"
 
 #if ( defined(WIN64) || defined(_WIN64) || defined(__WIN64__) )
 #  define OS_WIN32
@@ -278,8 +282,38 @@ public:
 
         /*! Доступ на запись для файла, страниц памяти и объекта проекции.
          *  Другим потокам/процесам разрешен доступ на чтение.\n
-         *  Файл обязательно должен существовать. */
-        append
+         *  Файл обязательно должен существовать.\n
+         *  Журнал с добавлением с конца файла - CFileMapAppend. */
+        append,
+
+        /*! Снимок: файл доступен только на чтение, проекция - на запись\n
+         *  с копированием страниц (copy-on-write), файл не изменяется.\n
+         *  Измененные страницы переносит в файл commit_snapshot(),\n
+         *  отменяет discard_snapshot(). Файл отражается только целиком.\n
+         *  Другим потокам/процесам разрешен доступ на чтение. */
+        snapshot
+    };
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief перечисление режимов конца строки для read_line() / write_line()
+    ///
+    enum class line_ending : uint32_t
+    {
+        /*! чтение - как mixed (на файле только с LF совпадает с lf);\n
+         *  write_line() добавляет LF или CR LF, если первый блок,\n
+         *  прочитанный read_line(), содержит только такие концы строк */
+        autodetect = 0,
+
+        /*! конец строки - LF, символ CR остается в строке */
+        lf = 1,
+
+        /*! конец строки - CR LF, одиночный LF остается в строке\n
+         *  (только read_line(), остальные читатели разбивают по LF, как mixed) */
+        crlf = 2,
+
+        /*! конец строки - LF или CR LF, CR перед LF отбрасывается */
+        mixed = 3
     };
 
 public:
@@ -397,9 +431,287 @@ public:
     void set_limit_memory( uint64_t limit_map_memory ) {
         if ( m_ptr_file == 0 && m_limit_memory == 0 ) {
             m_limit_memory = memory_allocation_granularity( limit_map_memory );
+            m_limit_block = m_limit_memory;
         }
     }
 
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief статистика отражения блоков проекции
+    ///
+    struct window_stats {
+        uint64_t window;        // текущий размер блока
+        uint64_t min_window;    // минимальный размер блока (адаптивный режим)
+        uint64_t max_window;    // максимальный размер блока (адаптивный режим)
+        uint64_t maps;          // количество отражений
+        uint64_t grows;         // количество увеличений блока
+        uint64_t shrinks;       // количество уменьшений блока
+        uint64_t map_time;      // суммарное время отражений, нс
+        uint64_t last_map_time; // время последнего отражения (со снятием предыдущего), нс
+        uint64_t rate;          // скорость обработки последнего блока, байт/с
+    };
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief включить адаптивный размер блока проекции (до открытия файла)
+    /// \param min_window - минимальный размер блока
+    /// \param max_window - максимальный размер блока (потолок памяти),\n
+    ///  ноль - выключить адаптивный режим
+    ///
+    /// размер блока выбирается при переходе к следующему блоку:\n
+    /// блок обработан быстро (отражение заметно по сравнению с обработкой) -\n
+    /// размер удваивается; блок обрабатывается долго или бюджет памяти\n
+    /// выдал меньше - размер уменьшается. Размеры кратны гранулярности страниц.
+    /// \see get_window_stats()
+    ///
+    void set_adaptive_window( uint64_t min_window, uint64_t max_window );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief задать перекрытие соседних блоков проекции (до открытия файла)
+    /// \param margin - перекрытие в байтах, ноль - без перекрытия
+    ///
+    /// в блочном режиме каждый блок отражается с запасом margin байт\n
+    /// (не дальше конца файла), граница блока (get_max_copy()) не меняется.\n
+    /// Запись длиной до margin байт, которая начинается в блоке, всегда\n
+    /// непрерывна по адресу get_map_address() (см. get_contiguous()),\n
+    /// check_map_region() за границу блока отражает блок с новой позиции,\n
+    /// read_line() копирует такую строку без разбиения.
+    ///
+    void set_window_overlap( uint64_t margin );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief задать режим конца строки (не зависит от платформы)
+    /// \param le - режим конца строки
+    ///
+    /// режим определяет, остается ли CR перед LF в строке у всех читателей строк\n
+    /// (line_length()), разбиение по CR LF в режиме crlf (только read_line() -\n
+    /// остальные читатели разбивают по LF, как mixed) и символы, которые\n
+    /// добавляет write_line(): lf - LF, crlf - CR LF, autodetect\n
+    /// и mixed - символы платформы, пока autodetect не определит их по файлу.\n
+    /// Определение повторяется после каждого open_file_map().
+    ///
+    void set_line_ending( line_ending le );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить режим конца строки
+    /// \return режим, заданный set_line_ending()
+    ///
+    line_ending get_line_ending() const {
+        return m_line_ending;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить статистику отражения блоков проекции
+    ///
+    const window_stats& get_window_stats() const {
+        return m_window_stats;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief закрепить диапазон текущей проекции в памяти (mlock / VirtualLock)
+    /// \param offset - смещение диапазона от начала файла
+    /// \param length - количество байт
+    /// \param on_fault - false - страницы читаются сразу (обращения к диапазону\n
+    ///  не вызывают ошибок страниц), true - страницы закрепляются по мере\n
+    ///  обращения (Linux, MLOCK_ONFAULT)
+    /// \return ноль - выполнено успешно, иначе номер ошибки\n
+    ///  (диапазон вне проекции - EINVAL, превышен RLIMIT_MEMLOCK - ENOMEM)
+    ///
+    /// диапазон должен лежать в текущей проекции. Закрепление снимается\n
+    /// автоматически при снятии проекции (переход к другому блоку, seek\n
+    /// за пределы блока, resize_map, close_file_map) или unlock_region().\n
+    /// Закрепленные страницы бюджет памяти не освобождает.
+    /// \see lock_window()
+    ///
+    uint64_t lock_region( uint64_t offset, uint64_t length, bool on_fault = false );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief закрепить в памяти текущую проекцию целиком
+    /// \param on_fault - страницы закрепляются по мере обращения
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    /// \see lock_region()
+    ///
+    uint64_t lock_window( bool on_fault = false );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief снять закрепление всех диапазонов текущей проекции
+    ///
+    void unlock_region();
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить количество закрепленных в памяти байт
+    ///
+    uint64_t get_locked() const {
+        return m_locked;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить диапазоны файла, измененные в проекции (режим снимка)
+    /// \param ranges - диапазоны (смещение от начала файла, размер),\n
+    ///  кратные странице памяти
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    /// Linux - измененные (скопированные) страницы определяются по\n
+    /// /proc/self/pagemap без чтения файла, иначе проекция сравнивается с файлом.
+    ///
+    uint64_t get_dirty_ranges( std::vector< std::pair<uint64_t, uint64_t> > &ranges );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief записать в файл только измененные страницы снимка
+    /// \param sync - дождаться записи данных на диск
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    /// после записи проекция снова совпадает с файлом (как discard_snapshot())
+    /// \see mode::snapshot
+    ///
+    uint64_t commit_snapshot( bool sync = false );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief отменить изменения снимка (проекция снова совпадает с файлом)
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    /// Linux - копии страниц сбрасываются (MADV_DONTNEED), адрес проекции\n
+    /// не меняется; иначе файл отражается заново.
+    ///
+    uint64_t discard_snapshot();
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief подключить объект к бюджету отраженной памяти (до открытия файла)
+    /// \param budget - бюджет, nullptr - отключить от бюджета
+    ///
+    /// в блочном режиме размер каждого блока запрашивается у бюджета\n
+    /// и может быть меньше заданного set_limit_memory()
+    /// \see CFileMapBudget
+    ///
+    void set_budget( CFileMapBudget *budget );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief включить режим однократного чтения (потоковая обработка)
+    /// \param step - через сколько обработанных байт освобождать страницы,\n
+    ///  ноль - выключить режим
+    /// \param pageout - Linux: MADV_PAGEOUT вместо MADV_DONTNEED (страницы\n
+    ///  сразу вытесняются из памяти)
+    ///
+    /// при продвижении позиции (read, write, check_map_region) страницы\n
+    /// позади m_offset освобождаются порциями не меньше step: страницы\n
+    /// текущей проекции - madvise (Windows - VirtualUnlock, удаление из\n
+    /// рабочего набора), а диапазон файла - из кеша страниц\n
+    /// (posix_fadvise( POSIX_FADV_DONTNEED )). При записи диапазон сначала\n
+    /// отдается на запись (sync_file_range), а из кеша удаляется на\n
+    /// следующей порции, когда запись завершена. Страницы, пропущенные\n
+    /// seek(), не освобождаются; частная запись (снимок) не освобождается.
+    /// \see get_released()
+    ///
+    void set_consume_once( uint64_t step, bool pageout = false );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить количество байт, освобожденных в режиме\n
+    ///  однократного чтения
+    ///
+    uint64_t get_released() const {
+        return m_released;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить текущее смещение от начала файла
+    /// \return смещение от начала файла
+    ///
+    uint64_t get_file_offset() const {
+        return m_offset.QuadPart;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить размер файла
+    /// \return размер файла
+    ///
+    uint64_t get_file_size() const {
+        return m_file_size.QuadPart;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить размер и время последнего изменения файла (по имени файла)
+    /// \param file_size - размер файла
+    /// \param file_time - время последнего изменения файла\n
+    ///  (*nix - наносекунды от эпохи, Windows - FILETIME)
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t get_file_info( uint64_t &file_size, uint64_t &file_time );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить текущую позицию в открытом файле
+    /// \param offset - смещение от начала файла
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    /// если позиция попадает в текущую проекцию - только сдвигается адрес,\n
+    /// иначе (блочный режим) отражается регион, содержащий позицию,\n
+    /// начало региона выравнивается по гранулярности страниц памяти.
+    ///
+    uint64_t seek( uint64_t offset );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief включить (выключить) хеширование данных при чтении/записи
+    /// \param md - алгоритм хеширования, none - выключить
+    /// \param block_size - размер блока для поблочных хешей, ноль - без них
+    ///
+    /// хеш обновляется в read_from_memory, write2memory и check_map_region\n
+    /// ровно по тем байтам, которые были прочитаны/записаны (переданы),\n
+    /// переход по seek() хеш не обновляет. Вызов сбрасывает накопленные\n
+    /// значения. Поблочные хеши считаются по блокам потока обработанных\n
+    /// байт: первый блок - первые block_size байт и т.д.
+    ///
+    void set_hash( CFileMapHash::method md, uint64_t block_size = 0 );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить хеш байт, обработанных после set_hash()
+    /// \return значение хеша (CRC32C - в младших 32 битах)
+    ///
+    uint64_t get_hash() const {
+        return m_hash.digest();
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить поблочные хеши обработанных байт
+    /// \return хеши блоков, последний (неполный) блок включается,\n
+    ///  если в нем есть хотя бы один байт
+    ///
+    std::vector<uint64_t> get_block_hashes() const;
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief вычислить хеш диапазона файла (для проверки)
+    /// \param offset - смещение от начала файла
+    /// \param length - количество байт
+    /// \param result - значение хеша
+    /// \param md - алгоритм хеширования, none - как в set_hash()
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    /// данные читаются прямо из проекции, текущая позиция восстанавливается,\n
+    /// хеш, накапливаемый при чтении/записи, не изменяется.
+    ///
+    uint64_t hash_range( uint64_t offset, uint64_t length, uint64_t &result,
+                         CFileMapHash::method md = CFileMapHash::method::none );
+
 public:
     ///////////////////////////////////////////////////////////////////////////////
     /// \brief end of file
@@ -445,7 +757,11 @@ public:
     ///////////////////////////////////////////////////////////////////////////////
     /// \brief прочитать строку из файла
     /// \param str - буфер для записи строки из файла
-    /// \return количество прочитанных байт
+    /// \return количество прочитанных байт (без символов конца строки)
+    ///
+    /// конец строки ищется по маске LF блоками по 64 байта (CFileMapSimd)\n
+    /// в соответствии с режимом set_line_ending(), CR LF, разделенный\n
+    /// между блоками проекции, распознается на любой платформе.
     ///
     uint64_t read_line( char *dest );
 
@@ -458,6 +774,19 @@ public:
     ///
     uint64_t read( char *dest, uint64_t length );
 
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief прочитать данные из файла с указанного смещения
+    /// \param offset - смещение от начала файла
+    /// \param dest - буфер для записи данных из файла
+    /// \param length - максимальное количество байт, которе может принять буфер
+    /// \return количество прочитанных байт
+    ///
+    /// текущая позиция устанавливается сразу за прочитанными данными
+    /// @see seek
+    /// @see read
+    uint64_t read_at( uint64_t offset, char *dest, uint64_t length );
+
 protected:
     ///////////////////////////////////////////////////////////////////////////////
     /// \brief передает указатель классу - наследнику\n
@@ -475,6 +804,46 @@ protected:
         return m_address.map_ptr;
     }
 
+protected:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить полное имя файла
+    /// \return полное имя файла
+    ///
+    const std::wstring& get_file_path() const {
+        return m_file_path;
+    }
+
+protected:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить описатель открытого файла
+    ///
+    HANDLE get_file_handle() const {
+        return m_file;
+    }
+
+protected:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief изменить размер открытого файла в проекции без переоткрытия\n
+    ///  (файл уже должен иметь этот размер, например, дописан другим процессом)
+    /// \param file_size - новый размер файла
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    /// текущая позиция сохраняется (при уменьшении - не дальше конца файла).\n
+    /// Файл целиком: Linux - mremap проекции, иначе проекция отражается заново.\n
+    /// Блочный режим: полный блок не меняется, неполный последний блок\n
+    /// отражается заново, следующие блоки отразит next_region().
+    ///
+    uint64_t resize_map( uint64_t file_size );
+
+protected:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить размер блока проекции, заданный set_limit_memory
+    /// \return размер блока, ноль - файл отражается целиком
+    ///
+    uint64_t get_limit_memory() const {
+        return m_limit_block;
+    }
+
 protected:
     ///////////////////////////////////////////////////////////////////////////////
     /// \brief получить максимальное количество оставшихся байт из проекции
@@ -484,6 +853,34 @@ protected:
         return (uint32_t)m_max_copy;
     }
 
+protected:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить максимальное количество оставшихся байт из проекции\n
+    ///  без усечения до 32 бит и без выхода за границу файла
+    /// \return количество байт, доступных по адресу get_map_address()
+    ///
+    inline uint64_t get_max_copy_ex() const {
+        uint64_t tail = ( m_file_size.QuadPart > m_offset.QuadPart ) ?
+                          m_file_size.QuadPart - m_offset.QuadPart : 0;
+        return ( m_max_copy < tail ) ? m_max_copy : tail;
+    }
+
+protected:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить количество байт, непрерывно доступных по адресу\n
+    ///  get_map_address() (с учетом перекрытия блоков, не дальше конца файла)
+    /// \return количество байт, check_map_region() допускает столько же
+    /// \see set_window_overlap()
+    ///
+    inline uint64_t get_contiguous() const {
+        if ( m_ptr_file == nullptr || m_limit_memory == 0 )
+            return get_max_copy_ex();
+        uint64_t mapped = (uint64_t)m_ptr_file + m_map_size - m_address.map_mth;
+        uint64_t tail = ( m_file_size.QuadPart > m_offset.QuadPart ) ?
+                          m_file_size.QuadPart - m_offset.QuadPart : 0;
+        return ( mapped < tail ) ? mapped : tail;
+    }
+
 protected:
     ///////////////////////////////////////////////////////////////////////////////
     /// \brief проверка выделеного региона и проекция следующего
@@ -519,6 +916,28 @@ protected:
     /// @see map_region()
     uint64_t next_region();
 
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief выбрать размер следующего блока (адаптивный режим)
+    ///
+    void adapt_window();
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief страницы проекции можно освободить без потери данных\n
+    ///  (не частная запись и не закреплены в памяти)
+    ///
+    bool is_droppable() const;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief освободить страницы позади позиции (режим однократного чтения)
+    /// \param end - граница обработанных данных (смещение от начала файла)
+    /// \param force - освободить все до end (и частичную страницу), не\n
+    ///  дожидаясь порции set_consume_once()
+    ///
+    void drop_consumed( uint64_t end, bool force );
+
 protected:
     ///////////////////////////////////////////////////////////////////////////////
     /// \brief  выравнивание региона с учетом гранулярности страниц памяти в OS
@@ -574,6 +993,14 @@ protected:
     ///
     uint64_t read_from_memory ( void *dest_ptr, uint64_t length );
 
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief обновить хеш (и поблочные хеши) обработанными байтами
+    /// \param data - адрес обработанных байт в проекции
+    /// \param length - количество байт
+    ///
+    void hash_update( const void *data, uint64_t length );
+
 protected:
     ///////////////////////////////////////////////////////////////////////////////
     /// \brief get_page_size - Get the system allocation granularity.
@@ -740,6 +1167,16 @@ private:
     ///
     uint64_t m_limit_memory;
 
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief размер блока проекции, заданный set_limit_memory()
+    ///
+    /// m_limit_memory уменьшается при отражении последнего (неполного) блока,\n
+    /// а этот размер остается неизменным и используется при переходе\n
+    /// к произвольной позиции файла (seek).
+    ///
+    uint64_t m_limit_block;
+
 private:
     ///////////////////////////////////////////////////////////////////////////////
     /// \brief максимальное количество байт для копирования,\n
@@ -772,40 +1209,160 @@ private:
     ///
     bool m_sync;
 
-#if defined(OS_WIN)
 private:
     ///////////////////////////////////////////////////////////////////////////////
-    /// \brief флаг возврата коретки, при считывании строки в системе Windows\n
-    /// символ переход на новую строку состоит из двух символов:\n
-    /// воврат каретки (код 13)\n
-    /// новая строка (код 10).\n
-    /// так при открытии файла блоками ( m_limit_memory > 0 ) может получится так\n
-    /// что символ перехода на новую строку разделяется между проекциями. в конец\n
-    /// первой проекции попадает символ возврата, а в начало следующей проекции\n
-    /// символ новой строки. Поэтому в методе read_line при считывании в блочном\n
-    /// режиме перед переходном на новый регион проверяется последний символ\n
-    /// текущего региона, и если он равен символу возврата - устанавливается\n
-    /// этот флаг. после открытия нового региона проверяется состояние этого\n
-    /// флага - и если флаг поднят (последним был симол возврата) то проверяется\n
-    /// первый символ нового региона - после чего флаг сбрасывается, не зависимо\n
-    /// от значения первого символа (если первый символ - новая строка)\n
-    /// то считается что достигнут конец текущей считываемой строки и происходит\n
-    /// возврат из метода read_line, иначе считывание продолжается до тех пор,\n
-    /// пока не будет найден конец строки.\n
-    ///
-    bool m_return;
-#endif  // defined(OS_WIN)
+    /// \brief статистика отражения блоков проекции
+    ///
+    window_stats m_window_stats;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief перекрытие соседних блоков проекции
+    /// @see CFileMap::set_window_overlap()
+    ///
+    uint64_t m_window_overlap;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief фактический размер отраженного региона (с перекрытием)
+    /// @see CFileMap::map_region()
+    /// @see CFileMap::unmap_region()
+    ///
+    uint64_t m_map_size;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief закрепленные в памяти диапазоны проекции (адрес, размер)
+    /// @see CFileMap::lock_region()
+    ///
+    std::vector< std::pair<void *, uint64_t> > m_locks;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief размер закрепленных в памяти диапазонов
+    ///
+    uint64_t m_locked;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief файл открыт в режиме снимка (mode::snapshot)
+    ///
+    bool m_snapshot;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief время окончания последнего отражения
+    ///
+    std::chrono::steady_clock::time_point m_window_time;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief учет проекции в бюджете отраженной памяти (nullptr - без бюджета)
+    ///
+    CFileMapBudget::owner_info *m_budget_info;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief хеш обработанных байт
+    ///
+    CFileMapHash m_hash;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief хеш текущего (неполного) блока
+    ///
+    CFileMapHash m_block_hash;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief размер блока для поблочных хешей, ноль - без них
+    ///
+    uint64_t m_hash_block;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief хеши завершенных блоков
+    ///
+    std::vector<uint64_t> m_block_hashes;
 
 private:
     ///////////////////////////////////////////////////////////////////////////////
-    /// \brief Определяемый платформой (подходящий) символ новой строки.
+    /// \brief порция освобождения страниц, ноль - режим однократного чтения выключен
+    /// @see CFileMap::set_consume_once()
+    ///
+    uint64_t m_consume_step;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief MADV_PAGEOUT вместо MADV_DONTNEED
+    ///
+    bool m_consume_pageout;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief граница освобожденных страниц (смещение от начала файла)
+    ///
+    uint64_t m_consumed;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief граница данных, удаленных из кеша страниц (при записи\n
+    ///  отстает от m_consumed на порцию, которая еще записывается)
+    ///
+    uint64_t m_uncached;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief количество освобожденных байт
+    ///
+    uint64_t m_released;
+
+protected:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief определить символы новой строки для write_line() по данным (режим autodetect)
+    /// \param data - данные
+    /// \param length - количество байт (просматриваются первые 64 KiB)
+    ///
+    /// на чтение не влияет - в режиме autodetect строки читаются как mixed
+    ///
+    void detect_line_ending( const char *data, uint64_t length );
+
+protected:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief длина строки без CR перед LF в соответствии с режимом set_line_ending()
+    /// \param data - начало строки
+    /// \param length - длина строки без LF
+    /// \param terminated - строка завершена LF (последняя строка файла без LF сохраняет CR)
+    /// \return длина строки без символов конца строки
+    ///
+    /// общее правило для всех читателей строк: CR остается в строке только в режиме lf
+    ///
+    uint64_t line_length( const char *data, uint64_t length, bool terminated = true ) const {
+        if ( terminated && m_line_ending != line_ending::lf && length != 0 && data[length-1] == '\r' )
+            length--;
+        return length;
+    }
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief заданный режим конца строки
+    ///
+    line_ending m_line_ending;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief символы новой строки для write_line() определены по файлу (autodetect)
+    ///
+    bool m_line_detected;
+
+protected:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief символы новой строки для write_line() (строка с нулем в конце).
+    /// по умолчанию определяются платформой:
     /// Chr(13) & Chr(10) для Windows
     /// Chr(10)  для Linux (Unix)
-#if defined(OS_WIN)
-    char m_new_line[2];
-#else
-    char m_new_line[1];
-#endif  // defined(OS_WIN)
+    /// \see set_line_ending()
+    char m_new_line[3];
 };
 
 #endif // FILEMAPILEMAP_H
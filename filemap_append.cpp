@@ -0,0 +1,535 @@
+/*!
+ *
+ * \file filemap_append.cpp
+ * \brief реализация класса журнала с добавлением в конец файла
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+
+#include "filemap_append.h"
+#include <iostream>
+#include <thread>
+#include <errno.h>
+
+using namespace std;
+
+namespace {
+
+// количество частей в таблице второго уровня
+const uint64_t CHUNK_TABLE = 4096;
+// наибольшее количество таблиц второго уровня (таблица первого уровня - 4 МБ)
+const uint64_t MAX_TABLES = 512 * 1024;
+
+}   // namespace
+
+///////////////////////////////////////////////////////////////////////////////
+// конструктор
+CFileMapAppend::CFileMapAppend( uint64_t chunk_size /*= 64*1024*1024*/ )
+    : CFileMap( 0 )
+{
+    m_chunk_size = memory_allocation_granularity( chunk_size ? chunk_size : 1 );
+    m_capacity = 0;                     // максимальный размер журнала
+    m_grown = 0;                        // текущий размер файла на диске
+    m_tail = 0;                         // хвост журнала
+    m_committed = 0;                    // граница подтвержденных данных
+    m_chunk_count = 0;                  // количество частей
+    m_table_count = 0;                  // количество таблиц второго уровня
+    m_log_file = INVALID_HANDLE_VALUE;  // описатель файла журнала
+#   if defined(OS_WIN)
+    m_log_mapping = NULL;               // объект "проекция файла"
+#   endif  // defined(OS_WIN)
+}   //  CFileMapAppend( uint64_t chunk_size )
+
+///////////////////////////////////////////////////////////////////////////////
+// деструктор
+CFileMapAppend::~CFileMapAppend()
+{
+    close_file_map();
+}   //  ~CFileMapAppend()
+
+///////////////////////////////////////////////////////////////////////////////
+// открыть (создать) файл журнала
+uint64_t CFileMapAppend::open_file_map()
+{
+    uint64_t last_error = 0;
+    uint64_t file_size = 0;
+
+    try
+    {
+        if ( m_log_file != INVALID_HANDLE_VALUE || get_file_path().length() == 0 ) {
+#           if defined(OS_WIN)
+            last_error = ERROR_INVALID_PARAMETER;
+#           else
+            last_error = EINVAL;
+#           endif  // defined(OS_WIN)
+            throw last_error;
+        }
+
+#       if defined(OS_WIN)
+        m_log_file = ::CreateFileW( get_file_path().c_str(),
+                                    GENERIC_READ | GENERIC_WRITE,
+                                    FILE_SHARE_READ,        /* читать журнал можно другим процессам */
+                                    NULL,
+                                    OPEN_ALWAYS,            /* открыть или создать */
+                                    FILE_ATTRIBUTE_NORMAL,
+                                    NULL );
+        if ( m_log_file == INVALID_HANDLE_VALUE ) {
+            last_error = ::GetLastError();
+            throw last_error;
+        }
+        LARGE_INTEGER size;
+        if ( ::GetFileSizeEx( m_log_file, &size ) == 0 ) {
+            last_error = ::GetLastError();
+            throw last_error;
+        }
+        file_size = size.QuadPart;
+#       else
+        string file_path = wchar_string( get_file_path().c_str(), get_file_path().length() );
+        m_log_file = ::open( file_path.c_str(), O_RDWR | O_CREAT | O_LARGEFILE,
+                             S_IRWXU|S_IRWXG|S_IROTH );
+        if ( m_log_file == INVALID_HANDLE_VALUE ) {
+            last_error = errno;
+            throw last_error;
+        }
+        struct stat info;
+        if ( ::fstat( m_log_file, &info ) != 0 ) {
+            last_error = errno;
+            throw last_error;
+        }
+        file_size = (uint64_t)info.st_size;
+#       endif  // defined(OS_WIN)
+
+        if ( m_capacity == 0 )
+            m_capacity = 1ull << 40;
+
+        /* после аварийного завершения файл увеличен с запасом до границы части
+         * (или до максимального размера) - отбросим нулевой хвост */
+        if ( file_size != 0 && ( file_size % m_chunk_size == 0 || file_size == m_capacity ) ) {
+            last_error = trim_zero_tail( file_size );
+            if ( last_error )
+                throw last_error;
+        }
+        if ( m_capacity < file_size )
+            m_capacity = file_size;
+
+        m_chunk_count = ( m_capacity + m_chunk_size - 1 ) / m_chunk_size;
+        uint64_t tables = ( m_chunk_count + CHUNK_TABLE - 1 ) / CHUNK_TABLE;
+        if ( tables > MAX_TABLES ) {
+            // слишком маленькая часть для такого максимального размера журнала
+#           if defined(OS_WIN)
+            last_error = ERROR_INVALID_PARAMETER;
+#           else
+            last_error = EINVAL;
+#           endif  // defined(OS_WIN)
+            throw last_error;
+        }
+        m_chunks.reset( new std::atomic<std::atomic<char*>*>[tables] );
+        for ( uint64_t index = 0; index < tables; index++ )
+            m_chunks[index] = nullptr;
+        m_table_count = tables;
+
+        m_grown = file_size;
+        m_tail = file_size;
+        m_committed = file_size;
+
+        // отразим часть, в которую пойдет первая запись
+        if ( file_size < m_capacity ) {
+            char *address = nullptr;
+            last_error = get_chunk( file_size / m_chunk_size, address );
+            if ( last_error )
+                throw last_error;
+        }
+    }
+    catch( uint64_t error ) {
+        last_error = error;
+        cout<< "an error number \"" << error << "\" is generated in the method open_file_map" <<endl;
+        close_file_map();
+    }
+
+    return last_error;
+}   //  open_file_map()
+
+///////////////////////////////////////////////////////////////////////////////
+// закрывает журнал
+void CFileMapAppend::close_file_map()
+{
+    if ( m_log_file == INVALID_HANDLE_VALUE )
+        return;
+
+    try
+    {
+        uint64_t last_error = 0;
+
+        for ( uint64_t table = 0; table < m_table_count; table++ ) {
+            std::atomic<char*> *slots = m_chunks[table].load( std::memory_order_acquire );
+            if ( slots == nullptr )
+                continue;
+            for ( uint64_t slot = 0; slot < CHUNK_TABLE; slot++ ) {
+                uint64_t index = table * CHUNK_TABLE + slot;
+                char *address = slots[slot].load( std::memory_order_acquire );
+                if ( address == nullptr )
+                    continue;
+#               if defined(OS_WIN)
+                if ( ::UnmapViewOfFile( address ) == 0 && last_error == 0 )
+                    last_error = ::GetLastError();
+#               else
+                uint64_t size = m_capacity - index * m_chunk_size;
+                if ( size > m_chunk_size )
+                    size = m_chunk_size;
+                if ( ::munmap( address, size ) != 0 && last_error == 0 )
+                    last_error = errno;
+#               endif  // defined(OS_WIN)
+            }
+            delete[] slots;
+            m_chunks[table] = nullptr;
+        }
+        m_chunks.reset();
+        m_chunk_count = 0;
+        m_table_count = 0;
+
+        // размер файла - только подтвержденные данные
+        LARGE_INTEGER committed;
+        committed.QuadPart = m_committed.load( std::memory_order_acquire );
+
+#       if defined(OS_WIN)
+        if ( m_log_mapping != NULL )
+            ::CloseHandle( m_log_mapping );
+        m_log_mapping = NULL;
+        if ( m_grown != (uint64_t)committed.QuadPart ) {
+            if ( ( ::SetFilePointerEx( m_log_file, committed, NULL, FILE_BEGIN ) == 0 ||
+                   ::SetEndOfFile( m_log_file ) == 0 ) && last_error == 0 )
+                last_error = ::GetLastError();
+        }
+        if ( ::CloseHandle( m_log_file ) == 0 && last_error == 0 )
+            last_error = ::GetLastError();
+#       else
+        if ( m_grown != (uint64_t)committed.QuadPart ) {
+            if ( ::ftruncate( m_log_file, committed.QuadPart ) != 0 && last_error == 0 )
+                last_error = errno;
+        }
+        if ( ::close( m_log_file ) != 0 && last_error == 0 )
+            last_error = errno;
+#       endif  // defined(OS_WIN)
+
+        m_log_file = INVALID_HANDLE_VALUE;
+        m_grown = 0;
+        m_capacity = 0;
+
+        if ( last_error )
+            throw last_error;
+    }
+    catch( uint64_t error ) {
+        cout <<"an error number \""<< error <<"\" is generated in the method close" <<endl;
+    }
+}   //  close_file_map()
+
+///////////////////////////////////////////////////////////////////////////////
+// зарезервировать диапазон байт в конце журнала
+uint64_t CFileMapAppend::reserve( uint64_t length, uint64_t &offset )
+{
+    if ( m_log_file == INVALID_HANDLE_VALUE ) {
+#       if defined(OS_WIN)
+        return ERROR_INVALID_PARAMETER;
+#       else
+        return EINVAL;
+#       endif  // defined(OS_WIN)
+    }
+
+    uint64_t tail = m_tail.load( std::memory_order_relaxed );
+    do {
+        if ( length > m_capacity - tail ) {
+#           if defined(OS_WIN)
+            return ERROR_DISK_FULL;
+#           else
+            return ENOSPC;
+#           endif  // defined(OS_WIN)
+        }
+    } while ( !m_tail.compare_exchange_weak( tail, tail + length,
+                                             std::memory_order_acq_rel,
+                                             std::memory_order_relaxed ) );
+    offset = tail;
+    return 0;
+}   //  reserve( uint64_t length, uint64_t &offset )
+
+///////////////////////////////////////////////////////////////////////////////
+// скопировать данные в зарезервированный диапазон
+uint64_t CFileMapAppend::copy( uint64_t offset, const void *data, uint64_t length )
+{
+    if ( offset + length > m_tail.load( std::memory_order_acquire ) ) {
+#       if defined(OS_WIN)
+        return ERROR_INVALID_PARAMETER;
+#       else
+        return EINVAL;
+#       endif  // defined(OS_WIN)
+    }
+
+    const char *src = (const char *)data;
+    while ( length ) {
+        char *address = nullptr;
+        uint64_t last_error = get_chunk( offset / m_chunk_size, address );
+        if ( last_error )
+            return last_error;
+        uint64_t position = offset % m_chunk_size;
+        uint64_t size = m_chunk_size - position;
+        if ( size > length )
+            size = length;
+        memcpy( address + position, src, (size_t)size );
+        src += size;
+        offset += size;
+        length -= size;
+    }
+    return 0;
+}   //  copy( uint64_t offset, const void *data, uint64_t length )
+
+///////////////////////////////////////////////////////////////////////////////
+// подтвердить, что зарезервированный диапазон записан
+void CFileMapAppend::commit( uint64_t offset, uint64_t length )
+{
+    // граница сдвигается строго по порядку резервирования
+    while ( m_committed.load( std::memory_order_acquire ) != offset )
+        std::this_thread::yield();
+    m_committed.store( offset + length, std::memory_order_release );
+}   //  commit( uint64_t offset, uint64_t length )
+
+///////////////////////////////////////////////////////////////////////////////
+// добавить запись в конец журнала
+uint64_t CFileMapAppend::append( const void *data, uint64_t length, uint64_t *offset /*= nullptr*/ )
+{
+    uint64_t position = 0;
+    if ( reserve( length, position ) != 0 )
+        return 0;
+
+    /* диапазон подтверждается и при ошибке копирования (остается заполненным
+     * нулями), иначе остановятся все последующие записи */
+    uint64_t last_error = copy( position, data, length );
+    commit( position, length );
+    if ( last_error ) {
+        cout<< "an error number \"" << last_error << "\" is generated in the method append" <<endl;
+        return 0;
+    }
+
+    if ( offset )
+        *offset = position;
+    return length;
+}   //  append( const void *data, uint64_t length, uint64_t *offset )
+
+///////////////////////////////////////////////////////////////////////////////
+// синхронизировать подтвержденные данные с диском
+uint64_t CFileMapAppend::flush()
+{
+    uint64_t committed = m_committed.load( std::memory_order_acquire );
+
+    for ( uint64_t index = 0; index < m_chunk_count; index++ ) {
+        uint64_t start = index * m_chunk_size;
+        if ( start >= committed )
+            break;
+        std::atomic<char*> *slot = get_slot( index, false );
+        if ( slot == nullptr ) {
+            // таблица второго уровня не создана - ни одна ее часть не отражена
+            index = index - index % CHUNK_TABLE + CHUNK_TABLE - 1;
+            continue;
+        }
+        char *address = slot->load( std::memory_order_acquire );
+        if ( address == nullptr )
+            continue;
+        uint64_t size = committed - start;
+        if ( size > m_chunk_size )
+            size = m_chunk_size;
+#       if defined(OS_WIN)
+        if ( ::FlushViewOfFile( address, (SIZE_T)size ) == 0 )
+            return ::GetLastError();
+#       else
+        if ( ::msync( address, size, MS_ASYNC ) != 0 )
+            return errno;
+#       endif  // defined(OS_WIN)
+    }
+    return 0;
+}   //  flush()
+
+///////////////////////////////////////////////////////////////////////////////
+// получить адрес части файла (отразить, если еще не отражена)
+uint64_t CFileMapAppend::get_chunk( uint64_t index, char *&address )
+{
+    if ( index >= m_chunk_count ) {
+#       if defined(OS_WIN)
+        return ERROR_INVALID_PARAMETER;
+#       else
+        return EINVAL;
+#       endif  // defined(OS_WIN)
+    }
+
+    std::atomic<char*> *slot = get_slot( index, false );
+    address = slot ? slot->load( std::memory_order_acquire ) : nullptr;
+    if ( address )
+        return 0;
+
+    std::lock_guard<std::mutex> lock( m_grow );
+    slot = get_slot( index, true );
+    address = slot->load( std::memory_order_acquire );
+    if ( address )
+        return 0;
+
+    uint64_t start = index * m_chunk_size;
+    uint64_t size = m_capacity - start;
+    if ( size > m_chunk_size )
+        size = m_chunk_size;
+
+    // файл увеличивается с запасом на одну часть вперед
+    uint64_t grow = start + size + m_chunk_size;
+    if ( grow > m_capacity )
+        grow = m_capacity;
+    uint64_t last_error = grow_file( grow );
+    if ( last_error )
+        return last_error;
+
+#   if defined(OS_WIN)
+    LARGE_INTEGER offset;
+    offset.QuadPart = start;
+    void *ptr = ::MapViewOfFile( m_log_mapping, FILE_MAP_WRITE,
+                                 offset.HighPart, offset.LowPart, (SIZE_T)size );
+    if ( ptr == NULL )
+        return ::GetLastError();
+#   else
+    void *ptr = ::mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_log_file, start );
+    if ( ptr == MAP_FAILED )
+        return errno;
+#   endif  // defined(OS_WIN)
+
+    address = (char *)ptr;
+    slot->store( address, std::memory_order_release );
+    return 0;
+}   //  get_chunk( uint64_t index, char *&address )
+
+///////////////////////////////////////////////////////////////////////////////
+// получить ячейку адреса части в таблице частей
+std::atomic<char*>* CFileMapAppend::get_slot( uint64_t index, bool create )
+{
+    std::atomic<char*> *slots = m_chunks[index / CHUNK_TABLE].load( std::memory_order_acquire );
+    if ( slots == nullptr ) {
+        if ( !create )
+            return nullptr;
+        slots = new std::atomic<char*>[CHUNK_TABLE];
+        for ( uint64_t slot = 0; slot < CHUNK_TABLE; slot++ )
+            slots[slot] = nullptr;
+        m_chunks[index / CHUNK_TABLE].store( slots, std::memory_order_release );
+    }
+    return &slots[index % CHUNK_TABLE];
+}   //  get_slot( uint64_t index, bool create )
+
+///////////////////////////////////////////////////////////////////////////////
+// отбросить нулевой хвост файла, оставшийся после аварийного завершения
+uint64_t CFileMapAppend::trim_zero_tail( uint64_t &file_size )
+{
+    /* файл увеличивается не больше, чем на часть вперед от отраженной части,
+     * поэтому запас не длиннее двух частей */
+    uint64_t stop = ( file_size > 2 * m_chunk_size ) ? file_size - 2 * m_chunk_size : 0;
+    uint64_t end = file_size;
+    vector<char> buffer( 1024 * 1024 );
+    while ( end > stop ) {
+        uint64_t length = std::min( end - stop, (uint64_t)buffer.size() );
+        uint64_t offset = end - length;
+#       if defined(OS_WIN)
+        OVERLAPPED overlapped;
+        memset( &overlapped, 0, sizeof(overlapped) );
+        overlapped.Offset = (DWORD)offset;
+        overlapped.OffsetHigh = (DWORD)( offset >> 32 );
+        DWORD done = 0;
+        if ( ::ReadFile( m_log_file, buffer.data(), (DWORD)length, &done, &overlapped ) == FALSE ||
+             done != length )
+            return ::GetLastError();
+#       else
+        ssize_t res = ::pread( m_log_file, buffer.data(), length, (off_t)offset );
+        if ( res != (ssize_t)length )
+            return ( res < 0 ) ? errno : EIO;
+#       endif  // defined(OS_WIN)
+        // последний ненулевой байт
+        uint64_t index = length;
+        while ( index != 0 && buffer[(size_t)( index - 1 )] == 0 )
+            index--;
+        end = offset + index;
+        if ( index != 0 )
+            break;
+    }
+    if ( end == file_size )
+        return 0;
+
+#   if defined(OS_WIN)
+    LARGE_INTEGER size;
+    size.QuadPart = end;
+    if ( ::SetFilePointerEx( m_log_file, size, NULL, FILE_BEGIN ) == 0 ||
+         ::SetEndOfFile( m_log_file ) == 0 )
+        return ::GetLastError();
+#   else
+    if ( ::ftruncate( m_log_file, (off_t)end ) != 0 )
+        return errno;
+#   endif  // defined(OS_WIN)
+    file_size = end;
+    return 0;
+}   //  trim_zero_tail( uint64_t &file_size )
+
+///////////////////////////////////////////////////////////////////////////////
+// увеличить файл (с предварительным выделением места)
+uint64_t CFileMapAppend::grow_file( uint64_t size )
+{
+    if ( size <= m_grown )
+        return 0;
+
+#   if defined(OS_WIN)
+    LARGE_INTEGER end;
+    end.QuadPart = size;
+    if ( ::SetFilePointerEx( m_log_file, end, NULL, FILE_BEGIN ) == 0 ||
+         ::SetEndOfFile( m_log_file ) == 0 )
+        return ::GetLastError();
+
+    /* размер объекта "проекция файла" фиксируется при создании, поэтому после
+     * роста файла создается новый объект, а отраженные части удерживают старый */
+    HANDLE mapping = ::CreateFileMapping( m_log_file, NULL, PAGE_READWRITE, 0, 0, NULL );
+    if ( mapping == NULL )
+        return ::GetLastError();
+    if ( m_log_mapping != NULL )
+        ::CloseHandle( m_log_mapping );
+    m_log_mapping = mapping;
+#   else
+#       if defined(OS_LINUX)
+    /* место выделяется сразу, чтобы запись в проекцию не получила SIGBUS
+     * при нехватке места на диске; если ФС не поддерживает fallocate -
+     * просто увеличиваем размер файла */
+    int res = ::posix_fallocate( m_log_file, m_grown, size - m_grown );
+    if ( res != 0 && res != EOPNOTSUPP && res != EINVAL )
+        return res;
+    if ( res != 0 && ::ftruncate( m_log_file, size ) != 0 )
+        return errno;
+#       else
+    if ( ::ftruncate( m_log_file, size ) != 0 )
+        return errno;
+#       endif  // defined(OS_LINUX)
+#   endif  // defined(OS_WIN)
+
+    m_grown = size;
+    return 0;
+}   //  grow_file( uint64_t size )
@@ -0,0 +1,298 @@
+/*!
+ *
+ * \file filemap_append.h
+ * \brief определение класса журнала с добавлением в конец файла
+ *
+ *  несколько потоков резервируют непересекающиеся диапазоны байт\n
+ *  атомарным сдвигом хвоста и копируют данные в проекцию параллельно,\n
+ *  файл растет заранее выделенными частями, граница подтвержденных\n
+ *  данных (commit) определяет, что видят читатели и какой размер\n
+ *  останется у файла после закрытия.
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied\n
+ * warranty. In no event will the authors be held liable for any damages\n
+ * arising from the use of this software.\n
+ *
+ * Permission is granted to anyone to use this software for any purpose,\n
+ * including commercial applications, and to alter it and redistribute it\n
+ * freely, subject to the following restrictions:\n
+ *
+ *    1. The origin of this software must not be misrepresented; you must not\n
+ *    claim that you wrote the original software. If you use this software\n
+ *    in a product, an acknowledgment in the product documentation would be\n
+ *    appreciated but is not required.\n
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be\n
+ *    misrepresented as being the original software.\n
+ *    3. This notice may not be removed or altered from any source\n
+ *    distribution.\n
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+#ifndef FILEMAP_APPEND_H
+#define FILEMAP_APPEND_H
+
+#include "filemap.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+
+
+//--------------------------------------------------------------------------------------------------//
+
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief The CFileMapAppend class - журнал с добавлением в конец файла
+///
+/// файл открывается (создается, если не существует), запись начинается\n
+/// с текущего конца файла. Файл отражается частями (chunk) фиксированного\n
+/// размера, каждая часть отражается один раз и остается на месте до закрытия,\n
+/// поэтому адреса зарезервированных диапазонов не меняются при росте файла.\n
+/// Файл увеличивается на одну часть вперед (с предварительным выделением места).\n
+///
+/// append() = reserve() + copy() + commit(), все три метода потокобезопасны.\n
+/// reserve() - атомарный сдвиг хвоста (без блокировок),\n
+/// copy() - копирование в проекцию (параллельно),\n
+/// commit() - ждет подтверждения предыдущих диапазонов и сдвигает границу\n
+/// подтвержденных данных, так что она всегда покрывает только полностью\n
+/// записанные данные. Зарезервированный диапазон обязательно должен быть\n
+/// подтвержден, иначе commit() последующих диапазонов не завершится.
+///
+/// граница подтвержденных данных хранится только в памяти: после аварийного\n
+/// завершения (без close_file_map()) файл остается увеличенным с запасом,\n
+/// заполненным нулями. При открытии такого файла (размер кратен части)\n
+/// нулевой хвост отбрасывается, и запись продолжается сразу за данными -\n
+/// нулевые байты в конце последней записи при этом тоже отбрасываются.
+///
+/// \code
+/// CFileMapAppend log;
+/// log.set_file_path( file_path );
+/// log.open_file_map();
+/// ... // в нескольких потоках
+/// log.append( record, record_size );
+/// ...
+/// log.close_file_map(); // размер файла = get_committed()
+/// \endcode
+///
+class CFileMapAppend : public CFileMap
+{
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief конструктор
+    /// \param chunk_size - размер части файла, отражаемой в память\n
+    ///  (выравнивается по гранулярности страниц памяти)
+    ///
+    CFileMapAppend( uint64_t chunk_size = 64*1024*1024 );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief деструктор (закрывает журнал)
+    ///
+    ~CFileMapAppend();
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief  открыть (создать) файл журнала, запись - с конца файла
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    /// \see set_file_size()
+    ///
+    uint64_t open_file_map();
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief закрывает журнал, размер файла подгоняется под границу\n
+    ///  подтвержденных данных
+    ///
+    void close_file_map();
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить максимальный размер журнала (до открытия)
+    /// \param file_size - максимальный размер файла, ноль - 1 TiB
+    ///
+    void set_file_size( uint64_t file_size ) {
+        if ( m_log_file == INVALID_HANDLE_VALUE )
+            m_capacity = file_size;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief зарезервировать диапазон байт в конце журнала
+    /// \param length - количество байт
+    /// \param offset - смещение диапазона от начала файла
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t reserve( uint64_t length, uint64_t &offset );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief скопировать данные в зарезервированный диапазон
+    /// \param offset - смещение от начала файла (внутри диапазона)
+    /// \param data - данные
+    /// \param length - количество байт
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t copy( uint64_t offset, const void *data, uint64_t length );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief подтвердить, что зарезервированный диапазон записан
+    /// \param offset - смещение диапазона (значение из reserve())
+    /// \param length - количество байт (значение для reserve())
+    ///
+    /// ждет подтверждения всех предыдущих диапазонов
+    ///
+    void commit( uint64_t offset, uint64_t length );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief добавить запись в конец журнала
+    /// \param data - данные
+    /// \param length - количество байт
+    /// \param offset - смещение записи от начала файла (может быть nullptr)
+    /// \return количество записанных байт
+    ///
+    uint64_t append( const void *data, uint64_t length, uint64_t *offset = nullptr );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief синхронизировать подтвержденные данные с диском (асинхронно)
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t flush();
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить границу подтвержденных данных
+    /// \return размер полностью записанных данных от начала файла
+    ///
+    uint64_t get_committed() const {
+        return m_committed.load( std::memory_order_acquire );
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить хвост журнала (включая неподтвержденные диапазоны)
+    ///
+    uint64_t get_tail() const {
+        return m_tail.load( std::memory_order_acquire );
+    }
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить адрес части файла (отразить, если еще не отражена)
+    /// \param index - номер части
+    /// \param address - адрес части
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t get_chunk( uint64_t index, char *&address );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief увеличить файл (с предварительным выделением места)
+    /// \param size - новый размер файла
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t grow_file( uint64_t size );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief отбросить нулевой хвост файла, оставшийся после аварийного завершения
+    /// \param file_size - размер файла (уменьшается до конца данных)
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t trim_zero_tail( uint64_t &file_size );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить ячейку адреса части в таблице частей
+    /// \param index - номер части
+    /// \param create - создать таблицу второго уровня (под блокировкой m_grow)
+    /// \return ячейка или nullptr, если таблица второго уровня еще не создана
+    ///
+    std::atomic<char*>* get_slot( uint64_t index, bool create );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief размер части файла, отражаемой в память
+    ///
+    uint64_t m_chunk_size;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief максимальный размер журнала
+    ///
+    uint64_t m_capacity;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief текущий размер файла на диске (с запасом)
+    ///
+    uint64_t m_grown;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief хвост журнала - начало следующего резервируемого диапазона
+    ///
+    std::atomic<uint64_t> m_tail;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief граница подтвержденных данных
+    ///
+    std::atomic<uint64_t> m_committed;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief адреса отраженных частей файла - двухуровневая таблица,\n
+    ///  таблицы второго уровня создаются при первом обращении к их частям
+    ///
+    std::unique_ptr<std::atomic<std::atomic<char*>*>[]> m_chunks;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief количество частей журнала
+    ///
+    uint64_t m_chunk_count;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief количество элементов в m_chunks (таблиц второго уровня)
+    ///
+    uint64_t m_table_count;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief блокировка роста файла и отражения частей
+    ///
+    std::mutex m_grow;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief описатель файла журнала
+    ///
+    HANDLE m_log_file;
+
+#if defined(OS_WIN)
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief объект "проекция файла" для текущего размера файла\n
+    ///  (уже отраженные части удерживают свои объекты сами)
+    ///
+    HANDLE m_log_mapping;
+#endif  // defined(OS_WIN)
+};
+
+#endif // FILEMAP_APPEND_H
@@ -0,0 +1,250 @@
+/*!
+ *
+ * \file filemap_async.cpp
+ * \brief реализация асинхронного интерфейса проекции на сопрограммах C++20
+ *
+ *  пул потоков ввода-вывода и ожидаемые операции CFileMapAsync.
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+
+#include "filemap_async.h"
+#include <algorithm>
+
+#if defined(__cpp_impl_coroutine)
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// конструктор
+CFileMapIoPool::CFileMapIoPool( uint32_t threads /*= 4*/ )
+{
+    m_stop = false;                 // признак остановки пула
+    if ( threads == 0 )
+        threads = std::max( 1u, thread::hardware_concurrency() );
+    for ( uint32_t index = 0; index < threads; index++ )
+        m_threads.emplace_back( &CFileMapIoPool::worker, this );
+}   //  CFileMapIoPool( uint32_t threads )
+
+///////////////////////////////////////////////////////////////////////////////
+// деструктор
+CFileMapIoPool::~CFileMapIoPool()
+{
+    {
+        lock_guard<mutex> lock( m_lock );
+        m_stop = true;
+    }
+    m_signal.notify_all();
+    for ( auto &th : m_threads )
+        th.join();
+}   //  ~CFileMapIoPool()
+
+///////////////////////////////////////////////////////////////////////////////
+// общий пул процесса
+CFileMapIoPool& CFileMapIoPool::global()
+{
+    static CFileMapIoPool pool;
+    return pool;
+}   //  global()
+
+///////////////////////////////////////////////////////////////////////////////
+// поставить задачу в очередь
+void CFileMapIoPool::submit( function<void()> task )
+{
+    {
+        lock_guard<mutex> lock( m_lock );
+        m_tasks.push_back( std::move( task ) );
+    }
+    m_signal.notify_one();
+}   //  submit( function<void()> task )
+
+///////////////////////////////////////////////////////////////////////////////
+// выполнять задачи (поток пула)
+void CFileMapIoPool::worker()
+{
+    for ( ;; ) {
+        function<void()> task;
+        {
+            unique_lock<mutex> lock( m_lock );
+            m_signal.wait( lock, [this]() { return m_stop || !m_tasks.empty(); } );
+            // при остановке сначала выполняются поставленные задачи
+            if ( m_tasks.empty() )
+                return;
+            task = std::move( m_tasks.front() );
+            m_tasks.pop_front();
+        }
+        task();
+    }
+}   //  worker()
+
+///////////////////////////////////////////////////////////////////////////////
+// выполнить операцию в пуле потоков и продолжить сопрограмму
+void CFileMapAsync::operation::await_suspend( std::coroutine_handle<> handle )
+{
+    CFileMapAsync *owner = m_owner;
+    owner->m_pool->submit( [this, owner, handle]() {
+        m_result = m_work();
+        owner->prefault();
+        // после resume() объект операции может быть уже разрушен
+        owner->resume( handle );
+    } );
+}   //  await_suspend( std::coroutine_handle<> handle )
+
+///////////////////////////////////////////////////////////////////////////////
+// конструктор
+CFileMapAsync::CFileMapAsync( uint64_t limit_map_memory /*= 0*/, CFileMapIoPool *pool /*= nullptr*/ )
+    : CFileMap( limit_map_memory )
+{
+    m_pool = pool ? pool : &CFileMapIoPool::global();   // пул потоков ввода-вывода
+    m_prefault_size = 8*1024*1024;  // объем предзагрузки страниц
+    m_resident_base = 0;            // начало блока с предзагруженными страницами
+    m_resident_end = 0;             // предзагруженных страниц нет
+}   //  CFileMapAsync( uint64_t limit_map_memory, CFileMapIoPool *pool )
+
+///////////////////////////////////////////////////////////////////////////////
+// открыть файл
+CFileMapAsync::operation CFileMapAsync::open_file_map_async( mode md, uint64_t offset /*= 0*/ )
+{
+    m_resident_end = 0;
+    return operation( this, [this, md, offset]() {
+        return open_file_map( md, offset );
+    }, false );
+}   //  open_file_map_async( mode md, uint64_t offset )
+
+///////////////////////////////////////////////////////////////////////////////
+// прочитать данные из файла
+CFileMapAsync::operation CFileMapAsync::read_async( char *dest, uint64_t length )
+{
+    return operation( this, [this, dest, length]() {
+        return read( dest, length );
+    }, is_resident( length ) );
+}   //  read_async( char *dest, uint64_t length )
+
+///////////////////////////////////////////////////////////////////////////////
+// прочитать строку из файла
+CFileMapAsync::operation CFileMapAsync::read_line_async( char *dest )
+{
+    // строка целиком в предзагруженной части блока - читаем без пула
+    bool ready = false;
+    if ( is_resident( 1 ) ) {
+        const char *address = (const char *)get_map_address();
+        const char *end = (const char *)memchr( address, '\n',
+                                                (size_t)( m_resident_end - m_offset.QuadPart ) );
+        ready = ( end != nullptr ) && (uint64_t)( end - address + 1 ) < get_max_copy_ex();
+    }
+    return operation( this, [this, dest]() {
+        return read_line( dest );
+    }, ready );
+}   //  read_line_async( char *dest )
+
+///////////////////////////////////////////////////////////////////////////////
+// записать данные в файл
+CFileMapAsync::operation CFileMapAsync::write_async( const char *str, uint64_t length )
+{
+    return operation( this, [this, str, length]() {
+        return write( str, length );
+    }, is_resident( length ) );
+}   //  write_async( const char *str, uint64_t length )
+
+///////////////////////////////////////////////////////////////////////////////
+// установить текущую позицию в открытом файле
+CFileMapAsync::operation CFileMapAsync::seek_async( uint64_t offset )
+{
+    return operation( this, [this, offset]() {
+        return seek( offset );
+    }, false );
+}   //  seek_async( uint64_t offset )
+
+///////////////////////////////////////////////////////////////////////////////
+// отразить следующий блок файла
+CFileMapAsync::operation CFileMapAsync::next_region_async()
+{
+    return operation( this, [this]() -> uint64_t {
+        // текущий блок еще не прочитан - только предзагрузка страниц
+        if ( get_max_copy_ex() != 0 || eof() )
+            return 0;
+        return next_region();
+    }, false );
+}   //  next_region_async()
+
+///////////////////////////////////////////////////////////////////////////////
+// проверить, что length байт от текущей позиции уже в памяти
+bool CFileMapAsync::is_resident( uint64_t length )
+{
+    if ( m_resident_end == 0 || get_map_address() == nullptr )
+        return false;
+    // блок сменился (seek, next_region) - предзагрузка не действительна
+    if ( m_offset.QuadPart - m_offset_block != m_resident_base )
+        return false;
+    /* операция не должна дойти до конца блока,
+     * иначе внутри будет отражен следующий блок */
+    return length < get_max_copy_ex() &&
+           m_offset.QuadPart + length <= m_resident_end;
+}   //  is_resident( uint64_t length )
+
+///////////////////////////////////////////////////////////////////////////////
+// предзагрузить страницы блока от текущей позиции
+void CFileMapAsync::prefault()
+{
+    m_resident_end = 0;
+    const char *address = (const char *)get_map_address();
+    if ( address == nullptr || !is_open() )
+        return;
+    uint64_t length = std::min( get_max_copy_ex(), m_prefault_size );
+    if ( length == 0 )
+        return;
+
+#   if !defined(OS_WIN)
+    // адрес для madvise выравнивается по странице
+    uint64_t page_size = get_page_size();
+    uintptr_t begin = (uintptr_t)address - (uintptr_t)address % page_size;
+    ::madvise( (void *)begin, (size_t)( (uintptr_t)address + length - begin ), MADV_WILLNEED );
+#   endif  // !defined(OS_WIN)
+
+    // чтение по байту на страницу (4 КБ) - страницы попадают в память в потоке пула
+    volatile const char *touch = address;
+    uint64_t offset = 0;
+    for ( ; offset < length; offset += 4096 )
+        (void)touch[offset];
+    (void)touch[length - 1];
+
+    m_resident_base = m_offset.QuadPart - m_offset_block;
+    m_resident_end = m_offset.QuadPart + length;
+}   //  prefault()
+
+///////////////////////////////////////////////////////////////////////////////
+// продолжить сопрограмму после операции в пуле
+void CFileMapAsync::resume( std::coroutine_handle<> handle )
+{
+    if ( m_executor )
+        m_executor( handle );
+    else
+        handle.resume();
+}   //  resume( std::coroutine_handle<> handle )
+
+#endif  // defined(__cpp_impl_coroutine)
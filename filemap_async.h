@@ -0,0 +1,318 @@
+/*!
+ *
+ * \file filemap_async.h
+ * \brief определение асинхронного интерфейса проекции на сопрограммах C++20
+ *
+ *  операции, которые могут блокировать поток (отражение следующего\n
+ *  блока, ошибки страниц, сброс данных при снятии проекции), выполняются\n
+ *  в небольшом пуле потоков ввода-вывода, сопрограмма продолжается, когда\n
+ *  данные уже в памяти. Доступно при поддержке сопрограмм компилятором.
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied\n
+ * warranty. In no event will the authors be held liable for any damages\n
+ * arising from the use of this software.\n
+ *
+ * Permission is granted to anyone to use this software for any purpose,\n
+ * including commercial applications, and to alter it and redistribute it\n
+ * freely, subject to the following restrictions:\n
+ *
+ *    1. The origin of this software must not be misrepresented; you must not\n
+ *    claim that you wrote the original software. If you use this software\n
+ *    in a product, an acknowledgment in the product documentation would be\n
+ *    appreciated but is not required.\n
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be\n
+ *    misrepresented as being the original software.\n
+ *    3. This notice may not be removed or altered from any source\n
+ *    distribution.\n
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+#ifndef FILEMAP_ASYNC_H
+#define FILEMAP_ASYNC_H
+
+#include "filemap.h"
+
+#if defined(__cpp_impl_coroutine)
+
+#include <coroutine>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+
+
+//--------------------------------------------------------------------------------------------------//
+
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief The CFileMapIoPool class - пул потоков ввода-вывода
+///
+/// задачи выполняются в порядке поступления, пул может быть общим\n
+/// для любого количества объектов CFileMapAsync.
+///
+class CFileMapIoPool
+{
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief конструктор
+    /// \param threads - количество потоков, ноль - по числу ядер
+    ///
+    CFileMapIoPool( uint32_t threads = 4 );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief деструктор (дожидается выполнения поставленных задач)
+    ///
+    ~CFileMapIoPool();
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief общий пул процесса
+    ///
+    static CFileMapIoPool& global();
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief поставить задачу в очередь
+    /// \param task - задача
+    ///
+    void submit( std::function<void()> task );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief выполнять задачи (поток пула)
+    ///
+    void worker();
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief блокировка очереди
+    ///
+    std::mutex m_lock;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief сигнал о новой задаче
+    ///
+    std::condition_variable m_signal;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief очередь задач
+    ///
+    std::deque< std::function<void()> > m_tasks;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief потоки пула
+    ///
+    std::vector<std::thread> m_threads;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief признак остановки пула
+    ///
+    bool m_stop;
+};
+
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief The CFileMapAsync class - асинхронный интерфейс проекции
+///
+/// каждая операция возвращает ожидаемый объект (co_await). Если данные\n
+/// операции лежат в текущем блоке и уже прочитаны в память (предзагрузка\n
+/// после предыдущей асинхронной операции), операция выполняется сразу, без\n
+/// переключения потоков. Иначе операция выполняется в пуле потоков, там же\n
+/// предзагружаются страницы следующих set_prefault_size() байт блока, и\n
+/// сопрограмма продолжается через set_executor() (по умолчанию - в потоке пула).\n
+/// Объект должна использовать одна сопрограмма: следующая операция\n
+/// начинается после завершения предыдущей.
+///
+/// \code
+/// CFileMapAsync file( 64*1024*1024 );
+/// file.set_executor( []( std::coroutine_handle<> h ) { loop.post( h ); } );
+/// ...
+/// while ( !file.eof() ) {
+///     uint64_t length = co_await file.read_line_async( buffer );
+///     ...
+/// }
+/// \endcode
+///
+class CFileMapAsync : public CFileMap
+{
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief ожидаемая операция (результат co_await - результат операции\n
+    ///  CFileMap: количество байт или номер ошибки)
+    ///
+    class operation
+    {
+    public:
+        operation( CFileMapAsync *owner, std::function<uint64_t()> work, bool ready )
+            : m_owner( owner ), m_work( std::move( work ) ), m_ready( ready ), m_result( 0 ) {}
+
+        bool await_ready() const noexcept {
+            return m_ready;
+        }
+
+        void await_suspend( std::coroutine_handle<> handle );
+
+        uint64_t await_resume() {
+            // данные уже в памяти - операция выполняется в вызывающем потоке
+            if ( m_ready )
+                m_result = m_work();
+            return m_result;
+        }
+
+    private:
+        CFileMapAsync             *m_owner;     // объект проекции
+        std::function<uint64_t()>  m_work;      // операция
+        bool                       m_ready;     // выполнить без пула потоков
+        uint64_t                   m_result;    // результат операции
+    };
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief конструктор
+    /// \param limit_map_memory - размер ограниения для единовремменого отражения\n
+    ///  файла в память, если равен нулю - то отражается сразу весь файл целиком.
+    /// \param pool - пул потоков ввода-вывода, nullptr - общий пул
+    ///
+    CFileMapAsync( uint64_t limit_map_memory = 0, CFileMapIoPool *pool = nullptr );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить способ продолжения сопрограммы после операции в пуле\n
+    ///  (например, постановка в очередь цикла событий)
+    /// \param executor - функция, пустая - продолжить в потоке пула
+    ///
+    void set_executor( std::function<void( std::coroutine_handle<> )> executor ) {
+        m_executor = std::move( executor );
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить объем предзагрузки страниц после операции в пуле
+    /// \param prefault_size - количество байт от текущей позиции (в пределах блока)
+    ///
+    void set_prefault_size( uint64_t prefault_size ) {
+        m_prefault_size = prefault_size;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief открыть файл (отражение первого блока - в пуле потоков)
+    /// \param md - режим обработки файла и проекции
+    /// \param offset - смещение байт от начала файла
+    /// \return ожидаемая операция, результат - ноль или номер ошибки
+    ///
+    operation open_file_map_async( mode md, uint64_t offset = 0 );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief прочитать данные из файла
+    /// \return ожидаемая операция, результат - количество прочитанных байт
+    /// @see CFileMap::read
+    ///
+    operation read_async( char *dest, uint64_t length );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief прочитать строку из файла
+    /// \return ожидаемая операция, результат - длина строки
+    /// @see CFileMap::read_line
+    ///
+    operation read_line_async( char *dest );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief записать данные в файл
+    /// \return ожидаемая операция, результат - количество записанных байт
+    /// @see CFileMap::write
+    ///
+    operation write_async( const char *str, uint64_t length );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить текущую позицию в открытом файле
+    /// \return ожидаемая операция, результат - ноль или номер ошибки
+    /// @see CFileMap::seek
+    ///
+    operation seek_async( uint64_t offset );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief отразить следующий блок файла (с предзагрузкой страниц)
+    /// \return ожидаемая операция, результат - ноль или номер ошибки
+    /// @see CFileMap::next_region
+    ///
+    operation next_region_async();
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief проверить, что length байт от текущей позиции уже в памяти
+    ///
+    bool is_resident( uint64_t length );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief предзагрузить страницы блока от текущей позиции (в потоке пула)
+    ///
+    void prefault();
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief продолжить сопрограмму после операции в пуле
+    ///
+    void resume( std::coroutine_handle<> handle );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief пул потоков ввода-вывода
+    ///
+    CFileMapIoPool *m_pool;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief способ продолжения сопрограммы
+    ///
+    std::function<void( std::coroutine_handle<> )> m_executor;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief объем предзагрузки страниц
+    ///
+    uint64_t m_prefault_size;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief начало блока, страницы которого предзагружены
+    ///
+    uint64_t m_resident_base;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief конец предзагруженной части (смещение от начала файла), ноль - нет
+    ///
+    uint64_t m_resident_end;
+};
+
+#endif  // defined(__cpp_impl_coroutine)
+
+#endif // FILEMAP_ASYNC_H
@@ -0,0 +1,311 @@
+/*!
+ *
+ * \file filemap_budget.cpp
+ * \brief реализация менеджера бюджета отраженной памяти процесса
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+
+#include "filemap.h"
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <errno.h>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// конструктор
+CFileMapBudget::CFileMapBudget( uint64_t budget /*= 0*/ )
+{
+    m_budget = budget;                          // бюджет в байтах
+    m_mapped = 0;                               // размер учтенных проекций
+    m_idle_time = chrono::milliseconds( 1000 ); // время простоя до освобождения страниц
+}   //  CFileMapBudget( uint64_t budget )
+
+///////////////////////////////////////////////////////////////////////////////
+// общий бюджет процесса
+CFileMapBudget& CFileMapBudget::global()
+{
+    static CFileMapBudget budget;
+    return budget;
+}   //  global()
+
+///////////////////////////////////////////////////////////////////////////////
+// установить бюджет
+void CFileMapBudget::set_budget( uint64_t budget )
+{
+    lock_guard<mutex> lock( m_lock );
+    m_budget = budget;
+}   //  set_budget( uint64_t budget )
+
+///////////////////////////////////////////////////////////////////////////////
+// установить бюджет как долю ограничения памяти cgroup
+uint64_t CFileMapBudget::set_budget_from_cgroup( double fraction /*= 0.5*/ )
+{
+    if ( fraction <= 0 || fraction > 1 ) {
+#       if defined(OS_WIN)
+        return ERROR_INVALID_PARAMETER;
+#       else
+        return EINVAL;
+#       endif  // defined(OS_WIN)
+    }
+
+#   if defined(OS_LINUX)
+    // cgroup v2, затем cgroup v1
+    const char *paths[] = { "/sys/fs/cgroup/memory.max",
+                            "/sys/fs/cgroup/memory/memory.limit_in_bytes" };
+    for ( const char *path : paths ) {
+        ifstream file( path );
+        string value;
+        if ( !( file >> value ) )
+            continue;
+        if ( value == "max" )
+            return ENOENT;
+        uint64_t limit = strtoull( value.c_str(), nullptr, 10 );
+        // cgroup v1 без ограничения возвращает почти 2^63
+        if ( limit == 0 || limit >= ( 1ull << 62 ) )
+            return ENOENT;
+        set_budget( (uint64_t)( limit * fraction ) );
+        return 0;
+    }
+    return ENOENT;
+#   elif defined(OS_WIN)
+    return ERROR_NOT_SUPPORTED;
+#   else
+    return ENOSYS;
+#   endif  // defined(OS_LINUX)
+}   //  set_budget_from_cgroup( double fraction )
+
+///////////////////////////////////////////////////////////////////////////////
+// установить время простоя
+void CFileMapBudget::set_idle_time( uint32_t milliseconds )
+{
+    lock_guard<mutex> lock( m_lock );
+    m_idle_time = chrono::milliseconds( milliseconds );
+}   //  set_idle_time( uint32_t milliseconds )
+
+///////////////////////////////////////////////////////////////////////////////
+// получить бюджет
+uint64_t CFileMapBudget::get_budget() const
+{
+    lock_guard<mutex> lock( m_lock );
+    return m_budget;
+}   //  get_budget()
+
+///////////////////////////////////////////////////////////////////////////////
+// получить размер учтенных проекций
+uint64_t CFileMapBudget::get_mapped() const
+{
+    lock_guard<mutex> lock( m_lock );
+    return m_mapped;
+}   //  get_mapped()
+
+///////////////////////////////////////////////////////////////////////////////
+// получить использование бюджета по объектам
+std::vector<CFileMapBudget::usage> CFileMapBudget::get_usage() const
+{
+    lock_guard<mutex> lock( m_lock );
+    vector<usage> result;
+    result.reserve( m_owners.size() );
+    for ( const owner_info &info : m_owners ) {
+        usage item;
+        item.owner = info.owner;
+        item.mapped = info.size;
+        item.evicted = info.evicted;
+        item.maps = info.maps;
+        item.evictions = info.evictions;
+        item.shrinks = info.shrinks;
+        result.push_back( item );
+    }
+    return result;
+}   //  get_usage()
+
+///////////////////////////////////////////////////////////////////////////////
+// подключить объект к бюджету
+CFileMapBudget::owner_info* CFileMapBudget::attach( const CFileMap *owner )
+{
+    lock_guard<mutex> lock( m_lock );
+    m_owners.emplace_back();
+    owner_info &info = m_owners.back();
+    info.budget = this;
+    info.owner = owner;
+    info.address = nullptr;
+    info.size = 0;
+    info.droppable = false;
+    info.evicted = false;
+    info.uses = 0;
+    info.last_uses = 0;
+    info.idle_since = chrono::steady_clock::now();
+    info.maps = 0;
+    info.evictions = 0;
+    info.shrinks = 0;
+    return &info;
+}   //  attach( const CFileMap *owner )
+
+///////////////////////////////////////////////////////////////////////////////
+// отключить объект от бюджета
+void CFileMapBudget::detach( owner_info *info )
+{
+    lock_guard<mutex> lock( m_lock );
+    for ( list<owner_info>::iterator it = m_owners.begin(); it != m_owners.end(); ++it ) {
+        if ( &(*it) == info ) {
+            if ( !it->evicted )
+                m_mapped -= it->size;
+            m_owners.erase( it );
+            break;
+        }
+    }
+}   //  detach( owner_info *info )
+
+///////////////////////////////////////////////////////////////////////////////
+// запросить размер проекции перед отражением
+uint64_t CFileMapBudget::acquire( owner_info *info, uint64_t wanted, uint64_t granularity, uint64_t extra /*= 0*/ )
+{
+    lock_guard<mutex> lock( m_lock );
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+    // проекции, к которым снова обращались, снова учитываются в бюджете
+    for ( owner_info &item : m_owners ) {
+        uint64_t uses = item.uses.load( memory_order_relaxed );
+        if ( uses != item.last_uses ) {
+            item.last_uses = uses;
+            item.idle_since = now;
+            if ( item.evicted ) {
+                item.evicted = false;
+                m_mapped += item.size;
+            }
+        }
+    }
+
+    if ( info->size && !info->evicted )
+        m_mapped -= info->size;
+    info->size = 0;
+    info->address = nullptr;
+    info->evicted = false;
+    info->idle_since = now;
+    info->maps++;
+
+    uint64_t granted = wanted;
+    if ( m_budget != 0 && granularity != 0 && granularity < wanted ) {
+        uint64_t free = ( m_budget > m_mapped ) ? m_budget - m_mapped : 0;
+        if ( wanted + extra > free ) {
+            evict( info, wanted + extra - free );
+            free = ( m_budget > m_mapped ) ? m_budget - m_mapped : 0;
+        }
+        if ( wanted + extra > free ) {
+            /* не больше свободного бюджета и справедливой доли, чтобы большие
+             * блоки при следующем отражении уступали бюджет остальным */
+            uint64_t active = 1;
+            for ( const owner_info &item : m_owners ) {
+                if ( &item != info && item.size && !item.evicted )
+                    active++;
+            }
+            uint64_t share = m_budget / active;
+            granted = std::min( free, share );
+            // байты сверх блока выдаются всегда, уменьшается только блок
+            granted = ( granted > extra ) ? granted - extra : 0;
+            granted = granted - granted % granularity;
+            if ( granted < granularity )
+                granted = granularity;
+            if ( granted < wanted )
+                info->shrinks++;
+            else
+                granted = wanted;
+        }
+    }
+
+    info->size = granted + extra;
+    m_mapped += granted + extra;
+    return granted;
+}   //  acquire( owner_info *info, uint64_t wanted, uint64_t granularity, uint64_t extra )
+
+///////////////////////////////////////////////////////////////////////////////
+// сообщить адрес отраженной проекции
+void CFileMapBudget::commit( owner_info *info, void *address, bool droppable, uint64_t size /*= 0*/ )
+{
+    lock_guard<mutex> lock( m_lock );
+    info->address = address;
+    info->droppable = droppable;
+    // проекция меньше выделенного размера (конец файла) - вернем остаток в бюджет
+    if ( size != 0 && size < info->size ) {
+        if ( !info->evicted )
+            m_mapped -= info->size - size;
+        info->size = size;
+    }
+}   //  commit( owner_info *info, void *address, bool droppable, uint64_t size )
+
+///////////////////////////////////////////////////////////////////////////////
+// вернуть размер проекции в бюджет
+void CFileMapBudget::release( owner_info *info )
+{
+    lock_guard<mutex> lock( m_lock );
+    if ( !info->evicted )
+        m_mapped -= info->size;
+    info->size = 0;
+    info->address = nullptr;
+    info->evicted = false;
+}   //  release( owner_info *info )
+
+///////////////////////////////////////////////////////////////////////////////
+// освободить резидентные страницы простаивающих проекций
+void CFileMapBudget::evict( owner_info *info, uint64_t wanted )
+{
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+    vector<owner_info*> idle;
+    for ( owner_info &item : m_owners ) {
+        if ( &item != info && item.address && item.size && item.droppable &&
+             !item.evicted && now - item.idle_since >= m_idle_time )
+            idle.push_back( &item );
+    }
+    // сначала самые давно простаивающие
+    sort( idle.begin(), idle.end(), []( const owner_info *a, const owner_info *b ) {
+        return a->idle_since < b->idle_since;
+    } );
+
+    uint64_t freed = 0;
+    for ( owner_info *item : idle ) {
+        if ( freed >= wanted )
+            break;
+        /* адрес действителен: объект снимает проекцию только после release(),
+         * который ждет эту же блокировку */
+#       if defined(OS_WIN)
+        /* для незаблокированных страниц VirtualUnlock удаляет их из рабочего
+         * набора процесса (возвращает ошибку ERROR_NOT_LOCKED) */
+        ::VirtualUnlock( item->address, (SIZE_T)item->size );
+#       else
+        if ( ::madvise( item->address, item->size, MADV_DONTNEED ) != 0 )
+            continue;
+#       endif  // defined(OS_WIN)
+        item->evicted = true;
+        item->evictions++;
+        m_mapped -= item->size;
+        freed += item->size;
+    }
+}   //  evict( owner_info *info, uint64_t wanted )
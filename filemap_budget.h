@@ -0,0 +1,256 @@
+/*!
+ *
+ * \file filemap_budget.h
+ * \brief определение менеджера бюджета отраженной памяти процесса
+ *
+ *  общий для объектов CFileMap бюджет отраженной памяти: размеры блоков\n
+ *  проекции выдаются из бюджета, при нехватке бюджета у простаивающих\n
+ *  проекций освобождаются резидентные страницы, а новые блоки уменьшаются.
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied\n
+ * warranty. In no event will the authors be held liable for any damages\n
+ * arising from the use of this software.\n
+ *
+ * Permission is granted to anyone to use this software for any purpose,\n
+ * including commercial applications, and to alter it and redistribute it\n
+ * freely, subject to the following restrictions:\n
+ *
+ *    1. The origin of this software must not be misrepresented; you must not\n
+ *    claim that you wrote the original software. If you use this software\n
+ *    in a product, an acknowledgment in the product documentation would be\n
+ *    appreciated but is not required.\n
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be\n
+ *    misrepresented as being the original software.\n
+ *    3. This notice may not be removed or altered from any source\n
+ *    distribution.\n
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+#ifndef FILEMAP_BUDGET_H
+#define FILEMAP_BUDGET_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <vector>
+
+class CFileMap;
+
+
+
+//--------------------------------------------------------------------------------------------------//
+
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief The CFileMapBudget class - бюджет отраженной памяти для объектов CFileMap
+///
+/// объект CFileMap подключается к бюджету через CFileMap::set_budget()\n
+/// до открытия файла. Перед каждым отражением блока (блочный режим) размер\n
+/// блока запрашивается у бюджета: если свободного бюджета не хватает, то\n
+/// сначала у проекций, которые не использовались дольше set_idle_time(),\n
+/// освобождаются резидентные страницы (проекция остается рабочей, страницы\n
+/// будут прочитаны из файла заново), затем блок уменьшается до свободного\n
+/// бюджета и не больше справедливой доли ( бюджет / число проекций ), но\n
+/// не меньше одной страницы - общий размер проекций превышает бюджет не\n
+/// больше, чем на страницу на объект. Перекрытие блоков (set_window_overlap())\n
+/// учитывается в бюджете вместе с блоком, но не уменьшается - объект с перекрытием\n
+/// может превысить бюджет еще на размер перекрытия. Файл, отраженный целиком, только учитывается.\n
+///
+/// все методы потокобезопасны, объекты CFileMap могут работать в разных потоках.
+///
+/// \code
+/// CFileMapBudget::global().set_budget_from_cgroup( 0.5 );
+/// ...
+/// CFileMap map( 64*1024*1024 );
+/// map.set_budget( &CFileMapBudget::global() );
+/// map.open_file_map( CFileMap::mode::read );
+/// \endcode
+///
+class CFileMapBudget
+{
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief учет проекции одного объекта CFileMap
+    ///
+    struct owner_info {
+        CFileMapBudget *budget;         // бюджет, к которому подключен объект
+        const CFileMap *owner;          // объект
+        void           *address;        // адрес текущей проекции
+        uint64_t        size;           // размер текущей проекции (учтенный в бюджете)
+        bool            droppable;      // страницы можно освободить (не частная запись)
+        bool            evicted;        // резидентные страницы освобождены
+        std::atomic<uint64_t> uses;     // счетчик обращений объекта к проекции
+        uint64_t        last_uses;      // значение uses при последней проверке
+        std::chrono::steady_clock::time_point idle_since;   // время последнего обращения
+        uint64_t        maps;           // количество отражений
+        uint64_t        evictions;      // количество освобождений страниц
+        uint64_t        shrinks;        // количество уменьшенных блоков
+    };
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief использование бюджета объектом (для отчета)
+    ///
+    struct usage {
+        const CFileMap *owner;          // объект
+        uint64_t        mapped;         // размер текущей проекции
+        bool            evicted;        // резидентные страницы освобождены
+        uint64_t        maps;           // количество отражений
+        uint64_t        evictions;      // количество освобождений страниц
+        uint64_t        shrinks;        // количество уменьшенных блоков
+    };
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief конструктор
+    /// \param budget - бюджет в байтах, ноль - без ограничения
+    ///
+    CFileMapBudget( uint64_t budget = 0 );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief общий бюджет процесса
+    ///
+    static CFileMapBudget& global();
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить бюджет
+    /// \param budget - бюджет в байтах, ноль - без ограничения
+    ///
+    void set_budget( uint64_t budget );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить бюджет как долю ограничения памяти cgroup (Linux)
+    /// \param fraction - доля ограничения памяти (0..1]
+    /// \return ноль - выполнено успешно, иначе номер ошибки\n
+    ///  (ENOENT - ограничение памяти не задано)
+    ///
+    uint64_t set_budget_from_cgroup( double fraction = 0.5 );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить время простоя, после которого страницы проекции\n
+    ///  могут быть освобождены
+    /// \param milliseconds - время простоя в миллисекундах
+    ///
+    void set_idle_time( uint32_t milliseconds );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить бюджет
+    ///
+    uint64_t get_budget() const;
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить размер учтенных (отраженных и не освобожденных) проекций
+    ///
+    uint64_t get_mapped() const;
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить использование бюджета по объектам
+    ///
+    std::vector<usage> get_usage() const;
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief подключить объект к бюджету (вызывается из CFileMap)
+    /// \param owner - объект
+    /// \return учет проекции объекта
+    ///
+    owner_info* attach( const CFileMap *owner );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief отключить объект от бюджета (проекция должна быть снята)
+    /// \param info - учет проекции объекта
+    ///
+    void detach( owner_info *info );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief запросить размер проекции перед отражением
+    /// \param info - учет проекции объекта
+    /// \param wanted - желаемый размер
+    /// \param granularity - гранулярность размера (страница памяти),\n
+    ///  если равна wanted - размер не уменьшается
+    /// \param extra - байты, которые отражаются сверх блока (перекрытие блоков),\n
+    ///  учитываются в бюджете, но не уменьшаются
+    /// \return выделенный размер (кратен granularity или равен wanted)
+    ///
+    uint64_t acquire( owner_info *info, uint64_t wanted, uint64_t granularity, uint64_t extra = 0 );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief сообщить адрес отраженной проекции
+    /// \param info - учет проекции объекта
+    /// \param address - адрес проекции
+    /// \param droppable - страницы можно освободить без потери данных
+    /// \param size - фактический размер проекции, если он меньше выделенного\n
+    ///  ( ноль - выделенный размер )
+    ///
+    void commit( owner_info *info, void *address, bool droppable, uint64_t size = 0 );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief вернуть размер проекции в бюджет (перед снятием проекции)
+    /// \param info - учет проекции объекта
+    ///
+    void release( owner_info *info );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief освободить резидентные страницы простаивающих проекций
+    /// \param info - учет проекции объекта, который запрашивает бюджет
+    /// \param wanted - сколько байт бюджета нужно
+    ///
+    void evict( owner_info *info, uint64_t wanted );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief блокировка
+    ///
+    mutable std::mutex m_lock;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief бюджет в байтах, ноль - без ограничения
+    ///
+    uint64_t m_budget;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief размер учтенных проекций
+    ///
+    uint64_t m_mapped;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief время простоя, после которого страницы могут быть освобождены
+    ///
+    std::chrono::milliseconds m_idle_time;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief подключенные объекты
+    ///
+    std::list<owner_info> m_owners;
+};
+
+#endif // FILEMAP_BUDGET_H
@@ -0,0 +1,263 @@
+/*!
+ *
+ * \file filemap_compare.cpp
+ * \brief реализация класса побайтного сравнения файлов
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+
+
+#include "filemap_compare.h"
+#include "filemap_simd.h"
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <errno.h>
+
+using namespace std;
+
+namespace {
+
+// порция сравнения, после которой проверяется, не найдено ли различие раньше
+const uint64_t COMPARE_STEP = 1024*1024;
+
+}   // namespace
+
+///////////////////////////////////////////////////////////////////////////////
+// конструктор
+CFileMapCompare::CFileMapCompare( uint64_t chunk_size /*= 64*1024*1024*/ )
+    : CFileMap( 0 )
+{
+    m_chunk_size = memory_allocation_granularity( chunk_size ? chunk_size : 1 );
+    m_threads = 1;                  // количество потоков
+}   //  CFileMapCompare()
+
+///////////////////////////////////////////////////////////////////////////////
+// найти первый различающийся байт
+uint64_t CFileMapCompare::find_first_difference( const wchar_t *other_path, uint64_t &offset )
+{
+    compare_job job;
+    job.other = other_path;
+    job.all = false;
+    job.max_ranges = 0;
+
+    offset = UINT64_MAX;
+    uint64_t last_error = compare( job );
+    if ( last_error )
+        return last_error;
+
+    if ( job.first.load() != UINT64_MAX )
+        offset = job.first.load();
+    else if ( job.size != job.tail )
+        offset = job.size;      // общая часть совпадает, больший файл длиннее
+    return 0;
+}   //  find_first_difference( const wchar_t *other_path, uint64_t &offset )
+
+///////////////////////////////////////////////////////////////////////////////
+// найти различающиеся диапазоны
+uint64_t CFileMapCompare::find_differences( const wchar_t *other_path, std::vector<range> &ranges,
+                                            size_t max_ranges /*= SIZE_MAX*/ )
+{
+    compare_job job;
+    job.other = other_path;
+    job.all = true;
+    job.max_ranges = max_ranges;
+
+    ranges.clear();
+    uint64_t last_error = compare( job );
+    if ( last_error )
+        return last_error;
+
+    // соберем диапазоны частей, диапазоны на границе частей объединим
+    for ( compare_chunk &chunk : job.chunks ) {
+        for ( const range &item : chunk.ranges ) {
+            if ( ranges.size() && ranges.back().first + ranges.back().second == item.first )
+                ranges.back().second += item.second;
+            else
+                ranges.push_back( item );
+        }
+    }
+    if ( job.size != job.tail ) {
+        if ( ranges.size() && ranges.back().first + ranges.back().second == job.size )
+            ranges.back().second += job.tail - job.size;
+        else
+            ranges.push_back( range( job.size, job.tail - job.size ) );
+    }
+    if ( ranges.size() > max_ranges )
+        ranges.resize( max_ranges );
+    return 0;
+}   //  find_differences( const wchar_t *other_path, std::vector<range> &ranges, size_t max_ranges )
+
+///////////////////////////////////////////////////////////////////////////////
+// сравнить файлы по частям
+uint64_t CFileMapCompare::compare( compare_job &job )
+{
+    uint64_t last_error = 0;
+    job.size = 0;
+    job.tail = 0;
+    job.next = 0;
+    job.first = UINT64_MAX;
+    job.error = 0;
+
+    try
+    {
+        uint64_t file_size = 0;
+        uint64_t file_time = 0;
+        last_error = get_file_info( file_size, file_time );
+        if ( last_error )
+            throw last_error;
+
+        uint64_t other_size = 0;
+        CFileMap other;
+        other.set_file_path( job.other.c_str() );
+        last_error = other.get_file_info( other_size, file_time );
+        if ( last_error )
+            throw last_error;
+
+        job.size = std::min( file_size, other_size );
+        job.tail = std::max( file_size, other_size );
+
+        // части общего размера, начало каждой кратно гранулярности страниц памяти
+        for ( uint64_t begin = 0; begin < job.size; begin += m_chunk_size ) {
+            compare_chunk chunk;
+            chunk.begin = begin;
+            chunk.end = std::min( begin + m_chunk_size, job.size );
+            job.chunks.push_back( chunk );
+        }
+
+        uint32_t threads = m_threads ? m_threads : std::max( 1u, std::thread::hardware_concurrency() );
+        if ( threads > job.chunks.size() )
+            threads = (uint32_t)std::max( (size_t)1, job.chunks.size() );
+
+        vector<thread> workers;
+        for ( uint32_t index = 1; index < threads; index++ )
+            workers.emplace_back( &CFileMapCompare::compare_worker, this, std::ref( job ) );
+        compare_worker( job );
+        for ( thread &worker : workers )
+            worker.join();
+
+        last_error = job.error;
+        if ( last_error )
+            throw last_error;
+    }
+    catch( uint64_t error ) {
+        last_error = error;
+        cout<< "an error number \"" << error << "\" is generated in the method compare" <<endl;
+    }
+    return last_error;
+}   //  compare( compare_job &job )
+
+///////////////////////////////////////////////////////////////////////////////
+// сравнивать части (выполняется в отдельном потоке)
+void CFileMapCompare::compare_worker( compare_job &job )
+{
+    for ( ;; ) {
+        size_t index = job.next.fetch_add( 1 );
+        if ( index >= job.chunks.size() || job.error.load() != 0 )
+            break;
+
+        compare_chunk &chunk = job.chunks[index];
+        // часть после уже найденного различия не нужна
+        if ( !job.all && chunk.begin >= job.first.load() )
+            break;
+
+        uint64_t error = compare_chunk_data( job, chunk );
+        if ( error ) {
+            uint64_t expected = 0;
+            job.error.compare_exchange_strong( expected, error );
+            break;
+        }
+    }
+}   //  compare_worker( compare_job &job )
+
+///////////////////////////////////////////////////////////////////////////////
+// сравнить часть файлов
+uint64_t CFileMapCompare::compare_chunk_data( compare_job &job, compare_chunk &chunk )
+{
+    // обе проекции начинаются с одного смещения и имеют один размер
+    CFileMapCompare first( m_chunk_size );
+    first.set_file_path( get_file_path().c_str() );
+    first.set_file_size( chunk.end );
+    uint64_t last_error = first.open_file_map( CFileMap::mode::read, chunk.begin );
+    if ( last_error )
+        return last_error;
+
+    CFileMapCompare second( m_chunk_size );
+    second.set_file_path( job.other.c_str() );
+    second.set_file_size( chunk.end );
+    last_error = second.open_file_map( CFileMap::mode::read, chunk.begin );
+    if ( last_error )
+        return last_error;
+
+    const char *a = (const char *)first.get_map_address();
+    const char *b = (const char *)second.get_map_address();
+    uint64_t length = chunk.end - chunk.begin;
+    if ( a == nullptr || b == nullptr ||
+         first.get_max_copy_ex() < length || second.get_max_copy_ex() < length ) {
+#       if defined(OS_WIN)
+        return ERROR_READ_FAULT;
+#       else
+        return EIO;
+#       endif  // defined(OS_WIN)
+    }
+#   if !defined(OS_WIN)
+    // части читаются один раз по порядку (начало части кратно странице памяти)
+    ::madvise( (void *)a, (size_t)length, MADV_SEQUENTIAL );
+    ::madvise( (void *)b, (size_t)length, MADV_SEQUENTIAL );
+#   endif  // !defined(OS_WIN)
+
+    if ( !job.all ) {
+        // первое различие: порциями, чтобы прекратить сравнение, если другой поток нашел различие раньше
+        for ( uint64_t offset = 0; offset < length; offset += COMPARE_STEP ) {
+            if ( chunk.begin + offset >= job.first.load() )
+                break;
+            uint64_t size = std::min( length - offset, COMPARE_STEP );
+            uint64_t found = CFileMapSimd::find_difference( a + offset, b + offset, size );
+            if ( found < size ) {
+                uint64_t position = chunk.begin + offset + found;
+                uint64_t current = job.first.load();
+                while ( position < current && !job.first.compare_exchange_weak( current, position ) )
+                    ;
+                break;
+            }
+        }
+        return 0;
+    }
+
+    // все диапазоны: чередуем поиск различающегося и совпадающего байта
+    uint64_t offset = 0;
+    while ( offset < length && chunk.ranges.size() < job.max_ranges ) {
+        offset += CFileMapSimd::find_difference( a + offset, b + offset, length - offset );
+        if ( offset == length )
+            break;
+        uint64_t size = CFileMapSimd::find_difference( a + offset, b + offset, length - offset, true );
+        chunk.ranges.push_back( range( chunk.begin + offset, size ) );
+        offset += size;
+    }
+    return 0;
+}   //  compare_chunk_data( compare_job &job, compare_chunk &chunk )
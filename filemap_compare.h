@@ -0,0 +1,206 @@
+/*!
+ *
+ * \file filemap_compare.h
+ * \brief определение класса побайтного сравнения файлов
+ *
+ *  два файла отражаются одинаковыми блоками и сравниваются векторными\n
+ *  инструкциями: поиск первого различия (с ранним выходом) или список\n
+ *  различающихся диапазонов, при необходимости - параллельно по частям.
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied\n
+ * warranty. In no event will the authors be held liable for any damages\n
+ * arising from the use of this software.\n
+ *
+ * Permission is granted to anyone to use this software for any purpose,\n
+ * including commercial applications, and to alter it and redistribute it\n
+ * freely, subject to the following restrictions:\n
+ *
+ *    1. The origin of this software must not be misrepresented; you must not\n
+ *    claim that you wrote the original software. If you use this software\n
+ *    in a product, an acknowledgment in the product documentation would be\n
+ *    appreciated but is not required.\n
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be\n
+ *    misrepresented as being the original software.\n
+ *    3. This notice may not be removed or altered from any source\n
+ *    distribution.\n
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+#ifndef FILEMAP_COMPARE_H
+#define FILEMAP_COMPARE_H
+
+#include "filemap.h"
+#include <atomic>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+
+//--------------------------------------------------------------------------------------------------//
+
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief The CFileMapCompare class - сравнение файла (set_file_path()) с другим файлом
+///
+/// файлы делятся на части размером chunk_size (кратно гранулярности страниц\n
+/// памяти), часть каждого файла отражается своей проекцией с одного и того же\n
+/// смещения, проекции сравниваются блоками по 64 байта (CFileMapSimd::neq_mask()).\n
+/// Части сравниваются в set_threads() потоках; при поиске первого различия\n
+/// части после уже найденного различия не просматриваются. Если размеры\n
+/// файлов разные, то различием считается и хвост большего файла.
+///
+/// \code
+/// CFileMapCompare compare;
+/// compare.set_file_path( primary_path );
+/// compare.set_threads( 4 );
+/// uint64_t offset;
+/// compare.find_first_difference( replica_path, offset );
+/// if ( offset != UINT64_MAX )
+///     ... // файлы различаются начиная с offset
+/// \endcode
+///
+class CFileMapCompare : public CFileMap
+{
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief диапазон различающихся байт ( смещение, количество байт )
+    ///
+    typedef std::pair<uint64_t, uint64_t> range;
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief конструктор
+    /// \param chunk_size - размер части файла, сравниваемой одной проекцией\n
+    ///  (выравнивается по гранулярности страниц памяти)
+    ///
+    CFileMapCompare( uint64_t chunk_size = 64*1024*1024 );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить количество потоков
+    /// \param threads - количество потоков, ноль - по числу ядер
+    ///
+    void set_threads( uint32_t threads ) {
+        m_threads = threads;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief найти первый различающийся байт
+    /// \param other_path - полное имя файла для сравнения
+    /// \param offset - смещение первого различия, UINT64_MAX - файлы совпадают
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t find_first_difference( const wchar_t *other_path, uint64_t &offset );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief найти первый различающийся байт
+    /// \param other_path - полное имя файла для сравнения
+    /// \param offset - смещение первого различия, UINT64_MAX - файлы совпадают
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t find_first_difference( const char *other_path, uint64_t &offset ) {
+        return find_first_difference( char_wstring( other_path ).c_str(), offset );
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief найти различающиеся диапазоны
+    /// \param other_path - полное имя файла для сравнения
+    /// \param ranges - диапазоны по возрастанию смещения (соседние объединены)
+    /// \param max_ranges - максимальное количество диапазонов
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t find_differences( const wchar_t *other_path, std::vector<range> &ranges,
+                               size_t max_ranges = SIZE_MAX );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief найти различающиеся диапазоны
+    /// \param other_path - полное имя файла для сравнения
+    /// \param ranges - диапазоны по возрастанию смещения (соседние объединены)
+    /// \param max_ranges - максимальное количество диапазонов
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t find_differences( const char *other_path, std::vector<range> &ranges,
+                               size_t max_ranges = SIZE_MAX ) {
+        return find_differences( char_wstring( other_path ).c_str(), ranges, max_ranges );
+    }
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief часть файлов
+    ///
+    struct compare_chunk {
+        uint64_t           begin;       // начало части
+        uint64_t           end;         // конец части
+        std::vector<range> ranges;      // различающиеся диапазоны части
+    };
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief общее состояние потоков сравнения
+    ///
+    struct compare_job {
+        std::wstring               other;       // файл для сравнения
+        bool                       all;         // искать все диапазоны (иначе - первое различие)
+        size_t                     max_ranges;  // максимальное количество диапазонов
+        uint64_t                   size;        // размер меньшего файла
+        uint64_t                   tail;        // размер большего файла
+        std::vector<compare_chunk> chunks;      // части файлов
+        std::atomic<size_t>        next;        // следующая часть
+        std::atomic<uint64_t>      first;       // первое найденное различие
+        std::atomic<uint64_t>      error;       // первая ошибка
+    };
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief сравнить файлы по частям
+    /// \param job - общее состояние сравнения
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t compare( compare_job &job );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief сравнивать части (выполняется в отдельном потоке)
+    /// \param job - общее состояние сравнения
+    ///
+    void compare_worker( compare_job &job );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief сравнить часть файлов
+    /// \param job - общее состояние сравнения
+    /// \param chunk - часть файлов
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t compare_chunk_data( compare_job &job, compare_chunk &chunk );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief размер части файла
+    ///
+    uint64_t m_chunk_size;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief количество потоков, ноль - по числу ядер
+    ///
+    uint32_t m_threads;
+};
+
+#endif // FILEMAP_COMPARE_H
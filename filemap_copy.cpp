@@ -0,0 +1,333 @@
+/*!
+ *
+ * \file filemap_copy.cpp
+ * \brief реализация класса параллельного копирования файлов
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+
+#include "filemap_copy.h"
+#include "filemap_simd.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <errno.h>
+#if defined(OS_LINUX)
+#  include <sys/ioctl.h>
+#  include <linux/fs.h>     //  FICLONE
+#  if defined(__GLIBC__) && ( __GLIBC__ > 2 || ( __GLIBC__ == 2 && __GLIBC_MINOR__ >= 27 ) )
+#    define FILEMAP_COPY_RANGE
+#  endif
+#endif  // defined(OS_LINUX)
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// конструктор
+CFileMapCopy::CFileMapCopy( uint64_t chunk_size /*= 64*1024*1024*/ )
+    : CFileMap( 0 )
+{
+    m_chunk_size = memory_allocation_granularity( chunk_size ? chunk_size : 1 );
+    m_threads = 0;                  // количество потоков - по числу ядер
+    m_kernel_copy = true;           // разрешено копирование средствами ядра
+    memset( &m_stats, 0, sizeof(m_stats) );
+}   //  CFileMapCopy()
+
+///////////////////////////////////////////////////////////////////////////////
+// скопировать исходный файл
+uint64_t CFileMapCopy::copy_file( const wchar_t *dest_path )
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    memset( &m_stats, 0, sizeof(m_stats) );
+
+    uint64_t last_error = 0;
+    uint64_t file_size = 0;
+    uint64_t file_time = 0;
+
+    copy_job job;
+    job.source = INVALID_HANDLE_VALUE;
+    job.dest = INVALID_HANDLE_VALUE;
+#   if defined(OS_WIN)
+    job.source_mapping = NULL;
+    job.dest_mapping = NULL;
+#   endif  // defined(OS_WIN)
+    job.md = method::none;
+    job.next = 0;
+    job.error = 0;
+
+    try
+    {
+        last_error = get_file_info( file_size, file_time );
+        if ( last_error )
+            throw last_error;
+        m_stats.file_size = file_size;
+
+        // откроем исходный файл и создадим файл-копию
+#       if defined(OS_WIN)
+        job.source = ::CreateFileW( get_file_path().c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                                    OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+        if ( job.source == INVALID_HANDLE_VALUE ) {
+            last_error = ::GetLastError();
+            throw last_error;
+        }
+        job.dest = ::CreateFileW( dest_path, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                                  CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL );
+        if ( job.dest == INVALID_HANDLE_VALUE ) {
+            last_error = ::GetLastError();
+            throw last_error;
+        }
+#       else
+        string source_path = wchar_string( get_file_path().c_str(), get_file_path().length() );
+        job.source = ::open( source_path.c_str(), O_RDONLY | O_LARGEFILE );
+        if ( job.source == INVALID_HANDLE_VALUE ) {
+            last_error = errno;
+            throw last_error;
+        }
+        string file_path = wchar_string( dest_path );
+        job.dest = ::open( file_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_LARGEFILE,
+                           S_IRWXU | S_IRWXG | S_IROTH );
+        if ( job.dest == INVALID_HANDLE_VALUE ) {
+            last_error = errno;
+            throw last_error;
+        }
+#       endif  // defined(OS_WIN)
+
+        if ( file_size ) {
+#           if defined(OS_LINUX) && defined(FICLONE)
+            // 1. reflink - копия разделяет блоки с исходным файлом
+            if ( m_kernel_copy && ::ioctl( job.dest, FICLONE, job.source ) == 0 ) {
+                job.md = method::reflink;
+                m_stats.copied = file_size;
+            }
+#           endif  // defined(OS_LINUX) && defined(FICLONE)
+        }
+
+        if ( file_size && job.md == method::none ) {
+            vector<extent> extents;
+            CFileMapSparse::query_extents( job.source, file_size, extents );
+
+            // размер файла-копии задается сразу, дыры остаются дырами
+#           if defined(OS_WIN)
+            LARGE_INTEGER size;
+            size.QuadPart = file_size;
+            if ( ::SetFilePointerEx( job.dest, size, NULL, FILE_BEGIN ) == FALSE ||
+                 ::SetEndOfFile( job.dest ) == FALSE ) {
+                last_error = ::GetLastError();
+                throw last_error;
+            }
+#           else
+            if ( ::ftruncate( job.dest, (off_t)file_size ) != 0 ) {
+                last_error = errno;
+                throw last_error;
+            }
+#           endif  // defined(OS_WIN)
+
+            // участки с данными - заранее выделим место и разобьем на части для потоков
+            for ( const extent &item : extents ) {
+#               if !defined(OS_WIN)
+                // файловая система может не поддерживать выделение - не ошибка
+                ::posix_fallocate( job.dest, (off_t)item.offset, (off_t)item.length );
+#               endif  // !defined(OS_WIN)
+                for ( uint64_t offset = 0; offset < item.length; offset += m_chunk_size ) {
+                    extent chunk;
+                    chunk.offset = item.offset + offset;
+                    chunk.length = std::min( item.length - offset, m_chunk_size );
+                    job.chunks.push_back( chunk );
+                }
+                m_stats.copied += item.length;
+            }
+            m_stats.holes = file_size - m_stats.copied;
+
+            job.md = method::mapping;
+#           if defined(FILEMAP_COPY_RANGE)
+            /* 2. copy_file_range - первый участок определяет, поддерживается ли
+             *    копирование между этими файлами (иначе EXDEV, EOPNOTSUPP, ...) */
+            if ( m_kernel_copy && job.chunks.size() ) {
+                job.md = method::copy_range;
+                if ( copy_range( job, job.chunks[0] ) == 0 )
+                    job.next = 1;
+                else
+                    job.md = method::mapping;
+            }
+#           endif  // defined(FILEMAP_COPY_RANGE)
+
+#           if defined(OS_WIN)
+            // 3. объекты "проекция файла" для копирования через проекции
+            if ( job.md == method::mapping && job.chunks.size() ) {
+                job.source_mapping = ::CreateFileMapping( job.source, NULL, PAGE_READONLY, 0, 0, NULL );
+                job.dest_mapping = ::CreateFileMapping( job.dest, NULL, PAGE_READWRITE, 0, 0, NULL );
+                if ( job.source_mapping == NULL || job.dest_mapping == NULL ) {
+                    last_error = ::GetLastError();
+                    throw last_error;
+                }
+            }
+#           endif  // defined(OS_WIN)
+
+            uint32_t threads = m_threads ? m_threads : std::max( 1u, std::thread::hardware_concurrency() );
+            if ( threads > job.chunks.size() )
+                threads = (uint32_t)std::max( (size_t)1, job.chunks.size() );
+            m_stats.threads = threads;
+
+            vector<thread> workers;
+            for ( uint32_t index = 1; index < threads; index++ )
+                workers.emplace_back( &CFileMapCopy::copy_worker, this, std::ref( job ) );
+            copy_worker( job );
+            for ( thread &worker : workers )
+                worker.join();
+
+            last_error = job.error;
+            if ( last_error )
+                throw last_error;
+        }
+        m_stats.md = job.md;
+    }
+    catch( uint64_t error ) {
+        last_error = error;
+        cout<< "an error number \"" << error << "\" is generated in the method copy_file" <<endl;
+    }
+
+#   if defined(OS_WIN)
+    if ( job.source_mapping )
+        ::CloseHandle( job.source_mapping );
+    if ( job.dest_mapping )
+        ::CloseHandle( job.dest_mapping );
+    if ( job.source != INVALID_HANDLE_VALUE )
+        ::CloseHandle( job.source );
+    if ( job.dest != INVALID_HANDLE_VALUE )
+        ::CloseHandle( job.dest );
+#   else
+    if ( job.source != INVALID_HANDLE_VALUE )
+        ::close( job.source );
+    if ( job.dest != INVALID_HANDLE_VALUE )
+        ::close( job.dest );
+#   endif  // defined(OS_WIN)
+
+    m_stats.elapsed = (uint64_t)chrono::duration_cast<chrono::nanoseconds>(
+                          chrono::steady_clock::now() - start ).count();
+    if ( m_stats.elapsed )
+        m_stats.rate = (uint64_t)( (double)m_stats.copied * 1e9 / (double)m_stats.elapsed );
+    return last_error;
+}   //  copy_file( const wchar_t *dest_path )
+
+///////////////////////////////////////////////////////////////////////////////
+// копировать участки (выполняется в отдельном потоке)
+void CFileMapCopy::copy_worker( copy_job &job )
+{
+    for ( ;; ) {
+        size_t index = job.next.fetch_add( 1 );
+        if ( index >= job.chunks.size() || job.error.load() != 0 )
+            break;
+
+        uint64_t error = ( job.md == method::copy_range ) ? copy_range( job, job.chunks[index] )
+                                                         : copy_mapped( job, job.chunks[index] );
+        if ( error ) {
+            uint64_t expected = 0;
+            job.error.compare_exchange_strong( expected, error );
+            break;
+        }
+    }
+}   //  copy_worker( copy_job &job )
+
+///////////////////////////////////////////////////////////////////////////////
+// скопировать участок средствами ядра
+uint64_t CFileMapCopy::copy_range( copy_job &job, const extent &chunk )
+{
+#   if defined(FILEMAP_COPY_RANGE)
+    loff_t in = (loff_t)chunk.offset;
+    loff_t out = (loff_t)chunk.offset;
+    uint64_t length = chunk.length;
+    while ( length ) {
+        ssize_t copied = ::copy_file_range( job.source, &in, job.dest, &out, (size_t)length, 0 );
+        if ( copied < 0 )
+            return errno;
+        if ( copied == 0 )
+            return EIO;     // исходный файл стал короче
+        length -= (uint64_t)copied;
+    }
+    return 0;
+#   else
+    (void)job;
+    (void)chunk;
+#       if defined(OS_WIN)
+    return ERROR_NOT_SUPPORTED;
+#       else
+    return ENOSYS;
+#       endif  // defined(OS_WIN)
+#   endif  // defined(FILEMAP_COPY_RANGE)
+}   //  copy_range( copy_job &job, const extent &chunk )
+
+///////////////////////////////////////////////////////////////////////////////
+// скопировать участок из проекции в проекцию
+uint64_t CFileMapCopy::copy_mapped( copy_job &job, const extent &chunk )
+{
+    // начало проекции кратно гранулярности страниц памяти
+    uint64_t start = chunk.offset - chunk.offset % get_page_size();
+    uint64_t delta = chunk.offset - start;
+    uint64_t size = delta + chunk.length;
+
+#   if defined(OS_WIN)
+    LARGE_INTEGER offset;
+    offset.QuadPart = start;
+    char *source = (char *)::MapViewOfFile( job.source_mapping, FILE_MAP_READ,
+                                            offset.HighPart, offset.LowPart, (SIZE_T)size );
+    if ( source == NULL )
+        return ::GetLastError();
+    char *dest = (char *)::MapViewOfFile( job.dest_mapping, FILE_MAP_WRITE,
+                                          offset.HighPart, offset.LowPart, (SIZE_T)size );
+    if ( dest == NULL ) {
+        uint64_t last_error = ::GetLastError();
+        ::UnmapViewOfFile( source );
+        return last_error;
+    }
+#   else
+    char *source = (char *)::mmap( nullptr, size, PROT_READ, MAP_SHARED, job.source, (off_t)start );
+    if ( source == MAP_FAILED )
+        return errno;
+    // исходный участок читается один раз по порядку
+    ::madvise( source, size, MADV_SEQUENTIAL );
+    char *dest = (char *)::mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, job.dest, (off_t)start );
+    if ( dest == MAP_FAILED ) {
+        uint64_t last_error = errno;
+        ::munmap( source, size );
+        return last_error;
+    }
+#   endif  // defined(OS_WIN)
+
+    CFileMapSimd::stream_copy( dest + delta, source + delta, chunk.length );
+
+    // данные запишет на диск система (как при снятии проекции в CFileMap)
+#   if defined(OS_WIN)
+    ::UnmapViewOfFile( dest );
+    ::UnmapViewOfFile( source );
+#   else
+    ::munmap( dest, size );
+    ::munmap( source, size );
+#   endif  // defined(OS_WIN)
+    return 0;
+}   //  copy_mapped( copy_job &job, const extent &chunk )
@@ -0,0 +1,226 @@
+/*!
+ *
+ * \file filemap_copy.h
+ * \brief определение класса параллельного копирования файлов
+ *
+ *  сначала копирование средствами ядра (reflink, copy_file_range),\n
+ *  иначе несколько потоков копируют непересекающиеся участки из\n
+ *  проекции в проекцию без заполнения кеша процессора. Дыры\n
+ *  разреженного файла сохраняются, место в приемнике выделяется заранее.
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied\n
+ * warranty. In no event will the authors be held liable for any damages\n
+ * arising from the use of this software.\n
+ *
+ * Permission is granted to anyone to use this software for any purpose,\n
+ * including commercial applications, and to alter it and redistribute it\n
+ * freely, subject to the following restrictions:\n
+ *
+ *    1. The origin of this software must not be misrepresented; you must not\n
+ *    claim that you wrote the original software. If you use this software\n
+ *    in a product, an acknowledgment in the product documentation would be\n
+ *    appreciated but is not required.\n
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be\n
+ *    misrepresented as being the original software.\n
+ *    3. This notice may not be removed or altered from any source\n
+ *    distribution.\n
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+#ifndef FILEMAP_COPY_H
+#define FILEMAP_COPY_H
+
+#include "filemap_sparse.h"
+#include <atomic>
+#include <vector>
+
+
+
+//--------------------------------------------------------------------------------------------------//
+
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief The CFileMapCopy class - параллельное копирование файла
+///
+/// исходный файл задается set_file_path(). Способы копирования по порядку:\n
+///  1. reflink (Linux, FICLONE) - файл-копия разделяет блоки с исходным;\n
+///  2. copy_file_range (Linux) - копирование внутри ядра (в том числе\n
+///     reflink на уровне участков), участки копируются параллельно;\n
+///  3. проекции - каждый поток отражает участок исходного файла и приемника\n
+///     и копирует его потоковыми инструкциями (non-temporal stores).\n
+/// Копируются только участки с данными (CFileMapSparse::query_extents()), дыры\n
+/// остаются дырами, для участков с данными место выделяется заранее.
+///
+/// \code
+/// CFileMapCopy copy;
+/// copy.set_file_path( source_path );
+/// last_error = copy.copy_file( dest_path );
+/// const CFileMapCopy::copy_stats &stats = copy.get_copy_stats();
+/// // stats.rate - байт в секунду
+/// \endcode
+///
+class CFileMapCopy : public CFileMap
+{
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief способ копирования
+    ///
+    enum class method : uint32_t
+    {
+        /*! копирование не выполнялось */
+        none = 0,
+        /*! reflink - общие блоки файловой системы */
+        reflink = 1,
+        /*! copy_file_range - копирование внутри ядра */
+        copy_range = 2,
+        /*! копирование из проекции в проекцию */
+        mapping = 3
+    };
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief статистика копирования
+    ///
+    struct copy_stats {
+        method   md;            // способ копирования
+        uint32_t threads;       // количество потоков
+        uint64_t file_size;     // размер файла
+        uint64_t copied;        // скопировано байт (участки с данными)
+        uint64_t holes;         // пропущено байт (дыры разреженного файла)
+        uint64_t elapsed;       // время копирования, нс
+        uint64_t rate;          // скорость копирования, байт/с
+    };
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief конструктор
+    /// \param chunk_size - размер участка, который копирует один поток за раз\n
+    ///  (выравнивается по гранулярности страниц памяти)
+    ///
+    CFileMapCopy( uint64_t chunk_size = 64*1024*1024 );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить количество потоков
+    /// \param threads - количество потоков, ноль - по числу ядер
+    ///
+    void set_threads( uint32_t threads ) {
+        m_threads = threads;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief разрешить копирование средствами ядра (reflink, copy_file_range)
+    /// \param enable - false - копировать только через проекции
+    ///
+    void set_kernel_copy( bool enable ) {
+        m_kernel_copy = enable;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief скопировать исходный файл
+    /// \param dest_path - полное имя файла-копии (создается или перезаписывается)
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t copy_file( const wchar_t *dest_path );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief скопировать исходный файл
+    /// \param dest_path - полное имя файла-копии (utf8)
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t copy_file( const char *dest_path ) {
+        return copy_file( char_wstring( dest_path ).c_str() );
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить статистику последнего копирования
+    ///
+    const copy_stats& get_copy_stats() const {
+        return m_stats;
+    }
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief участок файла
+    ///
+    typedef CFileMapSparse::extent extent;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief общее состояние потоков копирования
+    ///
+    struct copy_job {
+        HANDLE source;                  // исходный файл
+        HANDLE dest;                    // файл-копия
+#   if defined(OS_WIN)
+        HANDLE source_mapping;          // объект "проекция файла" исходного файла
+        HANDLE dest_mapping;            // объект "проекция файла" файла-копии
+#   endif  // defined(OS_WIN)
+        method md;                      // способ копирования
+        std::vector<extent> chunks;     // участки для копирования
+        std::atomic<size_t> next;       // следующий участок
+        std::atomic<uint64_t> error;    // первая ошибка
+    };
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief копировать участки (выполняется в отдельном потоке)
+    /// \param job - общее состояние копирования
+    ///
+    void copy_worker( copy_job &job );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief скопировать участок средствами ядра (copy_file_range)
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t copy_range( copy_job &job, const extent &chunk );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief скопировать участок из проекции в проекцию
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t copy_mapped( copy_job &job, const extent &chunk );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief размер участка, который копирует один поток за раз
+    ///
+    uint64_t m_chunk_size;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief количество потоков, ноль - по числу ядер
+    ///
+    uint32_t m_threads;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief разрешено копирование средствами ядра
+    ///
+    bool m_kernel_copy;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief статистика последнего копирования
+    ///
+    copy_stats m_stats;
+};
+
+#endif // FILEMAP_COPY_H
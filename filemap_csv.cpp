@@ -0,0 +1,229 @@
+/*!
+ *
+ * \file filemap_csv.cpp
+ * \brief реализация класса разбора файлов с разделителями (CSV/TSV)
+ *
+ *  потоковый разбор записей поверх проекции файла в память,\n
+ *  разделители, кавычки и переводы строк находятся за один\n
+ *  векторный проход (классификация битовыми масками).
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+#include "filemap_csv.h"
+#include "filemap_simd.h"
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// конструктор
+CFileMapCsv::CFileMapCsv( uint64_t limit_map_memory /*= 0*/,
+                          char separator /*= ','*/, char quote /*= '"'*/ )
+    : CFileMap( limit_map_memory )
+{
+    m_separator = separator;        // разделитель полей
+    m_quote = quote;                // символ кавычки
+    m_in_quote = false;             // признак "внутри кавычек"
+    m_pending = 0;                  // отложенный сдвиг проекции
+}   //  CFileMapCsv()
+
+///////////////////////////////////////////////////////////////////////////////
+// открыть файл используя предопределенный режим и сбросить состояние разбора
+uint64_t CFileMapCsv::open_file_map ( mode md, uint64_t offset /*= 0*/ )
+{
+    m_in_quote = false;
+    m_pending = 0;
+    m_positions.clear();
+    m_carry.clear();
+    m_record.clear();
+    return CFileMap::open_file_map( md, offset );
+}   //  open_file_map ( mode md, uint64_t offset /*= 0*/ )
+
+///////////////////////////////////////////////////////////////////////////////
+// прочитать очередную запись
+uint64_t CFileMapCsv::read_record( vector<string_view> &fields )
+{
+    fields.clear();
+    m_positions.clear();
+    m_carry.clear();
+    m_in_quote = false;
+
+    // сдвинем проекцию на предыдущую запись (поля больше не нужны)
+    if ( m_pending ) {
+        check_map_region( m_pending );
+        m_pending = 0;
+    }
+    if ( eof() )
+        return 0;
+    // проверим, сколько байт можно прочитать
+    if ( get_max_copy_ex() == 0 ) {
+        if ( next_region() != 0 )
+            return 0;
+    }
+
+    // флаг true - запись собирается в буфере m_carry
+    bool carried = false;
+
+    for ( ;; ) {
+        const char *file = (const char *)get_map_address();
+        uint64_t length = get_max_copy_ex();
+        uint64_t end = scan( file, length, m_carry.size() );
+
+        if ( end < length || m_offset.QuadPart + length >= m_file_size.QuadPart ) {
+            // найден конец записи, либо запись заканчивается концом файла
+            uint64_t consumed = ( end < length ) ? end + 1 : length;
+            if ( carried == false ) {
+                split( file, end, false, fields );
+                m_pending = consumed;
+            } else {
+                m_carry.append( file, (size_t)end );
+                check_map_region( consumed );
+                split( m_carry.data(), m_carry.size(), true, fields );
+            }
+            break;
+        }
+
+        /* запись разбита между проекциями - сохраним хвост текущей
+         * проекции и продолжим поиск в следующей */
+        m_carry.append( file, (size_t)length );
+        carried = true;
+        if ( check_map_region( length ) == 0 ) {
+            // не удалось отразить следующую часть файла
+            split( m_carry.data(), m_carry.size(), true, fields );
+            break;
+        }
+    }
+
+    return fields.size();
+}   //  read_record( vector<string_view> &fields )
+
+///////////////////////////////////////////////////////////////////////////////
+// найти конец записи, собирая позиции разделителей
+uint64_t CFileMapCsv::scan( const char *p, uint64_t length, uint64_t base )
+{
+    // буфер для неполного блока в конце проекции
+    alignas(64) char tail[CFileMapSimd::block_size];
+
+    for ( uint64_t index = 0; index < length; index += CFileMapSimd::block_size ) {
+        uint64_t size = length - index;
+        if ( size > CFileMapSimd::block_size )
+            size = CFileMapSimd::block_size;
+        const char *block = CFileMapSimd::load_block( p + index, size, tail );
+        uint64_t valid = CFileMapSimd::low_mask( size );
+
+        uint64_t separators = CFileMapSimd::eq_mask( block, m_separator ) & valid;
+        uint64_t lines = CFileMapSimd::eq_mask( block, '\n' ) & valid;
+
+        if ( m_quote ) {
+            /* маска "внутри кавычек": префиксный xor позиций кавычек,
+             * инвертированный, если блок начался внутри кавычек.
+             * удвоенная кавычка переключает состояние дважды и на
+             * разделители не влияет */
+            uint64_t quotes = CFileMapSimd::eq_mask( block, m_quote ) & valid;
+            uint64_t inside = CFileMapSimd::prefix_xor( quotes );
+            if ( m_in_quote )
+                inside = ~inside;
+            m_in_quote = ( inside >> 63 ) & 1;
+            separators &= ~inside;
+            lines &= ~inside;
+        }
+
+        if ( lines ) {
+            uint64_t end = CFileMapSimd::trailing_zeros( lines );
+            separators &= CFileMapSimd::low_mask( end );
+            m_in_quote = false;
+            while ( separators ) {
+                m_positions.push_back( base + index + CFileMapSimd::trailing_zeros( separators ) );
+                separators &= separators - 1;
+            }
+            return index + end;
+        }
+
+        while ( separators ) {
+            m_positions.push_back( base + index + CFileMapSimd::trailing_zeros( separators ) );
+            separators &= separators - 1;
+        }
+    }
+
+    return length;
+}   //  scan( const char *p, uint64_t length, uint64_t base )
+
+///////////////////////////////////////////////////////////////////////////////
+// разбить собранную запись на поля
+void CFileMapCsv::split( const char *data, uint64_t length, bool writable,
+                         vector<string_view> &fields )
+{
+    // CR перед LF в состав последнего поля не входит (кроме режима lf)
+    length = line_length( data, length );
+
+    /* поля с удвоенными кавычками из проекции копируются в m_record,
+     * места резервируется с запасом - перераспределения памяти не будет
+     * и ранее выданные поля останутся действительными */
+    m_record.clear();
+    if ( writable == false )
+        m_record.reserve( (size_t)length );
+
+    uint64_t start = 0;
+    for ( size_t index = 0; index <= m_positions.size(); index++ ) {
+        uint64_t stop = ( index < m_positions.size() ) ? m_positions[index] : length;
+        if ( stop > length )
+            stop = length;
+        const char *field = data + start;
+        uint64_t size = stop - start;
+        start = stop + 1;
+
+        if ( m_quote && size >= 2 && field[0] == m_quote && field[size-1] == m_quote ) {
+            // уберем обрамляющие кавычки
+            field = field + 1;
+            size = size - 2;
+
+            if ( memchr( field, m_quote, (size_t)size ) ) {
+                // заменим удвоенные кавычки одной
+                char *dest = nullptr;
+                if ( writable ) {
+                    dest = const_cast<char *>( field );
+                } else {
+                    size_t from = m_record.size();
+                    m_record.append( (size_t)size, '\0' );
+                    dest = &m_record[from];
+                }
+                uint64_t count = 0;
+                for ( uint64_t k = 0; k < size; k++ ) {
+                    dest[count++] = field[k];
+                    if ( field[k] == m_quote && k+1 < size && field[k+1] == m_quote )
+                        k++;
+                }
+                if ( writable == false )
+                    m_record.resize( m_record.size() - (size_t)(size - count) );
+                field = dest;
+                size = count;
+            }
+        }
+
+        fields.emplace_back( field, (size_t)size );
+    }
+}   //  split( const char *data, uint64_t length, bool writable, ...
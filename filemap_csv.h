@@ -0,0 +1,192 @@
+/*!
+ *
+ * \file filemap_csv.h
+ * \brief определение класса разбора файлов с разделителями (CSV/TSV)
+ *
+ *  потоковый разбор записей поверх проекции файла в память,\n
+ *  разделители, кавычки и переводы строк находятся за один\n
+ *  векторный проход (классификация битовыми масками).\n
+ *  поля возвращаются как std::string_view без копирования.
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied\n
+ * warranty. In no event will the authors be held liable for any damages\n
+ * arising from the use of this software.\n
+ *
+ * Permission is granted to anyone to use this software for any purpose,\n
+ * including commercial applications, and to alter it and redistribute it\n
+ * freely, subject to the following restrictions:\n
+ *
+ *    1. The origin of this software must not be misrepresented; you must not\n
+ *    claim that you wrote the original software. If you use this software\n
+ *    in a product, an acknowledgment in the product documentation would be\n
+ *    appreciated but is not required.\n
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be\n
+ *    misrepresented as being the original software.\n
+ *    3. This notice may not be removed or altered from any source\n
+ *    distribution.\n
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+#ifndef FILEMAP_CSV_H
+#define FILEMAP_CSV_H
+
+#include "filemap.h"
+#include <string_view>
+#include <vector>
+
+
+
+//--------------------------------------------------------------------------------------------------//
+
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief The CFileMapCsv class - потоковый разбор записей с разделителями
+///
+/// запись заканчивается символом новой строки вне кавычек (CR перед LF\n
+/// отбрасывается, кроме режима lf set_line_ending(); режим crlf разбирается\n
+/// как mixed - одиночный LF тоже завершает запись), поля разделяются символом m_separator вне кавычек.\n
+/// поле в кавычках возвращается без обрамляющих кавычек, удвоенная\n
+/// кавычка внутри поля заменяется одной.\n
+/// Если запись целиком лежит в текущей проекции и не требует замены\n
+/// кавычек - поля указывают прямо в проекцию. Запись, разбитая между\n
+/// проекциями (next_region), собирается во внутреннем буфере.\n
+/// Поля действительны до следующего вызова read_record().
+///
+/// \code
+/// CFileMapCsv csv( limit_memory, ';' );
+/// csv.set_file_path( file_path );
+/// csv.set_file_size( file_size );
+/// last_error = csv.open_file_map( CFileMap::mode::read );
+/// std::vector<std::string_view> fields;
+/// while ( csv.read_record( fields ) ) {
+///     ...
+/// }
+/// \endcode
+///
+class CFileMapCsv : public CFileMap
+{
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief конструктор
+    /// \param limit_map_memory - размер ограниения для единовремменого отражения\n
+    ///  файла в память, если равен нулю - то отражается сразу весь файл целиком.
+    /// \param separator - разделитель полей (',' для CSV, '\\t' для TSV)
+    /// \param quote - символ кавычки, ноль - кавычки не обрабатываются
+    ///
+    CFileMapCsv( uint64_t limit_map_memory = 0, char separator = ',', char quote = '"' );
+
+public:
+    using CFileMap::open_file_map;
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief  открыть файл используя предопределенный режим\n
+    ///  и сбросить состояние разбора
+    /// \param  md - режим обработки файла и проекции ( read, write, append )
+    /// \param  offset - смещение байт от начала файла
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    /// @see CFileMap::open_file_map
+    ///
+    uint64_t open_file_map ( mode md, uint64_t offset = 0 );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить разделитель полей
+    ///
+    void set_separator( char separator ) {
+        m_separator = separator;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить символ кавычки (ноль - кавычки не обрабатываются)
+    ///
+    void set_quote( char quote ) {
+        m_quote = quote;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief прочитать очередную запись
+    /// \param fields - поля записи (заполняется заново)
+    /// \return количество полей, ноль - записей больше нет
+    ///
+    uint64_t read_record( std::vector<std::string_view> &fields );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief найти конец записи, собирая позиции разделителей
+    /// \param p      - начало данных
+    /// \param length - количество байт
+    /// \param base   - смещение p от начала записи
+    /// \return позиция символа новой строки или length, если не найден
+    ///
+    uint64_t scan( const char *p, uint64_t length, uint64_t base );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief разбить собранную запись на поля
+    /// \param data     - начало записи
+    /// \param length   - длина записи без символа новой строки
+    /// \param writable - true - data можно изменять (запись в буфере)
+    /// \param fields   - поля записи
+    ///
+    void split( const char *data, uint64_t length, bool writable,
+                std::vector<std::string_view> &fields );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief разделитель полей
+    ///
+    char m_separator;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief символ кавычки
+    ///
+    char m_quote;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief признак "внутри кавычек" после последнего просмотренного байта
+    ///
+    bool m_in_quote;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief количество байт предыдущей записи, на которое еще не сдвинута\n
+    ///  проекция. сдвиг откладывается до следующего вызова read_record(),\n
+    ///  чтобы поля, указывающие в проекцию, оставались действительными.
+    ///
+    uint64_t m_pending;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief позиции разделителей от начала записи
+    ///
+    std::vector<uint64_t> m_positions;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief буфер записи, разбитой между проекциями
+    ///
+    std::string m_carry;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief буфер полей с удвоенными кавычками (для записи в проекции)
+    ///
+    std::string m_record;
+};
+
+#endif // FILEMAP_CSV_H
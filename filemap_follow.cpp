@@ -0,0 +1,346 @@
+/*!
+ *
+ * \file filemap_follow.cpp
+ * \brief реализация класса проекции растущего файла (tail -f)
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+
+#include "filemap_follow.h"
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <errno.h>
+#if defined(OS_LINUX)
+#include <sys/inotify.h>
+#include <poll.h>
+#endif
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// конструктор
+CFileMapFollow::CFileMapFollow( uint64_t limit_map_memory /*= 0*/ )
+    : CFileMap( limit_map_memory )
+{
+    m_poll_interval = 10;   // интервал опроса размера файла, мс
+    m_pending = false;      // файл еще не отражен
+    m_follow = false;       // объект открыт
+    m_start = 0;            // смещение начала чтения отложенного файла
+    m_changes = 0;          // счетчик изменений файла
+    m_truncations = 0;      // количество усечений файла
+    m_rotations = 0;        // количество ротаций файла
+    m_notify = -1;          // описатель inotify
+    m_watch = -1;           // описатель наблюдения за файлом
+}   //  CFileMapFollow( uint64_t limit_map_memory )
+
+///////////////////////////////////////////////////////////////////////////////
+// деструктор
+CFileMapFollow::~CFileMapFollow()
+{
+    close_file_map();
+}   //  ~CFileMapFollow()
+
+///////////////////////////////////////////////////////////////////////////////
+// открыть файл для отслеживания
+uint64_t CFileMapFollow::open_file_map( uint64_t offset /*= 0*/ )
+{
+    uint64_t last_error = 0;
+
+    try
+    {
+        if ( m_follow )
+            close_file_map();
+
+        m_follow = true;
+        m_pending = true;
+        m_start = offset;
+        watch();
+
+        last_error = open_file();
+        if ( last_error )
+            throw last_error;
+    }
+    catch( uint64_t error ) {
+        last_error = error;
+        cout<< "an error number \"" << error << "\" is generated in the method open_file_map" <<endl;
+        close_file_map();
+    }
+
+    return last_error;
+}   //  open_file_map( uint64_t offset /*= 0*/ )
+
+///////////////////////////////////////////////////////////////////////////////
+// закрывает объект и прекращает отслеживание файла
+void CFileMapFollow::close_file_map()
+{
+#   if defined(OS_LINUX)
+    if ( m_notify >= 0 )
+        ::close( m_notify );
+#   endif  // defined(OS_LINUX)
+    m_notify = -1;
+    m_watch = -1;
+    m_follow = false;
+    m_pending = false;
+    CFileMap::close_file_map();
+}   //  close_file_map()
+
+///////////////////////////////////////////////////////////////////////////////
+// открыть файл, если он не пустой
+uint64_t CFileMapFollow::open_file()
+{
+    uint64_t file_size = 0;
+    uint64_t file_time = 0;
+    uint64_t last_error = get_file_info( file_size, file_time );
+    if ( last_error || file_size == 0 )
+        return last_error;
+
+    set_file_size( file_size );
+    /* писать в файл могут другие процессы, поэтому совместный доступ
+     * разрешается на чтение, запись и удаление (ротация) */
+#   if defined(OS_WIN)
+    last_error = CFileMap::open_file_map( GENERIC_READ,
+                                          FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                          OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                                          PAGE_READONLY, FILE_MAP_READ );
+#   else
+    last_error = CFileMap::open_file_map( O_RDONLY, NO_FLAG, PROT_READ, MAP_PRIVATE );
+#   endif  // defined(OS_WIN)
+    if ( last_error ) {
+        CFileMap::close_file_map();
+        return last_error;
+    }
+
+    m_pending = false;
+    m_changes++;
+    uint64_t start = ( m_start < file_size ) ? m_start : file_size;
+    m_start = 0;
+    return seek( start );
+}   //  open_file()
+
+///////////////////////////////////////////////////////////////////////////////
+// проверить изменения файла (рост, усечение, ротация)
+uint64_t CFileMapFollow::refresh()
+{
+    if ( m_follow == false ) {
+#       if defined(OS_WIN)
+        return ERROR_INVALID_PARAMETER;
+#       else
+        return EINVAL;
+#       endif  // defined(OS_WIN)
+    }
+
+    if ( m_pending )
+        return open_file();
+
+    // размер открытого файла (по имени может быть уже другой файл)
+    uint64_t file_size = 0;
+#   if defined(OS_WIN)
+    LARGE_INTEGER size;
+    if ( ::GetFileSizeEx( get_file_handle(), &size ) == 0 )
+        return ::GetLastError();
+    file_size = size.QuadPart;
+#   else
+    struct stat info;
+    if ( ::fstat( get_file_handle(), &info ) != 0 )
+        return errno;
+    file_size = (uint64_t)info.st_size;
+#   endif  // defined(OS_WIN)
+
+    uint64_t last_error = 0;
+    if ( file_size > get_file_size() ) {
+        last_error = resize_map( file_size );
+        m_changes++;
+    } else if ( file_size < get_file_size() ) {
+        // файл усечен (copytruncate) - читаем с начала
+        last_error = resize_map( file_size );
+        if ( last_error == 0 && file_size )
+            last_error = seek( 0 );
+        m_truncations++;
+        m_changes++;
+    }
+    if ( last_error )
+        return last_error;
+
+    // старый файл дочитан до конца и заменен новым - переходим на новый
+    if ( eof() && is_rotated() ) {
+        // close_file_map() сбрасывает размер блока проекции - восстановим его
+        uint64_t limit_memory = get_limit_memory();
+        CFileMap::close_file_map();
+        set_limit_memory( limit_memory );
+        m_pending = true;
+        m_start = 0;
+        m_rotations++;
+        m_changes++;
+        watch();
+        last_error = open_file();
+    }
+    return last_error;
+}   //  refresh()
+
+///////////////////////////////////////////////////////////////////////////////
+// ждать появления новых данных
+bool CFileMapFollow::follow( uint32_t timeout )
+{
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::now() +
+                                                chrono::milliseconds( timeout );
+    refresh();
+    while ( m_pending || eof() ) {
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        if ( now >= deadline || m_follow == false )
+            return false;
+        wait( (uint32_t)chrono::duration_cast<chrono::milliseconds>( deadline - now ).count() + 1 );
+        refresh();
+    }
+    return true;
+}   //  follow( uint32_t timeout )
+
+///////////////////////////////////////////////////////////////////////////////
+// прочитать полную строку
+bool CFileMapFollow::read_line( char *dest, uint64_t &length, uint32_t timeout /*= 0*/ )
+{
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::now() +
+                                                chrono::milliseconds( timeout );
+    length = 0;
+
+    while ( m_follow ) {
+        if ( m_pending == false && eof() == false ) {
+            uint64_t position = get_file_offset();
+            uint64_t size = CFileMap::read_line( dest );
+            // строка завершена, если за ней есть данные или она кончается переводом строки
+            if ( eof() == false || ((const char *)get_map_address())[-1] == '\n' ) {
+                length = size;
+                return true;
+            }
+            // незавершенную строку оставим до следующего роста файла
+            seek( position );
+        }
+
+        // ждем изменения файла
+        uint64_t changes = m_changes;
+        refresh();
+        while ( m_changes == changes ) {
+            chrono::steady_clock::time_point now = chrono::steady_clock::now();
+            if ( now >= deadline || m_follow == false )
+                return false;
+            wait( (uint32_t)chrono::duration_cast<chrono::milliseconds>( deadline - now ).count() + 1 );
+            refresh();
+        }
+    }
+    return false;
+}   //  read_line( char *dest, uint64_t &length, uint32_t timeout )
+
+///////////////////////////////////////////////////////////////////////////////
+// проверить, что имя файла указывает на открытый файл
+bool CFileMapFollow::is_rotated()
+{
+    if ( m_pending )
+        return false;
+
+#   if defined(OS_WIN)
+    HANDLE file = ::CreateFileW( get_file_path().c_str(), 0,
+                                 FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                 NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+    if ( file == INVALID_HANDLE_VALUE )
+        return true;
+    BY_HANDLE_FILE_INFORMATION path_info;
+    BY_HANDLE_FILE_INFORMATION open_info;
+    BOOL res = ::GetFileInformationByHandle( file, &path_info ) &&
+               ::GetFileInformationByHandle( get_file_handle(), &open_info );
+    ::CloseHandle( file );
+    if ( res == FALSE )
+        return false;
+    return path_info.dwVolumeSerialNumber != open_info.dwVolumeSerialNumber ||
+           path_info.nFileIndexHigh != open_info.nFileIndexHigh ||
+           path_info.nFileIndexLow != open_info.nFileIndexLow;
+#   else
+    struct stat path_info;
+    struct stat open_info;
+    string file_path = wchar_string( get_file_path().c_str(), get_file_path().length() );
+    if ( ::stat( file_path.c_str(), &path_info ) != 0 )
+        return true;
+    if ( ::fstat( get_file_handle(), &open_info ) != 0 )
+        return false;
+    return path_info.st_ino != open_info.st_ino || path_info.st_dev != open_info.st_dev;
+#   endif  // defined(OS_WIN)
+}   //  is_rotated()
+
+///////////////////////////////////////////////////////////////////////////////
+// начать (перезапустить) отслеживание файла через inotify
+void CFileMapFollow::watch()
+{
+#   if defined(OS_LINUX)
+    if ( m_notify < 0 )
+        m_notify = ::inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+    if ( m_notify < 0 )
+        return;     // без inotify - опрос размера файла
+    if ( m_watch >= 0 )
+        ::inotify_rm_watch( m_notify, m_watch );
+    string file_path = wchar_string( get_file_path().c_str(), get_file_path().length() );
+    /* если файла еще нет (ротация) - m_watch = -1, и wait() опрашивает размер,
+     * пока refresh() не откроет новый файл */
+    m_watch = ::inotify_add_watch( m_notify, file_path.c_str(),
+                                   IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE |
+                                   IN_MOVE_SELF | IN_DELETE_SELF );
+#   endif  // defined(OS_LINUX)
+}   //  watch()
+
+///////////////////////////////////////////////////////////////////////////////
+// ждать события файла не дольше timeout
+void CFileMapFollow::wait( uint32_t timeout )
+{
+#   if defined(OS_LINUX)
+    if ( m_notify >= 0 && m_watch < 0 && m_pending == false )
+        watch();
+
+    if ( m_notify >= 0 && m_watch >= 0 && m_pending == false ) {
+        struct pollfd fds;
+        fds.fd = m_notify;
+        fds.events = POLLIN;
+        fds.revents = 0;
+        if ( ::poll( &fds, 1, (int)timeout ) > 0 ) {
+            // вычитаем события, важен только факт изменения файла
+            alignas(struct inotify_event) char buffer[4096];
+            ssize_t size = 0;
+            while ( ( size = ::read( m_notify, buffer, sizeof(buffer) ) ) > 0 ) {
+                for ( ssize_t pos = 0; pos < size; ) {
+                    const struct inotify_event *event = (const struct inotify_event *)( buffer + pos );
+                    if ( event->wd == m_watch && ( event->mask & IN_IGNORED ) )
+                        m_watch = -1;   // файл удален - наблюдение снято
+                    pos += sizeof(struct inotify_event) + event->len;
+                }
+            }
+        }
+        return;
+    }
+#   endif  // defined(OS_LINUX)
+
+    if ( timeout > m_poll_interval )
+        timeout = m_poll_interval;
+    this_thread::sleep_for( chrono::milliseconds( timeout ) );
+}   //  wait( uint32_t timeout )
@@ -0,0 +1,238 @@
+/*!
+ *
+ * \file filemap_follow.h
+ * \brief определение класса проекции растущего файла (tail -f)
+ *
+ *  файл отслеживается (inotify, иначе опрос fstat), при росте\n
+ *  проекция расширяется без переоткрытия файла, read_line возвращает\n
+ *  только полные строки. Обрабатываются усечение и ротация файла.
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied\n
+ * warranty. In no event will the authors be held liable for any damages\n
+ * arising from the use of this software.\n
+ *
+ * Permission is granted to anyone to use this software for any purpose,\n
+ * including commercial applications, and to alter it and redistribute it\n
+ * freely, subject to the following restrictions:\n
+ *
+ *    1. The origin of this software must not be misrepresented; you must not\n
+ *    claim that you wrote the original software. If you use this software\n
+ *    in a product, an acknowledgment in the product documentation would be\n
+ *    appreciated but is not required.\n
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be\n
+ *    misrepresented as being the original software.\n
+ *    3. This notice may not be removed or altered from any source\n
+ *    distribution.\n
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+#ifndef FILEMAP_FOLLOW_H
+#define FILEMAP_FOLLOW_H
+
+#include "filemap.h"
+
+
+
+//--------------------------------------------------------------------------------------------------//
+
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief The CFileMapFollow class - проекция растущего файла (tail -f)
+///
+/// файл открывается только на чтение (другие процессы могут в него писать),\n
+/// размер берется из файла. При росте файла проекция расширяется\n
+/// ( CFileMap::resize_map() ), при усечении (copytruncate) чтение\n
+/// продолжается с начала файла. При ротации (файл переименован/удален,\n
+/// по тому же имени создан новый) сначала дочитывается старый файл,\n
+/// затем открывается новый с начала.\n
+///
+/// изменения ожидаются через inotify (Linux), иначе - опросом размера\n
+/// файла с интервалом set_poll_interval().
+///
+/// \code
+/// CFileMapFollow log( limit );
+/// log.set_file_path( file_path );
+/// log.open_file_map( offset );
+/// while ( running ) {
+///     if ( log.read_line( buffer, length, 100 ) )
+///         process( buffer, length );
+/// }
+/// \endcode
+///
+class CFileMapFollow : public CFileMap
+{
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief конструктор
+    /// \param limit_map_memory - размер ограниения для единовремменого отражения\n
+    ///  файла в память, если равен нулю - то отражается весь файл целиком.
+    ///
+    CFileMapFollow( uint64_t limit_map_memory = 0 );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief деструктор
+    ///
+    ~CFileMapFollow();
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief  открыть файл для отслеживания
+    /// \param  offset - смещение от начала файла, с которого начинается чтение
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    /// файл должен существовать, но может быть пустым
+    ///
+    uint64_t open_file_map( uint64_t offset = 0 );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief закрывает объект и прекращает отслеживание файла
+    ///
+    void close_file_map();
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить интервал опроса размера файла (без inotify)
+    /// \param interval - интервал в миллисекундах
+    ///
+    void set_poll_interval( uint32_t interval ) {
+        m_poll_interval = interval ? interval : 1;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief проверить изменения файла (рост, усечение, ротация) без ожидания
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t refresh();
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief ждать появления новых данных
+    /// \param timeout - время ожидания в миллисекундах
+    /// \return true - есть непрочитанные данные
+    ///
+    bool follow( uint32_t timeout );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief прочитать полную строку (ждать ее появления не дольше timeout)
+    /// \param dest - буфер для записи строки из файла
+    /// \param length - количество прочитанных байт (без символов новой строки)
+    /// \param timeout - время ожидания в миллисекундах, ноль - не ждать
+    /// \return true - строка прочитана, false - полной строки пока нет\n
+    ///  (незавершенная строка останется непрочитанной)
+    ///
+    bool read_line( char *dest, uint64_t &length, uint32_t timeout = 0 );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief количество обнаруженных усечений файла
+    ///
+    uint64_t get_truncations() const {
+        return m_truncations;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief количество обнаруженных ротаций файла
+    ///
+    uint64_t get_rotations() const {
+        return m_rotations;
+    }
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief открыть файл, если он не пустой (пустой файл отразить нельзя)
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t open_file();
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief проверить, что имя файла указывает на открытый файл
+    /// \return true - файл по имени заменен другим (или удален)
+    ///
+    bool is_rotated();
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief начать (перезапустить) отслеживание файла через inotify
+    ///
+    void watch();
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief ждать события файла не дольше timeout
+    /// \param timeout - время ожидания в миллисекундах
+    ///
+    void wait( uint32_t timeout );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief интервал опроса размера файла в миллисекундах
+    ///
+    uint32_t m_poll_interval;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief файл еще не отражен (пустой или еще не создан после ротации)
+    ///
+    bool m_pending;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief объект открыт ( open_file_map() )
+    ///
+    bool m_follow;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief смещение, с которого начинается чтение отложенного файла
+    ///
+    uint64_t m_start;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief счетчик изменений файла (рост, усечение, ротация)
+    ///
+    uint64_t m_changes;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief количество усечений файла
+    ///
+    uint64_t m_truncations;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief количество ротаций файла
+    ///
+    uint64_t m_rotations;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief описатель inotify (-1 - опрос размера файла)
+    ///
+    int m_notify;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief описатель наблюдения inotify за файлом
+    ///
+    int m_watch;
+};
+
+#endif // FILEMAP_FOLLOW_H
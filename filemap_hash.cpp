@@ -0,0 +1,244 @@
+/*!
+ *
+ * \file filemap_hash.cpp
+ * \brief реализация класса инкрементального хеширования данных проекции
+ *
+ *  CRC32C (аппаратно при SSE4.2 / ARMv8 CRC, иначе таблично)\n
+ *  и xxHash64.
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+#include "filemap_hash.h"
+#include <string.h>
+#if defined(__SSE4_2__)
+#  include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+#  include <arm_acle.h>
+#endif
+
+namespace {
+
+const uint64_t PRIME64_1 = 11400714785074694791ull;
+const uint64_t PRIME64_2 = 14029467366897019727ull;
+const uint64_t PRIME64_3 = 1609587929392839161ull;
+const uint64_t PRIME64_4 = 9650029242287828579ull;
+const uint64_t PRIME64_5 = 2870177450012600261ull;
+
+inline uint64_t rotl64( uint64_t value, int shift )
+{
+    return ( value << shift ) | ( value >> (64 - shift) );
+}
+
+inline uint64_t read64( const unsigned char *p )
+{
+    uint64_t value;
+    memcpy( &value, p, sizeof(value) );
+    return value;
+}
+
+inline uint32_t read32( const unsigned char *p )
+{
+    uint32_t value;
+    memcpy( &value, p, sizeof(value) );
+    return value;
+}
+
+inline uint64_t xxh64_round( uint64_t acc, uint64_t input )
+{
+    acc += input * PRIME64_2;
+    acc = rotl64( acc, 31 );
+    return acc * PRIME64_1;
+}
+
+inline uint64_t xxh64_merge( uint64_t acc, uint64_t value )
+{
+    acc ^= xxh64_round( 0, value );
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+#if !defined(__SSE4_2__) && !defined(__ARM_FEATURE_CRC32)
+// таблицы CRC32C для обработки по 8 байт (slice-by-8)
+struct crc32c_table {
+    uint32_t data[8][256];
+    crc32c_table() {
+        for ( uint32_t index = 0; index < 256; index++ ) {
+            uint32_t crc = index;
+            for ( int bit = 0; bit < 8; bit++ )
+                crc = ( crc & 1 ) ? ( crc >> 1 ) ^ 0x82F63B78u : ( crc >> 1 );
+            data[0][index] = crc;
+        }
+        for ( uint32_t index = 0; index < 256; index++ ) {
+            for ( int k = 1; k < 8; k++ )
+                data[k][index] = ( data[k-1][index] >> 8 ) ^ data[0][data[k-1][index] & 0xFF];
+        }
+    }
+};
+#endif
+
+// обновить регистр CRC32C
+uint32_t crc32c_update( uint32_t crc, const unsigned char *p, uint64_t length )
+{
+#   if defined(__SSE4_2__)
+    uint64_t value = crc;
+    for ( ; length >= 8; length -= 8, p += 8 )
+        value = _mm_crc32_u64( value, read64( p ) );
+    crc = (uint32_t)value;
+    for ( ; length; length--, p++ )
+        crc = _mm_crc32_u8( crc, *p );
+    return crc;
+#   elif defined(__ARM_FEATURE_CRC32)
+    for ( ; length >= 8; length -= 8, p += 8 )
+        crc = __crc32cd( crc, read64( p ) );
+    for ( ; length; length--, p++ )
+        crc = __crc32cb( crc, *p );
+    return crc;
+#   else
+    static const crc32c_table table;
+    for ( ; length >= 8; length -= 8, p += 8 ) {
+        uint64_t value = read64( p ) ^ crc;
+        crc = table.data[7][ value        & 0xFF] ^ table.data[6][(value >>  8) & 0xFF] ^
+              table.data[5][(value >> 16) & 0xFF] ^ table.data[4][(value >> 24) & 0xFF] ^
+              table.data[3][(value >> 32) & 0xFF] ^ table.data[2][(value >> 40) & 0xFF] ^
+              table.data[1][(value >> 48) & 0xFF] ^ table.data[0][ value >> 56        ];
+    }
+    for ( ; length; length--, p++ )
+        crc = ( crc >> 8 ) ^ table.data[0][(crc ^ *p) & 0xFF];
+    return crc;
+#   endif
+}
+
+}   // namespace
+
+///////////////////////////////////////////////////////////////////////////////
+// начать вычисление хеша заново
+void CFileMapHash::reset( method md )
+{
+    m_method = md;
+    m_length = 0;
+    m_crc = 0xFFFFFFFFu;
+    m_acc[0] = PRIME64_1 + PRIME64_2;
+    m_acc[1] = PRIME64_2;
+    m_acc[2] = 0;
+    m_acc[3] = 0 - PRIME64_1;
+    m_tail_size = 0;
+}   //  reset( method md )
+
+///////////////////////////////////////////////////////////////////////////////
+// добавить порцию данных
+void CFileMapHash::update( const void *data, uint64_t length )
+{
+    const unsigned char *p = (const unsigned char *)data;
+    m_length += length;
+
+    switch ( m_method ) {
+    case method::crc32c:
+        m_crc = crc32c_update( m_crc, p, length );
+        break;
+
+    case method::xxh64:
+        // дополним неполную полосу
+        if ( m_tail_size ) {
+            uint64_t size = 32 - m_tail_size;
+            if ( size > length )
+                size = length;
+            memcpy( m_tail + m_tail_size, p, (size_t)size );
+            m_tail_size += (uint32_t)size;
+            p += size;
+            length -= size;
+            if ( m_tail_size < 32 )
+                break;
+            for ( int k = 0; k < 4; k++ )
+                m_acc[k] = xxh64_round( m_acc[k], read64( m_tail + k*8 ) );
+            m_tail_size = 0;
+        }
+        for ( ; length >= 32; length -= 32, p += 32 ) {
+            m_acc[0] = xxh64_round( m_acc[0], read64( p ) );
+            m_acc[1] = xxh64_round( m_acc[1], read64( p + 8 ) );
+            m_acc[2] = xxh64_round( m_acc[2], read64( p + 16 ) );
+            m_acc[3] = xxh64_round( m_acc[3], read64( p + 24 ) );
+        }
+        if ( length ) {
+            memcpy( m_tail, p, (size_t)length );
+            m_tail_size = (uint32_t)length;
+        }
+        break;
+
+    default:
+        break;
+    }
+}   //  update( const void *data, uint64_t length )
+
+///////////////////////////////////////////////////////////////////////////////
+// получить хеш данных, добавленных после reset()
+uint64_t CFileMapHash::digest() const
+{
+    switch ( m_method ) {
+    case method::crc32c:
+        return (uint64_t)( ~m_crc );
+
+    case method::xxh64: {
+        uint64_t h = 0;
+        if ( m_length >= 32 ) {
+            h = rotl64( m_acc[0], 1 ) + rotl64( m_acc[1], 7 ) +
+                rotl64( m_acc[2], 12 ) + rotl64( m_acc[3], 18 );
+            for ( int k = 0; k < 4; k++ )
+                h = xxh64_merge( h, m_acc[k] );
+        } else {
+            h = m_acc[2] + PRIME64_5;
+        }
+        h += m_length;
+
+        const unsigned char *p = m_tail;
+        uint32_t length = m_tail_size;
+        for ( ; length >= 8; length -= 8, p += 8 ) {
+            h ^= xxh64_round( 0, read64( p ) );
+            h = rotl64( h, 27 ) * PRIME64_1 + PRIME64_4;
+        }
+        if ( length >= 4 ) {
+            h ^= (uint64_t)read32( p ) * PRIME64_1;
+            h = rotl64( h, 23 ) * PRIME64_2 + PRIME64_3;
+            length -= 4;
+            p += 4;
+        }
+        for ( ; length; length--, p++ ) {
+            h ^= (*p) * PRIME64_5;
+            h = rotl64( h, 11 ) * PRIME64_1;
+        }
+
+        h ^= h >> 33;
+        h *= PRIME64_2;
+        h ^= h >> 29;
+        h *= PRIME64_3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    default:
+        return 0;
+    }
+}   //  digest()
@@ -0,0 +1,167 @@
+/*!
+ *
+ * \file filemap_hash.h
+ * \brief определение класса инкрементального хеширования данных проекции
+ *
+ *  CRC32C (аппаратно при SSE4.2 / ARMv8 CRC, иначе таблично)\n
+ *  и xxHash64. Хеш обновляется порциями по мере чтения/записи,\n
+ *  результат не зависит от того, как данные разбиты на порции.
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied\n
+ * warranty. In no event will the authors be held liable for any damages\n
+ * arising from the use of this software.\n
+ *
+ * Permission is granted to anyone to use this software for any purpose,\n
+ * including commercial applications, and to alter it and redistribute it\n
+ * freely, subject to the following restrictions:\n
+ *
+ *    1. The origin of this software must not be misrepresented; you must not\n
+ *    claim that you wrote the original software. If you use this software\n
+ *    in a product, an acknowledgment in the product documentation would be\n
+ *    appreciated but is not required.\n
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be\n
+ *    misrepresented as being the original software.\n
+ *    3. This notice may not be removed or altered from any source\n
+ *    distribution.\n
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+#ifndef FILEMAP_HASH_H
+#define FILEMAP_HASH_H
+
+#include <stdint.h>
+
+
+
+//--------------------------------------------------------------------------------------------------//
+
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief The CFileMapHash class - инкрементальный хеш
+///
+class CFileMapHash
+{
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief алгоритм хеширования
+    ///
+    enum class method : uint32_t
+    {
+        /*! хеширование выключено */
+        none = 0,
+        /*! CRC32C (Castagnoli), результат в младших 32 битах */
+        crc32c = 1,
+        /*! xxHash64, seed = 0 */
+        xxh64 = 2
+    };
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief конструктор
+    /// \param md - алгоритм хеширования
+    ///
+    CFileMapHash( method md = method::none ) {
+        reset( md );
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief начать вычисление хеша заново
+    /// \param md - алгоритм хеширования
+    ///
+    void reset( method md );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief добавить порцию данных
+    /// \param data - данные
+    /// \param length - количество байт
+    ///
+    void update( const void *data, uint64_t length );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить хеш данных, добавленных после reset()
+    /// \return значение хеша
+    ///
+    uint64_t digest() const;
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief алгоритм хеширования
+    ///
+    method get_method() const {
+        return m_method;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief количество байт, добавленных после reset()
+    ///
+    uint64_t get_length() const {
+        return m_length;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief вычислить хеш блока памяти
+    /// \param md - алгоритм хеширования
+    /// \param data - данные
+    /// \param length - количество байт
+    /// \return значение хеша
+    ///
+    static uint64_t hash( method md, const void *data, uint64_t length ) {
+        CFileMapHash state( md );
+        state.update( data, length );
+        return state.digest();
+    }
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief алгоритм хеширования
+    ///
+    method m_method;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief количество добавленных байт
+    ///
+    uint64_t m_length;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief регистр CRC32C
+    ///
+    uint32_t m_crc;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief аккумуляторы xxHash64
+    ///
+    uint64_t m_acc[4];
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief неполная полоса xxHash64 (32 байта)
+    ///
+    unsigned char m_tail[32];
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief количество байт в m_tail
+    ///
+    uint32_t m_tail_size;
+};
+
+#endif // FILEMAP_HASH_H
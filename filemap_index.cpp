@@ -0,0 +1,399 @@
+/*!
+ *
+ * \file filemap_index.cpp
+ * \brief реализация класса проекции файла с индексом строк
+ *
+ *  индекс смещений строк строится за один параллельный проход по файлу\n
+ *  и сохраняется в отдельный файл (смещение каждой every-й строки,\n
+ *  дельта-кодирование).
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+#include "filemap_index.h"
+#include "filemap_simd.h"
+#include <algorithm>
+#include <thread>
+#include <errno.h>
+
+using namespace std;
+
+/* формат файла индекса:
+ *   заголовок (index_header)
+ *   count пар (номер строки, смещение) - разности с предыдущей парой,
+ *   каждая разность записана как varint (7 бит на байт, старший бит -
+ *   признак продолжения) */
+namespace {
+
+const char     INDEX_MAGIC[8] = { 'F','M','L','I','N','D','E','X' };
+const uint32_t INDEX_VERSION  = 1;
+
+struct index_header {
+    char     magic[8];      // сигнатура файла индекса
+    uint32_t version;       // версия формата
+    uint32_t reserved;      // выравнивание
+    uint64_t file_size;     // размер исходного файла
+    uint64_t file_time;     // время изменения исходного файла
+    uint64_t every;         // шаг индекса
+    uint64_t line_count;    // количество строк в исходном файле
+    uint64_t count;         // количество точек индекса
+};
+
+void put_varint( string &out, uint64_t value )
+{
+    while ( value >= 0x80 ) {
+        out.push_back( (char)( (value & 0x7F) | 0x80 ) );
+        value >>= 7;
+    }
+    out.push_back( (char)value );
+}
+
+bool get_varint( const char *&p, const char *end, uint64_t &value )
+{
+    value = 0;
+    for ( uint32_t shift = 0; p < end && shift < 64; shift += 7 ) {
+        uint8_t byte = (uint8_t)*p++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if ( (byte & 0x80) == 0 )
+            return true;
+    }
+    return false;
+}
+
+}   // namespace
+
+///////////////////////////////////////////////////////////////////////////////
+// конструктор
+CFileMapLineIndex::CFileMapLineIndex( uint64_t limit_map_memory /*= 0*/ )
+    : CFileMap( limit_map_memory )
+{
+    m_index_path.clear();           // полное имя файла индекса
+    m_line_count = 0;               // количество строк в файле
+}   //  CFileMapLineIndex()
+
+///////////////////////////////////////////////////////////////////////////////
+// получить имя файла индекса
+wstring CFileMapLineIndex::index_path()
+{
+    if ( m_index_path.length() )
+        return m_index_path;
+    return get_file_path() + L".lidx";
+}   //  index_path()
+
+///////////////////////////////////////////////////////////////////////////////
+// построить индекс строк и сохранить его в файл индекса
+uint64_t CFileMapLineIndex::build_line_index( uint64_t every /*= 4096*/, uint32_t threads /*= 0*/ )
+{
+    uint64_t file_size = 0;
+    uint64_t file_time = 0;
+    uint64_t last_error = get_file_info( file_size, file_time );
+    if ( last_error )
+        return last_error;
+    if ( every == 0 )
+        every = 1;
+
+    m_lines.clear();
+    m_offsets.clear();
+    m_lines.push_back( 0 );
+    m_offsets.push_back( 0 );
+    m_line_count = 0;
+
+    if ( file_size ) {
+        if ( threads == 0 )
+            threads = std::max( 1u, std::thread::hardware_concurrency() );
+
+        // участки кратны гранулярности - с их начала можно отражать файл
+        uint64_t chunk_size = memory_allocation_granularity( (file_size + threads - 1) / threads );
+        uint64_t window = get_limit_memory() ? get_limit_memory() : chunk_size;
+
+        vector<chunk_info> chunks;
+        for ( uint64_t begin = 0; begin < file_size; begin += chunk_size ) {
+            chunk_info chunk;
+            chunk.begin = begin;
+            chunk.end = std::min( begin + chunk_size, file_size );
+            chunk.lines = 0;
+            chunk.last = 0;
+            chunk.error = 0;
+            chunks.push_back( chunk );
+        }
+
+        vector<thread> workers;
+        for ( size_t index = 1; index < chunks.size(); index++ ) {
+            workers.emplace_back( &CFileMapLineIndex::scan_chunk, this,
+                                  std::ref( chunks[index] ), every, window );
+        }
+        scan_chunk( chunks[0], every, window );
+        for ( thread &worker : workers )
+            worker.join();
+
+        // сведем результаты участков: номер строки = строки предыдущих участков + номер в участке
+        uint64_t line = 0;
+        for ( chunk_info &chunk : chunks ) {
+            if ( chunk.error )
+                return chunk.error;
+            for ( size_t index = 0; index < chunk.offsets.size(); index++ ) {
+                if ( chunk.offsets[index] >= file_size )
+                    break;
+                m_lines.push_back( line + (index + 1) * every );
+                m_offsets.push_back( chunk.offsets[index] );
+            }
+            line = line + chunk.lines;
+        }
+        // последняя строка без символа новой строки
+        m_line_count = line + ( chunks.back().last != '\n' ? 1 : 0 );
+    }
+
+    // сохраним индекс
+    index_header header;
+    memcpy( header.magic, INDEX_MAGIC, sizeof(header.magic) );
+    header.version = INDEX_VERSION;
+    header.reserved = 0;
+    header.file_size = file_size;
+    header.file_time = file_time;
+    header.every = every;
+    header.line_count = m_line_count;
+    header.count = m_lines.size();
+
+    string data( (const char *)&header, sizeof(header) );
+    for ( size_t index = 0; index < m_lines.size(); index++ ) {
+        put_varint( data, index ? m_lines[index] - m_lines[index-1] : m_lines[index] );
+        put_varint( data, index ? m_offsets[index] - m_offsets[index-1] : m_offsets[index] );
+    }
+
+    CFileMap output;
+    wstring path = index_path();
+    output.set_file_path( path.c_str() );
+    output.set_file_size( data.length() );
+    last_error = output.open_file_map( CFileMap::mode::write );
+    if ( last_error )
+        return last_error;
+    if ( output.write( data.c_str(), data.length() ) != data.length() ) {
+        output.close_file_map();
+#       if defined(OS_WIN)
+        return ERROR_WRITE_FAULT;
+#       else
+        return EIO;
+#       endif  // defined(OS_WIN)
+    }
+    output.close_file_map();
+
+    return 0;
+}   //  build_line_index( uint64_t every /*= 4096*/, uint32_t threads /*= 0*/ )
+
+///////////////////////////////////////////////////////////////////////////////
+// просмотреть участок файла (выполняется в отдельном потоке)
+void CFileMapLineIndex::scan_chunk( chunk_info &chunk, uint64_t every, uint64_t window )
+{
+    CFileMapLineIndex part( window );
+    part.set_file_path( get_file_path().c_str() );
+    part.set_file_size( chunk.end );
+    chunk.error = part.open_file_map( CFileMap::mode::read, chunk.begin );
+    if ( chunk.error )
+        return;
+
+    // буфер для неполного блока в конце проекции
+    alignas(64) char tail[CFileMapSimd::block_size];
+    // номер следующей строки участка, смещение которой нужно запомнить
+    uint64_t next = every;
+    uint64_t position = chunk.begin;
+
+    while ( position < chunk.end ) {
+        const char *file = (const char *)part.get_map_address();
+        uint64_t length = part.get_max_copy_ex();
+        if ( file == nullptr || length == 0 ) {
+#           if defined(OS_WIN)
+            chunk.error = ERROR_READ_FAULT;
+#           else
+            chunk.error = EIO;
+#           endif  // defined(OS_WIN)
+            return;
+        }
+
+        for ( uint64_t index = 0; index < length; index += CFileMapSimd::block_size ) {
+            uint64_t size = ( length - index > CFileMapSimd::block_size ) ? CFileMapSimd::block_size : length - index;
+            const char *block = CFileMapSimd::load_block( file + index, size, tail );
+            uint64_t lines = CFileMapSimd::eq_mask( block, '\n' ) & CFileMapSimd::low_mask( size );
+            uint64_t count = CFileMapSimd::popcount( lines );
+
+            if ( chunk.lines + count < next ) {
+                chunk.lines += count;
+                continue;
+            }
+            // в блоке есть строка для индекса - переберем символы новой строки
+            while ( lines ) {
+                chunk.lines++;
+                if ( chunk.lines == next ) {
+                    chunk.offsets.push_back( position + index + CFileMapSimd::trailing_zeros( lines ) + 1 );
+                    next += every;
+                }
+                lines &= lines - 1;
+            }
+        }
+
+        chunk.last = file[length-1];
+        position += length;
+        part.check_map_region( length );
+    }
+
+    part.close_file_map();
+}   //  scan_chunk( chunk_info &chunk, uint64_t every, uint64_t window )
+
+///////////////////////////////////////////////////////////////////////////////
+// загрузить индекс строк из файла индекса
+uint64_t CFileMapLineIndex::load_line_index()
+{
+    uint64_t file_size = 0;
+    uint64_t file_time = 0;
+    uint64_t last_error = get_file_info( file_size, file_time );
+    if ( last_error )
+        return last_error;
+
+    CFileMap input;
+    wstring path = index_path();
+    input.set_file_path( path.c_str() );
+    uint64_t index_size = 0;
+    uint64_t index_time = 0;
+    last_error = input.get_file_info( index_size, index_time );
+    if ( last_error )
+        return last_error;
+
+#   if defined(OS_WIN)
+    const uint64_t invalid_data = ERROR_INVALID_DATA;
+#   else
+    const uint64_t invalid_data = ESTALE;
+#   endif  // defined(OS_WIN)
+
+    if ( index_size < sizeof(index_header) )
+        return invalid_data;
+
+    string data( (size_t)index_size, '\0' );
+    input.set_file_size( index_size );
+    last_error = input.open_file_map( CFileMap::mode::read );
+    if ( last_error )
+        return last_error;
+    uint64_t length = input.read( &data[0], index_size );
+    input.close_file_map();
+    if ( length != index_size )
+        return invalid_data;
+
+    // проверим заголовок и соответствие исходному файлу
+    index_header header;
+    memcpy( &header, data.data(), sizeof(header) );
+    if ( memcmp( header.magic, INDEX_MAGIC, sizeof(header.magic) ) != 0 ||
+         header.version != INDEX_VERSION ||
+         header.file_size != file_size || header.file_time != file_time ) {
+        return invalid_data;
+    }
+
+    vector<uint64_t> lines;
+    vector<uint64_t> offsets;
+    lines.reserve( (size_t)header.count );
+    offsets.reserve( (size_t)header.count );
+    const char *p = data.data() + sizeof(header);
+    const char *end = data.data() + data.length();
+    uint64_t line = 0;
+    uint64_t offset = 0;
+    for ( uint64_t index = 0; index < header.count; index++ ) {
+        uint64_t line_delta = 0;
+        uint64_t offset_delta = 0;
+        if ( !get_varint( p, end, line_delta ) || !get_varint( p, end, offset_delta ) )
+            return invalid_data;
+        line += line_delta;
+        offset += offset_delta;
+        lines.push_back( line );
+        offsets.push_back( offset );
+    }
+    if ( lines.empty() || lines[0] != 0 )
+        return invalid_data;
+
+    m_lines.swap( lines );
+    m_offsets.swap( offsets );
+    m_line_count = header.line_count;
+    return 0;
+}   //  load_line_index()
+
+///////////////////////////////////////////////////////////////////////////////
+// перейти к началу строки с номером line
+uint64_t CFileMapLineIndex::seek_line( uint64_t line )
+{
+#   if defined(OS_WIN)
+    const uint64_t invalid_line = ERROR_INVALID_PARAMETER;
+#   else
+    const uint64_t invalid_line = EINVAL;
+#   endif  // defined(OS_WIN)
+
+    if ( m_lines.size() && line >= m_line_count )
+        return invalid_line;
+
+    // ближайшая точка индекса, не превышающая номер строки
+    uint64_t start_line = 0;
+    uint64_t start_offset = 0;
+    if ( m_lines.size() ) {
+        size_t index = std::upper_bound( m_lines.begin(), m_lines.end(), line ) - m_lines.begin() - 1;
+        start_line = m_lines[index];
+        start_offset = m_offsets[index];
+    }
+
+    uint64_t last_error = seek( start_offset );
+    if ( last_error )
+        return last_error;
+
+    // пропустим оставшиеся строки
+    uint64_t skip = line - start_line;
+    alignas(64) char tail[CFileMapSimd::block_size];
+
+    while ( skip ) {
+        if ( eof() )
+            return invalid_line;
+        if ( get_max_copy_ex() == 0 ) {
+            if ( next_region() != 0 )
+                return invalid_line;
+        }
+
+        const char *file = (const char *)get_map_address();
+        uint64_t length = get_max_copy_ex();
+        uint64_t index = 0;
+        for ( ; index < length; index += CFileMapSimd::block_size ) {
+            uint64_t size = ( length - index > CFileMapSimd::block_size ) ? CFileMapSimd::block_size : length - index;
+            const char *block = CFileMapSimd::load_block( file + index, size, tail );
+            uint64_t lines = CFileMapSimd::eq_mask( block, '\n' ) & CFileMapSimd::low_mask( size );
+            uint64_t count = CFileMapSimd::popcount( lines );
+            if ( count < skip ) {
+                skip -= count;
+                continue;
+            }
+            // искомая строка начинается в этом блоке
+            while ( --skip )
+                lines &= lines - 1;
+            index = index + CFileMapSimd::trailing_zeros( lines ) + 1;
+            break;
+        }
+        check_map_region( std::min( index, length ) );
+    }
+
+    return 0;
+}   //  seek_line( uint64_t line )
@@ -0,0 +1,195 @@
+/*!
+ *
+ * \file filemap_index.h
+ * \brief определение класса проекции файла с индексом строк
+ *
+ *  индекс смещений строк строится за один параллельный проход по файлу\n
+ *  и сохраняется в отдельный файл (смещение каждой every-й строки,\n
+ *  дельта-кодирование). По индексу выполняется переход к строке N\n
+ *  без последовательного чтения файла с начала.
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied\n
+ * warranty. In no event will the authors be held liable for any damages\n
+ * arising from the use of this software.\n
+ *
+ * Permission is granted to anyone to use this software for any purpose,\n
+ * including commercial applications, and to alter it and redistribute it\n
+ * freely, subject to the following restrictions:\n
+ *
+ *    1. The origin of this software must not be misrepresented; you must not\n
+ *    claim that you wrote the original software. If you use this software\n
+ *    in a product, an acknowledgment in the product documentation would be\n
+ *    appreciated but is not required.\n
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be\n
+ *    misrepresented as being the original software.\n
+ *    3. This notice may not be removed or altered from any source\n
+ *    distribution.\n
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+#ifndef FILEMAP_INDEX_H
+#define FILEMAP_INDEX_H
+
+#include "filemap.h"
+#include <vector>
+
+
+
+//--------------------------------------------------------------------------------------------------//
+
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief The CFileMapLineIndex class - проекция файла с индексом строк
+///
+/// строка с номером N начинается после N-го символа '\\n' (нумерация с нуля).\n
+/// Индекс хранит смещения каждой every-й строки, поэтому после перехода к\n
+/// ближайшей точке индекса остается пропустить не более every строк\n
+/// (векторный подсчет символов новой строки).\n
+/// Файл индекса проверяется по размеру и времени изменения исходного файла,\n
+/// устаревший индекс не загружается.
+///
+/// \code
+/// CFileMapLineIndex file( limit_memory );
+/// file.set_file_path( file_path );
+/// file.set_file_size( file_size );
+/// if ( file.load_line_index() != 0 )
+///     file.build_line_index();
+/// last_error = file.open_file_map( CFileMap::mode::read );
+/// file.seek_line( 1000000 );
+/// file.read_line( buffer );
+/// \endcode
+///
+class CFileMapLineIndex : public CFileMap
+{
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief конструктор
+    /// \param limit_map_memory - размер ограниения для единовремменого отражения\n
+    ///  файла в память, если равен нулю - то отражается сразу весь файл целиком.
+    ///
+    CFileMapLineIndex( uint64_t limit_map_memory = 0 );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить полное имя файла индекса\n
+    ///  по умолчанию - имя файла с расширением ".lidx"
+    /// \param index_path - полное имя файла индекса
+    ///
+    void set_index_path( const wchar_t *index_path ) {
+        m_index_path = index_path;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить полное имя файла индекса
+    /// \param index_path - полное имя файла индекса
+    ///
+    void set_index_path( const char *index_path ) {
+        m_index_path = char_wstring( index_path );
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief построить индекс строк и сохранить его в файл индекса
+    /// \param every   - шаг индекса (смещение запоминается для каждой every-й строки)
+    /// \param threads - количество потоков, ноль - по числу ядер
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    /// файл делится на участки, кратные гранулярности страниц памяти,\n
+    /// каждый участок просматривается в своем потоке отдельной проекцией.
+    ///
+    uint64_t build_line_index( uint64_t every = 4096, uint32_t threads = 0 );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief загрузить индекс строк из файла индекса
+    /// \return ноль - выполнено успешно, иначе номер ошибки\n
+    ///  (индекс устарел - ESTALE / ERROR_INVALID_DATA)
+    ///
+    uint64_t load_line_index();
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief перейти к началу строки с номером line (нумерация с нуля)
+    /// \param line - номер строки
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    /// работает и при отражении файла целиком, и в блочном режиме,\n
+    /// без загруженного индекса строки отсчитываются от начала файла.
+    ///
+    uint64_t seek_line( uint64_t line );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief количество строк в файле (по индексу)
+    /// \return количество строк, ноль - индекс не построен
+    ///
+    uint64_t get_line_count() const {
+        return m_line_count;
+    }
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief результат просмотра участка файла одним потоком
+    ///
+    struct chunk_info {
+        uint64_t begin;                 // начало участка
+        uint64_t end;                   // конец участка
+        uint64_t lines;                 // количество символов '\n' в участке
+        char     last;                  // последний байт участка
+        uint64_t error;                 // номер ошибки
+        std::vector<uint64_t> offsets;  // начала каждой every-й строки участка
+    };
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief просмотреть участок файла (выполняется в отдельном потоке)
+    /// \param chunk  - участок файла и результат просмотра
+    /// \param every  - шаг индекса
+    /// \param window - размер проекции для просмотра
+    ///
+    void scan_chunk( chunk_info &chunk, uint64_t every, uint64_t window );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить имя файла индекса
+    ///
+    std::wstring index_path();
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief полное имя файла индекса
+    ///
+    std::wstring m_index_path;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief номера строк точек индекса (по возрастанию)
+    ///
+    std::vector<uint64_t> m_lines;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief смещения от начала файла точек индекса
+    ///
+    std::vector<uint64_t> m_offsets;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief количество строк в файле
+    ///
+    uint64_t m_line_count;
+};
+
+#endif // FILEMAP_INDEX_H
@@ -0,0 +1,197 @@
+/*!
+ *
+ * \file filemap_lines.cpp
+ * \brief реализация класса пакетного чтения строк
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+
+
+#include "filemap_lines.h"
+#include "filemap_simd.h"
+#include <algorithm>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// конструктор
+CFileMapArena::CFileMapArena( uint64_t block_size /*= 64*1024*/ )
+{
+    m_block_size = block_size ? block_size : 1;
+    m_current = 0;                  // текущий блок
+    m_offset = 0;                   // занятая часть текущего блока
+    m_used = 0;                     // количество выделенных байт
+}   //  CFileMapArena()
+
+///////////////////////////////////////////////////////////////////////////////
+// выделить память
+char* CFileMapArena::allocate( uint64_t size )
+{
+    // найдем блок с достаточным свободным местом среди уже выделенных
+    while ( m_current < m_blocks.size() && m_blocks[m_current].size - m_offset < size ) {
+        m_current++;
+        m_offset = 0;
+    }
+    if ( m_current == m_blocks.size() ) {
+        block item;
+        item.size = std::max( m_block_size, size );
+        item.data.reset( new char[(size_t)item.size] );
+        m_blocks.push_back( std::move( item ) );
+        m_offset = 0;
+    }
+    char *ptr = m_blocks[m_current].data.get() + m_offset;
+    m_offset += size;
+    m_used += size;
+    return ptr;
+}   //  allocate( uint64_t size )
+
+///////////////////////////////////////////////////////////////////////////////
+// конструктор
+CFileMapLines::CFileMapLines( uint64_t limit_map_memory /*= 0*/ )
+    : CFileMap( limit_map_memory )
+{
+    m_pending = 0;                  // отложенный сдвиг проекции
+}   //  CFileMapLines()
+
+///////////////////////////////////////////////////////////////////////////////
+// открыть файл используя предопределенный режим и сбросить состояние чтения
+uint64_t CFileMapLines::open_file_map ( mode md, uint64_t offset /*= 0*/ )
+{
+    m_pending = 0;
+    m_carry.clear();
+    return CFileMap::open_file_map( md, offset );
+}   //  open_file_map ( mode md, uint64_t offset /*= 0*/ )
+
+///////////////////////////////////////////////////////////////////////////////
+// прочитать пакет строк
+uint64_t CFileMapLines::read_lines( vector<string_view> &lines, CFileMapArena &arena,
+                                    uint64_t max_lines, uint64_t max_bytes /*= UINT64_MAX*/ )
+{
+    lines.clear();
+
+    // сдвинем проекцию на строки предыдущего пакета (они больше не нужны)
+    if ( m_pending ) {
+        check_map_region( m_pending );
+        m_pending = 0;
+    }
+    if ( eof() )
+        return 0;
+    // проверим, сколько байт можно прочитать
+    if ( get_max_copy_ex() == 0 ) {
+        if ( next_region() != 0 )
+            return 0;
+    }
+
+    // буфер для неполного блока в конце проекции
+    alignas(64) char tail[CFileMapSimd::block_size];
+    uint64_t bytes = 0;
+    // флаг true - в пакете есть строки, указывающие в текущую проекцию
+    bool mapped = false;
+    // строка без символов конца строки по режиму set_line_ending(), как в read_line
+    auto make_line = [this]( const char *data, uint64_t length, bool terminated = true ) {
+        return string_view( data, (size_t)line_length( data, length, terminated ) );
+    };
+    // строку, собранную из нескольких проекций, скопируем в арену
+    auto push_carry = [&]( bool terminated ) {
+        char *data = arena.allocate( m_carry.size() );
+        memcpy( data, m_carry.data(), m_carry.size() );
+        lines.push_back( make_line( data, m_carry.size(), terminated ) );
+        m_carry.clear();
+    };
+
+    while ( lines.size() < max_lines && bytes < max_bytes ) {
+        const char *file = (const char *)get_map_address();
+        uint64_t length = get_max_copy_ex();
+        if ( file == nullptr || length == 0 )
+            break;
+
+        // начало очередной строки в проекции
+        uint64_t start = 0;
+        bool full = false;
+        for ( uint64_t index = 0; index < length && full == false; index += CFileMapSimd::block_size ) {
+            uint64_t size = ( length - index > CFileMapSimd::block_size ) ? CFileMapSimd::block_size : length - index;
+            const char *block = CFileMapSimd::load_block( file + index, size, tail );
+            uint64_t mask = CFileMapSimd::eq_mask( block, '\n' ) & CFileMapSimd::low_mask( size );
+            while ( mask ) {
+                uint64_t end = index + CFileMapSimd::trailing_zeros( mask );
+                mask &= mask - 1;
+                if ( m_carry.empty() ) {
+                    lines.push_back( make_line( file + start, end - start ) );
+                    mapped = true;
+                } else {
+                    // конец строки, разбитой между проекциями
+                    m_carry.append( file, (size_t)end );
+                    push_carry( true );
+                }
+                bytes += end + 1 - start;
+                start = end + 1;
+                if ( lines.size() >= max_lines || bytes >= max_bytes ) {
+                    full = true;
+                    break;
+                }
+            }
+        }
+        m_pending = start;
+        if ( full )
+            break;
+
+        if ( m_offset.QuadPart + length >= m_file_size.QuadPart ) {
+            // последняя строка файла без символа новой строки
+            if ( start < length || m_carry.size() ) {
+                if ( m_carry.empty() ) {
+                    lines.push_back( make_line( file + start, length - start, false ) );
+                } else {
+                    m_carry.append( file + start, (size_t)( length - start ) );
+                    push_carry( false );
+                }
+                bytes += length - start;
+            }
+            m_pending = length;
+            break;
+        }
+
+        /* строки пакета указывают в проекцию - следующую проекцию отразит
+         * следующий вызов, разбитая строка начнет следующий пакет */
+        if ( mapped )
+            break;
+
+        // сохраним начало разбитой строки и перейдем к следующей проекции
+        m_carry.append( file + start, (size_t)( length - start ) );
+        m_pending = 0;
+        if ( check_map_region( length ) == nullptr && eof() == false )
+            break;
+        if ( eof() ) {
+            // файл закончился на границе проекции
+            if ( m_carry.size() ) {
+                push_carry( false );
+            }
+            break;
+        }
+    }
+    return lines.size();
+}   //  read_lines( vector<string_view> &lines, CFileMapArena &arena, uint64_t max_lines, uint64_t max_bytes )
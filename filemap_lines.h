@@ -0,0 +1,215 @@
+/*!
+ *
+ * \file filemap_lines.h
+ * \brief определение класса пакетного чтения строк
+ *
+ *  read_lines() за один векторный проход выделяет много строк:\n
+ *  строки внутри проекции возвращаются как std::string_view без\n
+ *  копирования, строки на границе проекций копируются в арену.
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied\n
+ * warranty. In no event will the authors be held liable for any damages\n
+ * arising from the use of this software.\n
+ *
+ * Permission is granted to anyone to use this software for any purpose,\n
+ * including commercial applications, and to alter it and redistribute it\n
+ * freely, subject to the following restrictions:\n
+ *
+ *    1. The origin of this software must not be misrepresented; you must not\n
+ *    claim that you wrote the original software. If you use this software\n
+ *    in a product, an acknowledgment in the product documentation would be\n
+ *    appreciated but is not required.\n
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be\n
+ *    misrepresented as being the original software.\n
+ *    3. This notice may not be removed or altered from any source\n
+ *    distribution.\n
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+#ifndef FILEMAP_LINES_H
+#define FILEMAP_LINES_H
+
+#include "filemap.h"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+
+//--------------------------------------------------------------------------------------------------//
+
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief The CFileMapArena class - арена для строк пакета
+///
+/// память выделяется блоками, адреса выделенных байт не меняются до reset().\n
+/// reset() не освобождает блоки - следующий пакет использует их заново.
+///
+class CFileMapArena
+{
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief конструктор
+    /// \param block_size - размер блока арены
+    ///
+    CFileMapArena( uint64_t block_size = 64*1024 );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief выделить память
+    /// \param size - количество байт
+    /// \return адрес выделенной памяти (действителен до reset())
+    ///
+    char* allocate( uint64_t size );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief освободить всю выделенную память (блоки остаются для повторного использования)
+    ///
+    void reset() {
+        m_current = 0;
+        m_offset = 0;
+        m_used = 0;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить количество выделенных байт после reset()
+    ///
+    uint64_t get_used() const {
+        return m_used;
+    }
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief блок арены
+    ///
+    struct block {
+        std::unique_ptr<char[]> data;   // память блока
+        uint64_t                size;   // размер блока
+    };
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief размер нового блока
+    ///
+    uint64_t m_block_size;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief блоки арены
+    ///
+    std::vector<block> m_blocks;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief текущий блок
+    ///
+    size_t m_current;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief занятая часть текущего блока
+    ///
+    uint64_t m_offset;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief количество выделенных байт
+    ///
+    uint64_t m_used;
+};
+
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief The CFileMapLines class - пакетное чтение строк
+///
+/// read_lines() просматривает проекцию блоками по 64 байта (маска символов\n
+/// новой строки) и возвращает до max_lines строк (или пока не набрано\n
+/// max_bytes байт) без символа новой строки (CR перед LF отбрасывается,\n
+/// кроме режима lf set_line_ending(); режим crlf читается как mixed).\n
+/// Строки пакета, лежащие в проекции, указывают прямо в нее, поэтому пакет\n
+/// не переходит к следующей проекции после такой строки: строка, разбитая\n
+/// между проекциями, начинает следующий пакет и копируется в арену.\n
+/// Сдвиг проекции на прочитанные строки откладывается до следующего вызова.\n
+/// Строки действительны до следующего вызова read_lines() и arena.reset().
+///
+/// \code
+/// CFileMapLines file( limit_memory );
+/// file.set_file_path( file_path );
+/// file.set_file_size( file_size );
+/// last_error = file.open_file_map( CFileMap::mode::read );
+/// CFileMapArena arena;
+/// std::vector<std::string_view> lines;
+/// while ( file.read_lines( lines, arena, 4096 ) ) {
+///     ...
+///     arena.reset();
+/// }
+/// \endcode
+///
+class CFileMapLines : public CFileMap
+{
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief конструктор
+    /// \param limit_map_memory - размер ограниения для единовремменого отражения\n
+    ///  файла в память, если равен нулю - то отражается сразу весь файл целиком.
+    ///
+    CFileMapLines( uint64_t limit_map_memory = 0 );
+
+public:
+    using CFileMap::open_file_map;
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief  открыть файл используя предопределенный режим\n
+    ///  и сбросить состояние чтения
+    /// \param  md - режим обработки файла и проекции ( read, write, append )
+    /// \param  offset - смещение байт от начала файла
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    /// @see CFileMap::open_file_map
+    ///
+    uint64_t open_file_map ( mode md, uint64_t offset = 0 );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief прочитать пакет строк
+    /// \param lines - строки пакета (заполняется заново)
+    /// \param arena - арена для строк, разбитых между проекциями
+    /// \param max_lines - максимальное количество строк
+    /// \param max_bytes - пакет заканчивается, когда прочитано не меньше\n
+    ///  max_bytes байт (вместе с символами новой строки)
+    /// \return количество строк, ноль - строк больше нет
+    ///
+    uint64_t read_lines( std::vector<std::string_view> &lines, CFileMapArena &arena,
+                         uint64_t max_lines, uint64_t max_bytes = UINT64_MAX );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief количество прочитанных байт текущей проекции, на которое еще\n
+    ///  не сдвинута проекция (строки пакета указывают в проекцию)
+    ///
+    uint64_t m_pending;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief начало строки, разбитой между проекциями
+    ///
+    std::string m_carry;
+};
+
+#endif // FILEMAP_LINES_H
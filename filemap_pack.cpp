@@ -0,0 +1,766 @@
+/*!
+ *
+ * \file filemap_pack.cpp
+ * \brief реализация класса проекции файла, сжатого блоками
+ *
+ *  контейнер из независимо сжатых блоков фиксированного размера\n
+ *  и индекса блоков в конце файла.
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+#include "filemap_pack.h"
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <stdint.h>
+#include <errno.h>
+#if defined(FILEMAP_LZ4)
+#include <lz4.h>
+#endif
+#if defined(FILEMAP_ZSTD)
+#include <zstd.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+const char PACK_MAGIC[8]    = { 'F','M','P','A','C','K','0','1' };
+const char TRAILER_MAGIC[8] = { 'F','M','P','A','C','K','I','X' };
+
+// заголовок файла
+struct pack_header {
+    char     magic[8];      // сигнатура файла
+    uint32_t block_size;    // размер несжатого блока
+    uint32_t reserved;      // выравнивание
+};
+
+// окончание файла
+struct pack_trailer {
+    uint64_t index_offset;  // смещение индекса блоков
+    uint64_t block_count;   // количество блоков
+    uint64_t data_size;     // размер несжатых данных
+    char     magic[8];      // сигнатура окончания
+};
+
+#if !defined(FILEMAP_LZ4)
+inline uint32_t read32( const uint8_t *p )
+{
+    uint32_t value;
+    memcpy( &value, p, sizeof(value) );
+    return value;
+}
+
+// записать длину LZ4 (15 в токене + байты по 255)
+inline bool put_length( uint8_t *&op, const uint8_t *oend, uint64_t length )
+{
+    for ( ; length >= 255; length -= 255 ) {
+        if ( op >= oend )
+            return false;
+        *op++ = 255;
+    }
+    if ( op >= oend )
+        return false;
+    *op++ = (uint8_t)length;
+    return true;
+}
+
+/* сжатие в формат блока LZ4: последовательности (токен, литералы,
+ * смещение совпадения, длина совпадения). Жадный поиск по хешу 4 байт.
+ * По правилам формата последние 5 байт - всегда литералы, а последнее
+ * совпадение начинается не ближе 12 байт к концу блока. */
+uint64_t lz4_compress( const char *source, uint64_t length, char *dest, uint64_t capacity )
+{
+    const uint8_t *src = (const uint8_t *)source;
+    const uint8_t *ip = src;
+    const uint8_t *anchor = src;
+    const uint8_t *iend = src + length;
+    uint8_t *op = (uint8_t *)dest;
+    const uint8_t *oend = op + capacity;
+    vector<uint32_t> table( 4096, 0 );
+
+    if ( length >= 13 ) {
+        const uint8_t *mflimit = iend - 12;
+        const uint8_t *matchlimit = iend - 5;
+        while ( ip < mflimit ) {
+            uint32_t sequence = read32( ip );
+            uint32_t hash = ( sequence * 2654435761u ) >> 20;
+            const uint8_t *ref = src + table[hash];
+            table[hash] = (uint32_t)( ip - src );
+            if ( ref >= ip || ip - ref > 65535 || read32( ref ) != sequence ) {
+                ip++;
+                continue;
+            }
+
+            const uint8_t *match_end = ip + 4;
+            const uint8_t *ref_end = ref + 4;
+            while ( match_end < matchlimit && *match_end == *ref_end ) {
+                match_end++;
+                ref_end++;
+            }
+
+            uint64_t literals = ip - anchor;
+            uint64_t match = match_end - ip - 4;
+            if ( op >= oend )
+                return 0;
+            uint8_t *token = op++;
+            *token = (uint8_t)( ( std::min<uint64_t>( literals, 15 ) << 4 ) | std::min<uint64_t>( match, 15 ) );
+            if ( literals >= 15 && !put_length( op, oend, literals - 15 ) )
+                return 0;
+            if ( op + literals + 2 > oend )
+                return 0;
+            memcpy( op, anchor, (size_t)literals );
+            op += literals;
+            uint64_t distance = ip - ref;
+            *op++ = (uint8_t)( distance & 0xFF );
+            *op++ = (uint8_t)( distance >> 8 );
+            if ( match >= 15 && !put_length( op, oend, match - 15 ) )
+                return 0;
+
+            ip = match_end;
+            anchor = ip;
+        }
+    }
+
+    // последние литералы
+    uint64_t literals = iend - anchor;
+    if ( op >= oend )
+        return 0;
+    *op++ = (uint8_t)( std::min<uint64_t>( literals, 15 ) << 4 );
+    if ( literals >= 15 && !put_length( op, oend, literals - 15 ) )
+        return 0;
+    if ( op + literals > oend )
+        return 0;
+    memcpy( op, anchor, (size_t)literals );
+    op += literals;
+
+    return (uint64_t)( op - (uint8_t *)dest );
+}
+
+// распаковка формата блока LZ4 с проверкой границ
+bool lz4_decompress( const char *source, uint64_t length, char *dest, uint64_t size )
+{
+    const uint8_t *ip = (const uint8_t *)source;
+    const uint8_t *iend = ip + length;
+    uint8_t *op = (uint8_t *)dest;
+    uint8_t *oend = op + size;
+
+    while ( ip < iend ) {
+        uint8_t token = *ip++;
+        uint64_t literals = token >> 4;
+        if ( literals == 15 ) {
+            uint8_t byte = 0;
+            do {
+                if ( ip >= iend )
+                    return false;
+                byte = *ip++;
+                literals += byte;
+            } while ( byte == 255 );
+        }
+        if ( (uint64_t)(iend - ip) < literals || (uint64_t)(oend - op) < literals )
+            return false;
+        memcpy( op, ip, (size_t)literals );
+        op += literals;
+        ip += literals;
+        if ( ip >= iend )
+            break;
+
+        if ( iend - ip < 2 )
+            return false;
+        uint64_t distance = ip[0] | ( (uint64_t)ip[1] << 8 );
+        ip += 2;
+        if ( distance == 0 || distance > (uint64_t)( op - (uint8_t *)dest ) )
+            return false;
+        uint64_t match = token & 15;
+        if ( match == 15 ) {
+            uint8_t byte = 0;
+            do {
+                if ( ip >= iend )
+                    return false;
+                byte = *ip++;
+                match += byte;
+            } while ( byte == 255 );
+        }
+        match += 4;
+        if ( (uint64_t)(oend - op) < match )
+            return false;
+        // совпадение может перекрывать само себя - копируем побайтно
+        const uint8_t *ref = op - distance;
+        for ( uint64_t index = 0; index < match; index++ )
+            op[index] = ref[index];
+        op += match;
+    }
+
+    return op == oend;
+}
+#endif  // !defined(FILEMAP_LZ4)
+
+// сжать блок, ноль - блок не уменьшился (хранится без сжатия)
+uint64_t pack_block( CFileMapPack::codec method, const char *source, uint64_t length,
+                     char *dest, uint64_t capacity )
+{
+    switch ( method ) {
+    case CFileMapPack::codec::lz4:
+#       if defined(FILEMAP_LZ4)
+        return (uint64_t)std::max( 0, LZ4_compress_default( source, dest, (int)length, (int)capacity ) );
+#       else
+        return lz4_compress( source, length, dest, capacity );
+#       endif
+    case CFileMapPack::codec::zstd:
+#       if defined(FILEMAP_ZSTD)
+        {
+            size_t result = ZSTD_compress( dest, (size_t)capacity, source, (size_t)length, 3 );
+            return ZSTD_isError( result ) ? 0 : (uint64_t)result;
+        }
+#       else
+        return 0;
+#       endif
+    default:
+        return 0;
+    }
+}
+
+// распаковать блок
+bool unpack_block( uint32_t method, const char *source, uint64_t length, char *dest, uint64_t size )
+{
+    switch ( (CFileMapPack::codec)method ) {
+    case CFileMapPack::codec::stored:
+        if ( length != size )
+            return false;
+        memcpy( dest, source, (size_t)size );
+        return true;
+    case CFileMapPack::codec::lz4:
+#       if defined(FILEMAP_LZ4)
+        return LZ4_decompress_safe( source, dest, (int)length, (int)size ) == (int)size;
+#       else
+        return lz4_decompress( source, length, dest, size );
+#       endif
+    case CFileMapPack::codec::zstd:
+#       if defined(FILEMAP_ZSTD)
+        return ZSTD_decompress( dest, (size_t)size, source, (size_t)length ) == (size_t)size;
+#       else
+        return false;
+#       endif
+    default:
+        return false;
+    }
+}
+
+}   // namespace
+
+///////////////////////////////////////////////////////////////////////////////
+// конструктор
+CFileMapPack::CFileMapPack( uint64_t limit_map_memory /*= 0*/ )
+    : CFileMap( limit_map_memory )
+{
+    m_mode = mode::read;            // режим, в котором открыт файл
+    m_block_size = 256 * 1024;      // размер несжатого блока
+    m_codec = codec::lz4;           // метод сжатия новых блоков
+    m_data_size = 0;                // размер несжатых данных
+    m_data_limit = 0;               // максимальный размер несжатых данных при записи
+    m_position = 0;                 // текущая позиция в несжатых данных
+    m_threads = std::max( 1u, std::thread::hardware_concurrency() );
+    // в кеше должны поместиться блоки, распакованные за один раз
+    m_cache_blocks = std::max( 8u, m_threads );
+    m_used = 0;                     // счетчик обращений к кешу
+    m_last_block = UINT64_MAX;      // последний запрошенный блок
+    m_job = nullptr;                // текущее задание потоков распаковки
+    m_job_pending = 0;              // количество невыполненных заданий
+    m_job_stop = false;             // признак остановки потоков распаковки
+}   //  CFileMapPack()
+
+///////////////////////////////////////////////////////////////////////////////
+// деструктор
+CFileMapPack::~CFileMapPack()
+{
+    close_file_map();
+    stop_workers();
+}   //  ~CFileMapPack()
+
+///////////////////////////////////////////////////////////////////////////////
+// установить размер кеша распакованных блоков и количество потоков
+void CFileMapPack::set_cache( uint32_t cache_blocks, uint32_t threads /*= 0*/ )
+{
+    if ( threads == 0 )
+        threads = std::max( 1u, std::thread::hardware_concurrency() );
+    // потоки распаковки будут созданы заново в нужном количестве
+    if ( threads != m_threads )
+        stop_workers();
+    m_threads = threads;
+    // в кеше должны поместиться блоки, распакованные за один раз
+    m_cache_blocks = std::max( std::max( cache_blocks, threads ), 1u );
+}   //  set_cache( uint32_t cache_blocks, uint32_t threads /*= 0*/ )
+
+///////////////////////////////////////////////////////////////////////////////
+// открыть сжатый файл
+uint64_t CFileMapPack::open_file_map( mode md )
+{
+#   if defined(OS_WIN)
+    const uint64_t invalid_data = ERROR_INVALID_DATA;
+#   else
+    const uint64_t invalid_data = EINVAL;
+#   endif  // defined(OS_WIN)
+
+    uint64_t last_error = 0;
+    m_mode = md;
+    m_position = 0;
+    m_blocks.clear();
+    m_cache.clear();
+    m_buffer.clear();
+    m_last_block = UINT64_MAX;
+
+    try
+    {
+        if ( md == mode::write ) {
+            /* размер файла с запасом: несжатый блок, который не уменьшился,
+             * хранится как есть, поэтому сжатые данные не больше исходных */
+            uint64_t blocks = m_data_size / m_block_size + 1;
+            uint64_t capacity = sizeof(pack_header) + m_data_size +
+                                blocks * sizeof(block_info) + sizeof(pack_trailer);
+            CFileMap::set_file_size( capacity );
+            last_error = CFileMap::open_file_map( mode::write );
+            if ( last_error )
+                throw last_error;
+
+            pack_header header;
+            memcpy( header.magic, PACK_MAGIC, sizeof(header.magic) );
+            header.block_size = m_block_size;
+            header.reserved = 0;
+            CFileMap::write( (const char *)&header, sizeof(header) );
+            m_buffer.reserve( m_block_size );
+            m_data_limit = m_data_size;
+            m_data_size = 0;
+        } else if ( md == mode::read ) {
+            uint64_t file_size = 0;
+            uint64_t file_time = 0;
+            last_error = get_file_info( file_size, file_time );
+            if ( last_error )
+                throw last_error;
+            if ( file_size < sizeof(pack_header) + sizeof(pack_trailer) )
+                throw invalid_data;
+            CFileMap::set_file_size( file_size );
+            last_error = CFileMap::open_file_map( mode::read );
+            if ( last_error )
+                throw last_error;
+
+            // заголовок, окончание и индекс блоков
+            pack_header header;
+            pack_trailer trailer;
+            if ( CFileMap::read_at( 0, (char *)&header, sizeof(header) ) != sizeof(header) ||
+                 CFileMap::read_at( file_size - sizeof(trailer), (char *)&trailer,
+                                    sizeof(trailer) ) != sizeof(trailer) ||
+                 memcmp( header.magic, PACK_MAGIC, sizeof(header.magic) ) != 0 ||
+                 memcmp( trailer.magic, TRAILER_MAGIC, sizeof(trailer.magic) ) != 0 ||
+                 header.block_size == 0 ||
+                 trailer.index_offset < sizeof(header) ||
+                 trailer.index_offset > file_size - sizeof(trailer) ||
+                 trailer.block_count != ( file_size - sizeof(trailer) - trailer.index_offset ) / sizeof(block_info) ||
+                 ( file_size - sizeof(trailer) - trailer.index_offset ) % sizeof(block_info) != 0 ) {
+                throw invalid_data;
+            }
+            m_block_size = header.block_size;
+            m_blocks.resize( (size_t)trailer.block_count );
+            uint64_t length = trailer.block_count * sizeof(block_info);
+            if ( length && CFileMap::read_at( trailer.index_offset, (char *)m_blocks.data(), length ) != length )
+                throw invalid_data;
+
+            /* индекс проверяется целиком: сжатые блоки лежат между заголовком
+             * и индексом, все блоки, кроме последнего, полные, сумма размеров
+             * блоков равна размеру несжатых данных */
+            uint64_t data_size = 0;
+            for ( size_t k = 0; k < m_blocks.size(); k++ ) {
+                const block_info &block = m_blocks[k];
+                if ( block.offset < sizeof(header) ||
+                     block.packed > trailer.index_offset ||
+                     block.offset > trailer.index_offset - block.packed ||
+                     block.size == 0 || block.size > m_block_size ||
+                     ( k + 1 < m_blocks.size() && block.size != m_block_size ) ) {
+                    throw invalid_data;
+                }
+                data_size += block.size;
+            }
+            if ( data_size != trailer.data_size )
+                throw invalid_data;
+            m_data_size = trailer.data_size;
+        } else {
+            throw invalid_data;
+        }
+    }
+    catch( uint64_t error ) {
+        last_error = error;
+        if ( md == mode::read ) {
+            // непроверенный индекс не используется
+            m_blocks.clear();
+            m_data_size = 0;
+        }
+        cout<< "an error number \"" << error << "\" is generated in the method CFileMapPack::open_file_map" <<endl;
+    }
+
+    return last_error;
+}   //  open_file_map( mode md )
+
+///////////////////////////////////////////////////////////////////////////////
+// закрывает объект
+uint64_t CFileMapPack::close_file_map()
+{
+#   if defined(OS_WIN)
+    const uint64_t disk_full = ERROR_DISK_FULL;
+#   else
+    const uint64_t disk_full = ENOSPC;
+#   endif  // defined(OS_WIN)
+
+    uint64_t last_error = 0;
+    if ( m_mode == mode::write && is_open() ) {
+        try
+        {
+            // последний неполный блок, индекс блоков и окончание
+            if ( m_buffer.length() ) {
+                last_error = flush_block();
+                if ( last_error )
+                    throw last_error;
+            }
+
+            pack_trailer trailer;
+            trailer.index_offset = CFileMap::get_file_offset();
+            trailer.block_count = m_blocks.size();
+            trailer.data_size = m_data_size;
+            memcpy( trailer.magic, TRAILER_MAGIC, sizeof(trailer.magic) );
+            uint64_t length = m_blocks.size() * sizeof(block_info);
+            if ( length && CFileMap::write( (const char *)m_blocks.data(), length ) != length )
+                throw disk_full;
+            if ( CFileMap::write( (const char *)&trailer, sizeof(trailer) ) != sizeof(trailer) )
+                throw disk_full;
+        }
+        catch( uint64_t error ) {
+            last_error = error;
+            cout<< "an error number \"" << error << "\" is generated in the method CFileMapPack::close_file_map" <<endl;
+        }
+        CFileMap::close_file_map( true );
+    } else {
+        CFileMap::close_file_map();
+    }
+    m_mode = mode::read;
+    m_blocks.clear();
+    m_cache.clear();
+    m_buffer.clear();
+    m_position = 0;
+    return last_error;
+}   //  close_file_map()
+
+///////////////////////////////////////////////////////////////////////////////
+// установить текущую позицию в несжатых данных
+uint64_t CFileMapPack::seek( uint64_t offset )
+{
+    if ( m_mode != mode::read || offset > m_data_size ) {
+#       if defined(OS_WIN)
+        return ERROR_INVALID_PARAMETER;
+#       else
+        return EINVAL;
+#       endif  // defined(OS_WIN)
+    }
+    m_position = offset;
+    return 0;
+}   //  seek( uint64_t offset )
+
+///////////////////////////////////////////////////////////////////////////////
+// записать данные в файл
+uint64_t CFileMapPack::write( const char *str, uint64_t length )
+{
+    if ( m_mode != mode::write || !is_open() )
+        return 0;
+
+    // запас в файле рассчитан на размер, заданный set_file_size()
+    if ( length > m_data_limit - m_data_size )
+        length = m_data_limit - m_data_size;
+
+    // счетчик скопированных байт
+    uint64_t copied = 0;
+    while ( copied < length ) {
+        uint64_t size = std::min<uint64_t>( length - copied, m_block_size - m_buffer.length() );
+        m_buffer.append( str + copied, (size_t)size );
+        if ( m_buffer.length() == m_block_size && flush_block() != 0 ) {
+            // данные, которые не удалось записать, не учитываются
+            m_buffer.resize( m_buffer.length() - size );
+            break;
+        }
+        copied += size;
+    }
+    m_data_size += copied;
+    m_position = m_data_size;
+    return copied;
+}   //  write( const char *str, uint64_t length )
+
+///////////////////////////////////////////////////////////////////////////////
+// сжать накопленный блок и записать в файл
+uint64_t CFileMapPack::flush_block()
+{
+    block_info block;
+    block.offset = CFileMap::get_file_offset();
+    block.size = (uint32_t)m_buffer.length();
+    block.reserved = 0;
+
+    m_packed.resize( m_buffer.length() );
+    uint64_t packed = pack_block( m_codec, m_buffer.data(), m_buffer.length(),
+                                  &m_packed[0], m_packed.length() );
+    const char *data = m_packed.data();
+    if ( packed == 0 || packed >= m_buffer.length() ) {
+        // блок не уменьшился - хранится без сжатия
+        packed = m_buffer.length();
+        data = m_buffer.data();
+        block.method = (uint32_t)codec::stored;
+    } else {
+        block.method = (uint32_t)m_codec;
+    }
+    block.packed = (uint32_t)packed;
+
+    // data может указывать на m_buffer - буфер очищается только после записи
+    if ( CFileMap::write( data, packed ) != packed ) {
+#       if defined(OS_WIN)
+        return ERROR_DISK_FULL;
+#       else
+        return ENOSPC;
+#       endif  // defined(OS_WIN)
+    }
+    m_buffer.clear();
+    m_blocks.push_back( block );
+    return 0;
+}   //  flush_block()
+
+///////////////////////////////////////////////////////////////////////////////
+// получить распакованный блок
+const string* CFileMapPack::get_block( uint64_t index )
+{
+    m_used++;
+    for ( cache_entry &entry : m_cache ) {
+        if ( entry.block == index ) {
+            entry.used = m_used;
+            m_last_block = index;
+            return &entry.data;
+        }
+    }
+
+    /* при последовательном чтении распакуем сразу несколько следующих
+     * блоков в параллельных потоках */
+    uint64_t count = 1;
+    if ( index == m_last_block + 1 && m_threads > 1 )
+        count = std::min<uint64_t>( std::min( m_threads, m_cache_blocks ), m_blocks.size() - index );
+    m_last_block = index;
+
+    // сжатые данные читаются из проекции последовательно, распаковка - параллельно
+    vector<string> packed( (size_t)count );
+    vector<cache_entry> unpacked( (size_t)count );
+    vector<char> result( (size_t)count, 0 );
+    for ( uint64_t k = 0; k < count; k++ ) {
+        const block_info &block = m_blocks[(size_t)(index + k)];
+        packed[k].resize( block.packed );
+        if ( CFileMap::read_at( block.offset, &packed[k][0], block.packed ) != block.packed )
+            return nullptr;
+        unpacked[k].block = index + k;
+        unpacked[k].used = m_used;
+        unpacked[k].data.resize( block.size );
+    }
+
+    auto unpack = [&]( uint64_t k ) {
+        const block_info &block = m_blocks[(size_t)(index + k)];
+        result[k] = unpack_block( block.method, packed[k].data(), block.packed,
+                                  &unpacked[k].data[0], block.size );
+    };
+    run_parallel( count, unpack );
+
+    for ( uint64_t k = 0; k < count; k++ ) {
+        if ( result[k] == 0 )
+            break;
+        // вытесним блок, к которому дольше всего не обращались
+        if ( m_cache.size() >= m_cache_blocks ) {
+            auto oldest = std::min_element( m_cache.begin(), m_cache.end(),
+                []( const cache_entry &a, const cache_entry &b ) { return a.used < b.used; } );
+            m_cache.erase( oldest );
+        }
+        m_cache.push_back( std::move( unpacked[k] ) );
+    }
+
+    // запрошенный блок - первый из распакованных
+    for ( cache_entry &entry : m_cache ) {
+        if ( entry.block == index )
+            return &entry.data;
+    }
+    return nullptr;
+}   //  get_block( uint64_t index )
+
+///////////////////////////////////////////////////////////////////////////////
+// выполнить задания в текущем потоке и в потоках распаковки
+void CFileMapPack::run_parallel( uint64_t count, const std::function<void(uint64_t)> &job )
+{
+    if ( count > 1 ) {
+        // потоки создаются один раз, а не на каждую порцию блоков
+        while ( m_workers.size() + 1 < m_threads )
+            m_workers.emplace_back( &CFileMapPack::worker, this );
+        {
+            lock_guard<mutex> lock( m_job_lock );
+            m_job = &job;
+            for ( uint64_t k = count - 1; k > 0; k-- )
+                m_job_queue.push_back( k );
+            m_job_pending = count - 1;
+        }
+        m_job_signal.notify_all();
+    }
+
+    job( 0 );
+
+    if ( count > 1 ) {
+        // текущий поток тоже берет задания, затем ждет завершения остальных
+        for ( ;; ) {
+            uint64_t k = 0;
+            {
+                lock_guard<mutex> lock( m_job_lock );
+                if ( m_job_queue.empty() )
+                    break;
+                k = m_job_queue.back();
+                m_job_queue.pop_back();
+            }
+            job( k );
+            lock_guard<mutex> lock( m_job_lock );
+            m_job_pending--;
+        }
+        unique_lock<mutex> lock( m_job_lock );
+        m_job_done.wait( lock, [this]() { return m_job_pending == 0; } );
+        m_job = nullptr;
+    }
+}   //  run_parallel( uint64_t count, const std::function<void(uint64_t)> &job )
+
+///////////////////////////////////////////////////////////////////////////////
+// выполнять задания (поток распаковки)
+void CFileMapPack::worker()
+{
+    for ( ;; ) {
+        uint64_t k = 0;
+        const std::function<void(uint64_t)> *job = nullptr;
+        {
+            unique_lock<mutex> lock( m_job_lock );
+            m_job_signal.wait( lock, [this]() { return m_job_stop || !m_job_queue.empty(); } );
+            if ( m_job_queue.empty() )
+                return;
+            k = m_job_queue.back();
+            m_job_queue.pop_back();
+            job = m_job;
+        }
+        (*job)( k );
+        lock_guard<mutex> lock( m_job_lock );
+        if ( --m_job_pending == 0 )
+            m_job_done.notify_all();
+    }
+}   //  worker()
+
+///////////////////////////////////////////////////////////////////////////////
+// остановить потоки распаковки
+void CFileMapPack::stop_workers()
+{
+    {
+        lock_guard<mutex> lock( m_job_lock );
+        m_job_stop = true;
+    }
+    m_job_signal.notify_all();
+    for ( thread &th : m_workers )
+        th.join();
+    m_workers.clear();
+    m_job_stop = false;
+}   //  stop_workers()
+
+///////////////////////////////////////////////////////////////////////////////
+// прочитать данные из файла
+uint64_t CFileMapPack::read( char *dest, uint64_t length )
+{
+    if ( m_mode != mode::read )
+        return 0;
+
+    // счетчик скопированных байт
+    uint64_t copied = 0;
+    while ( copied < length && !eof() ) {
+        const string *block = get_block( m_position / m_block_size );
+        if ( block == nullptr )
+            break;
+        uint64_t from = m_position % m_block_size;
+        uint64_t size = std::min<uint64_t>( length - copied, block->length() - from );
+        memcpy( dest + copied, block->data() + from, (size_t)size );
+        copied += size;
+        m_position += size;
+    }
+    return copied;
+}   //  read( char *dest, uint64_t length )
+
+///////////////////////////////////////////////////////////////////////////////
+// прочитать данные с указанного смещения несжатых данных
+uint64_t CFileMapPack::read_at( uint64_t offset, char *dest, uint64_t length )
+{
+    if ( seek( offset ) != 0 )
+        return 0;
+    return read( dest, length );
+}   //  read_at( uint64_t offset, char *dest, uint64_t length )
+
+///////////////////////////////////////////////////////////////////////////////
+// прочитать строку из файла
+uint64_t CFileMapPack::read_line( char *dest )
+{
+    if ( m_mode != mode::read )
+        return 0;
+
+    // счетчик скопированных байт
+    uint64_t length = 0;
+    // найден конец строки
+    bool found_line = false;
+    while ( !eof() && !found_line ) {
+        const string *block = get_block( m_position / m_block_size );
+        if ( block == nullptr )
+            break;
+        uint64_t from = m_position % m_block_size;
+        const char *data = block->data() + from;
+        uint64_t size = block->length() - from;
+        detect_line_ending( data, size );
+        // в режиме crlf LF без CR перед ним (в том числе в конце предыдущего блока) - не конец строки
+        const char *found = data;
+        while ( (found = (const char *)memchr( found, '\n', (size_t)( data + size - found ) )) != nullptr ) {
+            if ( get_line_ending() != line_ending::crlf )
+                break;
+            if ( found != data ? found[-1] == '\r' : ( length && dest[length-1] == '\r' ) )
+                break;
+            found++;
+        }
+        if ( found ) {
+            size = (uint64_t)( found - data ) + 1;
+            found_line = true;
+        }
+        memcpy( dest + length, data, (size_t)size );
+        length += size;
+        m_position += size;
+    }
+
+    // символ(ы) новой строки в результат не входят
+    if ( found_line )
+        length = line_length( dest, length - 1 );
+    return length;
+}   //  read_line( char *dest )
@@ -0,0 +1,440 @@
+/*!
+ *
+ * \file filemap_pack.h
+ * \brief определение класса проекции файла, сжатого блоками
+ *
+ *  контейнер из независимо сжатых блоков фиксированного размера\n
+ *  и индекса блоков в конце файла. read, read_line и read_at работают\n
+ *  с несжатыми (логическими) данными, распакованные блоки кешируются,\n
+ *  при последовательном чтении блоки распаковываются параллельно.
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied\n
+ * warranty. In no event will the authors be held liable for any damages\n
+ * arising from the use of this software.\n
+ *
+ * Permission is granted to anyone to use this software for any purpose,\n
+ * including commercial applications, and to alter it and redistribute it\n
+ * freely, subject to the following restrictions:\n
+ *
+ *    1. The origin of this software must not be misrepresented; you must not\n
+ *    claim that you wrote the original software. If you use this software\n
+ *    in a product, an acknowledgment in the product documentation would be\n
+ *    appreciated but is not required.\n
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be\n
+ *    misrepresented as being the original software.\n
+ *    3. This notice may not be removed or altered from any source\n
+ *    distribution.\n
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+#ifndef FILEMAP_PACK_H
+#define FILEMAP_PACK_H
+
+#include "filemap.h"
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+
+//--------------------------------------------------------------------------------------------------//
+
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief The CFileMapPack class - проекция файла, сжатого блоками
+///
+/// формат файла:\n
+///   заголовок (сигнатура, размер блока)\n
+///   сжатые блоки, каждый распаковывается независимо\n
+///   индекс блоков (смещение, сжатый и исходный размер, метод сжатия)\n
+///   окончание (смещение индекса, количество блоков, размер данных)\n
+///
+/// методы сжатия: LZ4 (встроенная реализация формата блока LZ4, при\n
+/// FILEMAP_LZ4 - библиотека liblz4), zstd при FILEMAP_ZSTD. Блок, который\n
+/// не уменьшился при сжатии, хранится как есть.\n
+///
+/// При записи set_file_size() задает максимальный размер несжатых данных,\n
+/// файл создается с запасом и при закрытии подгоняется под размер данных.\n
+/// При чтении размер берется из файла, set_file_size() не нужен.
+///
+/// \code
+/// CFileMapPack pack;
+/// pack.set_file_path( file_path );
+/// pack.set_file_size( data_size );
+/// pack.open_file_map( CFileMap::mode::write );
+/// pack.write( data, data_size );
+/// pack.close_file_map();
+/// ...
+/// pack.open_file_map( CFileMap::mode::read );
+/// while ( !pack.eof() )
+///     length = pack.read_line( buffer );
+/// \endcode
+///
+class CFileMapPack : public CFileMap
+{
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief метод сжатия блока
+    ///
+    enum class codec : uint32_t
+    {
+        /*! блок хранится без сжатия */
+        stored = 0,
+        /*! формат блока LZ4 */
+        lz4 = 1,
+        /*! zstd (только при FILEMAP_ZSTD) */
+        zstd = 2
+    };
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief конструктор
+    /// \param limit_map_memory - размер ограниения для единовремменого отражения\n
+    ///  сжатого файла в память, если равен нулю - то отражается весь файл целиком.
+    ///
+    CFileMapPack( uint64_t limit_map_memory = 0 );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief деструктор (при записи дописывает индекс блоков)
+    ///
+    ~CFileMapPack();
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief  открыть сжатый файл
+    /// \param  md - режим обработки файла ( read, write )
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t open_file_map( mode md );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief закрывает объект, при записи сжимает последний блок\n
+    ///  и дописывает индекс блоков, размер файла подгоняется под данные
+    /// \return ноль - выполнено успешно, иначе номер ошибки\n
+    ///  (при записи - файл без индекса не может быть прочитан)
+    ///
+    uint64_t close_file_map();
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить размер несжатых данных (при записи - максимальный)
+    /// \param file_size - размер данных
+    ///
+    void set_file_size( uint64_t file_size ) {
+        m_data_size = file_size;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить размер блока и метод сжатия (до открытия на запись)
+    /// \param block_size - размер несжатого блока
+    /// \param method - метод сжатия
+    ///
+    void set_block( uint32_t block_size, codec method = codec::lz4 ) {
+        if ( m_blocks.empty() && block_size ) {
+            m_block_size = block_size;
+            m_codec = method;
+        }
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить размер кеша распакованных блоков и количество потоков
+    /// \param cache_blocks - количество блоков в кеше
+    /// \param threads - количество потоков распаковки, ноль - по числу ядер
+    ///
+    /// потоки распаковки создаются при первом последовательном чтении\n
+    /// и работают до разрушения объекта (или до изменения их количества)
+    ///
+    void set_cache( uint32_t cache_blocks, uint32_t threads = 0 );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief end of file (несжатых данных)
+    /// \return true- end of file
+    ///
+    bool eof() {
+        return ( m_position >= m_data_size );
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить размер несжатых данных
+    ///
+    uint64_t get_data_size() const {
+        return m_data_size;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить текущее смещение от начала несжатых данных
+    ///
+    uint64_t get_file_offset() const {
+        return m_position;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить текущую позицию в несжатых данных (только чтение)
+    /// \param offset - смещение от начала несжатых данных
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t seek( uint64_t offset );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief записать данные в файл
+    /// \param str - данные для записи
+    /// \param length - количство байт для записи
+    /// \return количество записанных байт
+    ///
+    /// всего записывается не больше размера, заданного set_file_size()
+    ///
+    uint64_t write( const char *str, uint64_t length );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief записать строку в файл (добавляет символ новой строки)
+    /// \param str - строка для записи
+    /// \return количество записанных байт
+    ///
+    uint64_t write_line( std::string &str ) {
+        str.append( m_new_line );
+        return write( str.c_str(), str.length() );
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief прочитать строку из файла
+    /// \param dest - буфер для записи строки из файла
+    /// \return количество прочитанных байт (без символов новой строки)
+    ///
+    /// конец строки - в соответствии с режимом set_line_ending(), как в CFileMap::read_line()
+    ///
+    uint64_t read_line( char *dest );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief прочитать данные из файла
+    /// \param dest - буфер для записи данных из файла
+    /// \param length - максимальное количество байт, которе может принять буфер
+    /// \return количество прочитанных байт
+    ///
+    uint64_t read( char *dest, uint64_t length );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief прочитать данные с указанного смещения несжатых данных
+    /// \param offset - смещение от начала несжатых данных
+    /// \param dest - буфер для записи данных из файла
+    /// \param length - максимальное количество байт, которе может принять буфер
+    /// \return количество прочитанных байт
+    ///
+    uint64_t read_at( uint64_t offset, char *dest, uint64_t length );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief описание блока в индексе
+    ///
+    struct block_info {
+        uint64_t offset;        // смещение сжатого блока от начала файла
+        uint32_t packed;        // размер сжатого блока
+        uint32_t size;          // размер несжатого блока
+        uint32_t method;        // метод сжатия (codec)
+        uint32_t reserved;      // выравнивание
+    };
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief распакованный блок в кеше
+    ///
+    struct cache_entry {
+        uint64_t    block;      // номер блока
+        uint64_t    used;       // счетчик последнего обращения (LRU)
+        std::string data;       // несжатые данные
+    };
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить распакованный блок (из кеша или распаковать)
+    /// \param index - номер блока
+    /// \return данные блока, nullptr - ошибка
+    ///
+    const std::string* get_block( uint64_t index );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief выполнить задания 0..count-1 в текущем потоке и в потоках распаковки
+    /// \param count - количество заданий
+    /// \param job - задание (номер задания)
+    ///
+    void run_parallel( uint64_t count, const std::function<void(uint64_t)> &job );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief выполнять задания (поток распаковки)
+    ///
+    void worker();
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief остановить потоки распаковки
+    ///
+    void stop_workers();
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief сжать накопленный блок и записать в файл
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t flush_block();
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief режим, в котором открыт файл
+    ///
+    mode m_mode;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief размер несжатого блока
+    ///
+    uint32_t m_block_size;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief метод сжатия новых блоков
+    ///
+    codec m_codec;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief размер несжатых данных
+    ///
+    uint64_t m_data_size;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief максимальный размер несжатых данных при записи
+    ///
+    uint64_t m_data_limit;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief текущая позиция в несжатых данных
+    ///
+    uint64_t m_position;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief индекс блоков
+    ///
+    std::vector<block_info> m_blocks;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief кеш распакованных блоков
+    ///
+    std::vector<cache_entry> m_cache;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief максимальное количество блоков в кеше
+    ///
+    uint32_t m_cache_blocks;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief количество потоков распаковки
+    ///
+    uint32_t m_threads;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief счетчик обращений к кешу
+    ///
+    uint64_t m_used;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief номер последнего запрошенного блока (признак последовательного чтения)
+    ///
+    uint64_t m_last_block;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief буфер накопления несжатого блока при записи
+    ///
+    std::string m_buffer;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief буфер сжатого блока
+    ///
+    std::string m_packed;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief потоки распаковки (кроме текущего потока)
+    ///
+    std::vector<std::thread> m_workers;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief блокировка заданий
+    ///
+    std::mutex m_job_lock;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief сигнал о новых заданиях
+    ///
+    std::condition_variable m_job_signal;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief сигнал о завершении всех заданий
+    ///
+    std::condition_variable m_job_done;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief текущее задание
+    ///
+    const std::function<void(uint64_t)> *m_job;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief номера заданий, которые еще не взяты в работу
+    ///
+    std::vector<uint64_t> m_job_queue;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief количество невыполненных заданий
+    ///
+    uint64_t m_job_pending;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief признак остановки потоков распаковки
+    ///
+    bool m_job_stop;
+};
+
+#endif // FILEMAP_PACK_H
@@ -0,0 +1,350 @@
+/*!
+ *
+ * \file filemap_residency.cpp
+ * \brief реализация класса оценки присутствия файла в кеше страниц
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+
+
+#include "filemap_residency.h"
+#include <algorithm>
+#include <iostream>
+#include <errno.h>
+
+using namespace std;
+
+namespace {
+
+#if defined(OS_LINUX)
+typedef unsigned char mincore_t;
+#else
+typedef char mincore_t;
+#endif  // defined(OS_LINUX)
+
+// учесть страницы блока mincore: резидентные байты внутри [begin, end) и биты карты
+uint64_t count_pages( uint64_t page_offset, const unsigned char *vec, uint64_t pages, uint64_t page_size,
+                      uint64_t begin, uint64_t end, std::vector<uint64_t> *bitmap, uint64_t first_page )
+{
+    uint64_t resident = 0;
+    for ( uint64_t index = 0; index < pages; index++ ) {
+        if ( ( vec[index] & 1 ) == 0 )
+            continue;
+        uint64_t start = std::max( page_offset + index * page_size, begin );
+        uint64_t stop = std::min( page_offset + (index + 1) * page_size, end );
+        if ( start >= stop )
+            continue;
+        resident += stop - start;
+        if ( bitmap ) {
+            uint64_t bit = ( page_offset + index * page_size - first_page ) / page_size;
+            (*bitmap)[bit / 64] |= (uint64_t)1 << (bit % 64);
+        }
+    }
+    return resident;
+}
+
+}   // namespace
+
+///////////////////////////////////////////////////////////////////////////////
+// конструктор
+CFileMapResidency::CFileMapResidency( uint64_t window /*= 256*1024*1024*/ )
+    : CFileMap( 0 )
+{
+    m_window = memory_allocation_granularity( window ? window : 1 );
+#   if defined(OS_WIN)
+    m_memory_page = 4096;
+#   else
+    m_memory_page = (uint64_t)::sysconf( _SC_PAGESIZE );
+#   endif  // defined(OS_WIN)
+    m_query_file = INVALID_HANDLE_VALUE;    // файл для проверки не открыт
+    m_query_size = 0;
+    m_prefetch_ahead = 256*1024*1024;       // подкачка опережает выдачу не больше чем на 256 МБ
+    m_next = 0;
+    m_stop = true;
+}   //  CFileMapResidency()
+
+///////////////////////////////////////////////////////////////////////////////
+// деструктор
+CFileMapResidency::~CFileMapResidency()
+{
+    stop_schedule();
+}   //  ~CFileMapResidency()
+
+///////////////////////////////////////////////////////////////////////////////
+// проверить страницы текущей проекции
+uint64_t CFileMapResidency::query_window( std::vector<uint64_t> *bitmap, uint64_t &resident )
+{
+    resident = 0;
+    if ( bitmap )
+        bitmap->clear();
+#   if defined(OS_WIN)
+    return ERROR_NOT_SUPPORTED;
+#   else
+    const char *address = (const char *)get_map_address();
+    uint64_t length = get_max_copy_ex();
+    if ( address == nullptr )
+        return EINVAL;
+    if ( length == 0 )
+        return 0;
+
+    uint64_t begin = (uint64_t)(uintptr_t)address;
+    uint64_t first_page = begin - begin % m_memory_page;
+    uint64_t pages = ( begin + length - first_page + m_memory_page - 1 ) / m_memory_page;
+    std::vector<unsigned char> vec( (size_t)pages );
+    if ( ::mincore( (void *)(uintptr_t)first_page, (size_t)( begin + length - first_page ),
+                    (mincore_t *)vec.data() ) != 0 )
+        return errno;
+
+    if ( bitmap )
+        bitmap->assign( (size_t)( (pages + 63) / 64 ), 0 );
+    resident = count_pages( first_page, vec.data(), pages, m_memory_page,
+                            begin, begin + length, bitmap, first_page );
+    return 0;
+#   endif  // defined(OS_WIN)
+}   //  query_window( std::vector<uint64_t> *bitmap, uint64_t &resident )
+
+///////////////////////////////////////////////////////////////////////////////
+// проверить страницы диапазона файла
+uint64_t CFileMapResidency::query_residency( uint64_t offset, uint64_t length,
+                                             std::vector<uint64_t> *bitmap, uint64_t &resident )
+{
+    resident = 0;
+    if ( bitmap )
+        bitmap->clear();
+
+    uint64_t last_error = open_query_file();
+    if ( last_error )
+        return last_error;
+    if ( offset >= m_query_size )
+        return 0;
+    length = std::min( length, m_query_size - offset );
+
+    uint64_t first_page = offset - offset % m_memory_page;
+    if ( bitmap )
+        bitmap->assign( (size_t)( ( (offset + length - first_page + m_memory_page - 1) / m_memory_page + 63 ) / 64 ), 0 );
+
+    uint64_t page_size = m_memory_page;
+    return query_pages( offset, length,
+        [&]( uint64_t page_offset, const unsigned char *vec, uint64_t pages ) {
+            resident += count_pages( page_offset, vec, pages, page_size,
+                                     offset, offset + length, bitmap, first_page );
+        } );
+}   //  query_residency( uint64_t offset, uint64_t length, std::vector<uint64_t> *bitmap, uint64_t &resident )
+
+///////////////////////////////////////////////////////////////////////////////
+// получить количество резидентных байт по диапазонам файла
+uint64_t CFileMapResidency::get_residency( uint64_t range_size, std::vector<range_info> &ranges )
+{
+    ranges.clear();
+    uint64_t last_error = open_query_file();
+    if ( last_error )
+        return last_error;
+
+    // диапазон кратен странице - каждая страница относится к одному диапазону
+    range_size = std::max( m_memory_page, ( range_size + m_memory_page - 1 ) / m_memory_page * m_memory_page );
+    for ( uint64_t offset = 0; offset < m_query_size; offset += range_size ) {
+        range_info item;
+        item.offset = offset;
+        item.length = std::min( range_size, m_query_size - offset );
+        item.resident = 0;
+        ranges.push_back( item );
+    }
+
+    uint64_t page_size = m_memory_page;
+    uint64_t file_size = m_query_size;
+    return query_pages( 0, m_query_size,
+        [&]( uint64_t page_offset, const unsigned char *vec, uint64_t pages ) {
+            for ( uint64_t index = 0; index < pages; index++ ) {
+                if ( vec[index] & 1 ) {
+                    uint64_t start = page_offset + index * page_size;
+                    ranges[(size_t)( start / range_size )].resident += std::min( page_size, file_size - start );
+                }
+            }
+        } );
+}   //  get_residency( uint64_t range_size, std::vector<range_info> &ranges )
+
+///////////////////////////////////////////////////////////////////////////////
+// упорядочить диапазоны и начать подкачку холодных диапазонов
+uint64_t CFileMapResidency::schedule( uint64_t range_size, std::vector<range_info> &order )
+{
+    stop_schedule();
+
+    uint64_t last_error = get_residency( range_size, order );
+    if ( last_error ) {
+        cout<< "an error number \"" << last_error << "\" is generated in the method schedule" <<endl;
+        return last_error;
+    }
+
+    // по убыванию доли резидентных байт, при равенстве - по смещению
+    std::stable_sort( order.begin(), order.end(), []( const range_info &a, const range_info &b ) {
+        return (double)a.resident / (double)a.length > (double)b.resident / (double)b.length;
+    } );
+
+    std::lock_guard<std::mutex> lock( m_lock );
+    m_order = order;
+    m_cold.assign( 1, 0 );
+    for ( const range_info &item : m_order )
+        m_cold.push_back( m_cold.back() + item.length - item.resident );
+    m_next = 0;
+    m_stop = false;
+
+#   if !defined(OS_WIN)
+    if ( m_cold.back() && m_prefetch_ahead )
+        m_prefetch = std::thread( &CFileMapResidency::prefetch_worker, this );
+#   endif  // !defined(OS_WIN)
+    return 0;
+}   //  schedule( uint64_t range_size, std::vector<range_info> &order )
+
+///////////////////////////////////////////////////////////////////////////////
+// получить следующий диапазон в порядке schedule()
+bool CFileMapResidency::next_range( range_info &item )
+{
+    std::lock_guard<std::mutex> lock( m_lock );
+    if ( m_next >= m_order.size() )
+        return false;
+    item = m_order[m_next++];
+    m_wake.notify_one();
+    return true;
+}   //  next_range( range_info &item )
+
+///////////////////////////////////////////////////////////////////////////////
+// остановить подкачку и закрыть файл проверки
+void CFileMapResidency::stop_schedule()
+{
+    {
+        std::lock_guard<std::mutex> lock( m_lock );
+        m_stop = true;
+        m_wake.notify_one();
+    }
+    if ( m_prefetch.joinable() )
+        m_prefetch.join();
+
+    std::lock_guard<std::mutex> lock( m_lock );
+    m_order.clear();
+    m_cold.clear();
+    m_next = 0;
+    if ( m_query_file != INVALID_HANDLE_VALUE ) {
+#       if defined(OS_WIN)
+        ::CloseHandle( m_query_file );
+#       else
+        ::close( m_query_file );
+#       endif  // defined(OS_WIN)
+        m_query_file = INVALID_HANDLE_VALUE;
+    }
+}   //  stop_schedule()
+
+///////////////////////////////////////////////////////////////////////////////
+// проверить страницы диапазона временными проекциями
+uint64_t CFileMapResidency::query_pages( uint64_t offset, uint64_t length,
+                                         const std::function<void( uint64_t, const unsigned char *, uint64_t )> &fn )
+{
+#   if defined(OS_WIN)
+    (void)offset;
+    (void)length;
+    (void)fn;
+    return ERROR_NOT_SUPPORTED;
+#   else
+    std::vector<unsigned char> vec;
+    uint64_t end = offset + length;
+    // начало проекции кратно гранулярности страниц памяти
+    for ( uint64_t start = offset - offset % get_page_size(); start < end; start += m_window ) {
+        uint64_t size = std::min( m_window, m_query_size - start );
+        // страницы только отражаются, обращения к ним нет - проверка ничего не подкачивает
+        void *address = ::mmap( nullptr, (size_t)size, PROT_READ, MAP_SHARED, m_query_file, (off_t)start );
+        if ( address == MAP_FAILED )
+            return errno;
+
+        uint64_t pages = ( size + m_memory_page - 1 ) / m_memory_page;
+        vec.resize( (size_t)pages );
+        if ( ::mincore( address, (size_t)size, (mincore_t *)vec.data() ) != 0 ) {
+            uint64_t last_error = errno;
+            ::munmap( address, (size_t)size );
+            return last_error;
+        }
+        ::munmap( address, (size_t)size );
+        fn( start, vec.data(), pages );
+    }
+    return 0;
+#   endif  // defined(OS_WIN)
+}   //  query_pages( uint64_t offset, uint64_t length, const std::function<...> &fn )
+
+///////////////////////////////////////////////////////////////////////////////
+// открыть файл для проверки
+uint64_t CFileMapResidency::open_query_file()
+{
+#   if defined(OS_WIN)
+    return ERROR_NOT_SUPPORTED;
+#   else
+    if ( m_query_file != INVALID_HANDLE_VALUE )
+        return 0;
+
+    string file_path = wchar_string( get_file_path().c_str(), get_file_path().length() );
+    m_query_file = ::open( file_path.c_str(), O_RDONLY | O_LARGEFILE );
+    if ( m_query_file == INVALID_HANDLE_VALUE )
+        return errno;
+
+    struct stat info;
+    if ( ::fstat( m_query_file, &info ) != 0 ) {
+        uint64_t last_error = errno;
+        ::close( m_query_file );
+        m_query_file = INVALID_HANDLE_VALUE;
+        return last_error;
+    }
+    m_query_size = (uint64_t)info.st_size;
+    return 0;
+#   endif  // defined(OS_WIN)
+}   //  open_query_file()
+
+///////////////////////////////////////////////////////////////////////////////
+// подкачка холодных диапазонов (выполняется в отдельном потоке)
+void CFileMapResidency::prefetch_worker()
+{
+#   if !defined(OS_WIN)
+    size_t index = 0;
+    std::unique_lock<std::mutex> lock( m_lock );
+    while ( !m_stop ) {
+        // уже выданные диапазоны подкачивать поздно
+        index = std::max( index, m_next );
+        while ( index < m_order.size() && m_order[index].resident == m_order[index].length )
+            index++;
+        if ( index >= m_order.size() )
+            break;
+
+        // подкачанное, но еще не выданное, не должно превышать m_prefetch_ahead
+        if ( index > m_next && m_cold[index + 1] - m_cold[m_next] > m_prefetch_ahead ) {
+            m_wake.wait( lock );
+            continue;
+        }
+
+        range_info item = m_order[index++];
+        lock.unlock();
+        ::posix_fadvise( m_query_file, (off_t)item.offset, (off_t)item.length, POSIX_FADV_WILLNEED );
+        lock.lock();
+    }
+#   endif  // !defined(OS_WIN)
+}   //  prefetch_worker()
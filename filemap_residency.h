@@ -0,0 +1,272 @@
+/*!
+ *
+ * \file filemap_residency.h
+ * \brief определение класса оценки присутствия файла в кеше страниц
+ *
+ *  mincore для текущей или временных проекций: битовая карта страниц\n
+ *  и количество резидентных байт по диапазонам; планировщик выдает\n
+ *  сначала диапазоны, уже находящиеся в памяти, а холодные диапазоны\n
+ *  тем временем подкачиваются в фоновом потоке.
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied\n
+ * warranty. In no event will the authors be held liable for any damages\n
+ * arising from the use of this software.\n
+ *
+ * Permission is granted to anyone to use this software for any purpose,\n
+ * including commercial applications, and to alter it and redistribute it\n
+ * freely, subject to the following restrictions:\n
+ *
+ *    1. The origin of this software must not be misrepresented; you must not\n
+ *    claim that you wrote the original software. If you use this software\n
+ *    in a product, an acknowledgment in the product documentation would be\n
+ *    appreciated but is not required.\n
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be\n
+ *    misrepresented as being the original software.\n
+ *    3. This notice may not be removed or altered from any source\n
+ *    distribution.\n
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+#ifndef FILEMAP_RESIDENCY_H
+#define FILEMAP_RESIDENCY_H
+
+#include "filemap.h"
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+
+//--------------------------------------------------------------------------------------------------//
+
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief The CFileMapResidency class - присутствие файла (set_file_path()) в кеше страниц
+///
+/// query_window() проверяет страницы текущей проекции (объект открыт\n
+/// open_file_map()), query_residency() и get_residency() отражают файл\n
+/// временными блоками размером window без обращения к страницам, поэтому\n
+/// проверка сама ничего не подкачивает.\n
+///
+/// schedule() делит файл на диапазоны и упорядочивает их по убыванию доли\n
+/// резидентных байт (при равенстве - по смещению); next_range() выдает\n
+/// диапазоны в этом порядке (потокобезопасно), а фоновый поток подкачивает\n
+/// холодные диапазоны (posix_fadvise( POSIX_FADV_WILLNEED )) не больше чем\n
+/// на set_prefetch_ahead() байт вперед выданных, чтобы не вытеснять их же.\n
+/// В Windows кеш страниц файла не доступен для проверки (ERROR_NOT_SUPPORTED).
+///
+/// \code
+/// CFileMapResidency residency;
+/// residency.set_file_path( file_path );
+/// std::vector<CFileMapResidency::range_info> order;
+/// residency.schedule( 64*1024*1024, order );
+/// CFileMapResidency::range_info item;
+/// while ( residency.next_range( item ) ) // в нескольких потоках
+///     process( item.offset, item.length );
+/// \endcode
+///
+class CFileMapResidency : public CFileMap
+{
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief диапазон файла
+    ///
+    struct range_info {
+        uint64_t offset;        // смещение диапазона
+        uint64_t length;        // количество байт
+        uint64_t resident;      // количество байт в кеше страниц
+    };
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief конструктор
+    /// \param window - размер временной проекции для проверки\n
+    ///  (выравнивается по гранулярности страниц памяти)
+    ///
+    CFileMapResidency( uint64_t window = 256*1024*1024 );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief деструктор (останавливает подкачку)
+    ///
+    ~CFileMapResidency();
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить, на сколько байт холодных диапазонов подкачка\n
+    ///  может опережать выдачу next_range()
+    /// \param bytes - количество байт
+    ///
+    void set_prefetch_ahead( uint64_t bytes ) {
+        m_prefetch_ahead = bytes;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief проверить страницы текущей проекции от текущей позиции\n
+    ///  до конца проекции
+    /// \param bitmap - битовая карта страниц (бит i - страница i, начиная\n
+    ///  со страницы текущей позиции), может быть nullptr
+    /// \param resident - количество резидентных байт
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t query_window( std::vector<uint64_t> *bitmap, uint64_t &resident );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief проверить страницы диапазона файла
+    /// \param offset - смещение диапазона
+    /// \param length - количество байт (обрезается по размеру файла)
+    /// \param bitmap - битовая карта страниц (бит i - страница i, начиная\n
+    ///  со страницы смещения offset), может быть nullptr
+    /// \param resident - количество резидентных байт
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t query_residency( uint64_t offset, uint64_t length,
+                              std::vector<uint64_t> *bitmap, uint64_t &resident );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить количество резидентных байт по диапазонам файла
+    /// \param range_size - размер диапазона (последний может быть меньше)
+    /// \param ranges - диапазоны по порядку смещений
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t get_residency( uint64_t range_size, std::vector<range_info> &ranges );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief упорядочить диапазоны (резидентные - первыми) и начать\n
+    ///  подкачку холодных диапазонов
+    /// \param range_size - размер диапазона (последний может быть меньше)
+    /// \param order - диапазоны в порядке обработки
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t schedule( uint64_t range_size, std::vector<range_info> &order );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить следующий диапазон в порядке schedule() (потокобезопасно)
+    /// \param item - диапазон
+    /// \return false - диапазоны закончились
+    ///
+    bool next_range( range_info &item );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief остановить подкачку и закрыть файл проверки
+    ///
+    void stop_schedule();
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief проверить страницы диапазона временными проекциями
+    /// \param offset - смещение диапазона
+    /// \param length - количество байт
+    /// \param fn - обработчик блока: смещение первой страницы блока,\n
+    ///  вектор mincore, количество страниц
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t query_pages( uint64_t offset, uint64_t length,
+                          const std::function<void( uint64_t, const unsigned char *, uint64_t )> &fn );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief открыть файл для проверки (если еще не открыт)
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t open_query_file();
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief подкачка холодных диапазонов (выполняется в отдельном потоке)
+    ///
+    void prefetch_worker();
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief размер временной проекции
+    ///
+    uint64_t m_window;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief размер страницы памяти (единица mincore)
+    ///
+    uint64_t m_memory_page;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief описатель файла для проверки и подкачки
+    ///
+    HANDLE m_query_file;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief размер файла для проверки
+    ///
+    uint64_t m_query_size;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief на сколько байт подкачка может опережать выдачу
+    ///
+    uint64_t m_prefetch_ahead;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief диапазоны в порядке обработки
+    ///
+    std::vector<range_info> m_order;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief холодные байты диапазонов m_order[0..i) (нарастающим итогом)
+    ///
+    std::vector<uint64_t> m_cold;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief следующий выдаваемый диапазон
+    ///
+    size_t m_next;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief остановить подкачку
+    ///
+    bool m_stop;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief блокировка выдачи диапазонов
+    ///
+    std::mutex m_lock;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief сигнал потоку подкачки
+    ///
+    std::condition_variable m_wake;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief поток подкачки
+    ///
+    std::thread m_prefetch;
+};
+
+#endif // FILEMAP_RESIDENCY_H
@@ -0,0 +1,228 @@
+/*!
+ *
+ * \file filemap_reverse.cpp
+ * \brief реализация класса чтения строк файла с конца (tail -n N)
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+
+#include "filemap_reverse.h"
+#include "filemap_simd.h"
+#include <algorithm>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// конструктор
+CFileMapReverse::CFileMapReverse( uint64_t limit_map_memory /*= 0*/ )
+    : CFileMap( limit_map_memory )
+{
+    m_window = nullptr;             // адрес текущего блока
+    m_window_begin = 0;             // начало текущего блока
+    m_window_end = 0;               // конец текущего блока
+    m_end = 0;                      // конец непрочитанной части файла
+    m_line_offset = 0;              // начало последней прочитанной строки
+    m_terminated = false;           // строка заканчивается символом новой строки
+    m_finished = true;              // достигнуто начало файла
+}   //  CFileMapReverse()
+
+///////////////////////////////////////////////////////////////////////////////
+// открыть файл на чтение, позиция - конец файла
+uint64_t CFileMapReverse::open_file_map()
+{
+    m_window = nullptr;
+    m_window_begin = 0;
+    m_window_end = 0;
+    m_end = 0;
+    m_line_offset = 0;
+    m_terminated = false;
+    m_finished = true;
+    m_carry.clear();
+
+    uint64_t file_size = 0;
+    uint64_t file_time = 0;
+    uint64_t last_error = get_file_info( file_size, file_time );
+    // в пустом файле строк нет
+    if ( last_error || file_size == 0 )
+        return last_error;
+
+    set_file_size( file_size );
+    last_error = CFileMap::open_file_map( CFileMap::mode::read );
+    if ( last_error )
+        return last_error;
+
+    // последний блок файла
+    last_error = map_back( file_size );
+    if ( last_error )
+        return last_error;
+
+    // символ новой строки в конце файла завершает последнюю строку
+    m_end = file_size;
+    if ( m_window[file_size - 1 - m_window_begin] == '\n' )
+        m_end = file_size - 1;
+    m_terminated = ( m_end != file_size );
+    m_finished = false;
+    return 0;
+}   //  open_file_map()
+
+///////////////////////////////////////////////////////////////////////////////
+// прочитать предыдущую строку
+bool CFileMapReverse::read_line_reverse( string_view &line )
+{
+    line = string_view();
+    m_carry.clear();
+    if ( m_finished )
+        return false;
+
+    // флаг true - строка собирается в буфере m_carry
+    bool carried = false;
+    // конец просматриваемой части строки
+    uint64_t end = m_end;
+
+    for ( ;; ) {
+        /* блок должен содержать байт перед end; проекцию могли сдвинуть
+         * методы CFileMap (read, seek) - тогда блок отражается заново */
+        if ( m_window == nullptr || m_window != (const char *)get_map_address() ||
+             end > m_window_end || ( end <= m_window_begin && end != 0 ) ) {
+            if ( map_back( end ) != 0 ) {
+                m_finished = true;
+                return false;
+            }
+        }
+
+        uint64_t length = end - m_window_begin;
+        uint64_t start = find_back( m_window, length );
+        if ( start < length ) {
+            // найден символ новой строки, который завершает предыдущую строку
+            m_end = m_window_begin + start;
+            start = start + 1;
+        } else if ( m_window_begin == 0 ) {
+            // строка начинается с начала файла
+            m_finished = true;
+            start = 0;
+        } else {
+            /* строка начинается в одном из предыдущих блоков - сохраним
+             * начало текущего блока и продолжим поиск в предыдущем */
+            m_carry.insert( 0, m_window, (size_t)length );
+            carried = true;
+            end = m_window_begin;
+            continue;
+        }
+
+        m_line_offset = m_window_begin + start;
+        if ( carried == false ) {
+            line = string_view( m_window + start, (size_t)( length - start ) );
+        } else {
+            m_carry.insert( 0, m_window + start, (size_t)( length - start ) );
+            line = m_carry;
+        }
+        break;
+    }
+
+    /* CR перед LF отбрасывается (кроме режима lf) после сборки строки, поэтому
+     * пара CR LF, разбитая между блоками, обрабатывается так же, как целая */
+    line = line.substr( 0, (size_t)line_length( line.data(), line.size(), m_terminated ) );
+    m_terminated = true;
+    return true;
+}   //  read_line_reverse( string_view &line )
+
+///////////////////////////////////////////////////////////////////////////////
+// прочитать последние строки файла
+uint64_t CFileMapReverse::tail_lines( uint64_t count, vector<string> &lines )
+{
+    lines.clear();
+    string_view line;
+    while ( lines.size() < count && read_line_reverse( line ) )
+        lines.emplace_back( line );
+    std::reverse( lines.begin(), lines.end() );
+    return lines.size();
+}   //  tail_lines( uint64_t count, vector<string> &lines )
+
+///////////////////////////////////////////////////////////////////////////////
+// отразить блок, который заканчивается смещением end
+uint64_t CFileMapReverse::map_back( uint64_t end )
+{
+    uint64_t last_error = 0;
+    uint64_t limit = get_limit_memory();
+
+    if ( limit == 0 ) {
+        // файл отражен целиком - вернем адрес на начало проекции
+        last_error = seek( 0 );
+        if ( last_error )
+            return last_error;
+        m_window = (const char *)get_map_address();
+        m_window_begin = 0;
+        m_window_end = m_file_size.QuadPart;
+        return 0;
+    }
+
+    // начало блока кратно гранулярности страниц, блок не больше limit
+    uint64_t start = ( end > limit ) ? memory_allocation_granularity( end - limit ) : 0;
+    for ( ;; ) {
+        m_offset.QuadPart = start;
+        last_error = map_region( 0, end - start );
+        if ( last_error )
+            return last_error;
+        if ( get_map_address() == nullptr ) {
+#           if defined(OS_WIN)
+            return ERROR_NOT_ENOUGH_MEMORY;
+#           else
+            return ENOMEM;
+#           endif  // defined(OS_WIN)
+        }
+        // бюджет памяти выдал меньше - сдвинем начало блока к концу
+        uint64_t granted = get_max_copy_ex();
+        if ( granted >= end - start )
+            break;
+        start = memory_allocation_granularity( end - granted );
+    }
+
+    m_window = (const char *)get_map_address();
+    m_window_begin = start;
+    m_window_end = end;
+    return 0;
+}   //  map_back( uint64_t end )
+
+///////////////////////////////////////////////////////////////////////////////
+// найти последний символ новой строки
+uint64_t CFileMapReverse::find_back( const char *p, uint64_t length )
+{
+    // буфер для неполного блока в начале проекции
+    alignas(64) char head[CFileMapSimd::block_size];
+
+    for ( uint64_t end = length; end; ) {
+        uint64_t size = ( end > CFileMapSimd::block_size ) ? CFileMapSimd::block_size : end;
+        uint64_t index = end - size;
+        const char *block = CFileMapSimd::load_block( p + index, size, head );
+        uint64_t lines = CFileMapSimd::eq_mask( block, '\n' ) & CFileMapSimd::low_mask( size );
+        if ( lines )
+            return index + CFileMapSimd::leading_bit( lines );
+        end = index;
+    }
+    return length;
+}   //  find_back( const char *p, uint64_t length )
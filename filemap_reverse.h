@@ -0,0 +1,189 @@
+/*!
+ *
+ * \file filemap_reverse.h
+ * \brief определение класса чтения строк файла с конца (tail -n N)
+ *
+ *  блоки проекции отражаются от конца файла к началу, символ новой\n
+ *  строки ищется векторно в обратном направлении, строки возвращаются\n
+ *  в обратном порядке как std::string_view без копирования.
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied\n
+ * warranty. In no event will the authors be held liable for any damages\n
+ * arising from the use of this software.\n
+ *
+ * Permission is granted to anyone to use this software for any purpose,\n
+ * including commercial applications, and to alter it and redistribute it\n
+ * freely, subject to the following restrictions:\n
+ *
+ *    1. The origin of this software must not be misrepresented; you must not\n
+ *    claim that you wrote the original software. If you use this software\n
+ *    in a product, an acknowledgment in the product documentation would be\n
+ *    appreciated but is not required.\n
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be\n
+ *    misrepresented as being the original software.\n
+ *    3. This notice may not be removed or altered from any source\n
+ *    distribution.\n
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+#ifndef FILEMAP_REVERSE_H
+#define FILEMAP_REVERSE_H
+
+#include "filemap.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+
+//--------------------------------------------------------------------------------------------------//
+
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief The CFileMapReverse class - чтение строк файла с конца
+///
+/// строка заканчивается символом '\\n' (CR перед LF отбрасывается, кроме\n
+/// режима lf set_line_ending(); режим crlf читается как mixed),\n
+/// символ новой строки в конце файла не образует пустую последнюю строку.\n
+/// В блочном режиме каждый следующий блок заканчивается там, где начинается\n
+/// непрочитанная часть файла. Если строка целиком лежит в текущей проекции -\n
+/// она указывает прямо в проекцию, строка, разбитая между проекциями,\n
+/// собирается во внутреннем буфере (CR, оставшийся в предыдущем блоке,\n
+/// отбрасывается после сборки). Строка действительна до следующего вызова\n
+/// read_line_reverse().
+///
+/// \code
+/// CFileMapReverse file( limit_memory );
+/// file.set_file_path( file_path );
+/// last_error = file.open_file_map();
+/// std::string_view line;
+/// while ( file.read_line_reverse( line ) ) {
+///     ... // строки от последней к первой
+/// }
+/// // или последние 100 строк в прямом порядке
+/// std::vector<std::string> lines;
+/// file.tail_lines( 100, lines );
+/// \endcode
+///
+class CFileMapReverse : public CFileMap
+{
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief конструктор
+    /// \param limit_map_memory - размер ограниения для единовремменого отражения\n
+    ///  файла в память, если равен нулю - то отражается сразу весь файл целиком.
+    ///
+    CFileMapReverse( uint64_t limit_map_memory = 0 );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief  открыть файл на чтение, позиция - конец файла\n
+    ///  (размер файла определяется по имени файла)
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t open_file_map();
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief прочитать предыдущую строку (от конца файла к началу)
+    /// \param line - строка без символа новой строки
+    /// \return true - строка прочитана, false - достигнуто начало файла
+    ///
+    bool read_line_reverse( std::string_view &line );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief прочитать последние строки файла (продолжает с текущей позиции)
+    /// \param count - количество строк
+    /// \param lines - строки в прямом порядке (заполняется заново)
+    /// \return количество прочитанных строк
+    ///
+    uint64_t tail_lines( uint64_t count, std::vector<std::string> &lines );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить смещение начала последней прочитанной строки
+    ///
+    uint64_t get_line_offset() const {
+        return m_line_offset;
+    }
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief отразить блок, который заканчивается смещением end
+    /// \param end - смещение конца блока от начала файла
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t map_back( uint64_t end );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief найти последний символ новой строки
+    /// \param p      - начало данных
+    /// \param length - количество байт
+    /// \return позиция символа новой строки или length, если не найден
+    ///
+    static uint64_t find_back( const char *p, uint64_t length );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief адрес текущего блока
+    ///
+    const char *m_window;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief смещение начала текущего блока от начала файла
+    ///
+    uint64_t m_window_begin;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief смещение конца текущего блока от начала файла
+    ///
+    uint64_t m_window_end;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief конец непрочитанной части файла (конец следующей строки)
+    ///
+    uint64_t m_end;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief смещение начала последней прочитанной строки
+    ///
+    uint64_t m_line_offset;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief следующая строка заканчивается символом новой строки\n
+    ///  (ложно только для последней строки файла без '\\n')
+    ///
+    bool m_terminated;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief достигнуто начало файла
+    ///
+    bool m_finished;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief буфер строки, разбитой между проекциями
+    ///
+    std::string m_carry;
+};
+
+#endif // FILEMAP_REVERSE_H
@@ -0,0 +1,451 @@
+/*!
+ *
+ * \file filemap_search.cpp
+ * \brief реализация класса поиска подстрок в проекции файла
+ *
+ *  поиск одной подстроки - векторная фильтрация по первому и последнему\n
+ *  байту, поиск нескольких подстрок - автомат Ахо-Корасик.
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+#include "filemap_search.h"
+#include "filemap_simd.h"
+#include <algorithm>
+#include <queue>
+#include <thread>
+#include <errno.h>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// конструктор
+CFileMapSearch::CFileMapSearch( uint64_t limit_map_memory /*= 0*/ )
+    : CFileMap( limit_map_memory )
+{
+    m_state = 0;                    // состояние автомата
+    m_overlap.clear();              // хвост просмотренных данных
+}   //  CFileMapSearch()
+
+///////////////////////////////////////////////////////////////////////////////
+// установить набор подстрок для поиска
+void CFileMapSearch::set_patterns( const vector<string> &patterns )
+{
+    shared_ptr<automaton> data = make_shared<automaton>();
+    data->max_length = 0;
+    for ( const string &pattern : patterns ) {
+        if ( pattern.length() ) {
+            data->patterns.push_back( pattern );
+            data->max_length = std::max( data->max_length, (uint64_t)pattern.length() );
+        }
+    }
+    if ( data->patterns.empty() ) {
+        m_automaton.reset();
+        return;
+    }
+
+    if ( data->patterns.size() > 1 ) {
+        /* построим бор подстрок, затем суффиксные ссылки обходом в ширину,
+         * и сразу заполним полную таблицу переходов (ДКА) */
+        vector<uint32_t> &next = data->next;
+        vector<vector<uint32_t> > output( 1 );
+        next.assign( 256, 0 );
+
+        for ( uint32_t index = 0; index < data->patterns.size(); index++ ) {
+            uint32_t state = 0;
+            for ( unsigned char ch : data->patterns[index] ) {
+                if ( next[state*256 + ch] == 0 ) {
+                    next[state*256 + ch] = (uint32_t)output.size();
+                    output.emplace_back();
+                    next.resize( next.size() + 256, 0 );
+                }
+                state = next[state*256 + ch];
+            }
+            output[state].push_back( index );
+        }
+
+        vector<uint32_t> fail( output.size(), 0 );
+        queue<uint32_t> states;
+        for ( uint32_t ch = 0; ch < 256; ch++ ) {
+            if ( next[ch] )
+                states.push( next[ch] );
+        }
+        while ( !states.empty() ) {
+            uint32_t state = states.front();
+            states.pop();
+            const vector<uint32_t> &tail = output[fail[state]];
+            output[state].insert( output[state].end(), tail.begin(), tail.end() );
+            for ( uint32_t ch = 0; ch < 256; ch++ ) {
+                uint32_t child = next[state*256 + ch];
+                if ( child ) {
+                    fail[child] = next[fail[state]*256 + ch];
+                    states.push( child );
+                } else {
+                    next[state*256 + ch] = next[fail[state]*256 + ch];
+                }
+            }
+        }
+
+        for ( const vector<uint32_t> &list : output ) {
+            data->output_begin.push_back( (uint32_t)data->outputs.size() );
+            data->outputs.insert( data->outputs.end(), list.begin(), list.end() );
+        }
+        data->output_begin.push_back( (uint32_t)data->outputs.size() );
+
+        // фильтр по первым байтам подстрок - пока автомат в начальном состоянии
+        for ( const string &pattern : data->patterns ) {
+            if ( data->first_bytes.find( pattern[0] ) == string::npos )
+                data->first_bytes.push_back( pattern[0] );
+        }
+        if ( data->first_bytes.length() > 8 )
+            data->first_bytes.clear();
+    }
+
+    m_automaton = data;
+}   //  set_patterns( const vector<string> &patterns )
+
+///////////////////////////////////////////////////////////////////////////////
+// найти совпадения от текущей позиции до конца файла
+uint64_t CFileMapSearch::find( const match_callback &callback )
+{
+    if ( !m_automaton ) {
+#       if defined(OS_WIN)
+        return ERROR_INVALID_PARAMETER;
+#       else
+        return EINVAL;
+#       endif  // defined(OS_WIN)
+    }
+
+    const automaton &data = *m_automaton;
+    const uint64_t keep = data.max_length - 1;
+    m_state = 0;
+    m_overlap.clear();
+
+    // позиция, с которой можно продолжить поиск после прерывания
+    bool stopped = false;
+    uint64_t stop_offset = 0;
+    match_callback report = [&]( const match_info &match ) {
+        if ( callback( match ) )
+            return true;
+        stopped = true;
+        stop_offset = match.offset + data.patterns[match.pattern].length();
+        return false;
+    };
+
+    while ( !eof() ) {
+        // проверим, сколько байт можно прочитать
+        if ( get_max_copy_ex() == 0 ) {
+            uint64_t last_error = next_region();
+            if ( last_error )
+                return last_error;
+        }
+        const char *file = (const char *)get_map_address();
+        uint64_t length = get_max_copy_ex();
+        uint64_t base = m_offset.QuadPart;
+
+        if ( data.patterns.size() == 1 ) {
+            // совпадения, начинающиеся в хвосте предыдущей проекции
+            if ( m_overlap.length() ) {
+                string stitch = m_overlap;
+                stitch.append( file, (size_t)std::min( length, keep ) );
+                scan_single( stitch.data(), stitch.length(), base - m_overlap.length(),
+                             m_overlap.length(), report );
+            }
+            if ( stopped == false )
+                scan_single( file, length, base, length, report );
+
+            // сохраним хвост для следующей проекции
+            if ( length >= keep ) {
+                m_overlap.assign( file + length - keep, (size_t)keep );
+            } else {
+                m_overlap.append( file, (size_t)length );
+                if ( m_overlap.length() > keep )
+                    m_overlap.erase( 0, m_overlap.length() - (size_t)keep );
+            }
+        } else {
+            scan_multi( file, length, base, report );
+        }
+
+        if ( stopped )
+            return seek( stop_offset );
+        check_map_region( length );
+    }
+
+    return 0;
+}   //  find( const match_callback &callback )
+
+///////////////////////////////////////////////////////////////////////////////
+// поиск одной подстроки в блоке памяти
+bool CFileMapSearch::scan_single( const char *p, uint64_t length, uint64_t base, uint64_t limit,
+                                  const match_callback &callback )
+{
+    const string &pattern = m_automaton->patterns[0];
+    const uint64_t size = pattern.length();
+    if ( length < size )
+        return true;
+
+    const char first = pattern[0];
+    const char last = pattern[size-1];
+    // последняя позиция, с которой может начинаться совпадение
+    const uint64_t end = std::min( length - size + 1, limit );
+    match_info match;
+    match.pattern = 0;
+    uint64_t index = 0;
+
+    /* фильтр: первый и последний байт подстроки сравниваются сразу для
+     * 64 позиций, полное сравнение - только для кандидатов */
+    for ( ; index + size - 1 + CFileMapSimd::block_size <= length && index < end;
+          index += CFileMapSimd::block_size ) {
+        uint64_t mask = CFileMapSimd::eq_mask( p + index, first ) &
+                        CFileMapSimd::eq_mask( p + index + size - 1, last );
+        while ( mask ) {
+            uint64_t position = index + CFileMapSimd::trailing_zeros( mask );
+            mask &= mask - 1;
+            if ( position >= end )
+                return true;
+            if ( size <= 2 || memcmp( p + position + 1, pattern.data() + 1, (size_t)size - 2 ) == 0 ) {
+                match.offset = base + position;
+                if ( !callback( match ) )
+                    return false;
+            }
+        }
+    }
+
+    // хвост блока
+    for ( ; index < end; index++ ) {
+        if ( p[index] == first && p[index+size-1] == last &&
+             memcmp( p + index, pattern.data(), (size_t)size ) == 0 ) {
+            match.offset = base + index;
+            if ( !callback( match ) )
+                return false;
+        }
+    }
+
+    return true;
+}   //  scan_single( const char *p, uint64_t length, uint64_t base, ...
+
+///////////////////////////////////////////////////////////////////////////////
+// поиск нескольких подстрок в блоке памяти (автомат Ахо-Корасик)
+bool CFileMapSearch::scan_multi( const char *p, uint64_t length, uint64_t base,
+                                 const match_callback &callback )
+{
+    const automaton &data = *m_automaton;
+    const uint32_t *next = data.next.data();
+    alignas(64) char tail[CFileMapSimd::block_size];
+    match_info match;
+
+    for ( uint64_t index = 0; index < length; index++ ) {
+        if ( m_state == 0 && data.first_bytes.length() ) {
+            // пропустим байты, с которых не начинается ни одна подстрока
+            while ( index < length ) {
+                uint64_t size = ( length - index > CFileMapSimd::block_size ) ? CFileMapSimd::block_size : length - index;
+                const char *block = CFileMapSimd::load_block( p + index, size, tail );
+                uint64_t mask = 0;
+                for ( char ch : data.first_bytes )
+                    mask |= CFileMapSimd::eq_mask( block, ch );
+                mask &= CFileMapSimd::low_mask( size );
+                if ( mask ) {
+                    index += CFileMapSimd::trailing_zeros( mask );
+                    break;
+                }
+                index += size;
+            }
+            if ( index >= length )
+                break;
+        }
+
+        m_state = next[m_state*256 + (unsigned char)p[index]];
+        for ( uint32_t k = data.output_begin[m_state]; k < data.output_begin[m_state+1]; k++ ) {
+            match.pattern = data.outputs[k];
+            match.offset = base + index + 1 - data.patterns[match.pattern].length();
+            if ( !callback( match ) )
+                return false;
+        }
+    }
+
+    return true;
+}   //  scan_multi( const char *p, uint64_t length, uint64_t base, ...
+
+///////////////////////////////////////////////////////////////////////////////
+// найти все совпадения от текущей позиции до конца файла
+uint64_t CFileMapSearch::find_all( vector<match_info> &matches, uint32_t threads /*= 1*/ )
+{
+    matches.clear();
+    if ( threads == 0 )
+        threads = std::max( 1u, std::thread::hardware_concurrency() );
+
+    if ( threads == 1 || !m_automaton ) {
+        uint64_t last_error = find( [&]( const match_info &match ) {
+            matches.push_back( match );
+            return true;
+        } );
+        std::sort( matches.begin(), matches.end(),
+                   []( const match_info &a, const match_info &b ) { return a.offset < b.offset; } );
+        return last_error;
+    }
+
+    // участки кратны гранулярности - с их начала можно отражать файл
+    const uint64_t begin = m_offset.QuadPart;
+    const uint64_t end = m_file_size.QuadPart;
+    const uint64_t granularity = memory_allocation_granularity( 1 );
+    uint64_t chunk_size = memory_allocation_granularity( (end - begin + threads - 1) / threads );
+    uint64_t window = get_limit_memory() ? get_limit_memory() : chunk_size;
+
+    struct chunk_info {
+        uint64_t begin;
+        uint64_t end;
+        uint64_t error;
+        vector<match_info> matches;
+    };
+    vector<chunk_info> chunks;
+    for ( uint64_t start = begin; start < end; ) {
+        chunk_info chunk;
+        chunk.begin = start;
+        chunk.end = std::min( start - start % granularity + chunk_size, end );
+        chunk.error = 0;
+        chunks.push_back( chunk );
+        start = chunk.end;
+    }
+
+    auto worker = [&]( chunk_info &chunk ) {
+        // участок просматривается с перекрытием на длину подстроки
+        CFileMapSearch part( window );
+        part.m_automaton = m_automaton;
+        part.set_file_path( get_file_path().c_str() );
+        part.set_file_size( std::min( chunk.end + m_automaton->max_length - 1, end ) );
+        chunk.error = part.open_file_map( CFileMap::mode::read, chunk.begin - chunk.begin % granularity );
+        if ( chunk.error == 0 )
+            chunk.error = part.seek( chunk.begin );
+        if ( chunk.error == 0 ) {
+            chunk.error = part.find( [&]( const match_info &match ) {
+                if ( match.offset < chunk.end )
+                    chunk.matches.push_back( match );
+                return true;
+            } );
+        }
+        part.close_file_map();
+    };
+
+    vector<thread> workers;
+    for ( size_t index = 1; index < chunks.size(); index++ )
+        workers.emplace_back( worker, std::ref( chunks[index] ) );
+    if ( chunks.size() )
+        worker( chunks[0] );
+    for ( thread &item : workers )
+        item.join();
+
+    for ( chunk_info &chunk : chunks ) {
+        if ( chunk.error )
+            return chunk.error;
+        matches.insert( matches.end(), chunk.matches.begin(), chunk.matches.end() );
+    }
+    std::sort( matches.begin(), matches.end(),
+               []( const match_info &a, const match_info &b ) { return a.offset < b.offset; } );
+
+    return seek( end );
+}   //  find_all( vector<match_info> &matches, uint32_t threads /*= 1*/ )
+
+///////////////////////////////////////////////////////////////////////////////
+// найти строки, содержащие совпадения
+uint64_t CFileMapSearch::find_lines( vector<string> &lines, uint32_t threads /*= 1*/ )
+{
+    lines.clear();
+    vector<match_info> matches;
+    uint64_t last_error = find_all( matches, threads );
+    if ( last_error )
+        return last_error;
+
+    // конец последней прочитанной строки
+    uint64_t line_end = 0;
+    bool first = true;
+    for ( const match_info &match : matches ) {
+        if ( first == false && match.offset <= line_end )
+            continue;
+        string line;
+        line_end = line_at( match.offset, line );
+        lines.push_back( line );
+        first = false;
+    }
+
+    return seek( m_file_size.QuadPart );
+}   //  find_lines( vector<string> &lines, uint32_t threads /*= 1*/ )
+
+///////////////////////////////////////////////////////////////////////////////
+// прочитать строку, содержащую смещение
+uint64_t CFileMapSearch::line_at( uint64_t offset, string &line )
+{
+    const uint64_t granularity = memory_allocation_granularity( 1 );
+    line.clear();
+
+    // найдем начало строки - просмотр назад блоками, кратными странице памяти
+    uint64_t begin = 0;
+    uint64_t stop = offset;
+    while ( stop > 0 ) {
+        uint64_t start = stop - 1;
+        start = start - start % granularity;
+        if ( seek( start ) != 0 )
+            break;
+        const char *file = (const char *)get_map_address();
+        uint64_t length = std::min( stop - start, get_max_copy_ex() );
+        const char *found = nullptr;
+        for ( const char *p = file + length; p > file; p-- ) {
+            if ( p[-1] == '\n' ) {
+                found = p;
+                break;
+            }
+        }
+        if ( found ) {
+            begin = start + (uint64_t)(found - file);
+            break;
+        }
+        stop = start;
+    }
+
+    // прочитаем строку до символа новой строки
+    if ( seek( begin ) != 0 )
+        return offset;
+    while ( !eof() ) {
+        if ( get_max_copy_ex() == 0 ) {
+            if ( next_region() != 0 )
+                break;
+        }
+        const char *file = (const char *)get_map_address();
+        uint64_t length = get_max_copy_ex();
+        const char *found = (const char *)memchr( file, '\n', (size_t)length );
+        if ( found ) {
+            line.append( file, found - file );
+            uint64_t line_end = m_offset.QuadPart + (uint64_t)(found - file);
+            line.resize( (size_t)line_length( line.data(), line.length() ) );
+            return line_end;
+        }
+        line.append( file, (size_t)length );
+        check_map_region( length );
+    }
+
+    // последняя строка файла без символа новой строки сохраняет CR
+    return m_file_size.QuadPart;
+}   //  line_at( uint64_t offset, string &line )
@@ -0,0 +1,213 @@
+/*!
+ *
+ * \file filemap_search.h
+ * \brief определение класса поиска подстрок в проекции файла
+ *
+ *  поиск одной подстроки - векторная фильтрация по первому и последнему\n
+ *  байту, поиск нескольких подстрок - автомат Ахо-Корасик.\n
+ *  совпадения на стыке проекций (map_region) не теряются.
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied\n
+ * warranty. In no event will the authors be held liable for any damages\n
+ * arising from the use of this software.\n
+ *
+ * Permission is granted to anyone to use this software for any purpose,\n
+ * including commercial applications, and to alter it and redistribute it\n
+ * freely, subject to the following restrictions:\n
+ *
+ *    1. The origin of this software must not be misrepresented; you must not\n
+ *    claim that you wrote the original software. If you use this software\n
+ *    in a product, an acknowledgment in the product documentation would be\n
+ *    appreciated but is not required.\n
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be\n
+ *    misrepresented as being the original software.\n
+ *    3. This notice may not be removed or altered from any source\n
+ *    distribution.\n
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+#ifndef FILEMAP_SEARCH_H
+#define FILEMAP_SEARCH_H
+
+#include "filemap.h"
+#include <functional>
+#include <memory>
+#include <vector>
+
+
+
+//--------------------------------------------------------------------------------------------------//
+
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief The CFileMapSearch class - поиск подстрок в проекции файла
+///
+/// поиск выполняется от текущей позиции до конца файла.\n
+/// для одной подстроки хвост проекции длиной (длина подстроки - 1)\n
+/// сохраняется и проверяется вместе с началом следующей проекции,\n
+/// состояние автомата Ахо-Корасик переносится между проекциями само.\n
+/// При параллельном поиске файл делится на участки, каждый участок\n
+/// просматривается своей проекцией с перекрытием на длину подстроки.
+///
+/// \code
+/// CFileMapSearch file( limit_memory );
+/// file.set_file_path( file_path );
+/// file.set_file_size( file_size );
+/// last_error = file.open_file_map( CFileMap::mode::read );
+/// file.set_patterns( { "ERROR", "FATAL" } );
+/// std::vector<std::string> lines;
+/// file.find_lines( lines, 4 );
+/// \endcode
+///
+class CFileMapSearch : public CFileMap
+{
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief найденное совпадение
+    ///
+    struct match_info {
+        uint64_t offset;    // смещение начала совпадения от начала файла
+        uint32_t pattern;   // номер подстроки в set_patterns()
+    };
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief функция обработки совпадения
+    ///  возвращает false - прекратить поиск
+    ///
+    typedef std::function<bool( const match_info &match )> match_callback;
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief конструктор
+    /// \param limit_map_memory - размер ограниения для единовремменого отражения\n
+    ///  файла в память, если равен нулю - то отражается сразу весь файл целиком.
+    ///
+    CFileMapSearch( uint64_t limit_map_memory = 0 );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить подстроку для поиска
+    /// \param pattern - подстрока
+    ///
+    void set_pattern( const std::string &pattern ) {
+        set_patterns( std::vector<std::string>( 1, pattern ) );
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить набор подстрок для поиска (пустые игнорируются)
+    /// \param patterns - подстроки
+    ///
+    void set_patterns( const std::vector<std::string> &patterns );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief найти совпадения от текущей позиции до конца файла
+    /// \param callback - функция обработки совпадения
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    /// после поиска позиция установлена в конец файла, а если поиск\n
+    /// прерван функцией обработки - сразу за прервавшим совпадением.
+    ///
+    uint64_t find( const match_callback &callback );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief найти все совпадения от текущей позиции до конца файла
+    /// \param matches - совпадения, упорядоченные по смещению
+    /// \param threads - количество потоков, ноль - по числу ядер
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t find_all( std::vector<match_info> &matches, uint32_t threads = 1 );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief найти строки, содержащие совпадения
+    /// \param lines   - строки без символов новой строки (каждая строка один раз)
+    /// \param threads - количество потоков, ноль - по числу ядер
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t find_lines( std::vector<std::string> &lines, uint32_t threads = 1 );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief скомпилированный набор подстрок
+    ///
+    struct automaton {
+        std::vector<std::string> patterns;  // подстроки
+        uint64_t max_length;                // длина самой длинной подстроки
+        std::vector<uint32_t> next;         // переходы автомата (состояние * 256 + байт)
+        std::vector<uint32_t> output_begin; // начало списка совпадений состояния в outputs
+        std::vector<uint32_t> outputs;      // номера подстрок, заканчивающихся в состоянии
+        std::string first_bytes;            // первые байты подстрок (фильтр, не больше 8)
+    };
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief поиск одной подстроки в блоке памяти
+    /// \param p        - начало блока
+    /// \param length   - размер блока
+    /// \param base     - смещение блока от начала файла
+    /// \param limit    - сообщаются только совпадения, начинающиеся раньше limit
+    /// \param callback - функция обработки совпадения
+    /// \return false - поиск прерван
+    ///
+    bool scan_single( const char *p, uint64_t length, uint64_t base, uint64_t limit,
+                      const match_callback &callback );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief поиск нескольких подстрок в блоке памяти (автомат Ахо-Корасик)
+    /// \param p        - начало блока
+    /// \param length   - размер блока
+    /// \param base     - смещение блока от начала файла
+    /// \param callback - функция обработки совпадения
+    /// \return false - поиск прерван
+    ///
+    bool scan_multi( const char *p, uint64_t length, uint64_t base,
+                     const match_callback &callback );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief прочитать строку, содержащую смещение
+    /// \param offset - смещение от начала файла
+    /// \param line   - строка без символов новой строки (по режиму set_line_ending(),\n
+    ///  режим crlf читается как mixed)
+    /// \return смещение конца строки (символа новой строки или конца файла)
+    ///
+    uint64_t line_at( uint64_t offset, std::string &line );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief скомпилированный набор подстрок\n
+    ///  (общий для потоков параллельного поиска)
+    ///
+    std::shared_ptr<const automaton> m_automaton;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief состояние автомата после последнего просмотренного байта
+    ///
+    uint32_t m_state;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief хвост уже просмотренных данных (длина подстроки - 1 байт)\n
+    ///  для поиска совпадений на стыке проекций
+    ///
+    std::string m_overlap;
+};
+
+#endif // FILEMAP_SEARCH_H
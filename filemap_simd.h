@@ -0,0 +1,319 @@
+/*!
+ *
+ * \file filemap_simd.h
+ * \brief векторные примитивы для обработки проекции файла
+ *
+ *  классификация байт блоками по 64 байта (битовые маски),\n
+ *  используется парсерами поверх CFileMap.\n
+ *  при отсутствии SSE2/AVX2 используется скалярная реализация.
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied\n
+ * warranty. In no event will the authors be held liable for any damages\n
+ * arising from the use of this software.\n
+ *
+ * Permission is granted to anyone to use this software for any purpose,\n
+ * including commercial applications, and to alter it and redistribute it\n
+ * freely, subject to the following restrictions:\n
+ *
+ *    1. The origin of this software must not be misrepresented; you must not\n
+ *    claim that you wrote the original software. If you use this software\n
+ *    in a product, an acknowledgment in the product documentation would be\n
+ *    appreciated but is not required.\n
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be\n
+ *    misrepresented as being the original software.\n
+ *    3. This notice may not be removed or altered from any source\n
+ *    distribution.\n
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+#ifndef FILEMAP_SIMD_H
+#define FILEMAP_SIMD_H
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#  define FILEMAP_AVX2
+#  include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+#  define FILEMAP_SSE2
+#  include <emmintrin.h>
+#endif
+#if defined(__PCLMUL__)
+#  define FILEMAP_PCLMUL
+#  include <wmmintrin.h>
+#endif
+#if defined(_MSC_VER)
+#  include <intrin.h>
+#endif
+
+
+
+//--------------------------------------------------------------------------------------------------//
+
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief The CFileMapSimd class - векторные примитивы
+///
+/// все функции статические и работают с блоком из 64 байт,\n
+/// результат - битовая маска, где бит i соответствует байту p[i].\n
+/// для хвоста меньше 64 байт используется load_block(), который\n
+/// копирует данные в выровненный буфер, дополненный нулями.
+///
+class CFileMapSimd
+{
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief размер блока классификации в байтах
+    ///
+    static const uint64_t block_size = 64;
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief маска байт блока, равных символу ch
+    /// \param p  - указатель на блок из 64 байт
+    /// \param ch - искомый символ
+    /// \return битовая маска совпадений
+    ///
+    static inline uint64_t eq_mask( const char *p, char ch ) {
+#   if defined(FILEMAP_AVX2)
+        const __m256i c  = _mm256_set1_epi8( ch );
+        const __m256i b0 = _mm256_loadu_si256( (const __m256i*)(p) );
+        const __m256i b1 = _mm256_loadu_si256( (const __m256i*)(p+32) );
+        uint64_t lo = (uint32_t)_mm256_movemask_epi8( _mm256_cmpeq_epi8( b0, c ) );
+        uint64_t hi = (uint32_t)_mm256_movemask_epi8( _mm256_cmpeq_epi8( b1, c ) );
+        return lo | (hi << 32);
+#   elif defined(FILEMAP_SSE2)
+        const __m128i c = _mm_set1_epi8( ch );
+        uint64_t m0 = (uint16_t)_mm_movemask_epi8( _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i*)(p)    ), c ) );
+        uint64_t m1 = (uint16_t)_mm_movemask_epi8( _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i*)(p+16) ), c ) );
+        uint64_t m2 = (uint16_t)_mm_movemask_epi8( _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i*)(p+32) ), c ) );
+        uint64_t m3 = (uint16_t)_mm_movemask_epi8( _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i*)(p+48) ), c ) );
+        return m0 | (m1 << 16) | (m2 << 32) | (m3 << 48);
+#   else
+        uint64_t mask = 0;
+        for ( uint64_t i = 0; i < block_size; i++ ) {
+            if ( p[i] == ch )
+                mask |= (uint64_t)1 << i;
+        }
+        return mask;
+#   endif
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief маска различающихся байт двух блоков
+    /// \param a - указатель на блок из 64 байт
+    /// \param b - указатель на блок из 64 байт
+    /// \return битовая маска байт, где a[i] != b[i]
+    ///
+    static inline uint64_t neq_mask( const char *a, const char *b ) {
+#   if defined(FILEMAP_AVX2)
+        const __m256i a0 = _mm256_loadu_si256( (const __m256i*)(a) );
+        const __m256i a1 = _mm256_loadu_si256( (const __m256i*)(a+32) );
+        const __m256i b0 = _mm256_loadu_si256( (const __m256i*)(b) );
+        const __m256i b1 = _mm256_loadu_si256( (const __m256i*)(b+32) );
+        uint64_t lo = (uint32_t)_mm256_movemask_epi8( _mm256_cmpeq_epi8( a0, b0 ) );
+        uint64_t hi = (uint32_t)_mm256_movemask_epi8( _mm256_cmpeq_epi8( a1, b1 ) );
+        return ~( lo | (hi << 32) );
+#   elif defined(FILEMAP_SSE2)
+        uint64_t m0 = (uint16_t)_mm_movemask_epi8( _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i*)(a)    ),
+                                                                   _mm_loadu_si128( (const __m128i*)(b)    ) ) );
+        uint64_t m1 = (uint16_t)_mm_movemask_epi8( _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i*)(a+16) ),
+                                                                   _mm_loadu_si128( (const __m128i*)(b+16) ) ) );
+        uint64_t m2 = (uint16_t)_mm_movemask_epi8( _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i*)(a+32) ),
+                                                                   _mm_loadu_si128( (const __m128i*)(b+32) ) ) );
+        uint64_t m3 = (uint16_t)_mm_movemask_epi8( _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i*)(a+48) ),
+                                                                   _mm_loadu_si128( (const __m128i*)(b+48) ) ) );
+        return ~( m0 | (m1 << 16) | (m2 << 32) | (m3 << 48) );
+#   else
+        uint64_t mask = 0;
+        for ( uint64_t i = 0; i < block_size; i += 8 ) {
+            uint64_t wa, wb;
+            memcpy( &wa, a + i, 8 );
+            memcpy( &wb, b + i, 8 );
+            if ( wa == wb )
+                continue;
+            for ( uint64_t j = 0; j < 8; j++ ) {
+                if ( a[i+j] != b[i+j] )
+                    mask |= (uint64_t)1 << (i+j);
+            }
+        }
+        return mask;
+#   endif
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief найти первый различающийся байт
+    /// \param a      - данные
+    /// \param b      - данные
+    /// \param length - количество байт
+    /// \param equal  - false - первый различающийся байт, true - первый совпадающий
+    /// \return смещение найденного байта, length - не найден
+    ///
+    /// блоки без искомых байт пропускаются одной проверкой маски
+    ///
+    static inline uint64_t find_difference( const char *a, const char *b, uint64_t length, bool equal = false ) {
+        uint64_t invert = equal ? ~(uint64_t)0 : 0;
+        uint64_t offset = 0;
+        for ( ; offset + block_size <= length; offset += block_size ) {
+            uint64_t mask = neq_mask( a + offset, b + offset ) ^ invert;
+            if ( mask )
+                return offset + trailing_zeros( mask );
+        }
+        if ( offset < length ) {
+            alignas(64) char tail_a[block_size];
+            alignas(64) char tail_b[block_size];
+            uint64_t size = length - offset;
+            uint64_t mask = ( neq_mask( load_block( a + offset, size, tail_a ),
+                                        load_block( b + offset, size, tail_b ) ) ^ invert ) & low_mask( size );
+            if ( mask )
+                return offset + trailing_zeros( mask );
+        }
+        return length;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief префиксный xor маски - бит i равен чётности количества\n
+    ///  установленных бит в позициях [0..i]. используется для вычисления\n
+    ///  маски "внутри кавычек".
+    /// \param mask - исходная маска
+    /// \return префиксный xor
+    ///
+    static inline uint64_t prefix_xor( uint64_t mask ) {
+#   if defined(FILEMAP_PCLMUL)
+        __m128i all = _mm_set1_epi8( (char)0xFF );
+        __m128i res = _mm_clmulepi64_si128( _mm_set_epi64x( 0, (long long)mask ), all, 0 );
+        return (uint64_t)_mm_cvtsi128_si64( res );
+#   else
+        mask ^= mask << 1;
+        mask ^= mask << 2;
+        mask ^= mask << 4;
+        mask ^= mask << 8;
+        mask ^= mask << 16;
+        mask ^= mask << 32;
+        return mask;
+#   endif
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief номер младшего установленного бита
+    /// \param mask - маска, не равная нулю
+    /// \return номер бита
+    ///
+    static inline uint64_t trailing_zeros( uint64_t mask ) {
+#   if defined(_MSC_VER)
+        unsigned long index = 0;
+        _BitScanForward64( &index, mask );
+        return index;
+#   else
+        return (uint64_t)__builtin_ctzll( mask );
+#   endif
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief номер старшего установленного бита
+    /// \param mask - маска, не равная нулю
+    /// \return номер бита
+    ///
+    static inline uint64_t leading_bit( uint64_t mask ) {
+#   if defined(_MSC_VER)
+        unsigned long index = 0;
+        _BitScanReverse64( &index, mask );
+        return index;
+#   else
+        return 63 - (uint64_t)__builtin_clzll( mask );
+#   endif
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief количество установленных бит
+    /// \param mask - маска
+    /// \return количество бит
+    ///
+    static inline uint64_t popcount( uint64_t mask ) {
+#   if defined(_MSC_VER)
+        return (uint64_t)__popcnt64( mask );
+#   else
+        return (uint64_t)__builtin_popcountll( mask );
+#   endif
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief маска первых length бит (length <= 64)
+    ///
+    static inline uint64_t low_mask( uint64_t length ) {
+        return ( length >= 64 ) ? ~(uint64_t)0 : (((uint64_t)1 << length) - 1);
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief копировать данные без заполнения кеша процессора\n
+    ///  (non-temporal stores), для больших объемов
+    /// \param dest   - приемник
+    /// \param src    - источник
+    /// \param length - количество байт
+    ///
+    static inline void stream_copy( char *dest, const char *src, uint64_t length ) {
+#   if defined(FILEMAP_SSE2)
+        // начало - до выравнивания приемника на 16 байт
+        uint64_t head = ( 16 - ( (uintptr_t)dest & 15 ) ) & 15;
+        if ( head > length )
+            head = length;
+        memcpy( dest, src, (size_t)head );
+        dest += head;
+        src += head;
+        length -= head;
+        for ( ; length >= block_size; length -= block_size, dest += block_size, src += block_size ) {
+            __m128i b0 = _mm_loadu_si128( (const __m128i*)(src) );
+            __m128i b1 = _mm_loadu_si128( (const __m128i*)(src+16) );
+            __m128i b2 = _mm_loadu_si128( (const __m128i*)(src+32) );
+            __m128i b3 = _mm_loadu_si128( (const __m128i*)(src+48) );
+            _mm_stream_si128( (__m128i*)(dest),    b0 );
+            _mm_stream_si128( (__m128i*)(dest+16), b1 );
+            _mm_stream_si128( (__m128i*)(dest+32), b2 );
+            _mm_stream_si128( (__m128i*)(dest+48), b3 );
+        }
+        _mm_sfence();
+#   endif
+        memcpy( dest, src, (size_t)length );
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief подготовить блок для классификации
+    /// \param p      - указатель на данные
+    /// \param length - количество доступных байт
+    /// \param buff   - буфер на 64 байта для неполного блока
+    /// \return указатель на 64 байта, которые можно безопасно прочитать
+    ///
+    /// если доступно не меньше 64 байт - возвращается сам указатель,\n
+    /// иначе хвост копируется в buff и дополняется нулями.
+    ///
+    static inline const char* load_block( const char *p, uint64_t length, char *buff ) {
+        if ( length >= block_size )
+            return p;
+        memset( buff, 0, block_size );
+        memcpy( buff, p, (size_t)length );
+        return buff;
+    }
+};
+
+#endif // FILEMAP_SIMD_H
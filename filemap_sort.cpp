@@ -0,0 +1,450 @@
+/*!
+ *
+ * \file filemap_sort.cpp
+ * \brief реализация класса внешней сортировки строк файла
+ *
+ *  параллельная сортировка частей во временные файлы и слияние\n
+ *  деревом проигравших.
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+
+#include "filemap_sort.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <errno.h>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// конструктор
+CFileMapSort::CFileMapSort( uint64_t run_size /*= 256*1024*1024*/ )
+    : CFileMap( run_size ? run_size : 1 )
+{
+    m_threads = 0;                  // количество потоков - по числу ядер
+    memset( &m_stats, 0, sizeof(m_stats) );
+}   //  CFileMapSort( uint64_t run_size )
+
+///////////////////////////////////////////////////////////////////////////////
+// отсортировать строки файла в выходной файл
+uint64_t CFileMapSort::sort_file( const wchar_t *output_path )
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    memset( &m_stats, 0, sizeof(m_stats) );
+
+    uint64_t last_error = 0;
+    uint64_t file_size = 0;
+    uint64_t file_time = 0;
+    wstring output = output_path;
+
+    sort_job job;
+    job.next = 0;
+    job.error = 0;
+
+    try
+    {
+        last_error = get_file_info( file_size, file_time );
+        if ( last_error )
+            throw last_error;
+        m_stats.file_size = file_size;
+
+        if ( file_size == 0 ) {
+            // пустой файл - пустой результат
+#           if defined(OS_WIN)
+            HANDLE file = ::CreateFileW( output.c_str(), GENERIC_WRITE, 0, NULL,
+                                         CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL );
+            if ( file == INVALID_HANDLE_VALUE ) {
+                last_error = ::GetLastError();
+                throw last_error;
+            }
+            ::CloseHandle( file );
+#           else
+            string file_path = wchar_string( output.c_str(), output.length() );
+            int file = ::open( file_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_LARGEFILE,
+                               S_IRWXU | S_IRWXG | S_IROTH );
+            if ( file == INVALID_HANDLE_VALUE ) {
+                last_error = errno;
+                throw last_error;
+            }
+            ::close( file );
+#           endif  // defined(OS_WIN)
+            return 0;
+        }
+
+        // 1. части по границам строк, одна часть сортируется сразу в выходной файл
+        last_error = split_runs( file_size, job.runs );
+        if ( last_error )
+            throw last_error;
+        m_stats.runs = job.runs.size();
+        for ( size_t index = 0; index < job.runs.size(); index++ ) {
+            if ( job.runs.size() == 1 ) {
+                job.runs[index].path = output;
+            } else if ( m_temp_dir.length() ) {
+                size_t name = output.find_last_of( L"/\\" );
+                name = ( name == wstring::npos ) ? 0 : name + 1;
+#               if defined(OS_WIN)
+                job.runs[index].path = m_temp_dir + L"\\" + output.substr( name );
+#               else
+                job.runs[index].path = m_temp_dir + L"/" + output.substr( name );
+#               endif  // defined(OS_WIN)
+                job.runs[index].path += L".run" + to_wstring( index );
+            } else {
+                job.runs[index].path = output + L".run" + to_wstring( index );
+            }
+        }
+
+        uint32_t threads = m_threads ? m_threads : std::max( 1u, std::thread::hardware_concurrency() );
+        if ( threads > job.runs.size() )
+            threads = (uint32_t)job.runs.size();
+        m_stats.threads = threads;
+
+        vector<thread> workers;
+        for ( uint32_t index = 1; index < threads; index++ )
+            workers.emplace_back( &CFileMapSort::sort_worker, this, std::ref( job ) );
+        sort_worker( job );
+        for ( thread &worker : workers )
+            worker.join();
+        last_error = job.error;
+        if ( last_error )
+            throw last_error;
+        for ( const run_info &run : job.runs )
+            m_stats.lines += run.lines;
+
+        chrono::steady_clock::time_point sorted = chrono::steady_clock::now();
+        m_stats.sort_time = (uint64_t)chrono::duration_cast<chrono::nanoseconds>( sorted - start ).count();
+
+        // 2. слияние частей
+        if ( job.runs.size() > 1 ) {
+            last_error = merge_runs( job.runs, output );
+            if ( last_error )
+                throw last_error;
+        }
+        m_stats.merge_time = (uint64_t)chrono::duration_cast<chrono::nanoseconds>(
+                                 chrono::steady_clock::now() - sorted ).count();
+    }
+    catch( uint64_t error ) {
+        last_error = error;
+        cout<< "an error number \"" << error << "\" is generated in the method sort_file" <<endl;
+    }
+
+    // временные файлы удаляются и при ошибке
+    if ( job.runs.size() > 1 ) {
+        for ( const run_info &run : job.runs )
+            remove_file( run.path );
+    }
+    return last_error;
+}   //  sort_file( const wchar_t *output_path )
+
+///////////////////////////////////////////////////////////////////////////////
+// разделить файл на части по границам строк
+uint64_t CFileMapSort::split_runs( uint64_t file_size, vector<run_info> &runs )
+{
+    runs.clear();
+    set_file_size( file_size );
+    uint64_t last_error = open_file_map( CFileMap::mode::read );
+    if ( last_error )
+        return last_error;
+
+    uint64_t run_size = get_limit_memory();
+    uint64_t begin = 0;
+    while ( begin < file_size ) {
+        uint64_t end = file_size;
+        if ( file_size - begin > run_size ) {
+            // часть заканчивается после первого '\n', начиная с begin + run_size - 1
+            last_error = seek( begin + run_size - 1 );
+            if ( last_error )
+                break;
+            while ( !eof() ) {
+                const char *data = (const char *)get_map_address();
+                uint64_t length = get_max_copy_ex();
+                const char *found = (const char *)memchr( data, '\n', (size_t)length );
+                if ( found ) {
+                    end = m_offset.QuadPart + ( found - data ) + 1;
+                    break;
+                }
+                if ( check_map_region( length ) == 0 && !eof() ) {
+#                   if defined(OS_WIN)
+                    last_error = ERROR_READ_FAULT;
+#                   else
+                    last_error = EIO;
+#                   endif  // defined(OS_WIN)
+                    break;
+                }
+            }
+            if ( last_error )
+                break;
+        }
+
+        run_info run;
+        run.begin = begin;
+        run.end = end;
+        run.size = 0;
+        run.lines = 0;
+        runs.push_back( run );
+        begin = end;
+    }
+
+    close_file_map();
+    return last_error;
+}   //  split_runs( uint64_t file_size, vector<run_info> &runs )
+
+///////////////////////////////////////////////////////////////////////////////
+// сортировать части (выполняется в отдельном потоке)
+void CFileMapSort::sort_worker( sort_job &job )
+{
+    for ( ;; ) {
+        size_t index = job.next.fetch_add( 1 );
+        if ( index >= job.runs.size() || job.error.load() != 0 )
+            break;
+
+        uint64_t error = sort_run( job.runs[index] );
+        if ( error ) {
+            uint64_t expected = 0;
+            job.error.compare_exchange_strong( expected, error );
+            break;
+        }
+    }
+}   //  sort_worker( sort_job &job )
+
+///////////////////////////////////////////////////////////////////////////////
+// отсортировать часть и записать ее в файл
+uint64_t CFileMapSort::sort_run( run_info &run )
+{
+    // проекция части целиком (начало - по гранулярности страниц памяти)
+    uint64_t base = run.begin - run.begin % get_page_size();
+    CFileMapSort input( memory_allocation_granularity( run.end - base ) );
+    input.set_file_path( get_file_path().c_str() );
+    input.set_file_size( run.end );
+    uint64_t last_error = input.open_file_map( CFileMap::mode::read, base );
+    if ( last_error )
+        return last_error;
+    if ( input.get_max_copy_ex() < run.end - base ) {
+        input.close_file_map();
+#       if defined(OS_WIN)
+        return ERROR_READ_FAULT;
+#       else
+        return EIO;
+#       endif  // defined(OS_WIN)
+    }
+
+    // строки части - указатели в проекцию
+    const char *data = (const char *)input.get_map_address() + ( run.begin - base );
+    const char *end = data + ( run.end - run.begin );
+    vector<string_view> lines;
+    while ( data < end ) {
+        const char *found = (const char *)memchr( data, '\n', end - data );
+        if ( found == nullptr )
+            found = end;
+        lines.push_back( string_view( data, found - data ) );
+        data = found + 1;
+    }
+    run.lines = lines.size();
+
+    if ( m_less ) {
+        std::sort( lines.begin(), lines.end(), [this]( string_view a, string_view b ) {
+            return m_less( a, b );
+        } );
+    } else {
+        std::sort( lines.begin(), lines.end() );
+    }
+
+    // каждая строка записывается с '\n'
+    run.size = 0;
+    for ( const string_view &line : lines )
+        run.size += line.size() + 1;
+
+    CFileMap output( std::min( get_limit_memory(), (uint64_t)16*1024*1024 ) );
+    output.set_file_path( run.path.c_str() );
+    output.set_file_size( run.size );
+    last_error = output.open_file_map( CFileMap::mode::write );
+    if ( last_error == 0 ) {
+        for ( const string_view &line : lines ) {
+            if ( output.write( line.data(), line.size() ) != line.size() ||
+                 output.write( "\n", 1 ) != 1 ) {
+#               if defined(OS_WIN)
+                last_error = ERROR_WRITE_FAULT;
+#               else
+                last_error = EIO;
+#               endif  // defined(OS_WIN)
+                break;
+            }
+        }
+        output.close_file_map();
+    }
+    input.close_file_map();
+    return last_error;
+}   //  sort_run( run_info &run )
+
+///////////////////////////////////////////////////////////////////////////////
+// слить отсортированные части в выходной файл
+uint64_t CFileMapSort::merge_runs( vector<run_info> &runs, const wstring &output_path )
+{
+    int count = (int)runs.size();
+    // память сортировки делится между частями и выходным файлом
+    uint64_t budget = get_limit_memory() * std::max( 1u, m_stats.threads );
+    uint64_t window = memory_allocation_granularity( budget / ( count + 1 ) );
+
+    uint64_t last_error = 0;
+    uint64_t total = 0;
+    vector<merge_cursor> cursors( count );
+    for ( int index = 0; index < count; index++ ) {
+        merge_cursor &cursor = cursors[index];
+        cursor.map.reset( new CFileMapSort( window ) );
+        cursor.map->set_file_path( runs[index].path.c_str() );
+        cursor.map->set_file_size( runs[index].size );
+        cursor.pending = 0;
+        cursor.done = false;
+        last_error = cursor.map->open_file_map( CFileMap::mode::read );
+        if ( last_error )
+            return last_error;
+        next_line( cursor );
+        total += runs[index].size;
+    }
+
+    CFileMap output( window );
+    output.set_file_path( output_path.c_str() );
+    output.set_file_size( total );
+    last_error = output.open_file_map( CFileMap::mode::write );
+    if ( last_error )
+        return last_error;
+
+    /* дерево проигравших: tree[1..count-1] - проигравшие в узлах,
+     * tree[0] - победитель (часть с минимальной строкой) */
+    vector<int> tree( count );
+    vector<int> winner( 2 * count );
+    for ( int index = 0; index < count; index++ )
+        winner[count + index] = index;
+    for ( int node = count - 1; node > 0; node-- ) {
+        int a = winner[2 * node];
+        int b = winner[2 * node + 1];
+        if ( beats( cursors, a, b ) ) {
+            winner[node] = a;
+            tree[node] = b;
+        } else {
+            winner[node] = b;
+            tree[node] = a;
+        }
+    }
+    tree[0] = winner[1];
+
+    while ( !cursors[tree[0]].done ) {
+        int current = tree[0];
+        const string_view &line = cursors[current].line;
+        if ( output.write( line.data(), line.size() ) != line.size() ||
+             output.write( "\n", 1 ) != 1 ) {
+#           if defined(OS_WIN)
+            last_error = ERROR_WRITE_FAULT;
+#           else
+            last_error = EIO;
+#           endif  // defined(OS_WIN)
+            break;
+        }
+        next_line( cursors[current] );
+
+        // новая строка части проходит от листа к корню
+        for ( int node = ( current + count ) / 2; node > 0; node /= 2 ) {
+            if ( beats( cursors, tree[node], current ) )
+                std::swap( tree[node], current );
+        }
+        tree[0] = current;
+    }
+
+    output.close_file_map();
+    for ( merge_cursor &cursor : cursors )
+        cursor.map->close_file_map();
+    return last_error;
+}   //  merge_runs( vector<run_info> &runs, const wstring &output_path )
+
+///////////////////////////////////////////////////////////////////////////////
+// перейти к следующей строке временного файла
+void CFileMapSort::next_line( merge_cursor &cursor )
+{
+    CFileMapSort &map = *cursor.map;
+    /* предыдущая строка указывала в проекцию - позиция сдвигается только
+     * сейчас, иначе отражение следующего блока сделало бы ее недействительной */
+    if ( cursor.pending ) {
+        map.check_map_region( cursor.pending );
+        cursor.pending = 0;
+    }
+    cursor.carry.clear();
+
+    for ( ;; ) {
+        if ( map.eof() ) {
+            cursor.line = cursor.carry;
+            cursor.done = cursor.carry.empty();
+            return;
+        }
+        const char *data = (const char *)map.get_map_address();
+        uint64_t length = map.get_max_copy_ex();
+        const char *found = (const char *)memchr( data, '\n', (size_t)length );
+        if ( found ) {
+            if ( cursor.carry.empty() ) {
+                cursor.line = string_view( data, found - data );
+                cursor.pending = ( found - data ) + 1;
+            } else {
+                cursor.carry.append( data, found - data );
+                cursor.line = cursor.carry;
+                map.check_map_region( ( found - data ) + 1 );
+            }
+            return;
+        }
+        // строка продолжается в следующем блоке
+        cursor.carry.append( data, (size_t)length );
+        map.check_map_region( length );
+    }
+}   //  next_line( merge_cursor &cursor )
+
+///////////////////////////////////////////////////////////////////////////////
+// строка части a идет раньше строки части b
+bool CFileMapSort::beats( const vector<merge_cursor> &cursors, int a, int b ) const
+{
+    const merge_cursor &first = cursors[a];
+    const merge_cursor &second = cursors[b];
+    if ( first.done || second.done )
+        return second.done && !first.done;
+    bool less = m_less ? m_less( first.line, second.line ) : ( first.line < second.line );
+    if ( less )
+        return true;
+    bool greater = m_less ? m_less( second.line, first.line ) : ( second.line < first.line );
+    // равные строки - в порядке частей
+    return !greater && a < b;
+}   //  beats( const vector<merge_cursor> &cursors, int a, int b )
+
+///////////////////////////////////////////////////////////////////////////////
+// удалить файл
+void CFileMapSort::remove_file( const wstring &path )
+{
+#   if defined(OS_WIN)
+    ::DeleteFileW( path.c_str() );
+#   else
+    string file_path = wchar_string( path.c_str(), path.length() );
+    ::unlink( file_path.c_str() );
+#   endif  // defined(OS_WIN)
+}   //  remove_file( const wstring &path )
@@ -0,0 +1,280 @@
+/*!
+ *
+ * \file filemap_sort.h
+ * \brief определение класса внешней сортировки строк файла
+ *
+ *  сортировка файлов больше оперативной памяти: части файла размером\n
+ *  с блок проекции сортируются параллельно во временные файлы, затем\n
+ *  сливаются турниром с проигравшими (loser tree) в выходной файл.
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied\n
+ * warranty. In no event will the authors be held liable for any damages\n
+ * arising from the use of this software.\n
+ *
+ * Permission is granted to anyone to use this software for any purpose,\n
+ * including commercial applications, and to alter it and redistribute it\n
+ * freely, subject to the following restrictions:\n
+ *
+ *    1. The origin of this software must not be misrepresented; you must not\n
+ *    claim that you wrote the original software. If you use this software\n
+ *    in a product, an acknowledgment in the product documentation would be\n
+ *    appreciated but is not required.\n
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be\n
+ *    misrepresented as being the original software.\n
+ *    3. This notice may not be removed or altered from any source\n
+ *    distribution.\n
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+#ifndef FILEMAP_SORT_H
+#define FILEMAP_SORT_H
+
+#include "filemap.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+
+//--------------------------------------------------------------------------------------------------//
+
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief The CFileMapSort class - внешняя сортировка строк файла
+///
+/// 1. файл делится на части (run) размером с блок проекции (limit_map_memory)\n
+///    по границам строк; каждая часть отражается целиком, указатели на ее\n
+///    строки сортируются в памяти, отсортированные строки записываются во\n
+///    временный файл через проекцию. Части обрабатываются параллельно\n
+///    (set_threads()), памяти нужно около ( блок + 16 байт на строку ) на поток.\n
+/// 2. временные файлы сливаются: каждый читается своим блоком проекции,\n
+///    строки сравниваются без копирования (std::string_view в проекцию),\n
+///    минимальную строку выбирает дерево проигравших - log2(k) сравнений\n
+///    на строку.\n
+/// 3. результат записывается в выходной файл через проекцию в режиме записи.\n
+///
+/// каждая строка результата заканчивается '\\n' (последняя строка файла без\n
+/// '\\n' его получает), CR перед '\\n' остается частью строки. Строки с равными\n
+/// ключами сохраняют порядок только внутри части. Временные файлы\n
+/// создаются в set_temp_dir() (по умолчанию - рядом с выходным файлом)\n
+/// и удаляются после слияния.
+///
+/// \code
+/// CFileMapSort sort( 512*1024*1024 );
+/// sort.set_file_path( input_path );
+/// sort.set_threads( 8 );
+/// sort.set_temp_dir( "/scratch" );
+/// sort.sort_file( output_path );
+/// \endcode
+///
+class CFileMapSort : public CFileMap
+{
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief статистика сортировки
+    ///
+    struct sort_stats {
+        uint64_t file_size;     // размер файла
+        uint64_t lines;         // количество строк
+        uint64_t runs;          // количество отсортированных частей
+        uint32_t threads;       // количество потоков
+        uint64_t sort_time;     // время сортировки частей (наносекунды)
+        uint64_t merge_time;    // время слияния (наносекунды)
+    };
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief конструктор
+    /// \param run_size - размер части, сортируемой в памяти (блок проекции)
+    ///
+    CFileMapSort( uint64_t run_size = 256*1024*1024 );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить количество потоков сортировки частей
+    /// \param threads - количество потоков, ноль - по числу ядер
+    ///
+    void set_threads( uint32_t threads ) {
+        m_threads = threads;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить каталог временных файлов
+    /// \param temp_dir - каталог, пустая строка - каталог выходного файла
+    ///
+    void set_temp_dir( const wchar_t *temp_dir ) {
+        m_temp_dir = temp_dir;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить каталог временных файлов
+    /// \param temp_dir - каталог, пустая строка - каталог выходного файла
+    ///
+    void set_temp_dir( const char *temp_dir ) {
+        m_temp_dir = char_wstring( temp_dir );
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить сравнение строк
+    /// \param less - функция ( a, b ): true - строка a идет раньше b\n
+    ///  (строки без '\\n'), по умолчанию - побайтное сравнение
+    ///
+    void set_comparator( std::function<bool( std::string_view a, std::string_view b )> less ) {
+        m_less = std::move( less );
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief отсортировать строки файла (set_file_path()) в выходной файл
+    /// \param output_path - полное имя выходного файла
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t sort_file( const wchar_t *output_path );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief отсортировать строки файла в выходной файл
+    /// \param output_path - полное имя выходного файла
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t sort_file( const char *output_path ) {
+        return sort_file( char_wstring( output_path ).c_str() );
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить статистику последней сортировки
+    ///
+    const sort_stats& get_sort_stats() const {
+        return m_stats;
+    }
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief часть файла, сортируемая в памяти
+    ///
+    struct run_info {
+        uint64_t     begin;         // начало части в исходном файле (начало строки)
+        uint64_t     end;           // конец части (после '\n' или конец файла)
+        uint64_t     size;          // размер отсортированной части (с '\n' в конце)
+        uint64_t     lines;         // количество строк
+        std::wstring path;          // временный файл (или выходной файл, если часть одна)
+    };
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief общее состояние потоков сортировки частей
+    ///
+    struct sort_job {
+        std::vector<run_info> runs;         // части файла
+        std::atomic<size_t>   next;         // следующая часть
+        std::atomic<uint64_t> error;        // первая ошибка
+    };
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief непрочитанная часть временного файла при слиянии
+    ///
+    struct merge_cursor {
+        std::unique_ptr<CFileMapSort> map;  // проекция временного файла
+        std::string_view line;              // текущая строка (в проекции или в carry)
+        std::string      carry;             // строка, разбитая между блоками проекции
+        uint64_t         pending;           // байт текущей строки в проекции (сдвиг позиции)
+        bool             done;              // строки закончились
+    };
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief разделить файл на части по границам строк
+    /// \param file_size - размер файла
+    /// \param runs - части файла
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t split_runs( uint64_t file_size, std::vector<run_info> &runs );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief сортировать части (выполняется в отдельном потоке)
+    /// \param job - общее состояние сортировки
+    ///
+    void sort_worker( sort_job &job );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief отсортировать часть и записать ее в файл
+    /// \param run - часть файла
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t sort_run( run_info &run );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief слить отсортированные части в выходной файл
+    /// \param runs - части (временные файлы)
+    /// \param output_path - полное имя выходного файла
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t merge_runs( std::vector<run_info> &runs, const std::wstring &output_path );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief перейти к следующей строке временного файла
+    /// \param cursor - непрочитанная часть
+    ///
+    void next_line( merge_cursor &cursor );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief строка части a идет раньше строки части b (для дерева проигравших)
+    ///
+    bool beats( const std::vector<merge_cursor> &cursors, int a, int b ) const;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief удалить файл
+    ///
+    void remove_file( const std::wstring &path );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief количество потоков, ноль - по числу ядер
+    ///
+    uint32_t m_threads;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief каталог временных файлов
+    ///
+    std::wstring m_temp_dir;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief сравнение строк
+    ///
+    std::function<bool( std::string_view a, std::string_view b )> m_less;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief статистика последней сортировки
+    ///
+    sort_stats m_stats;
+};
+
+#endif // FILEMAP_SORT_H
@@ -0,0 +1,296 @@
+/*!
+ *
+ * \file filemap_sorted.cpp
+ * \brief реализация класса двоичного поиска в отсортированном файле
+ *
+ *  деление пополам по смещениям с выравниванием на начало строки\n
+ *  или по номерам записей фиксированного размера.
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+
+#include "filemap_sorted.h"
+#include <algorithm>
+#include <errno.h>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// конструктор
+CFileMapSorted::CFileMapSorted( uint64_t limit_map_memory /*= 0*/ )
+    : CFileMap( limit_map_memory )
+{
+    m_record_size = 0;              // текстовый режим
+    m_header_size = 0;              // заголовка нет
+    m_probes = 0;                   // поиск не выполнялся
+    m_advised = nullptr;            // MADV_RANDOM не включался
+}   //  CFileMapSorted( uint64_t limit_map_memory )
+
+///////////////////////////////////////////////////////////////////////////////
+// найти первую запись с ключом не меньше key
+uint64_t CFileMapSorted::lower_bound( string_view key, uint64_t &offset )
+{
+    m_probes = 0;
+    uint64_t last_error = bound( key, false, ( m_record_size != 0 ) ? m_header_size : 0, offset );
+    advise_normal();
+    if ( last_error )
+        return last_error;
+    return seek( offset );
+}   //  lower_bound( string_view key, uint64_t &offset )
+
+///////////////////////////////////////////////////////////////////////////////
+// найти первую запись с ключом больше key
+uint64_t CFileMapSorted::upper_bound( string_view key, uint64_t &offset )
+{
+    m_probes = 0;
+    uint64_t last_error = bound( key, true, ( m_record_size != 0 ) ? m_header_size : 0, offset );
+    advise_normal();
+    if ( last_error )
+        return last_error;
+    return seek( offset );
+}   //  upper_bound( string_view key, uint64_t &offset )
+
+///////////////////////////////////////////////////////////////////////////////
+// найти диапазон записей с ключом key
+uint64_t CFileMapSorted::equal_range( string_view key, uint64_t &first, uint64_t &last )
+{
+    m_probes = 0;
+    uint64_t last_error = bound( key, false, ( m_record_size != 0 ) ? m_header_size : 0, first );
+    // верхняя граница не раньше нижней
+    if ( last_error == 0 )
+        last_error = bound( key, true, first, last );
+    advise_normal();
+    if ( last_error )
+        return last_error;
+    return seek( first );
+}   //  equal_range( string_view key, uint64_t &first, uint64_t &last )
+
+///////////////////////////////////////////////////////////////////////////////
+// двоичный поиск границы
+uint64_t CFileMapSorted::bound( string_view key, bool upper, uint64_t begin, uint64_t &offset )
+{
+    uint64_t file_size = m_file_size.QuadPart;
+    offset = file_size;
+    if ( !is_open() ) {
+#       if defined(OS_WIN)
+        return ERROR_INVALID_HANDLE;
+#       else
+        return EBADF;
+#       endif  // defined(OS_WIN)
+    }
+
+    uint64_t last_error = 0;
+    string_view record;
+    uint64_t next = 0;
+
+    if ( m_record_size != 0 ) {
+        // записи фиксированного размера - деление пополам по номерам
+        uint64_t count = ( file_size > m_header_size ) ? ( file_size - m_header_size ) / m_record_size : 0;
+        uint64_t lo = ( begin > m_header_size ) ? ( begin - m_header_size ) / m_record_size : 0;
+        uint64_t hi = count;
+        while ( lo < hi ) {
+            uint64_t mid = lo + ( hi - lo ) / 2;
+            last_error = record_at( m_header_size + mid * m_record_size, record, next );
+            if ( last_error )
+                return last_error;
+            if ( before( record, key, upper ) )
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        offset = ( lo < count ) ? m_header_size + lo * m_record_size : file_size;
+        return 0;
+    }
+
+    /* строки: lo - начало строки, все строки до lo идут раньше границы,
+     * все строки, начинающиеся не раньше hi, - не раньше границы */
+    uint64_t lo = begin;
+    uint64_t hi = file_size;
+    while ( lo < hi ) {
+        uint64_t mid = lo + ( hi - lo ) / 2;
+        uint64_t start = 0;
+        last_error = line_start( mid, hi, start );
+        if ( last_error )
+            return last_error;
+        if ( start >= hi ) {
+            // в [mid, hi) строки не начинаются - ищем в [lo, mid)
+            hi = mid;
+            continue;
+        }
+        last_error = record_at( start, record, next );
+        if ( last_error )
+            return last_error;
+        if ( before( record, key, upper ) )
+            lo = next;
+        else
+            hi = start;
+    }
+    offset = lo;
+    return 0;
+}   //  bound( string_view key, bool upper, uint64_t begin, uint64_t &offset )
+
+///////////////////////////////////////////////////////////////////////////////
+// запись идет раньше границы поиска
+bool CFileMapSorted::before( string_view record, string_view key, bool upper ) const
+{
+    string_view record_key = m_extractor ? m_extractor( record ) : record;
+    int result = m_comparator ? m_comparator( record_key, key ) : record_key.compare( key );
+    return upper ? ( result <= 0 ) : ( result < 0 );
+}   //  before( string_view record, string_view key, bool upper )
+
+///////////////////////////////////////////////////////////////////////////////
+// найти начало первой строки не раньше offset
+uint64_t CFileMapSorted::line_start( uint64_t offset, uint64_t limit, uint64_t &start )
+{
+    start = 0;
+    if ( offset == 0 )
+        return 0;
+
+    // строка начинается после '\n' на позиции offset - 1 или дальше
+    uint64_t position = offset - 1;
+    while ( position < limit ) {
+        uint64_t last_error = seek_probe( position );
+        if ( last_error )
+            return last_error;
+        const char *data = (const char *)get_map_address();
+        uint64_t length = std::min( get_max_copy_ex(), limit - position );
+        if ( length == 0 )
+            break;
+        const char *found = (const char *)memchr( data, '\n', (size_t)length );
+        if ( found ) {
+            start = position + ( found - data ) + 1;
+            return 0;
+        }
+        position += length;
+    }
+    start = limit;
+    return 0;
+}   //  line_start( uint64_t offset, uint64_t limit, uint64_t &start )
+
+///////////////////////////////////////////////////////////////////////////////
+// прочитать запись
+uint64_t CFileMapSorted::record_at( uint64_t offset, string_view &record, uint64_t &next )
+{
+    m_probes++;
+    uint64_t last_error = seek_probe( offset );
+    if ( last_error )
+        return last_error;
+
+    if ( m_record_size != 0 ) {
+        next = offset + m_record_size;
+        if ( get_contiguous() >= m_record_size ) {
+            record = string_view( (const char *)get_map_address(), (size_t)m_record_size );
+            return 0;
+        }
+        // запись разбита между блоками проекции
+        m_record.resize( (size_t)m_record_size );
+        if ( read( &m_record[0], m_record_size ) != m_record_size ) {
+#           if defined(OS_WIN)
+            return ERROR_HANDLE_EOF;
+#           else
+            return EIO;
+#           endif  // defined(OS_WIN)
+        }
+        record = m_record;
+        return 0;
+    }
+
+    uint64_t file_size = m_file_size.QuadPart;
+    uint64_t position = offset;
+    bool copied = false;
+    // запись завершена символом новой строки
+    bool terminated = false;
+    m_record.clear();
+    for ( ;; ) {
+        const char *data = (const char *)get_map_address();
+        uint64_t length = get_max_copy_ex();
+        const char *found = length ? (const char *)memchr( data, '\n', (size_t)length ) : nullptr;
+        if ( found ) {
+            if ( copied ) {
+                m_record.append( data, found - data );
+                record = m_record;
+            } else {
+                record = string_view( data, found - data );
+            }
+            next = position + ( found - data ) + 1;
+            terminated = true;
+            break;
+        }
+        // строка продолжается в следующем блоке (или последняя строка без '\n')
+        m_record.append( data, (size_t)length );
+        copied = true;
+        position += length;
+        if ( length == 0 || position >= file_size ) {
+            record = m_record;
+            next = file_size;
+            break;
+        }
+        last_error = seek_probe( position );
+        if ( last_error )
+            return last_error;
+    }
+
+    record = record.substr( 0, (size_t)line_length( record.data(), record.size(), terminated ) );
+    return 0;
+}   //  record_at( uint64_t offset, string_view &record, uint64_t &next )
+
+///////////////////////////////////////////////////////////////////////////////
+// установить позицию пробы
+uint64_t CFileMapSorted::seek_probe( uint64_t offset )
+{
+    uint64_t last_error = seek( offset );
+    if ( last_error )
+        return last_error;
+
+#   if !defined(OS_WIN)
+    // новый блок проекции - упреждающее чтение не нужно, пробы разбросаны по файлу
+    char *base = (char *)get_map_address() - m_offset_block;
+    if ( base != m_advised ) {
+        uint64_t length = m_offset_block + get_max_copy_ex();
+        if ( length )
+            ::madvise( base, (size_t)length, MADV_RANDOM );
+        m_advised = base;
+    }
+#   endif  // !defined(OS_WIN)
+    return 0;
+}   //  seek_probe( uint64_t offset )
+
+///////////////////////////////////////////////////////////////////////////////
+// вернуть обычный режим упреждающего чтения блоку проекции
+void CFileMapSorted::advise_normal()
+{
+#   if !defined(OS_WIN)
+    if ( m_advised != nullptr && get_map_address() != nullptr ) {
+        char *base = (char *)get_map_address() - m_offset_block;
+        uint64_t length = m_offset_block + get_max_copy_ex();
+        if ( base == m_advised && length )
+            ::madvise( base, (size_t)length, MADV_NORMAL );
+    }
+#   endif  // !defined(OS_WIN)
+    m_advised = nullptr;
+}   //  advise_normal()
@@ -0,0 +1,262 @@
+/*!
+ *
+ * \file filemap_sorted.h
+ * \brief определение класса двоичного поиска в отсортированном файле
+ *
+ *  поиск по файлу, отсортированному по ключу (одна запись на строку\n
+ *  или записи фиксированного размера): деление пополам по смещениям в\n
+ *  файле с выравниванием на начало строки, читается O(log n) страниц.
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied\n
+ * warranty. In no event will the authors be held liable for any damages\n
+ * arising from the use of this software.\n
+ *
+ * Permission is granted to anyone to use this software for any purpose,\n
+ * including commercial applications, and to alter it and redistribute it\n
+ * freely, subject to the following restrictions:\n
+ *
+ *    1. The origin of this software must not be misrepresented; you must not\n
+ *    claim that you wrote the original software. If you use this software\n
+ *    in a product, an acknowledgment in the product documentation would be\n
+ *    appreciated but is not required.\n
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be\n
+ *    misrepresented as being the original software.\n
+ *    3. This notice may not be removed or altered from any source\n
+ *    distribution.\n
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+#ifndef FILEMAP_SORTED_H
+#define FILEMAP_SORTED_H
+
+#include "filemap.h"
+#include <functional>
+#include <string>
+#include <string_view>
+
+
+
+//--------------------------------------------------------------------------------------------------//
+
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief The CFileMapSorted class - двоичный поиск записей по ключу
+///
+/// текстовый режим: запись - строка (без '\\n' и CR перед ним, CR остается\n
+/// в режиме lf set_line_ending(), режим crlf читается как mixed). Середина\n
+/// диапазона выбирается по смещению в байтах, затем позиция сдвигается на\n
+/// начало следующей строки, поэтому длина строк может быть любой.\n
+/// Режим записей фиксированного размера (set_record_size()): деление\n
+/// пополам по номерам записей после заголовка файла.\n
+///
+/// ключ записи получает функция set_key_extractor() (по умолчанию - вся\n
+/// запись), ключи сравнивает set_comparator() (по умолчанию - побайтно).\n
+/// Файл должен быть отсортирован по возрастанию ключа этим сравнением.\n
+/// На время поиска для блока проекции включается MADV_RANDOM, чтобы\n
+/// каждая проба читала только свою страницу, а не упреждающее окно.
+///
+/// \code
+/// CFileMapSorted file( 64*1024*1024 );
+/// file.set_file_path( file_path );
+/// file.set_file_size( file_size );
+/// file.open_file_map( CFileMap::mode::read );
+/// file.set_key_extractor( []( std::string_view line ) {
+///     return line.substr( 0, line.find( '\t' ) );
+/// } );
+/// uint64_t first, last;
+/// file.equal_range( "user42", first, last );
+/// while ( file.get_offset() < last )    // текущая позиция - first
+///     file.read_line( buffer );
+/// \endcode
+///
+class CFileMapSorted : public CFileMap
+{
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief конструктор
+    /// \param limit_map_memory - размер ограниения для единовремменого отражения\n
+    ///  файла в память, если равен нулю - то отражается сразу весь файл целиком.
+    ///
+    CFileMapSorted( uint64_t limit_map_memory = 0 );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить режим записей фиксированного размера
+    /// \param record_size - размер записи, ноль - текстовый режим (строки)
+    /// \param header_size - размер заголовка файла перед первой записью
+    ///
+    void set_record_size( uint64_t record_size, uint64_t header_size = 0 ) {
+        m_record_size = record_size;
+        m_header_size = header_size;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить функцию получения ключа записи
+    /// \param extractor - функция ( запись ) -> ключ (часть записи)
+    ///
+    void set_key_extractor( std::function<std::string_view( std::string_view record )> extractor ) {
+        m_extractor = std::move( extractor );
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить функцию сравнения ключей
+    /// \param comparator - функция ( a, b ): < 0 - a < b, 0 - равны, > 0 - a > b
+    ///
+    void set_comparator( std::function<int( std::string_view a, std::string_view b )> comparator ) {
+        m_comparator = std::move( comparator );
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief найти первую запись с ключом не меньше key
+    /// \param key - ключ
+    /// \param offset - смещение записи (размер файла - такой записи нет)
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    /// текущая позиция устанавливается на найденную запись
+    ///
+    uint64_t lower_bound( std::string_view key, uint64_t &offset );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief найти первую запись с ключом больше key
+    /// \param key - ключ
+    /// \param offset - смещение записи (размер файла - такой записи нет)
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    /// текущая позиция устанавливается на найденную запись
+    ///
+    uint64_t upper_bound( std::string_view key, uint64_t &offset );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief найти диапазон записей с ключом key
+    /// \param key - ключ
+    /// \param first - смещение первой записи с ключом (lower_bound)
+    /// \param last - смещение за последней записью с ключом (upper_bound)
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    /// текущая позиция устанавливается на first
+    ///
+    uint64_t equal_range( std::string_view key, uint64_t &first, uint64_t &last );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить количество записей, прочитанных последним поиском
+    ///
+    uint64_t get_probes() const {
+        return m_probes;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить текущую позицию в файле
+    ///
+    uint64_t get_offset() const {
+        return m_offset.QuadPart;
+    }
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief двоичный поиск границы
+    /// \param key - ключ
+    /// \param upper - false - первая запись >= key, true - первая запись > key
+    /// \param begin - начало диапазона поиска (начало записи)
+    /// \param offset - смещение найденной записи
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t bound( std::string_view key, bool upper, uint64_t begin, uint64_t &offset );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief запись идет раньше границы поиска
+    ///
+    bool before( std::string_view record, std::string_view key, bool upper ) const;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief найти начало первой строки не раньше offset (не дальше limit)
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t line_start( uint64_t offset, uint64_t limit, uint64_t &start );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief прочитать запись
+    /// \param offset - смещение записи
+    /// \param record - запись (в проекции или во внутреннем буфере)
+    /// \param next - смещение следующей записи
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t record_at( uint64_t offset, std::string_view &record, uint64_t &next );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить позицию пробы (блок проекции - MADV_RANDOM)
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t seek_probe( uint64_t offset );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief вернуть обычный режим упреждающего чтения блоку проекции
+    ///
+    void advise_normal();
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief размер записи, ноль - текстовый режим
+    ///
+    uint64_t m_record_size;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief размер заголовка файла (режим записей фиксированного размера)
+    ///
+    uint64_t m_header_size;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief функция получения ключа записи
+    ///
+    std::function<std::string_view( std::string_view record )> m_extractor;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief функция сравнения ключей
+    ///
+    std::function<int( std::string_view a, std::string_view b )> m_comparator;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief запись, разбитая между блоками проекции
+    ///
+    std::string m_record;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief количество записей, прочитанных последним поиском
+    ///
+    uint64_t m_probes;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief начало блока проекции с MADV_RANDOM
+    ///
+    char *m_advised;
+};
+
+#endif // FILEMAP_SORTED_H
@@ -0,0 +1,307 @@
+/*!
+ *
+ * \file filemap_sparse.cpp
+ * \brief реализация класса чтения разреженных файлов
+ *
+ *  карта участков с данными, обход участков и чтение с пропуском дыр.
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+
+#include "filemap_sparse.h"
+#include <algorithm>
+#include <errno.h>
+#if defined(OS_WIN)
+#  include <winioctl.h>     //  FSCTL_QUERY_ALLOCATED_RANGES
+#endif  // defined(OS_WIN)
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// конструктор
+CFileMapSparse::CFileMapSparse( uint64_t limit_map_memory /*= 0*/ )
+    : CFileMap( limit_map_memory )
+{
+    m_extent = 0;                   // индекс участка последнего поиска
+    m_pending = 0;                  // отложенного сдвига позиции нет
+    m_pending_offset = 0;           // позиция, к которой относится сдвиг
+    m_last_error = 0;               // номер последней ошибки
+}   //  CFileMapSparse( uint64_t limit_map_memory )
+
+///////////////////////////////////////////////////////////////////////////////
+// открыть файл и построить карту участков с данными
+uint64_t CFileMapSparse::open_file_map( mode md /*= mode::read*/ )
+{
+    m_extents.clear();
+    m_extent = 0;
+    m_pending = 0;
+    m_last_error = 0;
+
+    uint64_t file_size = 0;
+    uint64_t file_time = 0;
+    uint64_t last_error = get_file_info( file_size, file_time );
+    // в пустом файле участков нет
+    if ( last_error || file_size == 0 )
+        return last_error;
+
+    set_file_size( file_size );
+    last_error = CFileMap::open_file_map( md );
+    if ( last_error )
+        return last_error;
+
+    refresh_extents();
+    return 0;
+}   //  open_file_map( mode md )
+
+///////////////////////////////////////////////////////////////////////////////
+// построить карту участков с данными заново
+void CFileMapSparse::refresh_extents()
+{
+    m_extent = 0;
+    if ( get_file_handle() == INVALID_HANDLE_VALUE ) {
+        m_extents.clear();
+        return;
+    }
+    query_extents( get_file_handle(), get_file_size(), m_extents );
+}   //  refresh_extents()
+
+///////////////////////////////////////////////////////////////////////////////
+// получить количество байт в участках с данными
+uint64_t CFileMapSparse::get_data_size() const
+{
+    uint64_t size = 0;
+    for ( const extent &item : m_extents )
+        size += item.length;
+    return size;
+}   //  get_data_size()
+
+///////////////////////////////////////////////////////////////////////////////
+// обойти участки с данными
+uint64_t CFileMapSparse::for_each_data_extent(
+        const function<bool( uint64_t offset, const char *data, uint64_t length )> &fn )
+{
+    m_pending = 0;
+    if ( m_extents.empty() )
+        return 0;
+    m_last_error = seek( m_extents[0].offset );
+    if ( m_last_error )
+        return m_last_error;
+
+    run item;
+    while ( next_run( item ) ) {
+        // дыры только пропускаются
+        if ( item.data != nullptr && !fn( item.offset, item.data, item.length ) )
+            break;
+    }
+    apply_pending();
+    return m_last_error;
+}   //  for_each_data_extent( ... )
+
+///////////////////////////////////////////////////////////////////////////////
+// получить следующую серию байт от текущей позиции и сдвинуть позицию
+bool CFileMapSparse::next_run( run &item, uint64_t max_length /*= UINT64_MAX*/ )
+{
+    m_last_error = apply_pending();
+    if ( m_last_error )
+        return false;
+
+    uint64_t offset = m_offset.QuadPart;
+    uint64_t file_size = m_file_size.QuadPart;
+    if ( offset >= file_size || max_length == 0 || !is_open() )
+        return false;
+
+    item.offset = offset;
+    size_t index = find_extent( offset );
+    if ( index == m_extents.size() || m_extents[index].offset > offset ) {
+        // дыра - до начала следующего участка (или до конца файла), страницы не читаются
+        uint64_t end = ( index == m_extents.size() ) ? file_size : m_extents[index].offset;
+        item.length = std::min( end - offset, max_length );
+        item.data = nullptr;
+        m_last_error = seek( offset + item.length );
+        return ( m_last_error == 0 );
+    }
+
+    // данные - не дальше конца участка и конца блока проекции
+    if ( get_max_copy_ex() == 0 ) {
+        m_last_error = seek( offset );
+        if ( m_last_error )
+            return false;
+    }
+    uint64_t end = m_extents[index].offset + m_extents[index].length;
+    item.length = std::min( std::min( end - offset, get_max_copy_ex() ), max_length );
+    item.data = (const char *)get_map_address();
+
+    if ( item.length == get_max_copy_ex() && offset + item.length < file_size ) {
+        // check_map_region() отразил бы следующий блок - сдвиг позиции откладывается
+        m_pending = item.length;
+        m_pending_offset = offset;
+    } else {
+        check_map_region( item.length );
+    }
+    return true;
+}   //  next_run( run &item, uint64_t max_length )
+
+///////////////////////////////////////////////////////////////////////////////
+// прочитать данные из файла (дыры заполняются нулями)
+uint64_t CFileMapSparse::read_sparse( char *dest, uint64_t length )
+{
+    uint64_t copied = 0;
+    run item;
+    while ( copied < length && next_run( item, length - copied ) ) {
+        if ( item.data != nullptr )
+            memcpy( dest + copied, item.data, (size_t)item.length );
+        else
+            memset( dest + copied, 0, (size_t)item.length );
+        copied += item.length;
+    }
+    apply_pending();
+    return copied;
+}   //  read_sparse( char *dest, uint64_t length )
+
+///////////////////////////////////////////////////////////////////////////////
+// сдвинуть позицию на серию данных, отложенную next_run()
+uint64_t CFileMapSparse::apply_pending()
+{
+    uint64_t length = m_pending;
+    m_pending = 0;
+    // позицию могли изменить (seek) - сдвиг больше не относится к ней
+    if ( length == 0 || (uint64_t)m_offset.QuadPart != m_pending_offset )
+        return 0;
+    if ( check_map_region( length ) == 0 && !eof() ) {
+        // следующий блок не отразился - ошибку вернет повторное отражение
+        return seek( m_pending_offset + length );
+    }
+    return 0;
+}   //  apply_pending()
+
+///////////////////////////////////////////////////////////////////////////////
+// найти участок с данными, который содержит offset или начинается после него
+size_t CFileMapSparse::find_extent( uint64_t offset )
+{
+    // при последовательном чтении подходит тот же или следующий участок
+    for ( size_t index = m_extent; index < m_extents.size() && index < m_extent + 2; index++ ) {
+        if ( offset < m_extents[index].offset + m_extents[index].length &&
+             ( index == 0 || offset >= m_extents[index - 1].offset + m_extents[index - 1].length ) ) {
+            m_extent = index;
+            return index;
+        }
+    }
+    auto it = std::upper_bound( m_extents.begin(), m_extents.end(), offset,
+                                []( uint64_t value, const extent &item ) {
+                                    return value < item.offset + item.length;
+                                } );
+    m_extent = (size_t)( it - m_extents.begin() );
+    return m_extent;
+}   //  find_extent( uint64_t offset )
+
+///////////////////////////////////////////////////////////////////////////////
+// найти участки с данными
+void CFileMapSparse::query_extents( HANDLE file, uint64_t file_size, vector<extent> &extents )
+{
+    extents.clear();
+    if ( file_size == 0 )
+        return;
+    bool supported = true;
+
+#   if defined(OS_WIN)
+    FILE_ALLOCATED_RANGE_BUFFER query;
+    FILE_ALLOCATED_RANGE_BUFFER ranges[64];
+    query.FileOffset.QuadPart = 0;
+    query.Length.QuadPart = file_size;
+    for ( ;; ) {
+        DWORD bytes = 0;
+        BOOL result = ::DeviceIoControl( file, FSCTL_QUERY_ALLOCATED_RANGES, &query, sizeof(query),
+                                         ranges, sizeof(ranges), &bytes, NULL );
+        if ( result == FALSE && ::GetLastError() != ERROR_MORE_DATA ) {
+            // файловая система не сообщает о дырах
+            supported = false;
+            break;
+        }
+        DWORD count = bytes / sizeof(ranges[0]);
+        for ( DWORD index = 0; index < count; index++ ) {
+            uint64_t begin = (uint64_t)ranges[index].FileOffset.QuadPart;
+            uint64_t end = std::min( begin + (uint64_t)ranges[index].Length.QuadPart, file_size );
+            if ( end <= begin )
+                continue;
+            // соседние диапазоны объединяются
+            if ( extents.size() && extents.back().offset + extents.back().length == begin ) {
+                extents.back().length += end - begin;
+            } else {
+                extent item;
+                item.offset = begin;
+                item.length = end - begin;
+                extents.push_back( item );
+            }
+        }
+        if ( result != FALSE || count == 0 )
+            break;
+        query.FileOffset.QuadPart = ranges[count - 1].FileOffset.QuadPart + ranges[count - 1].Length.QuadPart;
+        if ( (uint64_t)query.FileOffset.QuadPart >= file_size )
+            break;
+        query.Length.QuadPart = file_size - query.FileOffset.QuadPart;
+    }
+#   elif defined(SEEK_DATA) && defined(SEEK_HOLE)
+    uint64_t offset = 0;
+    while ( offset < file_size ) {
+        off_t data = ::lseek( file, (off_t)offset, SEEK_DATA );
+        if ( data < 0 ) {
+            // ENXIO - до конца файла только дыра
+            if ( errno == ENXIO )
+                break;
+            if ( offset == 0 ) {
+                // поиск не поддерживается
+                supported = false;
+                break;
+            }
+            data = (off_t)offset;
+        }
+        off_t hole = ::lseek( file, data, SEEK_HOLE );
+        if ( hole < 0 || (uint64_t)hole > file_size )
+            hole = (off_t)file_size;
+        if ( hole <= data )
+            break;
+        extent item;
+        item.offset = (uint64_t)data;
+        item.length = (uint64_t)( hole - data );
+        extents.push_back( item );
+        offset = (uint64_t)hole;
+    }
+#   else
+    (void)file;
+    supported = false;
+#   endif  // defined(OS_WIN)
+
+    if ( supported == false ) {
+        // дыры не определяются - весь файл считается данными
+        extents.clear();
+        extent item;
+        item.offset = 0;
+        item.length = file_size;
+        extents.push_back( item );
+    }
+}   //  query_extents( HANDLE file, uint64_t file_size, vector<extent> &extents )
@@ -0,0 +1,235 @@
+/*!
+ *
+ * \file filemap_sparse.h
+ * \brief определение класса чтения разреженных файлов
+ *
+ *  карта участков с данными (SEEK_DATA/SEEK_HOLE, на Windows -\n
+ *  FSCTL_QUERY_ALLOCATED_RANGES): отражаются только участки с данными,\n
+ *  дыры сообщаются как серии нулей без обращения к памяти, поэтому\n
+ *  время обработки зависит от объема данных, а не от размера файла.
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied\n
+ * warranty. In no event will the authors be held liable for any damages\n
+ * arising from the use of this software.\n
+ *
+ * Permission is granted to anyone to use this software for any purpose,\n
+ * including commercial applications, and to alter it and redistribute it\n
+ * freely, subject to the following restrictions:\n
+ *
+ *    1. The origin of this software must not be misrepresented; you must not\n
+ *    claim that you wrote the original software. If you use this software\n
+ *    in a product, an acknowledgment in the product documentation would be\n
+ *    appreciated but is not required.\n
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be\n
+ *    misrepresented as being the original software.\n
+ *    3. This notice may not be removed or altered from any source\n
+ *    distribution.\n
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+#ifndef FILEMAP_SPARSE_H
+#define FILEMAP_SPARSE_H
+
+#include "filemap.h"
+#include <functional>
+#include <vector>
+
+
+
+//--------------------------------------------------------------------------------------------------//
+
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief The CFileMapSparse class - чтение разреженного файла по участкам
+///
+/// карта участков с данными строится при открытии файла (refresh_extents()\n
+/// строит ее заново, например, после записи в дыры). Если файловая система\n
+/// не сообщает о дырах, весь файл считается одним участком с данными.\n
+/// Участки с данными читаются через проекцию (в блочном режиме - блоками),\n
+/// позиция перемещается через дыры без отражения и чтения страниц. Хеш\n
+/// (set_hash()) учитывает только прочитанные участки с данными.
+///
+/// \code
+/// CFileMapSparse file( 64*1024*1024 );
+/// file.set_file_path( file_path );
+/// file.open_file_map();
+/// file.for_each_data_extent( []( uint64_t offset, const char *data, uint64_t length ) {
+///     ...
+///     return true;
+/// } );
+/// ...
+/// CFileMapSparse::run item;
+/// while ( file.next_run( item ) ) {
+///     if ( item.data == nullptr )
+///         ... // item.length нулей
+/// }
+/// \endcode
+///
+class CFileMapSparse : public CFileMap
+{
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief участок файла с данными
+    ///
+    struct extent {
+        uint64_t offset;                // смещение от начала файла
+        uint64_t length;                // размер участка
+    };
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief серия байт файла: данные в проекции или дыра
+    ///
+    struct run {
+        uint64_t    offset;             // смещение от начала файла
+        uint64_t    length;             // количество байт
+        const char *data;               // адрес данных в проекции, nullptr - дыра (нули)
+    };
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief конструктор
+    /// \param limit_map_memory - размер ограниения для единовремменого отражения\n
+    ///  файла в память, если равен нулю - то отражается сразу весь файл целиком.
+    ///
+    CFileMapSparse( uint64_t limit_map_memory = 0 );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief открыть файл и построить карту участков с данными
+    /// \param md - режим обработки файла и проекции
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t open_file_map( mode md = mode::read );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief построить карту участков с данными заново
+    ///
+    void refresh_extents();
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить карту участков с данными
+    ///
+    const std::vector<extent>& get_extents() const {
+        return m_extents;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить количество байт в участках с данными
+    ///
+    uint64_t get_data_size() const;
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief обойти участки с данными
+    /// \param fn - функция ( смещение, адрес в проекции, количество байт ),\n
+    ///  участок передается частями не больше блока проекции,\n
+    ///  false - прекратить обход
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    /// после обхода текущая позиция - конец файла (или конец последней части)
+    ///
+    uint64_t for_each_data_extent(
+            const std::function<bool( uint64_t offset, const char *data, uint64_t length )> &fn );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить следующую серию байт от текущей позиции и сдвинуть позицию
+    /// \param item - серия: данные (не дальше конца блока проекции) или дыра
+    /// \param max_length - максимальное количество байт в серии
+    /// \return false - конец файла или ошибка (см. get_last_error())
+    ///
+    /// адрес данных действителен до следующего вызова метода, меняющего позицию.\n
+    /// Если серия данных заканчивается на границе блока проекции, позиция\n
+    /// сдвигается на нее при следующем вызове next_run(), read_sparse()\n
+    /// или for_each_data_extent() (иначе адрес стал бы недействительным).
+    ///
+    bool next_run( run &item, uint64_t max_length = UINT64_MAX );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief прочитать данные из файла (дыры заполняются нулями без\n
+    ///  обращения к страницам файла)
+    /// \param dest - буфер
+    /// \param length - количество байт
+    /// \return количество прочитанных байт
+    ///
+    uint64_t read_sparse( char *dest, uint64_t length );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить номер последней ошибки next_run()
+    ///
+    uint64_t get_last_error() const {
+        return m_last_error;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief найти участки с данными (без дыр разреженного файла)
+    /// \param file - описатель открытого файла
+    /// \param file_size - размер файла
+    /// \param extents - участки с данными по возрастанию смещения
+    ///
+    static void query_extents( HANDLE file, uint64_t file_size, std::vector<extent> &extents );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief найти участок с данными, который содержит offset или начинается после него
+    /// \return индекс участка, m_extents.size() - до конца файла дыра
+    ///
+    size_t find_extent( uint64_t offset );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief карта участков с данными
+    ///
+    std::vector<extent> m_extents;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief индекс участка последнего поиска (последовательное чтение)
+    ///
+    size_t m_extent;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief сдвинуть позицию на серию данных, отложенную next_run()
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t apply_pending();
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief отложенный сдвиг позиции (серия данных до границы блока)
+    ///
+    uint64_t m_pending;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief позиция, к которой относится m_pending
+    ///
+    uint64_t m_pending_offset;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief номер последней ошибки
+    ///
+    uint64_t m_last_error;
+};
+
+#endif // FILEMAP_SPARSE_H
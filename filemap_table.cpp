@@ -0,0 +1,418 @@
+/*!
+ *
+ * \file filemap_table.cpp
+ * \brief реализация постоянной хеш-таблицы в проекции файла
+ *
+ *  открытая адресация, корзины по строке кэша, рост через расширение файла.
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+
+#include "filemap_table.h"
+#include "filemap_hash.h"
+#include <vector>
+#include <errno.h>
+
+using namespace std;
+
+/* формат файла таблицы:
+ *   заголовок (table_header, 64 байта)
+ *   bucket_count корзин (table_bucket, 64 байта)
+ *   bucket_count * 4 ключа по key_size байт (слот N - ключ N) */
+namespace {
+
+const char     TABLE_MAGIC[8] = { 'F','M','H','T','A','B','L','E' };
+const uint32_t TABLE_VERSION  = 1;
+const uint64_t BUCKET_SLOTS   = 4;
+const uint64_t SLOT_EMPTY     = 0;      // слот не занимался
+const uint64_t SLOT_DELETED   = 1;      // запись удалена (поиск продолжается)
+
+struct table_header {
+    char     magic[8];      // сигнатура файла таблицы
+    uint32_t version;       // версия формата
+    uint32_t key_size;      // размер ключа, ноль - ссылочные ключи
+    uint64_t bucket_count;  // количество корзин (степень двойки)
+    uint64_t count;         // количество записей
+    uint64_t deleted;       // количество удаленных слотов
+    uint64_t reserved[3];   // до размера строки кэша
+};
+
+struct table_bucket {
+    uint64_t hash[BUCKET_SLOTS];    // хеши ключей слотов (SLOT_EMPTY, SLOT_DELETED)
+    uint64_t value[BUCKET_SLOTS];   // значения слотов
+};
+
+static_assert( sizeof(table_header) == 64, "table header must fill a cache line" );
+static_assert( sizeof(table_bucket) == 64, "table bucket must fill a cache line" );
+
+#if defined(OS_WIN)
+const uint64_t invalid_data = ERROR_INVALID_DATA;
+#else
+const uint64_t invalid_data = EINVAL;
+#endif  // defined(OS_WIN)
+
+}   // namespace
+
+///////////////////////////////////////////////////////////////////////////////
+// конструктор
+CFileMapTable::CFileMapTable()
+    : CFileMap( 0 )
+{
+    m_table = nullptr;              // таблица не открыта
+    m_key_size = 0;                 // размер ключа
+}   //  CFileMapTable()
+
+///////////////////////////////////////////////////////////////////////////////
+// открыть таблицу
+uint64_t CFileMapTable::open_table( uint32_t key_size, uint64_t capacity /*= 1024*/ )
+{
+    close_table();
+    m_key_size = key_size;
+
+    uint64_t file_size = 0;
+    uint64_t file_time = 0;
+    uint64_t last_error = get_file_info( file_size, file_time );
+
+    if ( last_error != 0 || file_size == 0 ) {
+        // новая таблица: заполнение не больше 3/4 слотов
+        uint64_t bucket_count = 1;
+        while ( bucket_count * BUCKET_SLOTS * 3 < capacity * 4 )
+            bucket_count *= 2;
+        set_file_size( table_size( bucket_count ) );
+        last_error = open_file_map( CFileMap::mode::write );
+        if ( last_error )
+            return last_error;
+        m_table = (char *)get_map_address();
+
+        // файл создан заново - корзины и ключи уже нулевые (SLOT_EMPTY)
+        table_header *header = (table_header *)m_table;
+        memset( header, 0, sizeof(table_header) );
+        memcpy( header->magic, TABLE_MAGIC, sizeof(header->magic) );
+        header->version = TABLE_VERSION;
+        header->key_size = key_size;
+        header->bucket_count = bucket_count;
+        return 0;
+    }
+
+    if ( file_size < sizeof(table_header) )
+        return invalid_data;
+    set_file_size( file_size );
+    last_error = open_file_map( CFileMap::mode::append );
+    if ( last_error )
+        return last_error;
+    m_table = (char *)get_map_address();
+
+    // проверим заголовок
+    const table_header *header = (const table_header *)m_table;
+    uint64_t bucket_count = header->bucket_count;
+    if ( memcmp( header->magic, TABLE_MAGIC, sizeof(header->magic) ) != 0 ||
+         header->version != TABLE_VERSION || header->key_size != key_size ||
+         bucket_count == 0 || ( bucket_count & (bucket_count - 1) ) != 0 ||
+         bucket_count > file_size / sizeof(table_bucket) || table_size( bucket_count ) > file_size ||
+         header->count + header->deleted > bucket_count * BUCKET_SLOTS ) {
+        close_table();
+        return invalid_data;
+    }
+    return 0;
+}   //  open_table( uint32_t key_size, uint64_t capacity )
+
+///////////////////////////////////////////////////////////////////////////////
+// закрыть таблицу
+void CFileMapTable::close_table()
+{
+    if ( m_table == nullptr && !is_open() )
+        return;
+    m_table = nullptr;
+    close_file_map();
+}   //  close_table()
+
+///////////////////////////////////////////////////////////////////////////////
+// найти значение по ключу
+bool CFileMapTable::find( const void *key, uint32_t length, uint64_t &value ) const
+{
+    if ( m_table == nullptr || ( m_key_size != 0 && length != m_key_size ) )
+        return false;
+    uint64_t slot = find_slot( key_hash( key, length ), key, length, nullptr );
+    if ( slot == UINT64_MAX )
+        return false;
+    const table_bucket *buckets = (const table_bucket *)( m_table + sizeof(table_header) );
+    value = buckets[slot / BUCKET_SLOTS].value[slot % BUCKET_SLOTS];
+    return true;
+}   //  find( const void *key, uint32_t length, uint64_t &value )
+
+///////////////////////////////////////////////////////////////////////////////
+// добавить запись
+uint64_t CFileMapTable::insert( const void *key, uint32_t length, uint64_t value, bool replace /*= true*/ )
+{
+    if ( m_table == nullptr || ( m_key_size != 0 && length != m_key_size ) ) {
+#       if defined(OS_WIN)
+        return ERROR_INVALID_PARAMETER;
+#       else
+        return EINVAL;
+#       endif  // defined(OS_WIN)
+    }
+
+    uint64_t hash = key_hash( key, length );
+    uint64_t free_slot = UINT64_MAX;
+    uint64_t slot = find_slot( hash, key, length, &free_slot );
+    table_header *header = (table_header *)m_table;
+    if ( slot != UINT64_MAX ) {
+        if ( !replace ) {
+#           if defined(OS_WIN)
+            return ERROR_ALREADY_EXISTS;
+#           else
+            return EEXIST;
+#           endif  // defined(OS_WIN)
+        }
+        table_bucket *buckets = (table_bucket *)( m_table + sizeof(table_header) );
+        buckets[slot / BUCKET_SLOTS].value[slot % BUCKET_SLOTS] = value;
+        return 0;
+    }
+
+    // заполнение больше 3/4 (с удаленными слотами) - перестроим таблицу
+    uint64_t slots = header->bucket_count * BUCKET_SLOTS;
+    if ( free_slot == UINT64_MAX || ( header->count + header->deleted + 1 ) * 4 > slots * 3 ) {
+        // удаленные слоты занимают больше половины - достаточно перестроить без роста
+        uint64_t bucket_count = header->bucket_count;
+        if ( ( header->count + 1 ) * 8 > slots * 3 )
+            bucket_count *= 2;
+        uint64_t last_error = rehash( bucket_count );
+        if ( last_error )
+            return last_error;
+        header = (table_header *)m_table;
+        find_slot( hash, key, length, &free_slot );
+    }
+
+    table_bucket *buckets = (table_bucket *)( m_table + sizeof(table_header) );
+    table_bucket &bucket = buckets[free_slot / BUCKET_SLOTS];
+    if ( m_key_size ) {
+        char *keys = (char *)( buckets + header->bucket_count );
+        memcpy( keys + free_slot * m_key_size, key, m_key_size );
+    }
+    if ( bucket.hash[free_slot % BUCKET_SLOTS] == SLOT_DELETED )
+        header->deleted--;
+    bucket.value[free_slot % BUCKET_SLOTS] = value;
+    bucket.hash[free_slot % BUCKET_SLOTS] = hash;
+    header->count++;
+    return 0;
+}   //  insert( const void *key, uint32_t length, uint64_t value, bool replace )
+
+///////////////////////////////////////////////////////////////////////////////
+// удалить запись
+bool CFileMapTable::erase( const void *key, uint32_t length )
+{
+    if ( m_table == nullptr || ( m_key_size != 0 && length != m_key_size ) )
+        return false;
+    uint64_t slot = find_slot( key_hash( key, length ), key, length, nullptr );
+    if ( slot == UINT64_MAX )
+        return false;
+
+    table_header *header = (table_header *)m_table;
+    table_bucket *buckets = (table_bucket *)( m_table + sizeof(table_header) );
+    // слот остается занятым для поиска других ключей этой цепочки
+    buckets[slot / BUCKET_SLOTS].hash[slot % BUCKET_SLOTS] = SLOT_DELETED;
+    header->count--;
+    header->deleted++;
+    return true;
+}   //  erase( const void *key, uint32_t length )
+
+///////////////////////////////////////////////////////////////////////////////
+// сбросить изменения таблицы на диск
+uint64_t CFileMapTable::flush( bool wait /*= false*/ )
+{
+    if ( m_table == nullptr )
+        return 0;
+#   if defined(OS_WIN)
+    if ( ::FlushViewOfFile( m_table, (SIZE_T)get_file_size() ) == 0 )
+        return ::GetLastError();
+    if ( wait && ::FlushFileBuffers( get_file_handle() ) == 0 )
+        return ::GetLastError();
+#   else
+    if ( ::msync( m_table, (size_t)get_file_size(), wait ? MS_SYNC : MS_ASYNC ) != 0 )
+        return errno;
+#   endif  // defined(OS_WIN)
+    return 0;
+}   //  flush( bool wait )
+
+///////////////////////////////////////////////////////////////////////////////
+// получить количество записей
+uint64_t CFileMapTable::get_count() const
+{
+    return m_table ? ((const table_header *)m_table)->count : 0;
+}   //  get_count()
+
+///////////////////////////////////////////////////////////////////////////////
+// получить количество слотов
+uint64_t CFileMapTable::get_capacity() const
+{
+    return m_table ? ((const table_header *)m_table)->bucket_count * BUCKET_SLOTS : 0;
+}   //  get_capacity()
+
+///////////////////////////////////////////////////////////////////////////////
+// вычислить хеш ключа
+uint64_t CFileMapTable::key_hash( const void *key, uint32_t length )
+{
+    // старший бит отличает хеш от SLOT_EMPTY и SLOT_DELETED
+    return CFileMapHash::hash( CFileMapHash::method::xxh64, key, length ) | ( 1ull << 63 );
+}   //  key_hash( const void *key, uint32_t length )
+
+///////////////////////////////////////////////////////////////////////////////
+// найти слот ключа
+uint64_t CFileMapTable::find_slot( uint64_t hash, const void *key, uint32_t length,
+                                   uint64_t *free_slot ) const
+{
+    const table_header *header = (const table_header *)m_table;
+    const table_bucket *buckets = (const table_bucket *)( m_table + sizeof(table_header) );
+    const char *keys = (const char *)( buckets + header->bucket_count );
+    uint64_t mask = header->bucket_count - 1;
+    if ( free_slot )
+        *free_slot = UINT64_MAX;
+
+    uint64_t index = hash & mask;
+    for ( uint64_t probe = 0; probe <= mask; probe++, index = ( index + 1 ) & mask ) {
+        const table_bucket &bucket = buckets[index];
+        bool last = false;
+        for ( uint64_t item = 0; item < BUCKET_SLOTS; item++ ) {
+            uint64_t slot = index * BUCKET_SLOTS + item;
+            uint64_t value = bucket.hash[item];
+            if ( value == hash ) {
+                // хеш совпал - сравним ключ
+                bool equal = true;
+                if ( m_key_size )
+                    equal = ( memcmp( keys + slot * m_key_size, key, m_key_size ) == 0 );
+                else if ( m_resolver )
+                    equal = m_resolver( bucket.value[item], key, length );
+                if ( equal )
+                    return slot;
+            } else if ( value <= SLOT_DELETED ) {
+                if ( free_slot && *free_slot == UINT64_MAX )
+                    *free_slot = slot;
+                // пустой слот - дальше записей этой цепочки нет
+                if ( value == SLOT_EMPTY )
+                    last = true;
+            }
+        }
+        if ( last )
+            break;
+    }
+    return UINT64_MAX;
+}   //  find_slot( uint64_t hash, const void *key, uint32_t length, uint64_t *free_slot )
+
+///////////////////////////////////////////////////////////////////////////////
+// перестроить таблицу
+uint64_t CFileMapTable::rehash( uint64_t bucket_count )
+{
+    const table_header *header = (const table_header *)m_table;
+    const table_bucket *buckets = (const table_bucket *)( m_table + sizeof(table_header) );
+    const char *keys = (const char *)( buckets + header->bucket_count );
+
+    // сохраним записи
+    vector<uint64_t> hashes;
+    vector<uint64_t> values;
+    vector<char> saved_keys;
+    hashes.reserve( (size_t)header->count );
+    values.reserve( (size_t)header->count );
+    saved_keys.reserve( (size_t)( header->count * m_key_size ) );
+    for ( uint64_t slot = 0; slot < header->bucket_count * BUCKET_SLOTS; slot++ ) {
+        uint64_t hash = buckets[slot / BUCKET_SLOTS].hash[slot % BUCKET_SLOTS];
+        if ( hash <= SLOT_DELETED )
+            continue;
+        hashes.push_back( hash );
+        values.push_back( buckets[slot / BUCKET_SLOTS].value[slot % BUCKET_SLOTS] );
+        saved_keys.insert( saved_keys.end(), keys + slot * m_key_size, keys + ( slot + 1 ) * m_key_size );
+    }
+
+    uint64_t size = table_size( bucket_count );
+    if ( size > get_file_size() ) {
+        uint64_t last_error = grow_file( size );
+        if ( last_error )
+            return last_error;
+    }
+
+    table_header *new_header = (table_header *)m_table;
+    table_bucket *new_buckets = (table_bucket *)( m_table + sizeof(table_header) );
+    char *new_keys = (char *)( new_buckets + bucket_count );
+    memset( new_buckets, 0, (size_t)( size - sizeof(table_header) ) );
+    new_header->bucket_count = bucket_count;
+    new_header->count = hashes.size();
+    new_header->deleted = 0;
+
+    // ключи уникальны - достаточно найти первый пустой слот
+    uint64_t mask = bucket_count - 1;
+    for ( size_t entry = 0; entry < hashes.size(); entry++ ) {
+        uint64_t index = hashes[entry] & mask;
+        for ( ;; index = ( index + 1 ) & mask ) {
+            table_bucket &bucket = new_buckets[index];
+            uint64_t item = 0;
+            while ( item < BUCKET_SLOTS && bucket.hash[item] != SLOT_EMPTY )
+                item++;
+            if ( item == BUCKET_SLOTS )
+                continue;
+            bucket.hash[item] = hashes[entry];
+            bucket.value[item] = values[entry];
+            if ( m_key_size )
+                memcpy( new_keys + ( index * BUCKET_SLOTS + item ) * m_key_size,
+                        &saved_keys[entry * m_key_size], m_key_size );
+            break;
+        }
+    }
+    return 0;
+}   //  rehash( uint64_t bucket_count )
+
+///////////////////////////////////////////////////////////////////////////////
+// увеличить файл и проекцию
+uint64_t CFileMapTable::grow_file( uint64_t size )
+{
+#   if defined(OS_WIN)
+    LARGE_INTEGER end;
+    end.QuadPart = size;
+    if ( ::SetFilePointerEx( get_file_handle(), end, NULL, FILE_BEGIN ) == 0 ||
+         ::SetEndOfFile( get_file_handle() ) == 0 )
+        return ::GetLastError();
+#   else
+    if ( ::ftruncate( get_file_handle(), size ) != 0 )
+        return errno;
+#   endif  // defined(OS_WIN)
+
+    // проекция растет на месте (Linux - mremap) или отражается заново
+    uint64_t last_error = resize_map( size );
+    if ( last_error )
+        return last_error;
+    last_error = seek( 0 );
+    if ( last_error )
+        return last_error;
+    m_table = (char *)get_map_address();
+    return 0;
+}   //  grow_file( uint64_t size )
+
+///////////////////////////////////////////////////////////////////////////////
+// размер файла таблицы
+uint64_t CFileMapTable::table_size( uint64_t bucket_count ) const
+{
+    return sizeof(table_header) + bucket_count * ( sizeof(table_bucket) + BUCKET_SLOTS * m_key_size );
+}   //  table_size( uint64_t bucket_count )
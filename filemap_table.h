@@ -0,0 +1,230 @@
+/*!
+ *
+ * \file filemap_table.h
+ * \brief определение постоянной хеш-таблицы в проекции файла
+ *
+ *  хеш-таблица с открытой адресацией хранится в файле и используется\n
+ *  прямо через проекцию: запуск - одно отражение файла без перестроения,\n
+ *  поиск - обращение к одной строке кэша (корзина 64 байта).
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied\n
+ * warranty. In no event will the authors be held liable for any damages\n
+ * arising from the use of this software.\n
+ *
+ * Permission is granted to anyone to use this software for any purpose,\n
+ * including commercial applications, and to alter it and redistribute it\n
+ * freely, subject to the following restrictions:\n
+ *
+ *    1. The origin of this software must not be misrepresented; you must not\n
+ *    claim that you wrote the original software. If you use this software\n
+ *    in a product, an acknowledgment in the product documentation would be\n
+ *    appreciated but is not required.\n
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be\n
+ *    misrepresented as being the original software.\n
+ *    3. This notice may not be removed or altered from any source\n
+ *    distribution.\n
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+#ifndef FILEMAP_TABLE_H
+#define FILEMAP_TABLE_H
+
+#include "filemap.h"
+#include <functional>
+
+
+
+//--------------------------------------------------------------------------------------------------//
+
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief The CFileMapTable class - постоянная хеш-таблица ключ -> значение (uint64_t)
+///
+/// формат файла: заголовок (сигнатура, версия, размер ключа, количество\n
+/// корзин и записей), массив корзин по 64 байта (4 хеша и 4 значения -\n
+/// одна строка кэша), затем ключи фиксированного размера по слотам.\n
+/// Корзины просматриваются линейно, начиная с корзины хеша ключа, и только\n
+/// при совпадении 64-битного хеша сравнивается ключ.\n
+///
+/// ключи двух видов:\n
+///  - фиксированного размера (key_size > 0) - хранятся в таблице;\n
+///  - ссылочные (key_size == 0) - таблица хранит только хеш и значение\n
+///    (например, смещение записи в файле данных, где лежит ключ), ключ\n
+///    сравнивает функция set_key_resolver().
+///
+/// при заполнении больше чем на 3/4 файл расширяется (CFileMap::resize_map()),\n
+/// а таблица перестраивается с удвоенным количеством корзин. Изменения\n
+/// попадают в файл через проекцию, flush() сбрасывает их на диск\n
+/// (таблица не журналируется: после сбоя во время перестроения ее нужно\n
+/// построить заново).\n
+/// Поиск из нескольких потоков допустим, если таблица не изменяется.
+///
+/// \code
+/// CFileMapTable table;
+/// table.set_file_path( table_path );
+/// table.open_table( sizeof(uint64_t) );
+/// table.insert( &id, sizeof(id), offset );
+/// ...
+/// uint64_t offset;
+/// if ( table.find( &id, sizeof(id), offset ) )
+///     ...
+/// \endcode
+///
+class CFileMapTable : public CFileMap
+{
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief конструктор
+    ///
+    CFileMapTable();
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief открыть таблицу (создать, если файл не существует или пустой)
+    /// \param key_size - размер ключа в байтах, ноль - ссылочные ключи
+    /// \param capacity - начальное количество записей новой таблицы
+    /// \return ноль - выполнено успешно, иначе номер ошибки\n
+    ///  (файл не является таблицей или другой размер ключа - EINVAL / ERROR_INVALID_DATA)
+    ///
+    uint64_t open_table( uint32_t key_size, uint64_t capacity = 1024 );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief закрыть таблицу
+    ///
+    void close_table();
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить функцию сравнения ссылочных ключей
+    /// \param resolver - функция ( значение, ключ, длина ключа ),\n
+    ///  true - значение относится к этому ключу
+    ///
+    /// без функции ссылочные ключи равны при совпадении 64-битного хеша
+    ///
+    void set_key_resolver( std::function<bool( uint64_t value, const void *key, uint32_t length )> resolver ) {
+        m_resolver = std::move( resolver );
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief найти значение по ключу
+    /// \param key - ключ
+    /// \param length - длина ключа
+    /// \param value - значение
+    /// \return true - ключ найден
+    ///
+    bool find( const void *key, uint32_t length, uint64_t &value ) const;
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief добавить запись
+    /// \param key - ключ
+    /// \param length - длина ключа (для фиксированных ключей - равна размеру ключа)
+    /// \param value - значение
+    /// \param replace - заменить значение, если ключ уже есть
+    /// \return ноль - выполнено успешно, иначе номер ошибки\n
+    ///  (ключ уже есть и replace == false - EEXIST / ERROR_ALREADY_EXISTS)
+    ///
+    uint64_t insert( const void *key, uint32_t length, uint64_t value, bool replace = true );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief удалить запись
+    /// \param key - ключ
+    /// \param length - длина ключа
+    /// \return true - запись была и удалена
+    ///
+    bool erase( const void *key, uint32_t length );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief сбросить изменения таблицы на диск
+    /// \param wait - дождаться окончания записи
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t flush( bool wait = false );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить количество записей
+    ///
+    uint64_t get_count() const;
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить количество слотов (записей до заполнения - 3/4)
+    ///
+    uint64_t get_capacity() const;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief вычислить хеш ключа (старший бит установлен, 0 и 1 - служебные)
+    ///
+    static uint64_t key_hash( const void *key, uint32_t length );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief найти слот ключа
+    /// \param hash - хеш ключа
+    /// \param key - ключ
+    /// \param length - длина ключа
+    /// \param free_slot - первый свободный слот на пути поиска (UINT64_MAX - нет)
+    /// \return номер слота, UINT64_MAX - ключ не найден
+    ///
+    uint64_t find_slot( uint64_t hash, const void *key, uint32_t length, uint64_t *free_slot ) const;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief перестроить таблицу (с ростом файла)
+    /// \param bucket_count - новое количество корзин (степень двойки)
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t rehash( uint64_t bucket_count );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief увеличить файл и проекцию
+    /// \param size - новый размер файла
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    ///
+    uint64_t grow_file( uint64_t size );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief размер файла таблицы
+    /// \param bucket_count - количество корзин
+    ///
+    uint64_t table_size( uint64_t bucket_count ) const;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief начало таблицы в проекции (заголовок)
+    ///
+    char *m_table;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief размер ключа, ноль - ссылочные ключи
+    ///
+    uint32_t m_key_size;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief функция сравнения ссылочных ключей
+    ///
+    std::function<bool( uint64_t value, const void *key, uint32_t length )> m_resolver;
+};
+
+#endif // FILEMAP_TABLE_H
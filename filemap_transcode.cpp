@@ -0,0 +1,580 @@
+/*!
+ *
+ * \file filemap_transcode.cpp
+ * \brief реализация класса перекодирования текста при чтении и записи
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ *    1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *    3. This notice may not be removed or altered from any source
+ *    distribution.
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+
+
+#include "filemap_transcode.h"
+#include "filemap_simd.h"
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// порция проекции, перекодируемая за один раз
+const uint64_t DECODE_CHUNK = 64*1024;
+
+// символ замены для ошибочных последовательностей
+const uint32_t REPLACEMENT = 0xFFFD;
+
+// символы CP1251 0x80..0xFF
+const uint16_t CP1251_HIGH[128] = {
+    0x0402, 0x0403, 0x201A, 0x0453, 0x201E, 0x2026, 0x2020, 0x2021,
+    0x20AC, 0x2030, 0x0409, 0x2039, 0x040A, 0x040C, 0x040B, 0x040F,
+    0x0452, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+    0xFFFD, 0x2122, 0x0459, 0x203A, 0x045A, 0x045C, 0x045B, 0x045F,
+    0x00A0, 0x040E, 0x045E, 0x0408, 0x00A4, 0x0490, 0x00A6, 0x00A7,
+    0x0401, 0x00A9, 0x0404, 0x00AB, 0x00AC, 0x00AD, 0x00AE, 0x0407,
+    0x00B0, 0x00B1, 0x0406, 0x0456, 0x0491, 0x00B5, 0x00B6, 0x00B7,
+    0x0451, 0x2116, 0x0454, 0x00BB, 0x0458, 0x0405, 0x0455, 0x0457,
+    0x0410, 0x0411, 0x0412, 0x0413, 0x0414, 0x0415, 0x0416, 0x0417,
+    0x0418, 0x0419, 0x041A, 0x041B, 0x041C, 0x041D, 0x041E, 0x041F,
+    0x0420, 0x0421, 0x0422, 0x0423, 0x0424, 0x0425, 0x0426, 0x0427,
+    0x0428, 0x0429, 0x042A, 0x042B, 0x042C, 0x042D, 0x042E, 0x042F,
+    0x0430, 0x0431, 0x0432, 0x0433, 0x0434, 0x0435, 0x0436, 0x0437,
+    0x0438, 0x0439, 0x043A, 0x043B, 0x043C, 0x043D, 0x043E, 0x043F,
+    0x0440, 0x0441, 0x0442, 0x0443, 0x0444, 0x0445, 0x0446, 0x0447,
+    0x0448, 0x0449, 0x044A, 0x044B, 0x044C, 0x044D, 0x044E, 0x044F
+};
+
+// обратная таблица CP1251 ( символ, байт ) по возрастанию символа
+const vector< pair<uint32_t, unsigned char> >& cp1251_reverse()
+{
+    static const vector< pair<uint32_t, unsigned char> > table = []() {
+        vector< pair<uint32_t, unsigned char> > items;
+        for ( uint32_t index = 0; index < 128; index++ ) {
+            if ( CP1251_HIGH[index] != REPLACEMENT )
+                items.push_back( make_pair( (uint32_t)CP1251_HIGH[index], (unsigned char)( 0x80 + index ) ) );
+        }
+        sort( items.begin(), items.end() );
+        return items;
+    }();
+    return table;
+}
+
+// записать символ в UTF-8, возвращает количество байт
+inline uint64_t utf8_encode( uint32_t cp, char *dest )
+{
+    if ( cp < 0x80 ) {
+        dest[0] = (char)cp;
+        return 1;
+    }
+    if ( cp < 0x800 ) {
+        dest[0] = (char)( 0xC0 | ( cp >> 6 ) );
+        dest[1] = (char)( 0x80 | ( cp & 0x3F ) );
+        return 2;
+    }
+    if ( cp < 0x10000 ) {
+        dest[0] = (char)( 0xE0 | ( cp >> 12 ) );
+        dest[1] = (char)( 0x80 | ( ( cp >> 6 ) & 0x3F ) );
+        dest[2] = (char)( 0x80 | ( cp & 0x3F ) );
+        return 3;
+    }
+    dest[0] = (char)( 0xF0 | ( cp >> 18 ) );
+    dest[1] = (char)( 0x80 | ( ( cp >> 12 ) & 0x3F ) );
+    dest[2] = (char)( 0x80 | ( ( cp >> 6 ) & 0x3F ) );
+    dest[3] = (char)( 0x80 | ( cp & 0x3F ) );
+    return 4;
+}
+
+/* прочитать символ UTF-8, возвращает количество байт (ошибочная
+ * последовательность - U+FFFD), ноль - последовательность не закончена */
+inline uint64_t utf8_decode( const unsigned char *p, uint64_t length, uint32_t &cp )
+{
+    unsigned char c = p[0];
+    uint64_t size;
+    uint32_t least;
+    if ( c < 0x80 ) {
+        cp = c;
+        return 1;
+    } else if ( ( c & 0xE0 ) == 0xC0 ) {
+        size = 2;
+        cp = c & 0x1F;
+        least = 0x80;
+    } else if ( ( c & 0xF0 ) == 0xE0 ) {
+        size = 3;
+        cp = c & 0x0F;
+        least = 0x800;
+    } else if ( ( c & 0xF8 ) == 0xF0 ) {
+        size = 4;
+        cp = c & 0x07;
+        least = 0x10000;
+    } else {
+        cp = REPLACEMENT;
+        return 1;
+    }
+    for ( uint64_t index = 1; index < size; index++ ) {
+        if ( index >= length )
+            return 0;
+        if ( ( p[index] & 0xC0 ) != 0x80 ) {
+            cp = REPLACEMENT;
+            return index;
+        }
+        cp = ( cp << 6 ) | ( p[index] & 0x3F );
+    }
+    // избыточная запись, суррогаты и символы вне Unicode
+    if ( cp < least || cp > 0x10FFFF || ( cp >= 0xD800 && cp <= 0xDFFF ) )
+        cp = REPLACEMENT;
+    return size;
+}
+
+// количество байт ASCII в начале данных (проверяется блоками)
+inline uint64_t ascii_prefix( const char *src, uint64_t length )
+{
+    uint64_t index = 0;
+#   if defined(FILEMAP_SSE2)
+    for ( ; index + 16 <= length; index += 16 ) {
+        if ( _mm_movemask_epi8( _mm_loadu_si128( (const __m128i*)( src + index ) ) ) != 0 )
+            break;
+    }
+#   else
+    for ( ; index + 8 <= length; index += 8 ) {
+        uint64_t word;
+        memcpy( &word, src + index, 8 );
+        if ( word & 0x8080808080808080ull )
+            break;
+    }
+#   endif
+    while ( index < length && (unsigned char)src[index] < 0x80 )
+        index++;
+    return index;
+}
+
+}   // namespace
+
+///////////////////////////////////////////////////////////////////////////////
+// конструктор
+CFileMapTranscode::CFileMapTranscode( uint64_t limit_map_memory /*= 0*/,
+                                      encoding enc /*= encoding::utf16le*/ )
+    : CFileMap( limit_map_memory )
+{
+    m_encoding = enc;               // кодировка файла
+    m_decoded_pos = 0;              // позиция чтения в m_decoded
+    m_partial_size = 0;             // начало разбитого символа
+}   //  CFileMapTranscode()
+
+///////////////////////////////////////////////////////////////////////////////
+// открыть файл используя предопределенный режим и сбросить состояние перекодирования
+uint64_t CFileMapTranscode::open_file_map ( mode md, uint64_t offset /*= 0*/ )
+{
+    m_decoded.clear();
+    m_decoded_pos = 0;
+    m_encoded.clear();
+    m_partial_size = 0;
+
+    uint64_t last_error = CFileMap::open_file_map( md, offset );
+    if ( last_error || md != mode::read || offset != 0 )
+        return last_error;
+
+    // пропустим метку порядка байт
+    const unsigned char *file = (const unsigned char *)get_map_address();
+    uint64_t length = get_max_copy_ex();
+    if ( m_encoding == encoding::utf16le && length >= 2 && file[0] == 0xFF && file[1] == 0xFE )
+        check_map_region( 2 );
+    else if ( m_encoding == encoding::utf8 && length >= 3 && file[0] == 0xEF && file[1] == 0xBB && file[2] == 0xBF )
+        check_map_region( 3 );
+    return 0;
+}   //  open_file_map ( mode md, uint64_t offset /*= 0*/ )
+
+///////////////////////////////////////////////////////////////////////////////
+// прочитать текст в UTF-8
+uint64_t CFileMapTranscode::read_utf8( char *dest, uint64_t length )
+{
+    uint64_t copied = 0;
+    while ( copied < length ) {
+        if ( m_decoded_pos == m_decoded.size() ) {
+            m_decoded.clear();
+            m_decoded_pos = 0;
+            if ( decode() == false )
+                break;
+            continue;
+        }
+        uint64_t size = std::min( length - copied, (uint64_t)m_decoded.size() - m_decoded_pos );
+        memcpy( dest + copied, m_decoded.data() + m_decoded_pos, (size_t)size );
+        m_decoded_pos += size;
+        copied += size;
+    }
+    return copied;
+}   //  read_utf8( char *dest, uint64_t length )
+
+///////////////////////////////////////////////////////////////////////////////
+// прочитать строку в UTF-8
+bool CFileMapTranscode::read_line_utf8( std::string_view &line )
+{
+    // позиция, с которой продолжается поиск символа новой строки
+    uint64_t scan = m_decoded_pos;
+    for ( ;; ) {
+        const char *data = m_decoded.data();
+        const char *end = (const char *)memchr( data + scan, '\n', (size_t)( m_decoded.size() - scan ) );
+        if ( end ) {
+            uint64_t length = line_length( data + m_decoded_pos, (uint64_t)( end - data ) - m_decoded_pos );
+            line = std::string_view( data + m_decoded_pos, (size_t)length );
+            m_decoded_pos = (uint64_t)( end - data ) + 1;
+            return true;
+        }
+        // строка не закончилась - уберем прочитанное и перекодируем следующую порцию
+        scan = m_decoded.size() - m_decoded_pos;
+        m_decoded.erase( 0, (size_t)m_decoded_pos );
+        m_decoded_pos = 0;
+        if ( decode() == false )
+            break;
+    }
+
+    // последняя строка без символа новой строки (CR сохраняется, как в read_line)
+    if ( m_decoded_pos == m_decoded.size() )
+        return false;
+    uint64_t length = m_decoded.size() - m_decoded_pos;
+    line = std::string_view( m_decoded.data() + m_decoded_pos, (size_t)length );
+    m_decoded_pos = m_decoded.size();
+    return true;
+}   //  read_line_utf8( std::string_view &line )
+
+///////////////////////////////////////////////////////////////////////////////
+// записать текст в UTF-8 в кодировке файла
+uint64_t CFileMapTranscode::write_utf8( const char *data, uint64_t length )
+{
+    uint64_t written = 0;
+    while ( length ) {
+        uint64_t size = std::min( length, DECODE_CHUNK );
+        m_encoded.clear();
+        encode( data, size );
+        if ( m_encoded.size() ) {
+            uint64_t copied = write( m_encoded.data(), m_encoded.size() );
+            written += copied;
+            if ( copied != m_encoded.size() )
+                break;
+        }
+        data += size;
+        length -= size;
+    }
+    return written;
+}   //  write_utf8( const char *data, uint64_t length )
+
+///////////////////////////////////////////////////////////////////////////////
+// перекодировать очередную порцию проекции
+bool CFileMapTranscode::decode()
+{
+    if ( eof() ) {
+        // незавершенный символ в конце файла
+        if ( m_partial_size ) {
+            char buff[4];
+            m_decoded.append( buff, (size_t)utf8_encode( REPLACEMENT, buff ) );
+            m_partial_size = 0;
+            return true;
+        }
+        return false;
+    }
+    // проверим, сколько байт можно прочитать
+    if ( get_max_copy_ex() == 0 ) {
+        if ( next_region() != 0 )
+            return false;
+    }
+
+    const char *file = (const char *)get_map_address();
+    uint64_t available = get_max_copy_ex();
+    uint64_t length = std::min( available, DECODE_CHUNK );
+    uint64_t consumed = 0;
+
+    switch ( m_encoding ) {
+    case encoding::utf8:
+        m_decoded.append( file, (size_t)length );
+        consumed = length;
+        break;
+
+    case encoding::cp1251: {
+        size_t size = m_decoded.size();
+        m_decoded.resize( size + (size_t)length * 3 );
+        size += (size_t)cp1251_to_utf8( file, length, &m_decoded[size] );
+        m_decoded.resize( size );
+        consumed = length;
+        break;
+    }
+
+    case encoding::utf16le: {
+        char buff[16];
+        // дополним символ, начало которого осталось в предыдущей проекции
+        while ( m_partial_size && consumed < length ) {
+            char unit[8];
+            uint64_t take = std::min( length - consumed, (uint64_t)( 4 - m_partial_size ) );
+            memcpy( unit, m_partial, m_partial_size );
+            memcpy( unit + m_partial_size, file + consumed, (size_t)take );
+            uint64_t used = 0;
+            uint64_t size = utf16le_to_utf8( unit, m_partial_size + take, buff, used );
+            m_decoded.append( buff, (size_t)size );
+            if ( used == 0 ) {
+                // символ все еще не закончен (очень короткая проекция)
+                memcpy( m_partial + m_partial_size, file + consumed, (size_t)take );
+                m_partial_size += (uint32_t)take;
+                consumed += take;
+            } else if ( used >= m_partial_size ) {
+                consumed += used - m_partial_size;
+                m_partial_size = 0;
+            } else {
+                // ошибочный суррогат - оставшиеся байты начала символа разберем заново
+                memmove( m_partial, m_partial + used, (size_t)( m_partial_size - used ) );
+                m_partial_size -= (uint32_t)used;
+            }
+        }
+
+        size_t size = m_decoded.size();
+        m_decoded.resize( size + (size_t)( length - consumed ) * 3 / 2 + 4 );
+        uint64_t used = 0;
+        size += (size_t)utf16le_to_utf8( file + consumed, length - consumed, &m_decoded[size], used );
+        m_decoded.resize( size );
+        consumed += used;
+
+        // начало символа в конце проекции сохраним до следующей проекции
+        if ( consumed < length && length == available ) {
+            m_partial_size = (uint32_t)( length - consumed );
+            memcpy( m_partial, file + consumed, m_partial_size );
+            consumed = length;
+        }
+        break;
+    }
+    }
+
+    check_map_region( consumed );
+    return true;
+}   //  decode()
+
+///////////////////////////////////////////////////////////////////////////////
+// перекодировать UTF-8 в кодировку файла
+void CFileMapTranscode::encode( const char *data, uint64_t length )
+{
+    if ( m_encoding == encoding::utf8 ) {
+        m_encoded.append( data, (size_t)length );
+        return;
+    }
+
+    char buff[16];
+    // дополним последовательность, начало которой осталось от предыдущего вызова
+    while ( m_partial_size && length ) {
+        char unit[8];
+        uint64_t take = std::min( length, (uint64_t)( 4 - m_partial_size ) );
+        memcpy( unit, m_partial, m_partial_size );
+        memcpy( unit + m_partial_size, data, (size_t)take );
+        uint64_t used = 0;
+        uint64_t size = ( m_encoding == encoding::utf16le )
+                        ? utf8_to_utf16le( unit, m_partial_size + take, buff, used )
+                        : utf8_to_cp1251( unit, m_partial_size + take, buff, used );
+        m_encoded.append( buff, (size_t)size );
+        if ( used == 0 ) {
+            memcpy( m_partial + m_partial_size, data, (size_t)take );
+            m_partial_size += (uint32_t)take;
+            data += take;
+            length -= take;
+        } else if ( used >= m_partial_size ) {
+            data += used - m_partial_size;
+            length -= used - m_partial_size;
+            m_partial_size = 0;
+        } else {
+            memmove( m_partial, m_partial + used, (size_t)( m_partial_size - used ) );
+            m_partial_size -= (uint32_t)used;
+        }
+    }
+    if ( length == 0 )
+        return;
+
+    size_t size = m_encoded.size();
+    uint64_t used = 0;
+    if ( m_encoding == encoding::utf16le ) {
+        m_encoded.resize( size + (size_t)length * 2 );
+        size += (size_t)utf8_to_utf16le( data, length, &m_encoded[size], used );
+    } else {
+        m_encoded.resize( size + (size_t)length );
+        size += (size_t)utf8_to_cp1251( data, length, &m_encoded[size], used );
+    }
+    m_encoded.resize( size );
+
+    // начало последовательности в конце данных сохраним до следующего вызова
+    m_partial_size = (uint32_t)( length - used );
+    memcpy( m_partial, data + used, m_partial_size );
+}   //  encode( const char *data, uint64_t length )
+
+///////////////////////////////////////////////////////////////////////////////
+// перекодировать UTF-16LE в UTF-8
+uint64_t CFileMapTranscode::utf16le_to_utf8( const char *src, uint64_t length, char *dest, uint64_t &consumed )
+{
+    const unsigned char *p = (const unsigned char *)src;
+    uint64_t index = 0;
+    uint64_t out = 0;
+    while ( index + 2 <= length ) {
+        // 16 символов ASCII подряд упаковываются в байты целиком
+#       if defined(FILEMAP_SSE2)
+        if ( index + 32 <= length ) {
+            __m128i v0 = _mm_loadu_si128( (const __m128i*)( p + index ) );
+            __m128i v1 = _mm_loadu_si128( (const __m128i*)( p + index + 16 ) );
+            __m128i high = _mm_and_si128( _mm_or_si128( v0, v1 ), _mm_set1_epi16( (short)0xFF80 ) );
+            if ( _mm_movemask_epi8( _mm_cmpeq_epi16( high, _mm_setzero_si128() ) ) == 0xFFFF ) {
+                _mm_storeu_si128( (__m128i*)( dest + out ), _mm_packus_epi16( v0, v1 ) );
+                index += 32;
+                out += 16;
+                continue;
+            }
+        }
+#       else
+        if ( index + 8 <= length ) {
+            uint64_t word;
+            memcpy( &word, p + index, 8 );
+            if ( ( word & 0xFF80FF80FF80FF80ull ) == 0 ) {
+                dest[out]     = (char)p[index];
+                dest[out + 1] = (char)p[index + 2];
+                dest[out + 2] = (char)p[index + 4];
+                dest[out + 3] = (char)p[index + 6];
+                index += 8;
+                out += 4;
+                continue;
+            }
+        }
+#       endif
+
+        uint32_t unit = (uint32_t)p[index] | ( (uint32_t)p[index + 1] << 8 );
+        if ( unit >= 0xD800 && unit <= 0xDBFF ) {
+            // старший суррогат - нужен младший
+            if ( index + 4 > length )
+                break;
+            uint32_t low = (uint32_t)p[index + 2] | ( (uint32_t)p[index + 3] << 8 );
+            if ( low >= 0xDC00 && low <= 0xDFFF ) {
+                out += utf8_encode( 0x10000 + ( ( unit - 0xD800 ) << 10 ) + ( low - 0xDC00 ), dest + out );
+                index += 4;
+                continue;
+            }
+            unit = REPLACEMENT;
+        } else if ( unit >= 0xDC00 && unit <= 0xDFFF ) {
+            unit = REPLACEMENT;
+        }
+        out += utf8_encode( unit, dest + out );
+        index += 2;
+    }
+    consumed = index;
+    return out;
+}   //  utf16le_to_utf8( const char *src, uint64_t length, char *dest, uint64_t &consumed )
+
+///////////////////////////////////////////////////////////////////////////////
+// перекодировать CP1251 в UTF-8
+uint64_t CFileMapTranscode::cp1251_to_utf8( const char *src, uint64_t length, char *dest )
+{
+    uint64_t index = 0;
+    uint64_t out = 0;
+    while ( index < length ) {
+        // блоки ASCII копируются целиком
+        uint64_t ascii = ascii_prefix( src + index, length - index );
+        memcpy( dest + out, src + index, (size_t)ascii );
+        index += ascii;
+        out += ascii;
+        for ( ; index < length && (unsigned char)src[index] >= 0x80; index++ )
+            out += utf8_encode( CP1251_HIGH[(unsigned char)src[index] - 0x80], dest + out );
+    }
+    return out;
+}   //  cp1251_to_utf8( const char *src, uint64_t length, char *dest )
+
+///////////////////////////////////////////////////////////////////////////////
+// перекодировать UTF-8 в UTF-16LE
+uint64_t CFileMapTranscode::utf8_to_utf16le( const char *src, uint64_t length, char *dest, uint64_t &consumed )
+{
+    const unsigned char *p = (const unsigned char *)src;
+    uint64_t index = 0;
+    uint64_t out = 0;
+    while ( index < length ) {
+        // 16 символов ASCII подряд расширяются до UTF-16 целиком
+#       if defined(FILEMAP_SSE2)
+        if ( index + 16 <= length ) {
+            __m128i v = _mm_loadu_si128( (const __m128i*)( p + index ) );
+            if ( _mm_movemask_epi8( v ) == 0 ) {
+                _mm_storeu_si128( (__m128i*)( dest + out ), _mm_unpacklo_epi8( v, _mm_setzero_si128() ) );
+                _mm_storeu_si128( (__m128i*)( dest + out + 16 ), _mm_unpackhi_epi8( v, _mm_setzero_si128() ) );
+                index += 16;
+                out += 32;
+                continue;
+            }
+        }
+#       endif
+
+        uint32_t cp = 0;
+        uint64_t size = utf8_decode( p + index, length - index, cp );
+        if ( size == 0 )
+            break;
+        if ( cp >= 0x10000 ) {
+            uint32_t high = 0xD800 + ( ( cp - 0x10000 ) >> 10 );
+            uint32_t low = 0xDC00 + ( ( cp - 0x10000 ) & 0x3FF );
+            dest[out]     = (char)( high & 0xFF );
+            dest[out + 1] = (char)( high >> 8 );
+            dest[out + 2] = (char)( low & 0xFF );
+            dest[out + 3] = (char)( low >> 8 );
+            out += 4;
+        } else {
+            dest[out]     = (char)( cp & 0xFF );
+            dest[out + 1] = (char)( cp >> 8 );
+            out += 2;
+        }
+        index += size;
+    }
+    consumed = index;
+    return out;
+}   //  utf8_to_utf16le( const char *src, uint64_t length, char *dest, uint64_t &consumed )
+
+///////////////////////////////////////////////////////////////////////////////
+// перекодировать UTF-8 в CP1251
+uint64_t CFileMapTranscode::utf8_to_cp1251( const char *src, uint64_t length, char *dest, uint64_t &consumed )
+{
+    const vector< pair<uint32_t, unsigned char> > &table = cp1251_reverse();
+    const unsigned char *p = (const unsigned char *)src;
+    uint64_t index = 0;
+    uint64_t out = 0;
+    while ( index < length ) {
+        // блоки ASCII копируются целиком
+        uint64_t ascii = ascii_prefix( src + index, length - index );
+        memcpy( dest + out, src + index, (size_t)ascii );
+        index += ascii;
+        out += ascii;
+        if ( index == length )
+            break;
+
+        uint32_t cp = 0;
+        uint64_t size = utf8_decode( p + index, length - index, cp );
+        if ( size == 0 )
+            break;
+        if ( cp >= 0x410 && cp <= 0x44F ) {
+            // А..я
+            dest[out] = (char)( cp - 0x410 + 0xC0 );
+        } else {
+            auto item = lower_bound( table.begin(), table.end(), make_pair( cp, (unsigned char)0 ) );
+            dest[out] = ( item != table.end() && item->first == cp ) ? (char)item->second : '?';
+        }
+        out++;
+        index += size;
+    }
+    consumed = index;
+    return out;
+}   //  utf8_to_cp1251( const char *src, uint64_t length, char *dest, uint64_t &consumed )
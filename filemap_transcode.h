@@ -0,0 +1,264 @@
+/*!
+ *
+ * \file filemap_transcode.h
+ * \brief определение класса перекодирования текста при чтении и записи
+ *
+ *  UTF-16LE и CP1251 перекодируются в UTF-8 при чтении из проекции\n
+ *  (и обратно при записи) векторными ядрами: блоки ASCII копируются\n
+ *  целиком, остальные символы перекодируются по одному. Символ,\n
+ *  разбитый между проекциями, собирается из частей.
+ *
+ * Copyright (C) 2018 Pochepko PP.
+ * Contact: ppp.it@hotmail.com
+ *
+ * This file is part of software written by Pochepko PP.
+ *
+ * This software is provided 'as-is', without any express or implied\n
+ * warranty. In no event will the authors be held liable for any damages\n
+ * arising from the use of this software.\n
+ *
+ * Permission is granted to anyone to use this software for any purpose,\n
+ * including commercial applications, and to alter it and redistribute it\n
+ * freely, subject to the following restrictions:\n
+ *
+ *    1. The origin of this software must not be misrepresented; you must not\n
+ *    claim that you wrote the original software. If you use this software\n
+ *    in a product, an acknowledgment in the product documentation would be\n
+ *    appreciated but is not required.\n
+ *
+ *    2. Altered source versions must be plainly marked as such, and must not be\n
+ *    misrepresented as being the original software.\n
+ *    3. This notice may not be removed or altered from any source\n
+ *    distribution.\n
+ *
+ */
+//-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!-!
+
+
+#ifndef FILEMAP_TRANSCODE_H
+#define FILEMAP_TRANSCODE_H
+
+#include "filemap.h"
+#include <string>
+#include <string_view>
+
+
+
+//--------------------------------------------------------------------------------------------------//
+
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+/// \brief The CFileMapTranscode class - чтение и запись текста в UTF-8\n
+///  для файлов в кодировке UTF-16LE или CP1251
+///
+/// read_utf8() и read_line_utf8() перекодируют проекцию порциями во\n
+/// внутренний буфер UTF-8. Символ, разбитый между проекциями (байт\n
+/// UTF-16, суррогатная пара), дочитывается из следующей проекции;\n
+/// незавершенный символ в конце файла заменяется U+FFFD, как и\n
+/// ошибочные последовательности. write_utf8() перекодирует UTF-8 в\n
+/// кодировку файла и вызывает write(), последовательность UTF-8,\n
+/// разбитая между вызовами, дописывается следующим вызовом. Символы,\n
+/// которых нет в CP1251, записываются как '?'.\n
+/// При открытии на чтение с начала файла метка порядка байт (BOM) пропускается.
+///
+/// \code
+/// CFileMapTranscode file( limit_memory, CFileMapTranscode::encoding::utf16le );
+/// file.set_file_path( file_path );
+/// file.set_file_size( file_size );
+/// last_error = file.open_file_map( CFileMap::mode::read );
+/// std::string_view line;
+/// while ( file.read_line_utf8( line ) ) {
+///     ... // line в UTF-8
+/// }
+/// \endcode
+///
+class CFileMapTranscode : public CFileMap
+{
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief кодировка файла
+    ///
+    enum class encoding : uint32_t
+    {
+        /*! UTF-8 (без перекодирования) */
+        utf8 = 0,
+        /*! UTF-16 little endian */
+        utf16le = 1,
+        /*! Windows-1251 */
+        cp1251 = 2
+    };
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief конструктор
+    /// \param limit_map_memory - размер ограниения для единовремменого отражения\n
+    ///  файла в память, если равен нулю - то отражается сразу весь файл целиком.
+    /// \param enc - кодировка файла
+    ///
+    CFileMapTranscode( uint64_t limit_map_memory = 0, encoding enc = encoding::utf16le );
+
+public:
+    using CFileMap::open_file_map;
+
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief  открыть файл используя предопределенный режим\n
+    ///  и сбросить состояние перекодирования
+    /// \param  md - режим обработки файла и проекции ( read, write, append )
+    /// \param  offset - смещение байт от начала файла
+    /// \return ноль - выполнено успешно, иначе номер ошибки
+    /// @see CFileMap::open_file_map
+    ///
+    uint64_t open_file_map ( mode md, uint64_t offset = 0 );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief установить кодировку файла (до чтения/записи)
+    ///
+    void set_encoding( encoding enc ) {
+        m_encoding = enc;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief получить кодировку файла
+    ///
+    encoding get_encoding() const {
+        return m_encoding;
+    }
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief прочитать текст в UTF-8
+    /// \param dest - буфер
+    /// \param length - размер буфера
+    /// \return количество байт UTF-8, ноль - текст закончился
+    ///
+    /// символ UTF-8 может быть разбит между вызовами
+    ///
+    uint64_t read_utf8( char *dest, uint64_t length );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief прочитать строку в UTF-8
+    /// \param line - строка без символа новой строки (CR перед LF\n
+    ///  отбрасывается, кроме режима lf set_line_ending(); режим crlf\n
+    ///  читается как mixed), действительна до следующего вызова
+    /// \return false - строк больше нет
+    ///
+    bool read_line_utf8( std::string_view &line );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief записать текст в UTF-8 в кодировке файла
+    /// \param data - текст в UTF-8
+    /// \param length - количество байт
+    /// \return количество записанных в файл байт
+    ///
+    uint64_t write_utf8( const char *data, uint64_t length );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief перекодировать UTF-16LE в UTF-8
+    /// \param src - данные UTF-16LE
+    /// \param length - количество байт
+    /// \param dest - буфер не меньше length * 3 / 2 + 4 байт
+    /// \param consumed - количество обработанных байт src (незавершенный\n
+    ///  символ в конце не обрабатывается)
+    /// \return количество байт UTF-8
+    ///
+    static uint64_t utf16le_to_utf8( const char *src, uint64_t length, char *dest, uint64_t &consumed );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief перекодировать CP1251 в UTF-8
+    /// \param src - данные CP1251
+    /// \param length - количество байт
+    /// \param dest - буфер не меньше length * 3 байт
+    /// \return количество байт UTF-8
+    ///
+    static uint64_t cp1251_to_utf8( const char *src, uint64_t length, char *dest );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief перекодировать UTF-8 в UTF-16LE
+    /// \param src - данные UTF-8
+    /// \param length - количество байт
+    /// \param dest - буфер не меньше length * 2 байт
+    /// \param consumed - количество обработанных байт src (незавершенная\n
+    ///  последовательность в конце не обрабатывается)
+    /// \return количество байт UTF-16LE
+    ///
+    static uint64_t utf8_to_utf16le( const char *src, uint64_t length, char *dest, uint64_t &consumed );
+
+public:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief перекодировать UTF-8 в CP1251
+    /// \param src - данные UTF-8
+    /// \param length - количество байт
+    /// \param dest - буфер не меньше length байт
+    /// \param consumed - количество обработанных байт src (незавершенная\n
+    ///  последовательность в конце не обрабатывается)
+    /// \return количество байт CP1251
+    ///
+    static uint64_t utf8_to_cp1251( const char *src, uint64_t length, char *dest, uint64_t &consumed );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief перекодировать очередную порцию проекции и добавить в m_decoded
+    /// \return false - файл закончился
+    ///
+    bool decode();
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief перекодировать UTF-8 в кодировку файла (с началом символа\n
+    ///  из предыдущего вызова) и добавить в m_encoded
+    /// \param data - текст в UTF-8
+    /// \param length - количество байт
+    ///
+    /// незавершенная последовательность в конце сохраняется в m_partial
+    ///
+    void encode( const char *data, uint64_t length );
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief кодировка файла
+    ///
+    encoding m_encoding;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief перекодированный текст (UTF-8)
+    ///
+    std::string m_decoded;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief позиция чтения в m_decoded
+    ///
+    uint64_t m_decoded_pos;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief текст в кодировке файла для записи
+    ///
+    std::string m_encoded;
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief начало символа, разбитого между проекциями (чтение)\n
+    ///  или между вызовами write_utf8() (запись)
+    ///
+    char m_partial[4];
+
+private:
+    ///////////////////////////////////////////////////////////////////////////////
+    /// \brief количество байт в m_partial
+    ///
+    uint32_t m_partial_size;
+};
+
+#endif // FILEMAP_TRANSCODE_H